@@ -0,0 +1,150 @@
+#include "cachecodec.h"
+#include <lz4.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    constexpr uint32_t WORDS_PER_PARTICLE = 4; // x, y, z, packed radius and inverse mass (see Particle)
+
+    struct EncodedHeader {
+        uint32_t rawSize;
+        uint32_t encoding;
+        float precision;     // 0 if positions aren't quantized
+        uint32_t padding;
+    };
+
+    // Words past the end of the reference (e.g. it was captured before the buffer grew) read as zero.
+    uint32_t loadWord(const std::vector<uint8_t>& bytes, size_t wordIdx) {
+        uint32_t word = 0;
+        if ((wordIdx + 1) * sizeof(uint32_t) <= bytes.size()) {
+            std::memcpy(&word, bytes.data() + wordIdx * sizeof(uint32_t), sizeof(uint32_t));
+        }
+        return word;
+    }
+
+    float asFloat(uint32_t word) {
+        float value;
+        std::memcpy(&value, &word, sizeof(float));
+        return value;
+    }
+
+    uint32_t asWord(float value) {
+        uint32_t word;
+        std::memcpy(&word, &value, sizeof(float));
+        return word;
+    }
+
+    // Maps small negative integers to small unsigned ones (0, -1, 1, -2, ... to 0, 1, 2, 3, ...), so their high bytes are zero too.
+    uint32_t zigzag(int32_t value) { return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31); }
+    int32_t unzigzag(uint32_t value) { return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1); }
+
+    bool isQuantizedPositionWord(CacheEncoding encoding, float precision, size_t wordIdx) {
+        return encoding == CacheEncoding::Particles && precision > 0.0f && (wordIdx % WORDS_PER_PARTICLE) != 3;
+    }
+
+    constexpr uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+
+    uint64_t rotateLeft(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+}
+
+void CacheCodec::encode(const std::vector<uint8_t>& data, const std::vector<uint8_t>& reference, CacheEncoding encoding, float precision, std::vector<uint8_t>& encoded) {
+    thread_local std::vector<uint8_t> shuffled;
+    const size_t numWords = data.size() / sizeof(uint32_t);
+    const size_t numTailBytes = data.size() - numWords * sizeof(uint32_t);
+    if (encoding != CacheEncoding::Particles) precision = 0.0f;
+
+    // Residual and byte-plane shuffle in one pass: plane k holds byte k of every residual word. Any trailing bytes (not a whole word) follow as is.
+    shuffled.resize(data.size());
+    for (size_t i = 0; i < numWords; ++i) {
+        uint32_t word = loadWord(data, i);
+        uint32_t referenceWord = loadWord(reference, i);
+        uint32_t residual;
+        if (isQuantizedPositionWord(encoding, precision, i)) {
+            double steps = std::round((static_cast<double>(asFloat(word)) - asFloat(referenceWord)) / precision);
+            steps = std::clamp(steps, static_cast<double>(INT32_MIN / 2), static_cast<double>(INT32_MAX / 2));
+            residual = zigzag(static_cast<int32_t>(steps));
+        } else {
+            residual = word ^ referenceWord;
+        }
+
+        for (size_t k = 0; k < sizeof(uint32_t); ++k) {
+            shuffled[k * numWords + i] = static_cast<uint8_t>(residual >> (8 * k));
+        }
+    }
+    std::copy(data.end() - numTailBytes, data.end(), shuffled.begin() + numWords * sizeof(uint32_t));
+
+    const int maxCompressedSize = LZ4_compressBound(static_cast<int>(shuffled.size()));
+    encoded.resize(sizeof(EncodedHeader) + maxCompressedSize);
+    EncodedHeader header = { static_cast<uint32_t>(data.size()), static_cast<uint32_t>(encoding), precision, 0 };
+    std::memcpy(encoded.data(), &header, sizeof(EncodedHeader));
+
+    int compressedSize = LZ4_compress_default(
+        reinterpret_cast<const char*>(shuffled.data()),
+        reinterpret_cast<char*>(encoded.data() + sizeof(EncodedHeader)),
+        static_cast<int>(shuffled.size()),
+        maxCompressedSize
+    );
+    encoded.resize(sizeof(EncodedHeader) + compressedSize);
+}
+
+bool CacheCodec::decode(const uint8_t* encoded, size_t encodedSize, const std::vector<uint8_t>& reference, std::vector<uint8_t>& data) {
+    thread_local std::vector<uint8_t> shuffled;
+    if (encodedSize < sizeof(EncodedHeader)) return false;
+
+    EncodedHeader header;
+    std::memcpy(&header, encoded, sizeof(EncodedHeader));
+    const CacheEncoding encoding = static_cast<CacheEncoding>(header.encoding);
+    const float precision = header.precision;
+
+    shuffled.resize(header.rawSize);
+    int decompressedSize = LZ4_decompress_safe(
+        reinterpret_cast<const char*>(encoded + sizeof(EncodedHeader)),
+        reinterpret_cast<char*>(shuffled.data()),
+        static_cast<int>(encodedSize - sizeof(EncodedHeader)),
+        static_cast<int>(header.rawSize)
+    );
+    if (decompressedSize != static_cast<int>(header.rawSize)) return false;
+
+    const size_t numWords = header.rawSize / sizeof(uint32_t);
+    const size_t numTailBytes = header.rawSize - numWords * sizeof(uint32_t);
+    data.resize(header.rawSize);
+    for (size_t i = 0; i < numWords; ++i) {
+        uint32_t residual = 0;
+        for (size_t k = 0; k < sizeof(uint32_t); ++k) {
+            residual |= static_cast<uint32_t>(shuffled[k * numWords + i]) << (8 * k);
+        }
+
+        uint32_t referenceWord = loadWord(reference, i);
+        uint32_t word;
+        if (isQuantizedPositionWord(encoding, precision, i)) {
+            word = asWord(static_cast<float>(asFloat(referenceWord) + static_cast<double>(unzigzag(residual)) * precision));
+        } else {
+            word = residual ^ referenceWord;
+        }
+        std::memcpy(data.data() + i * sizeof(uint32_t), &word, sizeof(uint32_t));
+    }
+    std::copy(shuffled.end() - numTailBytes, shuffled.end(), data.begin() + numWords * sizeof(uint32_t));
+
+    return true;
+}
+
+// Mixes in 8 bytes at a time (the same round as xxHash64, in a single lane), then avalanches the result.
+uint64_t CacheCodec::hash(const std::vector<uint8_t>& data) {
+    uint64_t result = HASH_PRIME_1 ^ data.size();
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data.data() + i, sizeof(uint64_t));
+        result = rotateLeft(result + word * HASH_PRIME_2, 31) * HASH_PRIME_1;
+    }
+    for (; i < data.size(); ++i) {
+        result = rotateLeft(result + data[i] * HASH_PRIME_2, 31) * HASH_PRIME_1;
+    }
+
+    result ^= result >> 33;
+    result *= HASH_PRIME_2;
+    result ^= result >> 29;
+    return (result == 0) ? 1 : result;
+}
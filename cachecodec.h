@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// What a cached buffer holds, which decides how it's compressed (see CacheCodec).
+enum class CacheEncoding {
+    Words,      // Any buffer of 32-bit values (uints, floats, packed structs)
+    Particles   // Particle structs, whose positions can be quantized
+};
+
+/**
+ * Compresses simulation cache buffers relative to a reference copy of the same buffer (the start frame, or an earlier cached frame - see SimulationCache).
+ *
+ * 1. Residual: every 32-bit word is XORed with the reference's, so anything unchanged since the reference (most of isSurface, the constraint buffers)
+ *    becomes zero. With a precision above zero, particle positions are instead quantized to a multiple of the precision away from their reference
+ *    position. That's lossy, but the error is bounded by half the precision, as long as the reference is itself the decoded copy (not the original).
+ * 2. Byte-plane shuffle: byte k of every word is stored together, so the (mostly zero) high bytes of small residuals form long runs.
+ * 3. LZ4, which is fast enough to decode while scrubbing.
+ *
+ * Encoded buffers carry a small header with everything needed to decode them, so frames encoded with different settings can share a cache.
+ */
+namespace CacheCodec {
+    void encode(const std::vector<uint8_t>& data, const std::vector<uint8_t>& reference, CacheEncoding encoding, float precision, std::vector<uint8_t>& encoded);
+
+    // Returns false (leaving data in an unspecified state) if the encoded buffer is corrupt.
+    bool decode(const uint8_t* encoded, size_t encodedSize, const std::vector<uint8_t>& reference, std::vector<uint8_t>& data);
+    inline bool decode(const std::vector<uint8_t>& encoded, const std::vector<uint8_t>& reference, std::vector<uint8_t>& data) {
+        return decode(encoded.data(), encoded.size(), reference, data);
+    }
+
+    // 64-bit hash of a buffer's contents, for telling whether it's changed. Never 0 (which callers can use for "unknown").
+    uint64_t hash(const std::vector<uint8_t>& data);
+}
@@ -0,0 +1,93 @@
+#include "captureencoder.h"
+#include <chrono>
+
+CaptureEncoder::CaptureEncoder() {
+    worker = std::thread(&CaptureEncoder::workLoop, this);
+}
+
+CaptureEncoder::~CaptureEncoder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_one();
+    if (worker.joinable()) worker.join();
+}
+
+void CaptureEncoder::submit(Job&& job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+void CaptureEncoder::takeCompleted(std::vector<Job>& completed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    completed.swap(completedJobs);
+}
+
+void CaptureEncoder::waitUntilIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return jobs.empty() && !busy; });
+}
+
+void CaptureEncoder::workLoop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return; // Anything still queued is dropped (the cache is going away)
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+        }
+
+        const auto encodeStart = std::chrono::steady_clock::now();
+        encode(job);
+        job.encodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - encodeStart).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            completedJobs.push_back(std::move(job));
+            busy = false;
+        }
+        idle.notify_all();
+    }
+}
+
+void CaptureEncoder::encode(Job& job) {
+    for (CapturedBuffer& capturedBuffer : job.buffers) {
+        capturedBuffer.hash = CacheCodec::hash(capturedBuffer.data);
+        capturedBuffer.unchanged = false;
+    }
+    if (!job.compress) return;
+    // A keyframe's reference is the start frame, so whatever's left here from the last chain is just capacity to reuse.
+    chainData.resize(job.buffers.size());
+    chainHashes.resize(job.buffers.size());
+
+    for (size_t i = 0; i < job.buffers.size(); ++i) {
+        CapturedBuffer& capturedBuffer = job.buffers[i];
+        // Buffers that rarely change (isSurface, the constraint indices) usually haven't since the last frame. The chain data is already right.
+        if (!job.isKeyframe && capturedBuffer.hash == chainHashes[i]) {
+            capturedBuffer.unchanged = true;
+            capturedBuffer.data.clear();
+            continue;
+        }
+        chainHashes[i] = capturedBuffer.hash;
+
+        const std::vector<uint8_t>& reference = job.isKeyframe ? *capturedBuffer.startFrameData : chainData[i];
+        CacheCodec::encode(capturedBuffer.data, reference, capturedBuffer.encoding, job.precision, encodeScratch);
+
+        // This job is the next one's reference. If positions were quantized, that has to be what a restore would decode, not what was captured,
+        // or the error would accumulate down the chain.
+        if (capturedBuffer.encoding == CacheEncoding::Particles && job.precision > 0.0f) {
+            CacheCodec::decode(encodeScratch, reference, decodeScratch);
+            chainData[i].swap(decodeScratch);
+        } else {
+            chainData[i].swap(capturedBuffer.data);
+        }
+        capturedBuffer.data.swap(encodeScratch);
+    }
+}
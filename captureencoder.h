@@ -0,0 +1,74 @@
+#pragma once
+
+#include "directx/directx.h"
+#include "cachecodec.h"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+
+/**
+ * Encodes captured simulation frames on a background thread, so compressing them doesn't hold up playback (see SimulationCache::cacheData).
+ *
+ * Jobs are encoded strictly in the order they're submitted. That lets a delta job be encoded against the job before it (as the encoder keeps
+ * the previous job's decoded data), even though that job hasn't come back to the main thread yet.
+ */
+class CaptureEncoder {
+
+public:
+    struct CapturedBuffer {
+        ComPtr<ID3D11Buffer> buffer;
+        CacheEncoding encoding;
+        std::shared_ptr<const std::vector<uint8_t>> startFrameData; // Keyframes are encoded against this
+        std::vector<uint8_t> data;  // Raw when submitted, encoded (if compressing) when completed
+        uint64_t hash = 0;          // Of the raw data (see CacheCodec::hash), set by the encoder
+        bool unchanged = false;     // Deltas only: the raw data matched the previous job's, so it's left empty (not encoded)
+    };
+
+    struct Job {
+        uint64_t captureId;
+        double frame;
+        bool compress;
+        float precision;
+        bool isKeyframe;            // Otherwise, a delta against the previous job (which must have the same buffers, in the same order)
+        double referenceFrame;
+        uint64_t referenceCaptureId;
+        int chainLength;
+        std::vector<CapturedBuffer> buffers;
+        double encodeMilliseconds = 0.0;    // Set by the encoder
+    };
+
+    CaptureEncoder();
+    ~CaptureEncoder();
+
+    CaptureEncoder(const CaptureEncoder&) = delete;
+    CaptureEncoder& operator=(const CaptureEncoder&) = delete;
+
+    void submit(Job&& job);
+    // Swaps the completed jobs (in the order they were submitted) into completed, which should be empty. Swapping rather than returning a new list
+    // means both sides keep their capacity.
+    void takeCompleted(std::vector<Job>& completed);
+    void waitUntilIdle();
+
+private:
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable idle;
+    std::deque<Job> jobs;
+    std::vector<Job> completedJobs;
+    bool busy = false;
+    bool stopping = false;
+    std::thread worker;
+
+    // Only touched on the worker thread: the decoded data of the last job encoded (and the hash of its raw data), per buffer.
+    std::vector<std::vector<uint8_t>> chainData;
+    std::vector<uint64_t> chainHashes;
+    std::vector<uint8_t> encodeScratch;
+    std::vector<uint8_t> decodeScratch;
+
+    void workLoop();
+    void encode(Job& job);
+};
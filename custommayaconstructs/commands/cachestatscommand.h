@@ -0,0 +1,79 @@
+#pragma once
+#include <maya/MGlobal.h>
+#include <maya/MPxCommand.h>
+#include <maya/MArgDatabase.h>
+#include <maya/MArgList.h>
+#include <maya/MSyntax.h>
+#include <maya/MString.h>
+#include "simulationcache.h"
+#include <sstream>
+
+/**
+ * Reports the simulation cache's stats (see SimulationCache::Stats) as a JSON string, e.g. from Python: json.loads(cmds.cacheStats()).
+ * With -reset, the counters and timings start over after being reported.
+ */
+class CacheStatsCommand : public MPxCommand {
+public:
+    inline static const MString commandName = MString("cacheStats");
+
+    static void* creator() {
+        return new CacheStatsCommand();
+    }
+
+    static MSyntax syntax() {
+        MSyntax syntax;
+        syntax.addFlag("-r", "-reset", MSyntax::kNoArg);
+        return syntax;
+    }
+
+    bool isUndoable() const override {
+        return false;
+    }
+
+    MStatus doIt(const MArgList& args) override {
+        MArgDatabase argData(syntax(), args);
+        SimulationCache* simulationCache = SimulationCache::instance();
+        setResult(MString(toJson(simulationCache->getStats()).c_str()));
+
+        if (argData.isFlagSet("-r")) simulationCache->resetStats();
+        return MStatus::kSuccess;
+    }
+
+private:
+    static std::string toJson(const SimulationCache::Stats& stats) {
+        std::ostringstream json;
+        json << "{\"memoryFrames\": " << stats.memoryFrames
+             << ", \"framesInFlight\": " << stats.framesInFlight
+             << ", \"diskFrames\": " << stats.diskFrames
+             << ", \"arenaUsedBytes\": " << stats.arenaUsedBytes
+             << ", \"arenaReservedBytes\": " << stats.arenaReservedBytes
+             << ", \"diskFileBytes\": " << stats.diskFileBytes
+             << ", \"buffers\": [";
+        for (size_t i = 0; i < stats.buffers.size(); ++i) {
+            const SimulationCache::BufferStats& buffer = stats.buffers[i];
+            json << (i > 0 ? ", " : "")
+                 << "{\"name\": \"" << buffer.name
+                 << "\", \"encoding\": \"" << (buffer.encoding == CacheEncoding::Particles ? "particles" : "words")
+                 << "\", \"frameBytes\": " << buffer.frameBytes
+                 << ", \"storedBytes\": " << buffer.storedBytes << "}";
+        }
+        json << "], \"memoryHits\": " << stats.memoryHits
+             << ", \"diskHits\": " << stats.diskHits
+             << ", \"interpolatedHits\": " << stats.interpolatedHits
+             << ", \"startFrameHits\": " << stats.startFrameHits
+             << ", \"misses\": " << stats.misses
+             << ", \"evictions\": " << stats.evictions
+             << ", \"spills\": " << stats.spills
+             << ", \"captures\": " << stats.numCaptures
+             << ", \"captureMsP50\": " << stats.captureP50
+             << ", \"captureMsP99\": " << stats.captureP99
+             << ", \"encodes\": " << stats.numEncodes
+             << ", \"encodeMsP50\": " << stats.encodeP50
+             << ", \"encodeMsP99\": " << stats.encodeP99
+             << ", \"restores\": " << stats.numRestores
+             << ", \"restoreMsP50\": " << stats.restoreP50
+             << ", \"restoreMsP99\": " << stats.restoreP99
+             << "}";
+        return json.str();
+    }
+};
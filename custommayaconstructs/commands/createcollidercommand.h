@@ -8,6 +8,7 @@
 #include <maya/MDagPath.h>
 #include <maya/MFnDagNode.h>
 #include "../../utils.h"
+#include "../usernodes/meshcollider.h"
 #include <maya/MObject.h>
 #include <maya/MStatus.h>
 #include <maya/MString.h>
@@ -64,6 +65,10 @@ public:
 
         // Create the collider shape node under the transform
         MObject colliderNodeObj = Utils::createDagNode(colliderName, colliderParentObj, colliderName + "Shape#", &dagModifier);
+        if (colliderName == MeshCollider::typeName) {
+            connectSelectedMesh(selectedDagPath, colliderNodeObj);
+        }
+
         MSelectionList newSelection;
         MDagPath parentDagPath;
         MDagPath::getAPathTo(colliderParentObj, parentDagPath);
@@ -78,6 +83,20 @@ public:
 
 private:
     MSelectionList activeSelectionList;
+
+    // The collider was parented under the selected mesh's transform, so the mesh's object space is the collider's parent space (as MeshCollider expects).
+    void connectSelectedMesh(MDagPath selectedDagPath, const MObject& colliderNodeObj) {
+        if (!selectedDagPath.isValid() || selectedDagPath.extendToShape() != MS::kSuccess || !selectedDagPath.hasFn(MFn::kMesh)) {
+            MGlobal::displayWarning("Select a mesh before creating a mesh collider. Otherwise, connect a mesh's outMesh to the collider's inputMesh.");
+            return;
+        }
+
+        MPlug outMeshPlug = MFnDagNode(selectedDagPath).findPlug("outMesh", false);
+        MPlug inputMeshPlug = MFnDependencyNode(colliderNodeObj).findPlug(MeshCollider::aInputMesh, false);
+        dagModifier.connect(outMeshPlug, inputMeshPlug);
+        dagModifier.doIt();
+    }
+
     MString colliderName;
     MDagModifier dagModifier;
 };
\ No newline at end of file
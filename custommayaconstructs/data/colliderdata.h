@@ -4,6 +4,9 @@
 #include <maya/MTypeId.h>
 #include <maya/MString.h>
 #include <maya/MMatrix.h>
+#include <memory>
+
+struct MeshSDF; // forward declaration
 
 class ColliderData : public MPxData {
 public:
@@ -62,15 +65,18 @@ public:
     float getRadius() const { return radius; }
     void setInfinite(bool inf) { infinite = inf; }
     bool isInfinite() const { return infinite; }
+    void setMeshSDF(const std::shared_ptr<const MeshSDF>& sdf) { meshSDF = sdf; }
+    const std::shared_ptr<const MeshSDF>& getMeshSDF() const { return meshSDF; }
 
 private:
     MMatrix worldMatrix;
-    float friction;
-
-    // Collection of collider parameters. Not all parameters are used by all collider types.
-    float width;
-    float height;
-    float depth;
-    float radius;
-    bool infinite;
+    float friction = 0.0f;
+
+    // Collection of collider parameters. Not all parameters are used by all collider types (the rest stay zero).
+    float width = 0.0f;
+    float height = 0.0f;
+    float depth = 0.0f;
+    float radius = 0.0f;
+    bool infinite = false;
+    std::shared_ptr<const MeshSDF> meshSDF; // Shared (not copied) between data objects, since it's immutable once baked
 };
\ No newline at end of file
@@ -9,6 +9,7 @@ struct ParticleDataContainer {
     uint numParticles = 0;
     std::vector<Particle>* particles = nullptr;
     std::vector<uint>* isSurface = nullptr;
+    std::vector<VoxelAdjacency>* voxelAdjacency = nullptr;
     float particleRadius = 0.0f;
 };
 
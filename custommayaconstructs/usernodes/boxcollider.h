@@ -77,15 +77,15 @@ public:
 
     void writeDataIntoBuffer(const ColliderData* const data, ColliderBuffer& colliderBuffer, int index = -1) override
     {
-        if (index == -1) index = colliderBuffer.numColliders++;
-        data->getWorldMatrix().inverse().get(colliderBuffer.inverseWorldMatrix[index]);
-        data->getWorldMatrix().get(colliderBuffer.worldMatrix[index]);
-        colliderBuffer.inverseWorldMatrix[index][3][3] = data->getFriction(); // store friction in inverse world matrix
+        if (index == -1) index = colliderBuffer.addCollider();
+        data->getWorldMatrix().inverse().get(colliderBuffer.colliders[index].inverseWorldMatrix);
+        data->getWorldMatrix().get(colliderBuffer.colliders[index].worldMatrix);
+        colliderBuffer.colliders[index].inverseWorldMatrix[3][3] = data->getFriction(); // store friction in inverse world matrix
         // Hijack elements in bottom row to store geometric parameters.
-        colliderBuffer.worldMatrix[index][0][3] = data->getWidth();
-        colliderBuffer.worldMatrix[index][1][3] = data->getHeight();
-        colliderBuffer.worldMatrix[index][2][3] = data->getDepth();
-        colliderBuffer.worldMatrix[index][3][3] = 0.0f; // collider type 0 = box
+        colliderBuffer.colliders[index].worldMatrix[0][3] = data->getWidth();
+        colliderBuffer.colliders[index].worldMatrix[1][3] = data->getHeight();
+        colliderBuffer.colliders[index].worldMatrix[2][3] = data->getDepth();
+        colliderBuffer.colliders[index].worldMatrix[3][3] = 0.0f; // collider type 0 = box
     }
 
     MStatus compute(const MPlug& plug, MDataBlock& dataBlock) override
@@ -64,14 +64,14 @@ public:
 
     void writeDataIntoBuffer(const ColliderData* const data, ColliderBuffer& colliderBuffer, int index = -1) override
     {
-        if (index == -1) index = colliderBuffer.numColliders++;
-        data->getWorldMatrix().inverse().get(colliderBuffer.inverseWorldMatrix[index]);
-        data->getWorldMatrix().get(colliderBuffer.worldMatrix[index]);
-        colliderBuffer.inverseWorldMatrix[index][3][3] = data->getFriction(); // store friction in inverse world matrix
+        if (index == -1) index = colliderBuffer.addCollider();
+        data->getWorldMatrix().inverse().get(colliderBuffer.colliders[index].inverseWorldMatrix);
+        data->getWorldMatrix().get(colliderBuffer.colliders[index].worldMatrix);
+        colliderBuffer.colliders[index].inverseWorldMatrix[3][3] = data->getFriction(); // store friction in inverse world matrix
         // Hijack elements in bottom row to store geometric parameters.
-        colliderBuffer.worldMatrix[index][0][3] = data->getRadius();
-        colliderBuffer.worldMatrix[index][1][3] = data->getHeight();
-        colliderBuffer.worldMatrix[index][3][3] = 2.0f; // collider type 2 = capsule
+        colliderBuffer.colliders[index].worldMatrix[0][3] = data->getRadius();
+        colliderBuffer.colliders[index].worldMatrix[1][3] = data->getHeight();
+        colliderBuffer.colliders[index].worldMatrix[3][3] = 2.0f; // collider type 2 = capsule
     }
 
     MStatus compute(const MPlug& plug, MDataBlock& dataBlock) override
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "colliderlocator.h"
+#include "../../meshsdf.h"
+#include <maya/MFnNumericAttribute.h>
+#include <maya/MFnTypedAttribute.h>
+#include <maya/MPlugArray.h>
+#include <maya/MStatus.h>
+
+/**
+ * Collides particles with an arbitrary (closed) mesh, via a signed distance field baked from it (see MeshSDF).
+ *
+ * The mesh is expected in the object space of the collider's parent transform (createCollider parents the collider under the selected mesh,
+ * and connects the mesh's outMesh). The SDF is only rebaked when the mesh or bake settings change; moving the collider just moves the SDF.
+ */
+class MeshCollider : public ColliderLocator {
+
+public:
+    inline static const MTypeId id = MTypeId(0x810F7);
+    inline static const MString typeName = MString("MeshCollider");
+
+    inline static MObject aInputMesh;
+    inline static MObject aCellSize;
+    inline static MObject aNarrowBandCells;
+    inline static MObject aColliderData;
+    inline static MObject aParentTransformMatrix;
+    inline static MObject aFriction;
+
+    static void* creator() { return new MeshCollider(); }
+    static MStatus initialize() {
+        MStatus status = initializeBaseAttributes(aColliderData, aParentTransformMatrix, aFriction);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        MFnTypedAttribute tAttr;
+        aInputMesh = tAttr.create("inputMesh", "inm", MFnData::kMesh);
+        tAttr.setStorable(false);
+        tAttr.setReadable(false);
+        tAttr.setWritable(true);
+        status = addAttribute(aInputMesh);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        MFnNumericAttribute nAttr;
+        aCellSize = nAttr.create("cellSize", "cs", MFnNumericData::kFloat, 0.1f);
+        nAttr.setMin(0.0001f);
+        nAttr.setSoftMax(1.0f);
+        nAttr.setStorable(true);
+        nAttr.setReadable(true);
+        nAttr.setWritable(true);
+        status = addAttribute(aCellSize);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        // Thicker than the particle radius (in cells), or fast particles can tunnel past the band before they're pushed out.
+        aNarrowBandCells = nAttr.create("narrowBandCells", "nbc", MFnNumericData::kInt, 3);
+        nAttr.setMin(1);
+        nAttr.setSoftMax(10);
+        nAttr.setStorable(true);
+        nAttr.setReadable(true);
+        nAttr.setWritable(true);
+        status = addAttribute(aNarrowBandCells);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        attributeAffects(aInputMesh, aColliderData);
+        attributeAffects(aCellSize, aColliderData);
+        attributeAffects(aNarrowBandCells, aColliderData);
+
+        return MS::kSuccess;
+    }
+
+    // Only these inputs need a rebake. Everything else (e.g. the transform) can reuse the current SDF.
+    MStatus setDependentsDirty(const MPlug& plug, MPlugArray& plugArray) override
+    {
+        if (plug == aInputMesh || plug == aCellSize || plug == aNarrowBandCells) {
+            sdfDirty = true;
+        }
+        return ColliderLocator::setDependentsDirty(plug, plugArray);
+    }
+
+    void prepareForDraw() override
+    {
+        ColliderLocator::prepareForDraw();
+        std::shared_ptr<const MeshSDF> sdf = meshSDF;
+        if (!sdf) {
+            cachedHalfExtents = MVector::zero;
+            return;
+        }
+
+        for (int i = 0; i < 3; ++i) {
+            cachedCenter[i] = 0.5 * (sdf->boundsMin(i) + sdf->boundsMax(i));
+            cachedHalfExtents[i] = 0.5 * (sdf->boundsMax(i) - sdf->boundsMin(i));
+        }
+    }
+
+    // Draws the bounds of the baked SDF.
+    void draw(MUIDrawManager& drawManager) override
+    {
+        if (!shouldDraw || cachedHalfExtents == MVector::zero) return;
+        drawManager.box(cachedCenter, MVector::yAxis, MVector::xAxis, cachedHalfExtents.x, cachedHalfExtents.y, cachedHalfExtents.z, false);
+    }
+
+    void writeDataIntoBuffer(const ColliderData* const data, ColliderBuffer& colliderBuffer, int index = -1) override
+    {
+        int sdfIndex;
+        if (index == -1) {
+            index = colliderBuffer.addCollider();
+            sdfIndex = colliderBuffer.addMeshSDF(data->getMeshSDF());
+        } else {
+            sdfIndex = static_cast<int>(colliderBuffer.colliders[index].worldMatrix[0][3]);
+            colliderBuffer.meshSDFs[sdfIndex] = data->getMeshSDF();
+        }
+
+        data->getWorldMatrix().inverse().get(colliderBuffer.colliders[index].inverseWorldMatrix);
+        data->getWorldMatrix().get(colliderBuffer.colliders[index].worldMatrix);
+        colliderBuffer.colliders[index].inverseWorldMatrix[3][3] = data->getFriction(); // store friction in inverse world matrix
+        // Hijack elements in bottom row to store geometric parameters.
+        colliderBuffer.colliders[index].worldMatrix[0][3] = static_cast<float>(sdfIndex);
+        colliderBuffer.colliders[index].worldMatrix[3][3] = 5.0f; // collider type 5 = mesh (signed distance field)
+    }
+
+    MStatus compute(const MPlug& plug, MDataBlock& dataBlock) override
+    {
+        if (plug != aColliderData) return MS::kUnknownParameter;
+
+        MMatrix parentTransformMat = dataBlock.inputValue(aParentTransformMatrix).asMatrix();
+        MMatrix worldMat = Utils::getWorldMatrixWithoutScale(thisMObject());
+        float cellSize = dataBlock.inputValue(aCellSize).asFloat();
+        int narrowBandCells = dataBlock.inputValue(aNarrowBandCells).asInt();
+        MDataHandle frictionHandle = dataBlock.inputValue(aFriction);
+        float friction = frictionHandle.asFloat();
+
+        // Colliders move rigidly (without scale), so any scale of the parent transform is baked into the SDF instead.
+        MMatrix meshToLocal = parentTransformMat * worldMat.inverse();
+        if (sdfDirty || !meshToLocal.isEquivalent(bakedMeshToLocal, 1e-6)) {
+            MObject mesh = dataBlock.inputValue(aInputMesh).asMesh();
+            meshSDF = mesh.isNull() ? nullptr : MeshSDF::bake(mesh, meshToLocal, cellSize, narrowBandCells);
+            bakedMeshToLocal = meshToLocal;
+            sdfDirty = false;
+        }
+
+        Utils::createPluginData<ColliderData>(
+            dataBlock,
+            aColliderData,
+            [this, &worldMat, &friction](ColliderData* colliderData) {
+                colliderData->setWorldMatrix(worldMat);
+                colliderData->setMeshSDF(meshSDF);
+                colliderData->setFriction(friction);
+            }
+        );
+
+        return MS::kSuccess;
+    }
+
+private:
+    std::shared_ptr<const MeshSDF> meshSDF;
+    MMatrix bakedMeshToLocal;
+    bool sdfDirty = true;
+    MPoint cachedCenter = MPoint::origin;
+    MVector cachedHalfExtents = MVector::zero;
+
+    MeshCollider() : ColliderLocator() {}
+    ~MeshCollider() override {}
+};
@@ -33,11 +33,16 @@ public:
     inline static MObject aVgsRelaxation;
     inline static MObject aVgsEdgeUniformity;
     inline static MObject aVgsIterations;
+    inline static MObject aVgsResidualTolerance;
+    inline static MObject aVgsTargetResidual;
     inline static MObject aGravityStrength;
     inline static MObject aFaceConstraintLow;
     inline static MObject aFaceConstraintHigh;
     inline static MObject aParticleMassLow;
     inline static MObject aParticleMassHigh;
+    inline static MObject aSleepingEnabled;
+    inline static MObject aSleepVelocity;
+    inline static MObject aSleepStrain;
     // Inputs
     inline static MObject aTriggerIn;
     inline static MObject aVoxelDataIn;
@@ -48,6 +53,8 @@ public:
     inline static MObject aParticleData;
     inline static MObject aParticleSRV;
     inline static MObject aSimulateSubstepFunction;
+    inline static MObject aVgsResidual;
+    inline static MObject aVgsAverageIterations;
     
     PBDNode() = default;
     ~PBDNode() override {
@@ -99,6 +106,22 @@ public:
         addAttribute(aVgsIterations);
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
+        // Voxels stop iterating once their largest particle correction (relative to particle radius) drops below this. 0 disables.
+        aVgsResidualTolerance = nAttr.create("vgsResidualTolerance", "vgsrt", MFnNumericData::kFloat, 0.0f, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        nAttr.setMin(0.0f);
+        nAttr.setSoftMax(0.1f);
+        status = addAttribute(aVgsResidualTolerance);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        // If non-zero, the VGS iteration count adapts each frame to keep the worst voxel residual near this value.
+        aVgsTargetResidual = nAttr.create("vgsTargetResidual", "vgstr", MFnNumericData::kFloat, 0.0f, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        nAttr.setMin(0.0f);
+        nAttr.setSoftMax(0.1f);
+        status = addAttribute(aVgsTargetResidual);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
         aGravityStrength = nAttr.create("gravityStrength", "gs", MFnNumericData::kFloat, -9.81f, &status);
         CHECK_MSTATUS_AND_RETURN_IT(status);
         nAttr.setMin(-100.0f);
@@ -134,6 +157,27 @@ public:
         status = addAttribute(aParticleMassHigh);
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
+        aSleepingEnabled = nAttr.create("sleepingEnabled", "se", MFnNumericData::kBoolean, false, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        status = addAttribute(aSleepingEnabled);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        // Speed (world units per second) under which a voxel is considered at rest
+        aSleepVelocity = nAttr.create("sleepVelocity", "sv", MFnNumericData::kFloat, 0.05f, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        nAttr.setMin(0.0f);
+        nAttr.setSoftMax(1.0f);
+        status = addAttribute(aSleepVelocity);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        // Edge strain (fraction of rest length) under which a voxel is considered at rest
+        aSleepStrain = nAttr.create("sleepStrain", "ss", MFnNumericData::kFloat, 0.02f, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        nAttr.setMin(0.0f);
+        nAttr.setSoftMax(0.2f);
+        status = addAttribute(aSleepStrain);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
         // Input attribute for GlobalSolver to trigger updates
         aTriggerIn = nAttr.create("triggerin", "tgi", MFnNumericData::kBoolean, false, &status);
         CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -199,6 +243,23 @@ public:
         status = addAttribute(aParticleBufferOffset);
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
+        // Convergence of the VGS solve, reported a frame late (see VGSCompute::collectResidualStats)
+        aVgsResidual = nAttr.create("vgsResidual", "vgsres", MFnNumericData::kFloat, 0.0f, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        nAttr.setStorable(false);
+        nAttr.setWritable(false);
+        nAttr.setReadable(true);
+        status = addAttribute(aVgsResidual);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        aVgsAverageIterations = nAttr.create("vgsAverageIterations", "vgsai", MFnNumericData::kFloat, 0.0f, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        nAttr.setStorable(false);
+        nAttr.setWritable(false);
+        nAttr.setReadable(true);
+        status = addAttribute(aVgsAverageIterations);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
         MFnTypedAttribute tParticleSRVAttr;
         aParticleSRV = tParticleSRVAttr.create("particleSRV", "psrv", D3D11Data::id, MObject::kNullObj, &status);
         CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -211,6 +272,12 @@ public:
         status = attributeAffects(aTriggerIn, aTriggerOut);
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
+        status = attributeAffects(aTriggerIn, aVgsResidual);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        status = attributeAffects(aTriggerIn, aVgsAverageIterations);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
         status = attributeAffects(aParticleBufferOffset, aParticleSRV);
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
@@ -321,8 +388,13 @@ public:
             dataBlock.inputValue(aVgsRelaxation).asFloat(),
             dataBlock.inputValue(aVgsEdgeUniformity).asFloat(),
             static_cast<uint>(dataBlock.inputValue(aVgsIterations).asInt()),
+            dataBlock.inputValue(aVgsResidualTolerance).asFloat(),
+            dataBlock.inputValue(aVgsTargetResidual).asFloat(),
             dataBlock.inputValue(aGravityStrength).asFloat(),
-            static_cast<float>(secondsPerFrame) / numSubsteps
+            static_cast<float>(secondsPerFrame) / numSubsteps,
+            dataBlock.inputValue(aSleepingEnabled).asBool(),
+            dataBlock.inputValue(aSleepVelocity).asFloat(),
+            dataBlock.inputValue(aSleepStrain).asFloat()
         });
     }
 
@@ -343,6 +415,11 @@ public:
     void mergeRenderParticles() {
         pbd.mergeRenderParticles();
     }
+
+    // Called by the GlobalSolver once per simulated frame.
+    void updateAdaptiveVGS() {
+        pbd.updateAdaptiveVGS();
+    }
     
 private:
     PBD pbd;
@@ -356,8 +433,11 @@ private:
         ComPtr<ID3D11UnorderedAccessView> oldParticlesUAV = DirectX::createUAV(GlobalSolver::getBuffer(GlobalSolver::BufferType::OLDPARTICLE), numberParticles, particleBufferOffset);
         ComPtr<ID3D11UnorderedAccessView> isSurfaceUAV = DirectX::createUAV(GlobalSolver::getBuffer(GlobalSolver::BufferType::SURFACE), numVoxels, voxelOffset);
         ComPtr<ID3D11ShaderResourceView> isDraggingSRV = DirectX::createSRV(GlobalSolver::getBuffer(GlobalSolver::BufferType::DRAGGING), numVoxels, voxelOffset);
+        ComPtr<ID3D11UnorderedAccessView> voxelActivityUAV = DirectX::createUAV(GlobalSolver::getBuffer(GlobalSolver::BufferType::ACTIVITY), numVoxels, voxelOffset);
+        ComPtr<ID3D11UnorderedAccessView> voxelAdjacencyUAV = DirectX::createUAV(GlobalSolver::getBuffer(GlobalSolver::BufferType::ADJACENCY), numVoxels, voxelOffset);
+        ComPtr<ID3D11UnorderedAccessView> surfaceVoxelsUAV = DirectX::createUAV(GlobalSolver::getBuffer(GlobalSolver::BufferType::SURFACE_LIST));
 
-        pbd.setGPUResourceHandles(particleUAV, oldParticlesUAV, isSurfaceUAV, isDraggingSRV);
+        pbd.setGPUResourceHandles(particleUAV, oldParticlesUAV, isSurfaceUAV, isDraggingSRV, voxelActivityUAV, voxelAdjacencyUAV, surfaceVoxelsUAV, voxelOffset);
         pbd.setInitialized(true);
     }
 
@@ -378,6 +458,15 @@ private:
             return MS::kSuccess;
         }
 
+        if (plug == aVgsResidual || plug == aVgsAverageIterations) {
+            const VGSResidualStats& stats = pbd.getVGSResidualStats();
+            dataBlock.outputValue(aVgsResidual).setFloat(stats.maxResidual);
+            dataBlock.outputValue(aVgsAverageIterations).setFloat(stats.averageIterations);
+            dataBlock.setClean(aVgsResidual);
+            dataBlock.setClean(aVgsAverageIterations);
+            return MS::kSuccess;
+        }
+
         updateSimulationParameters(dataBlock);
         return MS::kUnknownParameter;
     }
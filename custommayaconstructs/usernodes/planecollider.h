@@ -82,14 +82,14 @@ public:
 
     void writeDataIntoBuffer(const ColliderData* const data, ColliderBuffer& colliderBuffer, int index = -1) override
     {
-        if (index == -1) index = colliderBuffer.numColliders++;
-        data->getWorldMatrix().get(colliderBuffer.worldMatrix[index]);
+        if (index == -1) index = colliderBuffer.addCollider();
+        data->getWorldMatrix().get(colliderBuffer.colliders[index].worldMatrix);
         // Hijack elements in bottom row to store geometric parameters.
-        colliderBuffer.worldMatrix[index][0][3] = data->getWidth();
-        colliderBuffer.worldMatrix[index][1][3] = data->getHeight();
-        colliderBuffer.worldMatrix[index][2][3] = data->isInfinite() ? 1.0f : 0.0f; 
-        colliderBuffer.worldMatrix[index][3][3] = 4.0f; // collider type 4 = plane
-        colliderBuffer.inverseWorldMatrix[index][3][3] = data->getFriction(); // store friction in inverse world matrix
+        colliderBuffer.colliders[index].worldMatrix[0][3] = data->getWidth();
+        colliderBuffer.colliders[index].worldMatrix[1][3] = data->getHeight();
+        colliderBuffer.colliders[index].worldMatrix[2][3] = data->isInfinite() ? 1.0f : 0.0f; 
+        colliderBuffer.colliders[index].worldMatrix[3][3] = 4.0f; // collider type 4 = plane
+        colliderBuffer.colliders[index].inverseWorldMatrix[3][3] = data->getFriction(); // store friction in inverse world matrix
     }
 
     MStatus compute(const MPlug& plug, MDataBlock& dataBlock) override
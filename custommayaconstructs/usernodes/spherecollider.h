@@ -51,12 +51,12 @@ public:
 
     void writeDataIntoBuffer(const ColliderData* const data, ColliderBuffer& colliderBuffer, int index = -1) override
     {
-        if (index == -1) index = colliderBuffer.numColliders++;
-        data->getWorldMatrix().get(colliderBuffer.worldMatrix[index]);
+        if (index == -1) index = colliderBuffer.addCollider();
+        data->getWorldMatrix().get(colliderBuffer.colliders[index].worldMatrix);
         // Hijack elements in bottom row to store geometric parameters.
-        colliderBuffer.worldMatrix[index][0][3] = data->getRadius();
-        colliderBuffer.worldMatrix[index][3][3] = 1.0f; // collider type 1 = sphere
-        colliderBuffer.inverseWorldMatrix[index][3][3] = data->getFriction(); // store friction in inverse world matrix
+        colliderBuffer.colliders[index].worldMatrix[0][3] = data->getRadius();
+        colliderBuffer.colliders[index].worldMatrix[3][3] = 1.0f; // collider type 1 = sphere
+        colliderBuffer.colliders[index].inverseWorldMatrix[3][3] = data->getFriction(); // store friction in inverse world matrix
     }
 
     MStatus compute(const MPlug& plug, MDataBlock& dataBlock) override
@@ -1,12 +1,17 @@
 #pragma once
 
 #include "directx/compute/computeshader.h"
+#include "directx/compute/surfacevoxelscompute.h"
 
 struct ParticleCollisionCB {
     float inverseCellSize;
     unsigned int hashGridSize;
     unsigned int numParticles;
     float friction = 0.5f;
+    float skinRadius = 0.0f;
+    unsigned int maxNeighborPairs = 0;
+    float correctionScale = 0.0f;
+    unsigned int padding0 = 0;
 };
 
 static constexpr int HASH_TABLE_SIZE_TO_PARTICLES = 2;
@@ -30,7 +35,7 @@ public:
 
     void dispatch() override {
         DirectX::clearUintBuffer(collisionCellParticleCountsUAV);
-        ComputeShader::dispatch(numWorkgroups);
+        ComputeShader::dispatchIndirect(surfaceVoxelArgsBuffer, SurfaceVoxelsCompute::argsOffset(SurfaceVoxelsCompute::BUILD_GRID_ARGS));
     }
 
     const ComPtr<ID3D11Buffer>& getParticleCollisionCB() const { return particleCollisionCB; }
@@ -51,6 +56,12 @@ public:
         this->isSurfaceSRV = isSurfaceSRV;
     }
 
+    // Collision building is dispatched indirectly, over the particles of the surface voxel list only (see SurfaceVoxelsCompute).
+    void setSurfaceVoxels(const ComPtr<ID3D11ShaderResourceView>& surfaceVoxelsSRV, const ComPtr<ID3D11Buffer>& surfaceVoxelArgsBuffer) {
+        this->surfaceVoxelsSRV = surfaceVoxelsSRV;
+        this->surfaceVoxelArgsBuffer = surfaceVoxelArgsBuffer;
+    }
+
     void setFriction(float friction) {
         if (friction == particleCollisionCBData.friction) return;
         particleCollisionCBData.friction = friction;
@@ -58,7 +69,6 @@ public:
     }
 
 private:
-    int numWorkgroups = 0;
     ParticleCollisionCB particleCollisionCBData;
     ComPtr<ID3D11Buffer> particleCollisionCB;
     ComPtr<ID3D11Buffer> collisionCellParticleCountsBuffer;
@@ -66,9 +76,11 @@ private:
     ComPtr<ID3D11UnorderedAccessView> collisionCellParticleCountsUAV;
     ComPtr<ID3D11ShaderResourceView> particlesSRV;
     ComPtr<ID3D11ShaderResourceView> isSurfaceSRV;
+    ComPtr<ID3D11ShaderResourceView> surfaceVoxelsSRV;
+    ComPtr<ID3D11Buffer> surfaceVoxelArgsBuffer;
 
     void bind() override {
-        ID3D11ShaderResourceView* srvs[] = { particlesSRV.Get(), isSurfaceSRV.Get() };
+        ID3D11ShaderResourceView* srvs[] = { particlesSRV.Get(), isSurfaceSRV.Get(), surfaceVoxelsSRV.Get() };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
         ID3D11UnorderedAccessView* uavs[] = { collisionCellParticleCountsUAV.Get() };
@@ -79,7 +91,7 @@ private:
     }
 
     void unbind() override {
-        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr };
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
         ID3D11UnorderedAccessView* uavs[] = { nullptr };
@@ -90,8 +102,6 @@ private:
     }
 
     void initializeBuffers(int numParticles, float particleSize) {
-        numWorkgroups = Utils::divideRoundUp(numParticles, BUILD_COLLISION_GRID_THREADS);
-
         // Multiplpy by a factor to reduce hash collisions.
         // Add one as a "guard" / so the last cell will contribute to the scan and there will be record of it.
         // Round up to the nearest power of two so it can be prefix scanned.
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "directx/compute/computeshader.h"
+#include "directx/compute/surfacevoxelscompute.h"
 
 class BuildCollisionParticlesCompute : public ComputeShader
 {
@@ -25,7 +26,7 @@ public:
 
     void dispatch() override {
         DirectX::clearUintBuffer(particlesByCollisionCellUAV);
-        ComputeShader::dispatch(numWorkgroups);
+        ComputeShader::dispatchIndirect(surfaceVoxelArgsBuffer, SurfaceVoxelsCompute::argsOffset(SurfaceVoxelsCompute::BUILD_PARTICLES_ARGS));
     }
 
     const ComPtr<ID3D11ShaderResourceView>& getParticlesByCollisionCellSRV() const { return particlesByCollisionCellSRV; }
@@ -38,13 +39,20 @@ public:
         this->isSurfaceSRV = isSurfaceSRV;
     }
 
+    // Collision building is dispatched indirectly, over the particles of the surface voxel list only (see SurfaceVoxelsCompute).
+    void setSurfaceVoxels(const ComPtr<ID3D11ShaderResourceView>& surfaceVoxelsSRV, const ComPtr<ID3D11Buffer>& surfaceVoxelArgsBuffer) {
+        this->surfaceVoxelsSRV = surfaceVoxelsSRV;
+        this->surfaceVoxelArgsBuffer = surfaceVoxelArgsBuffer;
+    }
+
 private:
-    int numWorkgroups = 0;
     // Passed in
     ComPtr<ID3D11ShaderResourceView> particlesSRV;
     ComPtr<ID3D11Buffer> particleCollisionCB;
     ComPtr<ID3D11UnorderedAccessView> collisionCellParticleCountsUAV;
     ComPtr<ID3D11ShaderResourceView> isSurfaceSRV;
+    ComPtr<ID3D11ShaderResourceView> surfaceVoxelsSRV;
+    ComPtr<ID3D11Buffer> surfaceVoxelArgsBuffer;
     
     // Created internally
     ComPtr<ID3D11Buffer> particlesByCollisionCellBuffer;
@@ -52,7 +60,7 @@ private:
     ComPtr<ID3D11ShaderResourceView> particlesByCollisionCellSRV;
     
     void bind() override {
-        ID3D11ShaderResourceView* srvs[] = { particlesSRV.Get(), isSurfaceSRV.Get() };
+        ID3D11ShaderResourceView* srvs[] = { particlesSRV.Get(), isSurfaceSRV.Get(), surfaceVoxelsSRV.Get() };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
         ID3D11UnorderedAccessView* uavs[] = { collisionCellParticleCountsUAV.Get(), particlesByCollisionCellUAV.Get() };
@@ -63,7 +71,7 @@ private:
     }
 
     void unbind() override {
-        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr };
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
         ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr };
@@ -76,7 +84,6 @@ private:
     void initializeBuffers(int numParticles) {
         // Each particle can overlap up to 8 cells, so we need to allocate memory accordingly.
         int numBufferElements = 8 * numParticles;
-        numWorkgroups = Utils::divideRoundUp(numBufferElements, BUILD_COLLISION_PARTICLE_THREADS);
 
         std::vector<uint> emptyData(numBufferElements, 0);
         particlesByCollisionCellBuffer = DirectX::createReadWriteBuffer<uint>(emptyData);
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "directx/compute/computeshader.h"
+#include "directx/compute/buildcollisiongridcompute.h"
+#include "directx/compute/prefixscancompute.h"
+#include "directx/compute/radixsortcompute.h"
+#include <algorithm>
+
+/**
+ * Sorted alternative to the hashed collision grid (BuildCollisionGridCompute -> PrefixScanCompute -> BuildCollisionParticlesCompute).
+ *
+ * Every surface particle emits a (Morton cell key, particle index) pair per overlapped cell. The pairs are radix sorted by key, so each exact cell's
+ * particles are contiguous, and the start of each cell's run is written to a dense array with the same layout as the hashed grid's scanned counts.
+ * So the narrowphase is the same, except that no two cells share a bucket, and a particle pair spanning several cells is only solved in one of them.
+ *
+ * The narrowphase is dispatched indirectly over the occupied cells only (see getSolveDispatchArgsBuffer).
+ *
+ * A non-zero skin radius inflates particles (and cells) so that the grid also finds pairs that are close but not yet touching (see NeighborPairsCompute).
+ */
+class BuildSortedCollisionGridCompute : public ComputeShader
+{
+public:
+    BuildSortedCollisionGridCompute() = default;
+
+    BuildSortedCollisionGridCompute(
+        int numParticles,
+        float particleSize,
+        float skinRadius = 0.0f
+    ) : ComputeShader(IDR_SHADER27) {
+        if (numParticles <= 0) return;
+        loadShaderObject(markCellsEntryPoint);
+        loadShaderObject(writeCellsEntryPoint);
+        initializeBuffers(numParticles, particleSize, skinRadius);
+    };
+
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(cellKeysBuffer);
+        DirectX::notifyMayaOfMemoryUsage(particleIndicesBuffer);
+        DirectX::notifyMayaOfMemoryUsage(sortEntryCountBuffer);
+        DirectX::notifyMayaOfMemoryUsage(particleMinCellsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(cellStartFlagsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(cellStartsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(solveDispatchArgsBuffer);
+        radixSortCompute.reset();
+        cellStartFlagsScan.reset();
+    }
+
+    void dispatch() override {
+        if (!sortEntryCountUAV) return; // Not created yet
+
+        DirectX::clearUintBuffer(sortEntryCountUAV);
+        DirectX::clearUintBuffer(cellKeysUAV, COLLISION_CELL_KEY_EMPTY);
+
+        activePass = Pass::BuildKeys;
+        ComputeShader::dispatchIndirect(surfaceVoxelArgsBuffer, SurfaceVoxelsCompute::argsOffset(SurfaceVoxelsCompute::BUILD_PARTICLES_ARGS));
+
+        radixSortCompute.dispatch();
+
+        activePass = Pass::MarkCells;
+        ComputeShader::dispatch(numEntryWorkgroups, markCellsEntryPoint);
+
+        cellStartFlagsScan.dispatch();
+
+        activePass = Pass::WriteCells;
+        ComputeShader::dispatch(numEntryWorkgroups, writeCellsEntryPoint);
+    }
+
+    const ComPtr<ID3D11Buffer>& getParticleCollisionCB() const { return particleCollisionCB; }
+
+    const ComPtr<ID3D11ShaderResourceView>& getParticlesByCellSRV() const { return particleIndicesSRV; }
+
+    const ComPtr<ID3D11ShaderResourceView>& getCellKeysSRV() const { return cellKeysSRV; }
+
+    const ComPtr<ID3D11ShaderResourceView>& getCellStartsSRV() const { return cellStartsSRV; }
+
+    const ComPtr<ID3D11ShaderResourceView>& getParticleMinCellsSRV() const { return particleMinCellsSRV; }
+
+    const ComPtr<ID3D11Buffer>& getSolveDispatchArgsBuffer() const { return solveDispatchArgsBuffer; }
+
+    void setParticlesSRV(const ComPtr<ID3D11ShaderResourceView>& particlesSRV) {
+        this->particlesSRV = particlesSRV;
+    }
+
+    void setIsSurfaceSRV(const ComPtr<ID3D11ShaderResourceView>& isSurfaceSRV) {
+        this->isSurfaceSRV = isSurfaceSRV;
+    }
+
+    // Collision building is dispatched indirectly, over the particles of the surface voxel list only (see SurfaceVoxelsCompute).
+    void setSurfaceVoxels(const ComPtr<ID3D11ShaderResourceView>& surfaceVoxelsSRV, const ComPtr<ID3D11Buffer>& surfaceVoxelArgsBuffer) {
+        this->surfaceVoxelsSRV = surfaceVoxelsSRV;
+        this->surfaceVoxelArgsBuffer = surfaceVoxelArgsBuffer;
+    }
+
+    void setFriction(float friction) {
+        if (friction == particleCollisionCBData.friction) return;
+        particleCollisionCBData.friction = friction;
+        DirectX::updateConstantBuffer(particleCollisionCB, particleCollisionCBData);
+    }
+
+private:
+    enum class Pass { BuildKeys, MarkCells, WriteCells };
+    inline static constexpr int markCellsEntryPoint = IDR_SHADER30;
+    inline static constexpr int writeCellsEntryPoint = IDR_SHADER31;
+    Pass activePass = Pass::BuildKeys;
+    int numEntryWorkgroups = 0;
+    ParticleCollisionCB particleCollisionCBData;
+    ComPtr<ID3D11Buffer> particleCollisionCB;
+    // Sorted (cell key, particle index) pairs
+    ComPtr<ID3D11Buffer> cellKeysBuffer;
+    ComPtr<ID3D11ShaderResourceView> cellKeysSRV;
+    ComPtr<ID3D11UnorderedAccessView> cellKeysUAV;
+    ComPtr<ID3D11Buffer> particleIndicesBuffer;
+    ComPtr<ID3D11ShaderResourceView> particleIndicesSRV;
+    ComPtr<ID3D11UnorderedAccessView> particleIndicesUAV;
+    ComPtr<ID3D11Buffer> sortEntryCountBuffer;
+    ComPtr<ID3D11ShaderResourceView> sortEntryCountSRV;
+    ComPtr<ID3D11UnorderedAccessView> sortEntryCountUAV;
+    ComPtr<ID3D11Buffer> particleMinCellsBuffer;
+    ComPtr<ID3D11ShaderResourceView> particleMinCellsSRV;
+    ComPtr<ID3D11UnorderedAccessView> particleMinCellsUAV;
+    // Cell ranges
+    ComPtr<ID3D11Buffer> cellStartFlagsBuffer;
+    ComPtr<ID3D11ShaderResourceView> cellStartFlagsSRV;
+    ComPtr<ID3D11UnorderedAccessView> cellStartFlagsUAV;
+    ComPtr<ID3D11Buffer> cellStartsBuffer;
+    ComPtr<ID3D11ShaderResourceView> cellStartsSRV;
+    ComPtr<ID3D11UnorderedAccessView> cellStartsUAV;
+    ComPtr<ID3D11Buffer> solveDispatchArgsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> solveDispatchArgsUAV;
+    RadixSortCompute radixSortCompute;
+    PrefixScanCompute cellStartFlagsScan;
+    // Passed in
+    ComPtr<ID3D11ShaderResourceView> particlesSRV;
+    ComPtr<ID3D11ShaderResourceView> isSurfaceSRV;
+    ComPtr<ID3D11ShaderResourceView> surfaceVoxelsSRV;
+    ComPtr<ID3D11Buffer> surfaceVoxelArgsBuffer;
+
+    void bind() override {
+        switch (activePass) {
+        case Pass::BuildKeys: {
+            ID3D11ShaderResourceView* srvs[] = { particlesSRV.Get(), isSurfaceSRV.Get(), surfaceVoxelsSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { cellKeysUAV.Get(), particleIndicesUAV.Get(), sortEntryCountUAV.Get(), particleMinCellsUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+
+            ID3D11Buffer* cbvs[] = { particleCollisionCB.Get() };
+            DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+            break;
+        }
+        case Pass::MarkCells: {
+            ID3D11ShaderResourceView* srvs[] = { cellKeysSRV.Get(), sortEntryCountSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { cellStartFlagsUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        case Pass::WriteCells: {
+            ID3D11ShaderResourceView* srvs[] = { cellKeysSRV.Get(), sortEntryCountSRV.Get(), cellStartFlagsSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { cellStartsUAV.Get(), solveDispatchArgsUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        }
+    }
+
+    void unbind() override {
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+
+        ID3D11Buffer* cbvs[] = { nullptr };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    }
+
+    void initializeBuffers(int numParticles, float particleSize, float skinRadius) {
+        // Each particle can overlap up to 8 cells. Round up to a power of two (at least one radix sort workgroup) so the entries can be sorted and scanned.
+        int numEntries = static_cast<int>(pow(2, Utils::ilogbaseceil(std::max(8 * numParticles, RADIX_SORT_THREADS), 2)));
+        numEntryWorkgroups = Utils::divideRoundUp(numEntries, BUILD_COLLISION_PARTICLE_THREADS);
+
+        std::vector<uint> emptyEntries(numEntries, 0);
+        cellKeysBuffer = DirectX::createReadWriteBuffer(emptyEntries);
+        cellKeysSRV = DirectX::createSRV(cellKeysBuffer);
+        cellKeysUAV = DirectX::createUAV(cellKeysBuffer);
+
+        particleIndicesBuffer = DirectX::createReadWriteBuffer(emptyEntries);
+        particleIndicesSRV = DirectX::createSRV(particleIndicesBuffer);
+        particleIndicesUAV = DirectX::createUAV(particleIndicesBuffer);
+
+        cellStartFlagsBuffer = DirectX::createReadWriteBuffer(emptyEntries);
+        cellStartFlagsSRV = DirectX::createSRV(cellStartFlagsBuffer);
+        cellStartFlagsUAV = DirectX::createUAV(cellStartFlagsBuffer);
+
+        sortEntryCountBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(1, 0));
+        sortEntryCountSRV = DirectX::createSRV(sortEntryCountBuffer);
+        sortEntryCountUAV = DirectX::createUAV(sortEntryCountBuffer);
+
+        particleMinCellsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(numParticles, 0));
+        particleMinCellsSRV = DirectX::createSRV(particleMinCellsBuffer);
+        particleMinCellsUAV = DirectX::createUAV(particleMinCellsBuffer);
+
+        // At most one cell per entry, plus guard entries up to the end of the narrowphase's last workgroup (see write_collision_cells.hlsl).
+        cellStartsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(numEntries + SOLVE_COLLISION_THREADS + 1, 0));
+        cellStartsSRV = DirectX::createSRV(cellStartsBuffer);
+        cellStartsUAV = DirectX::createUAV(cellStartsBuffer);
+
+        solveDispatchArgsBuffer = DirectX::createIndirectArgsBuffer(1);
+        solveDispatchArgsUAV = DirectX::createUAV(solveDispatchArgsBuffer, 3, 0, DXGI_FORMAT_R32_UINT);
+
+        radixSortCompute = RadixSortCompute(cellKeysBuffer, particleIndicesBuffer);
+        cellStartFlagsScan = PrefixScanCompute(cellStartFlagsUAV);
+
+        // Same cell size as the hashed grid (plus the skin). In this mode, hashGridSize is the maximum number of occupied cells (bounds the narrowphase).
+        particleCollisionCBData.inverseCellSize = 1.0f / (2.0f * particleSize + skinRadius);
+        particleCollisionCBData.hashGridSize = numEntries;
+        particleCollisionCBData.numParticles = numParticles;
+        particleCollisionCBData.skinRadius = skinRadius;
+        particleCollisionCBData.maxNeighborPairs = NEIGHBOR_PAIRS_PER_PARTICLE * numParticles;
+        // Corrections are at most about a particle radius, so this leaves plenty of headroom for summing many of them in 32 bits.
+        particleCollisionCBData.correctionScale = 65536.0f / particleSize;
+        particleCollisionCB = DirectX::createConstantBuffer<ParticleCollisionCB>(particleCollisionCBData);
+    }
+};
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "directx/compute/computeshader.h"
+#include "directx/compute/surfacevoxelscompute.h"
+#include <array>
+
+struct CollisionCullingCB {
+    uint numVoxels{0};
+    uint numClusters{0};
+    uint numObjects{0};
+    float skinRadius{0.0f};
+};
+
+struct CollisionObjectRange {
+    uint firstVoxel;
+    uint numVoxels;
+    uint firstCluster;
+    uint numClusters;
+};
+
+/**
+ * Culls surface voxels that can't be touching anything before particle collisions are binned, using a shallow bounding volume hierarchy
+ * refit every time the collision grid is built:
+ *   1. Per-object (PBD node) AABBs. Objects that overlap no other object contribute nothing (unless fractured, or folded onto themselves; see below).
+ *   2. Per-cluster AABBs, over runs of COLLISION_CLUSTER_SIZE consecutive (Morton-ordered) voxels.
+ *   3. Per-voxel bounding spheres.
+ *
+ * The result is a per-voxel mask that the collision grid builders use in place of isSurface, so culled voxels never enter a cell.
+ * The per-voxel passes only run over the surface voxel list (see SurfaceVoxelsCompute).
+ * Objects that have lost face constraints can collide with their own pieces, so all of their surface voxels stay in.
+ * Intact objects can collide with themselves too, where they fold over. The first refit's cluster bounds (the objects' initial state, as this is
+ * created along with the solver's buffers) are kept as rest bounds, and a cluster that now overlaps one of its object's clusters that it didn't
+ * overlap at rest keeps all of its surface voxels.
+ */
+class CollisionCullingCompute : public ComputeShader
+{
+public:
+    CollisionCullingCompute() = default;
+
+    /**
+     * objectParticleOffsets: where each object's particles start in the global particle buffer, in increasing order.
+     */
+    CollisionCullingCompute(
+        const std::vector<uint>& objectParticleOffsets,
+        int numParticles,
+        const ComPtr<ID3D11UnorderedAccessView>& collisionStatsUAV
+    ) : ComputeShader(IDR_SHADER37),
+        collisionStatsUAV(collisionStatsUAV)
+    {
+        if (numParticles <= 0 || objectParticleOffsets.empty()) return;
+        loadShaderObject(refitObjectBoundsEntryPoint);
+        loadShaderObject(cullClustersEntryPoint);
+        loadShaderObject(cullVoxelsEntryPoint);
+        initializeBuffers(objectParticleOffsets, numParticles);
+    }
+
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(objectRangesBuffer);
+        DirectX::notifyMayaOfMemoryUsage(clusterObjectsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(boundsMinBuffer);
+        DirectX::notifyMayaOfMemoryUsage(boundsMaxBuffer);
+        DirectX::notifyMayaOfMemoryUsage(restBoundsMinBuffer);
+        DirectX::notifyMayaOfMemoryUsage(restBoundsMaxBuffer);
+        DirectX::notifyMayaOfMemoryUsage(objectFlagsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(voxelSpheresBuffer);
+        DirectX::notifyMayaOfMemoryUsage(clusterIsCandidateBuffer);
+        DirectX::notifyMayaOfMemoryUsage(isCollisionCandidateBuffer);
+        DirectX::notifyMayaOfMemoryUsage(collisionCullingCB);
+    }
+
+    // Refits the hierarchy to the current particle positions and rewrites the candidate mask. Call before building the collision grid.
+    void dispatch() override {
+        if (!isCollisionCandidateUAV) return; // Not created yet
+
+        DirectX::clearUintBuffer(boundsMinUAV, 0xFFFFFFFF);
+        DirectX::clearUintBuffer(boundsMaxUAV);
+        DirectX::clearUintBuffer(objectFlagsUAV);
+        DirectX::clearUintBuffer(isCollisionCandidateUAV);
+
+        const UINT voxelArgsOffset = SurfaceVoxelsCompute::argsOffset(SurfaceVoxelsCompute::CULLING_ARGS);
+        activePass = Pass::RefitVoxels;
+        ComputeShader::dispatchIndirect(surfaceVoxelArgsBuffer, voxelArgsOffset);
+
+        activePass = Pass::RefitObjects;
+        ComputeShader::dispatch(numClusterWorkgroups, refitObjectBoundsEntryPoint);
+
+        if (!hasRestBounds) {
+            DirectX::getContext()->CopyResource(restBoundsMinBuffer.Get(), boundsMinBuffer.Get());
+            DirectX::getContext()->CopyResource(restBoundsMaxBuffer.Get(), boundsMaxBuffer.Get());
+            hasRestBounds = true;
+        }
+
+        activePass = Pass::CullClusters;
+        ComputeShader::dispatch(numClusterWorkgroups, cullClustersEntryPoint);
+
+        activePass = Pass::CullVoxels;
+        ComputeShader::dispatchIndirect(surfaceVoxelArgsBuffer, voxelArgsOffset, cullVoxelsEntryPoint);
+    }
+
+    // Use in place of the isSurface SRV when binning particles for collisions.
+    const ComPtr<ID3D11ShaderResourceView>& getCollisionCandidatesSRV() const { return isCollisionCandidateSRV; }
+
+    void setParticlesSRV(const ComPtr<ID3D11ShaderResourceView>& particlesSRV) {
+        this->particlesSRV = particlesSRV;
+    }
+
+    void setIsSurfaceSRV(const ComPtr<ID3D11ShaderResourceView>& isSurfaceSRV) {
+        this->isSurfaceSRV = isSurfaceSRV;
+    }
+
+    void setSurfaceVoxels(const ComPtr<ID3D11ShaderResourceView>& surfaceVoxelsSRV, const ComPtr<ID3D11Buffer>& surfaceVoxelArgsBuffer) {
+        this->surfaceVoxelsSRV = surfaceVoxelsSRV;
+        this->surfaceVoxelArgsBuffer = surfaceVoxelArgsBuffer;
+    }
+
+    // Must match the skin radius of the collision grid (if any), so that culled voxels are at least a skin away from everything.
+    void setSkinRadius(float skinRadius) {
+        if (!collisionCullingCB || skinRadius == collisionCullingCBData.skinRadius) return;
+        collisionCullingCBData.skinRadius = skinRadius;
+        DirectX::updateConstantBuffer(collisionCullingCB, collisionCullingCBData);
+    }
+
+private:
+    enum class Pass { RefitVoxels, RefitObjects, CullClusters, CullVoxels };
+    inline static constexpr int refitObjectBoundsEntryPoint = IDR_SHADER38;
+    inline static constexpr int cullClustersEntryPoint = IDR_SHADER39;
+    inline static constexpr int cullVoxelsEntryPoint = IDR_SHADER40;
+    Pass activePass = Pass::RefitVoxels;
+    int numClusterWorkgroups = 0;
+    bool hasRestBounds = false;
+    CollisionCullingCB collisionCullingCBData;
+    ComPtr<ID3D11Buffer> collisionCullingCB;
+    // Owned resources
+    ComPtr<ID3D11Buffer> objectRangesBuffer;
+    ComPtr<ID3D11ShaderResourceView> objectRangesSRV;
+    ComPtr<ID3D11Buffer> clusterObjectsBuffer;
+    ComPtr<ID3D11ShaderResourceView> clusterObjectsSRV;
+    ComPtr<ID3D11Buffer> boundsMinBuffer;
+    ComPtr<ID3D11ShaderResourceView> boundsMinSRV;
+    ComPtr<ID3D11UnorderedAccessView> boundsMinUAV;
+    ComPtr<ID3D11Buffer> boundsMaxBuffer;
+    ComPtr<ID3D11ShaderResourceView> boundsMaxSRV;
+    ComPtr<ID3D11UnorderedAccessView> boundsMaxUAV;
+    ComPtr<ID3D11Buffer> restBoundsMinBuffer;
+    ComPtr<ID3D11ShaderResourceView> restBoundsMinSRV;
+    ComPtr<ID3D11Buffer> restBoundsMaxBuffer;
+    ComPtr<ID3D11ShaderResourceView> restBoundsMaxSRV;
+    ComPtr<ID3D11Buffer> objectFlagsBuffer;
+    ComPtr<ID3D11ShaderResourceView> objectFlagsSRV;
+    ComPtr<ID3D11UnorderedAccessView> objectFlagsUAV;
+    ComPtr<ID3D11Buffer> voxelSpheresBuffer;
+    ComPtr<ID3D11ShaderResourceView> voxelSpheresSRV;
+    ComPtr<ID3D11UnorderedAccessView> voxelSpheresUAV;
+    ComPtr<ID3D11Buffer> clusterIsCandidateBuffer;
+    ComPtr<ID3D11ShaderResourceView> clusterIsCandidateSRV;
+    ComPtr<ID3D11UnorderedAccessView> clusterIsCandidateUAV;
+    ComPtr<ID3D11Buffer> isCollisionCandidateBuffer;
+    ComPtr<ID3D11ShaderResourceView> isCollisionCandidateSRV;
+    ComPtr<ID3D11UnorderedAccessView> isCollisionCandidateUAV;
+    // Passed-in resources
+    ComPtr<ID3D11ShaderResourceView> particlesSRV;
+    ComPtr<ID3D11ShaderResourceView> isSurfaceSRV;
+    ComPtr<ID3D11ShaderResourceView> surfaceVoxelsSRV;
+    ComPtr<ID3D11Buffer> surfaceVoxelArgsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> collisionStatsUAV;
+
+    void bind() override {
+        switch (activePass) {
+        case Pass::RefitVoxels: {
+            ID3D11ShaderResourceView* srvs[] = { objectRangesSRV.Get(), particlesSRV.Get(), isSurfaceSRV.Get(), surfaceVoxelsSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { boundsMinUAV.Get(), boundsMaxUAV.Get(), objectFlagsUAV.Get(), voxelSpheresUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        case Pass::RefitObjects: {
+            ID3D11ShaderResourceView* srvs[] = { objectRangesSRV.Get(), clusterObjectsSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { boundsMinUAV.Get(), boundsMaxUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        case Pass::CullClusters: {
+            ID3D11ShaderResourceView* srvs[] = {
+                objectRangesSRV.Get(), clusterObjectsSRV.Get(), boundsMinSRV.Get(), boundsMaxSRV.Get(), objectFlagsSRV.Get(), restBoundsMinSRV.Get(), restBoundsMaxSRV.Get()
+            };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { clusterIsCandidateUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        case Pass::CullVoxels: {
+            ID3D11ShaderResourceView* srvs[] = {
+                objectRangesSRV.Get(), isSurfaceSRV.Get(), boundsMinSRV.Get(), boundsMaxSRV.Get(), objectFlagsSRV.Get(), clusterIsCandidateSRV.Get(), voxelSpheresSRV.Get(),
+                surfaceVoxelsSRV.Get()
+            };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { isCollisionCandidateUAV.Get(), collisionStatsUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        }
+
+        ID3D11Buffer* cbvs[] = { collisionCullingCB.Get() };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    }
+
+    void unbind() override {
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+
+        ID3D11Buffer* cbvs[] = { nullptr };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    }
+
+    void initializeBuffers(const std::vector<uint>& objectParticleOffsets, int numParticles) {
+        uint numVoxels = static_cast<uint>(numParticles / 8);
+        uint numObjects = static_cast<uint>(objectParticleOffsets.size());
+
+        // Clusters never span two objects, so each object's clusters start fresh at its first voxel.
+        std::vector<CollisionObjectRange> objectRanges(numObjects);
+        std::vector<uint> clusterObjects;
+        for (uint i = 0; i < numObjects; ++i) {
+            uint firstVoxel = objectParticleOffsets[i] / 8;
+            uint endVoxel = (i + 1 < numObjects) ? objectParticleOffsets[i + 1] / 8 : numVoxels;
+            uint numObjectClusters = Utils::divideRoundUp(endVoxel - firstVoxel, COLLISION_CLUSTER_SIZE);
+            objectRanges[i] = { firstVoxel, endVoxel - firstVoxel, static_cast<uint>(clusterObjects.size()), numObjectClusters };
+            clusterObjects.insert(clusterObjects.end(), numObjectClusters, i);
+        }
+        uint numClusters = static_cast<uint>(clusterObjects.size());
+
+        numClusterWorkgroups = Utils::divideRoundUp(numClusters, COLLISION_CULLING_THREADS);
+
+        objectRangesBuffer = DirectX::createReadOnlyBuffer(objectRanges);
+        objectRangesSRV = DirectX::createSRV(objectRangesBuffer);
+        clusterObjectsBuffer = DirectX::createReadOnlyBuffer(clusterObjects);
+        clusterObjectsSRV = DirectX::createSRV(clusterObjectsBuffer);
+
+        // (x, y, z, unused) per cluster, then per object.
+        std::vector<std::array<uint, 4>> emptyBounds(numClusters + numObjects, { 0, 0, 0, 0 });
+        boundsMinBuffer = DirectX::createReadWriteBuffer(emptyBounds);
+        boundsMinSRV = DirectX::createSRV(boundsMinBuffer);
+        boundsMinUAV = DirectX::createUAV(boundsMinBuffer);
+        boundsMaxBuffer = DirectX::createReadWriteBuffer(emptyBounds);
+        boundsMaxSRV = DirectX::createSRV(boundsMaxBuffer);
+        boundsMaxUAV = DirectX::createUAV(boundsMaxBuffer);
+        restBoundsMinBuffer = DirectX::createReadWriteBuffer(emptyBounds);
+        restBoundsMinSRV = DirectX::createSRV(restBoundsMinBuffer);
+        restBoundsMaxBuffer = DirectX::createReadWriteBuffer(emptyBounds);
+        restBoundsMaxSRV = DirectX::createSRV(restBoundsMaxBuffer);
+
+        objectFlagsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(numObjects, 0));
+        objectFlagsSRV = DirectX::createSRV(objectFlagsBuffer);
+        objectFlagsUAV = DirectX::createUAV(objectFlagsBuffer);
+
+        // (center, radius) per voxel
+        voxelSpheresBuffer = DirectX::createReadWriteBuffer(std::vector<std::array<float, 4>>(numVoxels, { 0.0f, 0.0f, 0.0f, 0.0f }));
+        voxelSpheresSRV = DirectX::createSRV(voxelSpheresBuffer);
+        voxelSpheresUAV = DirectX::createUAV(voxelSpheresBuffer);
+
+        clusterIsCandidateBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(numClusters, 0));
+        clusterIsCandidateSRV = DirectX::createSRV(clusterIsCandidateBuffer);
+        clusterIsCandidateUAV = DirectX::createUAV(clusterIsCandidateBuffer);
+
+        isCollisionCandidateBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(numVoxels, 0));
+        isCollisionCandidateSRV = DirectX::createSRV(isCollisionCandidateBuffer);
+        isCollisionCandidateUAV = DirectX::createUAV(isCollisionCandidateBuffer);
+
+        collisionCullingCBData = { numVoxels, numClusters, numObjects, 0.0f };
+        collisionCullingCB = DirectX::createConstantBuffer<CollisionCullingCB>(collisionCullingCBData);
+    }
+};
@@ -34,6 +34,22 @@ public:
         unbind();
     };
 
+    // Dispatch with thread group counts read from the GPU (see DirectX::createIndirectArgsBuffer). 
+    // argsOffset is in bytes, and must point at a (x, y, z) triple of thread group counts.
+    virtual void dispatchIndirect(const ComPtr<ID3D11Buffer>& argsBuffer, UINT argsOffset) {
+        dispatchIndirect(argsBuffer, argsOffset, mainId);
+    }
+
+    virtual void dispatchIndirect(const ComPtr<ID3D11Buffer>& argsBuffer, UINT argsOffset, int entryPointId) {
+        if (!argsBuffer) return;
+
+        DirectX::getContext()->CSSetShader(shaderCache[entryPointId].Get(), NULL, 0);
+
+        bind();
+        DirectX::getContext()->DispatchIndirect(argsBuffer.Get(), argsOffset);
+        unbind();
+    }
+
     static void clearShaderCache() {
         shaderCache.clear();
     }
@@ -49,8 +65,8 @@ protected:
     virtual void unbind() = 0;
     virtual void reset() {}
 
-    void registerBufferForCaching(const ComPtr<ID3D11Buffer>& buffer) {
-        simCacheRegistrations.push_back(SimulationCache::instance()->registerBuffer(buffer));
+    void registerBufferForCaching(const ComPtr<ID3D11Buffer>& buffer, const std::string& name) {
+        simCacheRegistrations.push_back(SimulationCache::instance()->registerBuffer(buffer, name));
     }
 
     void loadShaderObject(int id) {
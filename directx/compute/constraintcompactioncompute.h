@@ -0,0 +1,207 @@
+#pragma once
+
+#include "directx/compute/computeshader.h"
+#include "directx/compute/faceconstraintscompute.h"
+#include "shaders/constants.hlsli"
+#include <array>
+#include <algorithm>
+
+struct ConstraintCompactionCB {
+    uint numConstraints{0};
+    uint firstConstraint{0};
+    uint liveSlot{0};
+    uint padding0{0};
+};
+
+/**
+ * Maintains dense lists of the constraints that haven't broken yet (per face axis, and per long-range level), so that
+ * per-substep and per-frame constraint passes only launch threads for live constraints. Broken constraints never come back
+ * (short of restoring a cached frame), so the lists only need rebuilding every so often as fracture accumulates.
+ *
+ * Constraint data itself never moves: the live lists hold indices into the original constraint arrays, so anything keyed by
+ * constraint index (paint limits, face to long-range mappings, cached state) stays valid.
+ */
+class ConstraintCompactionCompute : public ComputeShader
+{
+public:
+    // Substeps between rebuilds. Until then, the lists may still hold constraints that broke since the last rebuild (passes skip those as before).
+    static constexpr int COMPACTION_INTERVAL_SUBSTEPS = 16;
+
+    static constexpr UINT argsOffset(int liveSlot) {
+        return static_cast<UINT>(liveSlot * 3 * sizeof(UINT));
+    }
+
+    ConstraintCompactionCompute() = default;
+
+    ConstraintCompactionCompute(
+        const std::array<FaceConstraints, 3>& faceConstraints,
+        const std::array<uint, LONG_RANGE_LEVELS + 1>& longRangeLevelOffsets
+    ) : ComputeShader(IDR_SHADER24)
+    {
+        loadShaderObject(compactLongRangeConstraintsEntryPoint);
+        loadShaderObject(writeArgsEntryPoint);
+        initializeBuffers(faceConstraints, longRangeLevelOffsets);
+    }
+
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(liveLongRangeConstraintsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(liveCountsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(liveDispatchArgsBuffer);
+        for (int i = 0; i < 3; i++) {
+            DirectX::notifyMayaOfMemoryUsage(liveFaceConstraintsBuffers[i]);
+            DirectX::notifyMayaOfMemoryUsage(faceCompactionCBs[i]);
+        }
+        for (int level = 0; level < LONG_RANGE_LEVELS; level++) {
+            DirectX::notifyMayaOfMemoryUsage(longRangeCompactionCBs[level]);
+        }
+    }
+
+    /**
+     * Rebuilds all live lists and their dispatch args from scratch.
+     */
+    void dispatch() override {
+        if (!liveCountsUAV) return; // Not created yet
+
+        DirectX::clearUintBuffer(liveCountsUAV);
+
+        for (int axis = 0; axis < 3; axis++) {
+            passUAVs = { faceConstraintIndicesUAVs[axis], liveFaceConstraintsUAVs[axis] };
+            passCB = faceCompactionCBs[axis];
+            ComputeShader::dispatch(numFaceConstraintWorkgroups[axis]);
+        }
+
+        passUAVs = { longRangeParticleIndicesUAV, liveLongRangeConstraintsUAV };
+        for (int level = 0; level < LONG_RANGE_LEVELS; level++) {
+            passCB = longRangeCompactionCBs[level];
+            ComputeShader::dispatch(numLongRangeConstraintWorkgroups[level], compactLongRangeConstraintsEntryPoint);
+        }
+
+        passUAVs = {};
+        passCB = nullptr;
+        ComputeShader::dispatch(1, writeArgsEntryPoint);
+
+        substepsSinceCompaction = 0;
+        lastSeenRestoreCount = SimulationCache::instance()->getRestoreCount();
+        isStale = false;
+    }
+
+    // Call once per substep, before anything reads the live lists.
+    void onSubstep() {
+        if (isStale || cacheWasRestored() || ++substepsSinceCompaction >= COMPACTION_INTERVAL_SUBSTEPS) {
+            dispatch();
+        }
+    }
+
+    // Call before reading the live lists outside of a substep (e.g. paint or render passes). Only rebuilds if the lists
+    // could be missing live constraints (a cached frame, with fewer broken constraints, was restored since the last rebuild).
+    void ensureCurrent() {
+        if (isStale || cacheWasRestored()) {
+            dispatch();
+        }
+    }
+
+    const ComPtr<ID3D11ShaderResourceView>& getLiveFaceConstraintsSRV(int axis) const {
+        return liveFaceConstraintsSRVs[axis];
+    }
+
+    const ComPtr<ID3D11ShaderResourceView>& getLiveLongRangeConstraintsSRV() const {
+        return liveLongRangeConstraintsSRV;
+    }
+
+    const ComPtr<ID3D11ShaderResourceView>& getLiveCountsSRV() const {
+        return liveCountsSRV;
+    }
+
+    const ComPtr<ID3D11Buffer>& getLiveDispatchArgsBuffer() const {
+        return liveDispatchArgsBuffer;
+    }
+
+    void setFaceConstraintIndicesUAV(int axis, const ComPtr<ID3D11UnorderedAccessView>& faceConstraintIndicesUAV) {
+        faceConstraintIndicesUAVs[axis] = faceConstraintIndicesUAV;
+    }
+
+    void setLongRangeParticleIndicesUAV(const ComPtr<ID3D11UnorderedAccessView>& longRangeParticleIndicesUAV) {
+        this->longRangeParticleIndicesUAV = longRangeParticleIndicesUAV;
+    }
+
+private:
+    inline static constexpr int compactLongRangeConstraintsEntryPoint = IDR_SHADER25;
+    inline static constexpr int writeArgsEntryPoint = IDR_SHADER26;
+    std::array<int, 3> numFaceConstraintWorkgroups = { 0, 0, 0 };
+    std::array<int, LONG_RANGE_LEVELS> numLongRangeConstraintWorkgroups{};
+    int substepsSinceCompaction = 0;
+    uint64_t lastSeenRestoreCount = 0;
+    bool isStale = true; // Lists start empty; build them before first use.
+    // UAVs that differ per pass, bound to slots u0 and u1 respectively (see bind()).
+    std::array<ComPtr<ID3D11UnorderedAccessView>, 2> passUAVs;
+    ComPtr<ID3D11Buffer> passCB;
+    // Owned resources
+    std::array<ComPtr<ID3D11Buffer>, 3> faceCompactionCBs;
+    std::array<ComPtr<ID3D11Buffer>, LONG_RANGE_LEVELS> longRangeCompactionCBs;
+    std::array<ComPtr<ID3D11Buffer>, 3> liveFaceConstraintsBuffers;
+    std::array<ComPtr<ID3D11UnorderedAccessView>, 3> liveFaceConstraintsUAVs;
+    std::array<ComPtr<ID3D11ShaderResourceView>, 3> liveFaceConstraintsSRVs;
+    ComPtr<ID3D11Buffer> liveLongRangeConstraintsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> liveLongRangeConstraintsUAV;
+    ComPtr<ID3D11ShaderResourceView> liveLongRangeConstraintsSRV;
+    ComPtr<ID3D11Buffer> liveCountsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> liveCountsUAV;
+    ComPtr<ID3D11ShaderResourceView> liveCountsSRV;
+    ComPtr<ID3D11Buffer> liveDispatchArgsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> liveDispatchArgsUAV;
+    // Passed-in resources
+    std::array<ComPtr<ID3D11UnorderedAccessView>, 3> faceConstraintIndicesUAVs;
+    ComPtr<ID3D11UnorderedAccessView> longRangeParticleIndicesUAV;
+
+    bool cacheWasRestored() const {
+        return SimulationCache::instance()->getRestoreCount() != lastSeenRestoreCount;
+    }
+
+    void bind() override
+    {
+        ID3D11UnorderedAccessView* uavs[] = { passUAVs[0].Get(), passUAVs[1].Get(), liveCountsUAV.Get(), liveDispatchArgsUAV.Get() };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+
+        ID3D11Buffer* cbvs[] = { passCB.Get() };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    };
+
+    void unbind() override
+    {
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+
+        ID3D11Buffer* cbvs[] = { nullptr };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    };
+
+    void initializeBuffers(const std::array<FaceConstraints, 3>& faceConstraints, const std::array<uint, LONG_RANGE_LEVELS + 1>& longRangeLevelOffsets) {
+        // Lists are sized for the worst case (nothing broken). Sizes are padded to at least one element, since D3D11 doesn't allow empty buffers.
+        for (int i = 0; i < 3; i++) {
+            uint numConstraints = faceConstraints[i].size();
+            numFaceConstraintWorkgroups[i] = Utils::divideRoundUp(numConstraints, VGS_THREADS);
+            liveFaceConstraintsBuffers[i] = DirectX::createReadWriteBuffer(std::vector<uint>(std::max(numConstraints, 1u), 0));
+            liveFaceConstraintsUAVs[i] = DirectX::createUAV(liveFaceConstraintsBuffers[i]);
+            liveFaceConstraintsSRVs[i] = DirectX::createSRV(liveFaceConstraintsBuffers[i]);
+            faceCompactionCBs[i] = DirectX::createConstantBuffer<ConstraintCompactionCB>({ numConstraints, 0, static_cast<uint>(LIVE_FACE_CONSTRAINTS_SLOT + i), 0 });
+        }
+
+        uint numLongRangeConstraints = longRangeLevelOffsets[LONG_RANGE_LEVELS];
+        liveLongRangeConstraintsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(std::max(numLongRangeConstraints, 1u), 0));
+        liveLongRangeConstraintsUAV = DirectX::createUAV(liveLongRangeConstraintsBuffer);
+        liveLongRangeConstraintsSRV = DirectX::createSRV(liveLongRangeConstraintsBuffer);
+        for (int level = 0; level < LONG_RANGE_LEVELS; level++) {
+            uint firstConstraint = longRangeLevelOffsets[level];
+            uint numLevelConstraints = longRangeLevelOffsets[level + 1] - firstConstraint;
+            numLongRangeConstraintWorkgroups[level] = Utils::divideRoundUp(numLevelConstraints, VGS_THREADS);
+            longRangeCompactionCBs[level] = DirectX::createConstantBuffer<ConstraintCompactionCB>({ numLevelConstraints, firstConstraint, static_cast<uint>(LIVE_LONG_RANGE_CONSTRAINTS_SLOT + level), 0 });
+        }
+
+        liveCountsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(NUM_LIVE_SLOTS, 0));
+        liveCountsUAV = DirectX::createUAV(liveCountsBuffer);
+        liveCountsSRV = DirectX::createSRV(liveCountsBuffer);
+
+        liveDispatchArgsBuffer = DirectX::createIndirectArgsBuffer(NUM_LIVE_SLOTS);
+        liveDispatchArgsUAV = DirectX::createUAV(liveDispatchArgsBuffer, NUM_LIVE_SLOTS * 3, 0, DXGI_FORMAT_R32_UINT);
+    }
+};
@@ -11,8 +11,8 @@ struct FaceConstraintsCB {
     int faceTwoId;
     float constraintLow;
     float constraintHigh;
-    int padding0;
-    int padding1;
+    int axis;
+    uint voxelOffset;
     int padding2;
 };
 
@@ -55,14 +55,18 @@ public:
         }
     }
 
+    // Dispatches over the active face constraints only (those touching an awake voxel). See VoxelActivityCompute.
     void dispatch() override
     {
         extraUAVs[0] = longRangeConstraintCountersUAV;
 
         for (activeConstraintAxis = 0; activeConstraintAxis < 3; activeConstraintAxis++) {
             extraUAVs[1] = longRangeConstraintIndicesUAVs[activeConstraintAxis];
-            ComputeShader::dispatch(numWorkgroups[activeConstraintAxis]);
+            activeSRVs[0] = activeConstraintsSRVs[activeConstraintAxis];
+            activeSRVs[1] = activeCountsSRV;
+            ComputeShader::dispatchIndirect(dispatchArgsBuffer, dispatchArgsOffsets[activeConstraintAxis]);
         }
+        activeSRVs = {};
         activeConstraintAxis = 0;
     };
 
@@ -82,8 +86,11 @@ public:
         }
 
         for (activeConstraintAxis = 0; activeConstraintAxis < 3; activeConstraintAxis++) {
-            ComputeShader::dispatch(numWorkgroups[activeConstraintAxis], updateFaceConstraintsEntryPoint);
+            activeSRVs = { liveConstraintsSRVs[activeConstraintAxis], liveCountsSRV };
+            ComputeShader::dispatchIndirect(liveDispatchArgsBuffer, liveDispatchArgsOffsets[activeConstraintAxis], updateFaceConstraintsEntryPoint);
         }
+        activeSRVs = {};
+        activeConstraintAxis = 0;
     }
 
     void mergeRenderParticles() {
@@ -91,8 +98,10 @@ public:
 
         ComputeShader::dispatch(numExpandParticlesWorkgroups, expandRenderParticlesEntryPoint);
         for (activeConstraintAxis = 0; activeConstraintAxis < 3; activeConstraintAxis++) {
-            ComputeShader::dispatch(numWorkgroups[activeConstraintAxis], mergeRenderParticlesEntryPoint);
+            activeSRVs = { liveConstraintsSRVs[activeConstraintAxis], liveCountsSRV };
+            ComputeShader::dispatchIndirect(liveDispatchArgsBuffer, liveDispatchArgsOffsets[activeConstraintAxis], mergeRenderParticlesEntryPoint);
         }
+        activeSRVs = {};
         activeConstraintAxis = 0;
     }
 
@@ -117,6 +126,22 @@ public:
         this->isSurfaceUAV = isSurfaceUAV;
     }
 
+    void setVoxelAdjacencyUAV(const ComPtr<ID3D11UnorderedAccessView>& voxelAdjacencyUAV) {
+        this->voxelAdjacencyUAV = voxelAdjacencyUAV;
+    }
+
+    // The global surface voxel list (see SurfaceVoxelsCompute), which voxels exposed by breaking constraints get appended to.
+    // voxelOffset converts this model's voxel indices into global ones.
+    void setSurfaceVoxels(const ComPtr<ID3D11UnorderedAccessView>& surfaceVoxelsUAV, uint voxelOffset) {
+        this->surfaceVoxelsUAV = surfaceVoxelsUAV;
+        if (faceConstraintsCBData[0].voxelOffset == voxelOffset) return;
+
+        for (int i = 0; i < 3; i++) {
+            faceConstraintsCBData[i].voxelOffset = voxelOffset;
+            DirectX::updateConstantBuffer(faceConstraintsCBs[i], faceConstraintsCBData[i]);
+        }
+    }
+
     void setRenderParticlesUAV(const ComPtr<ID3D11UnorderedAccessView>& renderParticlesUAV) {
         this->renderParticlesUAV = renderParticlesUAV;
     }
@@ -125,16 +150,54 @@ public:
         this->longRangeConstraintCountersUAV = longRangeConstraintCountersUAV;
     }
 
+    void setActiveConstraints(
+        const std::array<ComPtr<ID3D11ShaderResourceView>, 3>& activeConstraintsSRVs,
+        const ComPtr<ID3D11ShaderResourceView>& activeCountsSRV,
+        const ComPtr<ID3D11Buffer>& dispatchArgsBuffer,
+        const std::array<UINT, 3>& dispatchArgsOffsets
+    ) {
+        this->activeConstraintsSRVs = activeConstraintsSRVs;
+        this->activeCountsSRV = activeCountsSRV;
+        this->dispatchArgsBuffer = dispatchArgsBuffer;
+        this->dispatchArgsOffsets = dispatchArgsOffsets;
+    }
+
+    // Live (unbroken) constraint lists, used by the paint and render passes. See ConstraintCompactionCompute.
+    void setLiveConstraints(
+        const std::array<ComPtr<ID3D11ShaderResourceView>, 3>& liveConstraintsSRVs,
+        const ComPtr<ID3D11ShaderResourceView>& liveCountsSRV,
+        const ComPtr<ID3D11Buffer>& liveDispatchArgsBuffer,
+        const std::array<UINT, 3>& liveDispatchArgsOffsets
+    ) {
+        this->liveConstraintsSRVs = liveConstraintsSRVs;
+        this->liveCountsSRV = liveCountsSRV;
+        this->liveDispatchArgsBuffer = liveDispatchArgsBuffer;
+        this->liveDispatchArgsOffsets = liveDispatchArgsOffsets;
+    }
+
+    const ComPtr<ID3D11UnorderedAccessView>& getFaceConstraintIndicesUAV(int axis) const {
+        return faceConstraintIndicesUAVs[axis];
+    }
+
 private:
     inline static constexpr int updateFaceConstraintsEntryPoint = IDR_SHADER5;
     inline static constexpr int mergeRenderParticlesEntryPoint = IDR_SHADER16;
     inline static constexpr int expandRenderParticlesEntryPoint = IDR_SHADER17;
     int activeConstraintAxis = 0; // x = 0, y = 1, z = 2
-    std::array<int, 3> numWorkgroups = { 0, 0, 0 };
     int numExpandParticlesWorkgroups = 0;
     // UAVs that get bound depending on which entry point is being dispatched
-    // There are 4 shared UAVs, and up to 2 extra UAVs that may get set. Note that Maya's version of DX11 only supports up to 8 UAVs bound at once.
+    // There are 4 shared UAVs, up to 2 extra UAVs that may get set, and the voxel adjacency and surface voxel UAVs (only used when solving). Note that Maya's version of DX11 only supports up to 8 UAVs bound at once.
     std::array<ComPtr<ID3D11UnorderedAccessView>, 2> extraUAVs;
+    // Active (or live) constraint list and counts, only bound while solving (see VoxelActivityCompute) or during the paint and render passes
+    std::array<ComPtr<ID3D11ShaderResourceView>, 2> activeSRVs;
+    std::array<ComPtr<ID3D11ShaderResourceView>, 3> activeConstraintsSRVs;
+    ComPtr<ID3D11ShaderResourceView> activeCountsSRV;
+    ComPtr<ID3D11Buffer> dispatchArgsBuffer;
+    std::array<UINT, 3> dispatchArgsOffsets = { 0, 0, 0 };
+    std::array<ComPtr<ID3D11ShaderResourceView>, 3> liveConstraintsSRVs;
+    ComPtr<ID3D11ShaderResourceView> liveCountsSRV;
+    ComPtr<ID3D11Buffer> liveDispatchArgsBuffer;
+    std::array<UINT, 3> liveDispatchArgsOffsets = { 0, 0, 0 };
     std::array<FaceConstraintsCB, 3> faceConstraintsCBData;
     std::array<ComPtr<ID3D11UnorderedAccessView>, 3> faceConstraintIndicesUAVs;
     std::array<ComPtr<ID3D11UnorderedAccessView>, 3> faceConstraintLimitsUAVs;
@@ -146,6 +209,8 @@ private:
     VGSConstants vgsConstants;
     ComPtr<ID3D11Buffer> vgsConstantBuffer;
     ComPtr<ID3D11UnorderedAccessView> isSurfaceUAV;
+    ComPtr<ID3D11UnorderedAccessView> voxelAdjacencyUAV; // Face connection bits cleared when a constraint breaks (see VoxelAdjacency)
+    ComPtr<ID3D11UnorderedAccessView> surfaceVoxelsUAV;
     ComPtr<ID3D11UnorderedAccessView> particlesUAV;
     ComPtr<ID3D11UnorderedAccessView> paintDeltaUAV;  // Only used during update from paint values
     ComPtr<ID3D11UnorderedAccessView> paintValueUAV;  // Only used during update from paint values
@@ -154,9 +219,12 @@ private:
 
     void bind() override
     {
+        ID3D11ShaderResourceView* srvs[] = { activeSRVs[0].Get(), activeSRVs[1].Get() };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
         ID3D11UnorderedAccessView* uavs[] = { 
             particlesUAV.Get(), faceConstraintIndicesUAVs[activeConstraintAxis].Get(),  faceConstraintLimitsUAVs[activeConstraintAxis].Get(), isSurfaceUAV.Get(),
-            extraUAVs[0].Get(), extraUAVs[1].Get()
+            extraUAVs[0].Get(), extraUAVs[1].Get(), voxelAdjacencyUAV.Get(), surfaceVoxelsUAV.Get()
         };
         DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
 
@@ -166,7 +234,10 @@ private:
 
     void unbind() override
     {
-        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
         DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
 
         ID3D11Buffer* cbvs[] = { nullptr, nullptr };
@@ -190,17 +261,17 @@ private:
         vgsConstants.particleRadius = particleRadius;
         vgsConstants.voxelRestVolume = voxelRestVolume;
         vgsConstants.compliance = 0;
+        vgsConstants.residualTolerance = 0; // Always run the full iteration count (adaptive early-out is for intra-voxel VGS only)
         vgsConstantBuffer = DirectX::createConstantBuffer<VGSConstants>(vgsConstants);
 
         // Order of vertex indices and face IDs corresponds to definitions in cube.h
         faceConstraintsCBData = std::array<FaceConstraintsCB, 3>{
             FaceConstraintsCB{{1, 3, 5, 7}, {0, 2, 4, 6}, faceConstraints[0].size(), 1, 0, 0, 0, 0, 0, 0},
-            FaceConstraintsCB{{2, 3, 6, 7}, {0, 1, 4, 5}, faceConstraints[1].size(), 3, 2, 0, 0, 0, 0, 0},
-            FaceConstraintsCB{{4, 5, 6, 7}, {0, 1, 2, 3}, faceConstraints[2].size(), 5, 4, 0, 0, 0, 0, 0}
+            FaceConstraintsCB{{2, 3, 6, 7}, {0, 1, 4, 5}, faceConstraints[1].size(), 3, 2, 0, 0, 1, 0, 0},
+            FaceConstraintsCB{{4, 5, 6, 7}, {0, 1, 2, 3}, faceConstraints[2].size(), 5, 4, 0, 0, 2, 0, 0}
         };    
 
         for (int i = 0; i < 3; i++) {
-            numWorkgroups[i] = Utils::divideRoundUp(faceConstraints[i].size(), VGS_THREADS);
             faceConstraintLimitsBuffers[i] = DirectX::createReadWriteBuffer(faceConstraints[i].limits);
             faceConstraintIndexBuffers[i] = DirectX::createReadWriteBuffer(faceConstraints[i].voxelIndices);
             faceConstraintIndicesUAVs[i] = DirectX::createUAV(faceConstraintIndexBuffers[i]);
@@ -209,7 +280,7 @@ private:
             longRangeConstraintIndicesBuffers[i] = DirectX::createReadWriteBuffer(faceIdxToLongRangeConstraintIndices[i]);
             longRangeConstraintIndicesUAVs[i] = DirectX::createUAV(longRangeConstraintIndicesBuffers[i]);
             // The indices get cached because they can change when face constraints are broken (set to -1)
-            registerBufferForCaching(faceConstraintIndexBuffers[i]);
+            registerBufferForCaching(faceConstraintIndexBuffers[i], "faceConstraintIndices" + std::to_string(i));
         }
     }
 };
\ No newline at end of file
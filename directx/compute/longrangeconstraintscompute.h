@@ -3,16 +3,21 @@
 #include "directx/compute/computeshader.h"
 
 struct LongRangeConstraints {
-    // Each group of 8 consecutive indices corresponds to one voxel's long-range constraint particles
+    // Each group of 8 consecutive indices corresponds to one cluster's long-range constraint particles (its 8 outermost corner particles).
+    // Constraints are grouped by level, finest first: level i occupies [levelOffsets[i], levelOffsets[i + 1]).
     std::vector<uint> particleIndices;
+    std::array<uint, LONG_RANGE_LEVELS + 1> levelOffsets{};
+    // LONG_RANGE_CONSTRAINTS_PER_FACE entries per face constraint: the 4 level 0 constraints, then one per coarser level.
     std::array<std::vector<uint>, 3> faceIdxToLRConstraintIndices;
 };
 
+static_assert(LONG_RANGE_BREAK_THRESHOLD(LONG_RANGE_LEVELS - 1) < LONG_RANGE_BROKEN, "Long-range break thresholds must fit in the 4-bit counter");
+
 struct LongRangeConstraintsCB {
     uint numConstraints{0};
+    uint firstConstraint{0};
+    uint countSlot{0};
     uint padding0{0};
-    uint padding1{0};
-    uint padding2{0};
 };
 
 class LongRangeConstraintsCompute : public ComputeShader
@@ -32,11 +37,28 @@ public:
 
     void reset() override {
         DirectX::notifyMayaOfMemoryUsage(longRangeParticleIndicesBuffer, false);
-        DirectX::notifyMayaOfMemoryUsage(longRangeConstraintsCB, false);
+        for (int level = 0; level < LONG_RANGE_LEVELS; level++) {
+            DirectX::notifyMayaOfMemoryUsage(longRangeConstraintsCBs[level], false);
+            DirectX::notifyMayaOfMemoryUsage(vgsConstantsCBs[level], false);
+        }
     }
 
+    // Solves the levels coarse-to-fine, so that corrections cross the whole body in one substep and the finer levels then clean up locally.
+    // Each level dispatches over its active constraints only (those touching an awake voxel). See VoxelActivityCompute.
     void dispatch() override {
-        ComputeShader::dispatch(numWorkgroups);
+        for (currentLevel = LONG_RANGE_LEVELS - 1; currentLevel >= 0; currentLevel--) {
+            if (levelOffsets[currentLevel + 1] == levelOffsets[currentLevel]) continue;
+            ComputeShader::dispatchIndirect(dispatchArgsBuffer, dispatchArgsOffset + static_cast<UINT>(currentLevel * 3 * sizeof(UINT)));
+        }
+        currentLevel = 0;
+    }
+
+    uint getNumConstraints() const {
+        return levelOffsets[LONG_RANGE_LEVELS];
+    }
+
+    const std::array<uint, LONG_RANGE_LEVELS + 1>& getLevelOffsets() const {
+        return levelOffsets;
     }
 
     // This is hijacked by the FaceConstraintsCompute shader as a counter for number of broken face constraints
@@ -49,46 +71,66 @@ public:
         particlesUAV = uav;
     }
 
+    // dispatchArgsOffset is that of level 0; the args of each coarser level follow consecutively.
+    void setActiveConstraints(
+        const ComPtr<ID3D11ShaderResourceView>& activeConstraintsSRV,
+        const ComPtr<ID3D11ShaderResourceView>& activeCountsSRV,
+        const ComPtr<ID3D11Buffer>& dispatchArgsBuffer,
+        UINT dispatchArgsOffset
+    ) {
+        this->activeConstraintsSRV = activeConstraintsSRV;
+        this->activeCountsSRV = activeCountsSRV;
+        this->dispatchArgsBuffer = dispatchArgsBuffer;
+        this->dispatchArgsOffset = dispatchArgsOffset;
+    }
+
     void updateVGSParameters(
         float vgsRelaxation,
         float vgsEdgeUniformity,
         uint vgsIterations,
         float compliance
     ) {
-        vgsConstants.relaxation = vgsRelaxation;
-        vgsConstants.edgeUniformity = vgsEdgeUniformity;
-        vgsConstants.iterCount = vgsIterations;
-        vgsConstants.compliance = compliance;
-        DirectX::updateConstantBuffer(vgsConstantsCB, vgsConstants);
+        for (int level = 0; level < LONG_RANGE_LEVELS; level++) {
+            vgsConstants[level].relaxation = vgsRelaxation;
+            vgsConstants[level].edgeUniformity = vgsEdgeUniformity;
+            vgsConstants[level].iterCount = vgsIterations;
+            vgsConstants[level].compliance = compliance;
+            DirectX::updateConstantBuffer(vgsConstantsCBs[level], vgsConstants[level]);
+        }
     }
 
 private:
-    int numWorkgroups = 0;
-    VGSConstants vgsConstants;
+    std::array<uint, LONG_RANGE_LEVELS + 1> levelOffsets{};
+    int currentLevel = 0;
+    std::array<VGSConstants, LONG_RANGE_LEVELS> vgsConstants;
     // Owned resources
     ComPtr<ID3D11Buffer> longRangeParticleIndicesBuffer;
-    ComPtr<ID3D11Buffer> longRangeConstraintsCB;
-    ComPtr<ID3D11Buffer> vgsConstantsCB;
+    std::array<ComPtr<ID3D11Buffer>, LONG_RANGE_LEVELS> longRangeConstraintsCBs;
+    std::array<ComPtr<ID3D11Buffer>, LONG_RANGE_LEVELS> vgsConstantsCBs;
     ComPtr<ID3D11ShaderResourceView> longRangeParticleIndicesSRV;
     ComPtr<ID3D11UnorderedAccessView> longRangeParticleIndicesUAV;
     // Passed-in resources
     ComPtr<ID3D11UnorderedAccessView> particlesUAV;
+    ComPtr<ID3D11ShaderResourceView> activeConstraintsSRV;
+    ComPtr<ID3D11ShaderResourceView> activeCountsSRV;
+    ComPtr<ID3D11Buffer> dispatchArgsBuffer;
+    UINT dispatchArgsOffset = 0;
 
     void bind() override
     {
-        ID3D11ShaderResourceView* srvs[] = { longRangeParticleIndicesSRV.Get() };
+        ID3D11ShaderResourceView* srvs[] = { longRangeParticleIndicesSRV.Get(), activeConstraintsSRV.Get(), activeCountsSRV.Get() };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
         ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get() };
         DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
 
-        ID3D11Buffer* cbvs[] = { longRangeConstraintsCB.Get(), vgsConstantsCB.Get() };
+        ID3D11Buffer* cbvs[] = { longRangeConstraintsCBs[currentLevel].Get(), vgsConstantsCBs[currentLevel].Get() };
         DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
     };
 
     void unbind() override
     {
-        ID3D11ShaderResourceView* srvs[] = { nullptr };
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
         ID3D11UnorderedAccessView* uavs[] = { nullptr };
@@ -99,29 +141,37 @@ private:
     };
 
     void initializeBuffers(uint numParticles, float particleRadius, float voxelRestVolume, const LongRangeConstraints& constraints) {
-        uint numConstraints = static_cast<uint>(constraints.particleIndices.size() / 8);
-        numWorkgroups = Utils::divideRoundUp(numConstraints, VGS_THREADS);
+        levelOffsets = constraints.levelOffsets;
 
         longRangeParticleIndicesBuffer = DirectX::createReadWriteBuffer(constraints.particleIndices);
         longRangeParticleIndicesSRV = DirectX::createSRV(longRangeParticleIndicesBuffer);
         longRangeParticleIndicesUAV = DirectX::createUAV(longRangeParticleIndicesBuffer);
         // Must be considered for caching because the lower bits store the broken face constraint counts, which change (unlike the constraint indices themselves).
         // (TODO: consider the tradeoff here: smaller simulation state storage but means more data gets to be cached, when caching is enabled. Basically GPU memory vs CPU memory tradeoff.)
-        registerBufferForCaching(longRangeParticleIndicesBuffer);
+        registerBufferForCaching(longRangeParticleIndicesBuffer, "longRangeParticleIndices");
         
-        longRangeConstraintsCB = DirectX::createConstantBuffer<LongRangeConstraintsCB>({ numConstraints, 0, 0, 0 });
-
-        // Defaults
-        vgsConstants.relaxation = 0.5f;
-        vgsConstants.edgeUniformity = 1.0f;
-        vgsConstants.iterCount = 3;
-        vgsConstants.numVoxels = numParticles / 8;
-        vgsConstants.compliance = 0;
-
-        // These two values get fudged a bit. Long range constraints treat 2x2x2 groups of voxels as a one voxel.
-        // So the effective particle radius is **tripled** (not doubled - draw it out :)), and the rest volume is adjusted accordingly.
-        vgsConstants.particleRadius = particleRadius * 3.0f;
-        vgsConstants.voxelRestVolume = voxelRestVolume * (216.0f / 8.0f);
-        vgsConstantsCB = DirectX::createConstantBuffer<VGSConstants>(vgsConstants);
+        for (int level = 0; level < LONG_RANGE_LEVELS; level++) {
+            uint numLevelConstraints = levelOffsets[level + 1] - levelOffsets[level];
+            longRangeConstraintsCBs[level] = DirectX::createConstantBuffer<LongRangeConstraintsCB>({ 
+                numLevelConstraints, levelOffsets[level], static_cast<uint>(ACTIVE_LONG_RANGE_CONSTRAINTS_SLOT + level), 0 
+            });
+
+            // Defaults
+            VGSConstants& levelConstants = vgsConstants[level];
+            levelConstants.relaxation = 0.5f;
+            levelConstants.edgeUniformity = 1.0f;
+            levelConstants.iterCount = 3;
+            levelConstants.numVoxels = numParticles / 8;
+            levelConstants.compliance = 0;
+            levelConstants.residualTolerance = 0; // Always run the full iteration count (adaptive early-out is for intra-voxel VGS only)
+
+            // These two values get fudged a bit. Long range constraints treat clusters of (clusterSize)^3 voxels as one voxel.
+            // The corner particles sit one particle radius in from the cluster's corners, and a voxel is 4 particle radii wide, so the effective 
+            // particle radius is (2 * clusterSize - 1) times the real one (e.g. **tripled** for 2x2x2 - draw it out :)), and the rest volume is adjusted accordingly.
+            const float radiusScale = static_cast<float>(2 * (2u << level) - 1);
+            levelConstants.particleRadius = particleRadius * radiusScale;
+            levelConstants.voxelRestVolume = voxelRestVolume * radiusScale * radiusScale * radiusScale;
+            vgsConstantsCBs[level] = DirectX::createConstantBuffer<VGSConstants>(levelConstants);
+        }
     };
 };
\ No newline at end of file
@@ -0,0 +1,264 @@
+#pragma once
+
+#include "directx/compute/computeshader.h"
+#include "directx/compute/solvecollisionscompute.h"
+#include <algorithm>
+
+/**
+ * Verlet-style neighbor lists for particle collisions. A rebuild runs the sorted broadphase with an inflated ("skin") radius, and lists every
+ * pair of particles within skin distance of touching. Until the next rebuild, each substep's narrowphase just walks that list, skipping the
+ * grid build, sort and binning entirely.
+ *
+ * The list stays valid as long as no particle has moved more than half the skin radius since it was built. That's checked on the GPU every
+ * substep, into a one-word flag. The flag is read back without ever waiting on the GPU: a copy is queued, and polled at the start of each substep
+ * until it's ready (often a substep or two later, at worst the next frame). A violation halves the rebuild interval, and if the list it was found on
+ * is still in use, forces a rebuild. The interval grows back by one substep per frame without violations, going by the frame stats once they're read back.
+ * The list is always rebuilt on a frame's first substep, so teleports (cache restores, scrubbing) are safe.
+ */
+class NeighborPairsCompute : public ComputeShader
+{
+public:
+    NeighborPairsCompute() = default;
+
+    NeighborPairsCompute(
+        int numParticles,
+        const ComPtr<ID3D11Buffer>& particleCollisionCB,
+        const ComPtr<ID3D11UnorderedAccessView>& collisionStatsUAV
+    ) : ComputeShader(IDR_SHADER34),
+        particleCollisionCB(particleCollisionCB),
+        collisionStatsUAV(collisionStatsUAV)
+    {
+        if (numParticles <= 0) return;
+        loadShaderObject(buildPairsEntryPoint);
+        loadShaderObject(applyCorrectionsEntryPoint);
+        loadShaderObject(writeArgsEntryPoint);
+        initializeBuffers(numParticles);
+    }
+
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(neighborPairsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(neighborPairCountBuffer);
+        DirectX::notifyMayaOfMemoryUsage(solveDispatchArgsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(positionCorrectionsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(neighborListParticlesBuffer);
+        DirectX::notifyMayaOfMemoryUsage(skinViolationBuffer);
+    }
+
+    // Call at the start of each substep (before the sorted grid is built). Returns whether the list should be rebuilt this substep.
+    bool shouldRebuild(int substep) {
+        bool rebuild = (substep == 0 || ++substepsSinceRebuild >= rebuildInterval);
+        uint violatedList;
+        if (tryReadSkinViolation(violatedList)) {
+            rebuildInterval = std::max(1, rebuildInterval / 2);
+            rebuild = rebuild || (violatedList == listGeneration);
+        }
+
+        if (rebuild) substepsSinceRebuild = 0;
+        return rebuild;
+    }
+
+    // Lists the pairs from the freshly built sorted grid, and snapshots particle positions to measure displacement against.
+    void rebuild() {
+        if (!neighborPairCountUAV) return; // Not created yet
+
+        DirectX::clearUintBuffer(neighborPairCountUAV);
+        DirectX::clearUintBuffer(skinViolationUAV);
+        ++listGeneration;
+        activePass = Pass::BuildPairs;
+        ComputeShader::dispatchIndirect(sortedGrid.solveDispatchArgsBuffer, 0, buildPairsEntryPoint);
+
+        activePass = Pass::WriteArgs;
+        ComputeShader::dispatch(1, writeArgsEntryPoint);
+
+        DirectX::getContext()->CopyResource(neighborListParticlesBuffer.Get(), particlesBuffer.Get());
+    }
+
+    // Solves the listed pairs, then applies their corrections (and checks for stale lists, for a later shouldRebuild to read back).
+    void dispatch() override {
+        if (!neighborPairCountUAV) return;
+
+        activePass = Pass::SolvePairs;
+        ComputeShader::dispatchIndirect(solveDispatchArgsBuffer, 0);
+
+        activePass = Pass::ApplyCorrections;
+        ComputeShader::dispatch(numParticleWorkgroups, applyCorrectionsEntryPoint);
+
+        // Only one copy in flight at a time: queuing another would keep the staging buffer busy, so it'd never be ready to read.
+        if (!skinCheckPending) {
+            DirectX::getContext()->CopyResource(skinViolationStaging.Get(), skinViolationBuffer.Get());
+            stagedListGeneration = listGeneration;
+            skinCheckPending = true;
+        }
+    }
+
+    // Call with each frame's stats once they've been read back (see SolveCollisionsCompute::collectStats), and not with stale ones.
+    // Violations already shrank the interval when their flag was read back, so this only grows it back.
+    void updateRebuildInterval(const CollisionStats& stats, int numSubsteps) {
+        if (stats.skinViolations == 0) {
+            rebuildInterval = std::min(numSubsteps, rebuildInterval + 1);
+        }
+    }
+
+    int getRebuildInterval() const { return rebuildInterval; }
+
+    void setSortedGrid(
+        const ComPtr<ID3D11ShaderResourceView>& particlesByCellSRV,
+        const ComPtr<ID3D11ShaderResourceView>& cellStartsSRV,
+        const ComPtr<ID3D11ShaderResourceView>& cellKeysSRV,
+        const ComPtr<ID3D11ShaderResourceView>& particleMinCellsSRV,
+        const ComPtr<ID3D11Buffer>& solveDispatchArgsBuffer
+    ) {
+        sortedGrid = { particlesByCellSRV, cellStartsSRV, cellKeysSRV, particleMinCellsSRV, solveDispatchArgsBuffer };
+    }
+
+    void setParticles(const ComPtr<ID3D11Buffer>& particlesBuffer, const ComPtr<ID3D11UnorderedAccessView>& particlesUAV) {
+        this->particlesBuffer = particlesBuffer;
+        this->particlesUAV = particlesUAV;
+    }
+
+    void setOldParticlesSRV(const ComPtr<ID3D11ShaderResourceView>& oldParticlesSRV) {
+        this->oldParticlesSRV = oldParticlesSRV;
+    }
+
+    void setIsSurfaceSRV(const ComPtr<ID3D11ShaderResourceView>& isSurfaceSRV) {
+        this->isSurfaceSRV = isSurfaceSRV;
+    }
+
+    // Glued voxel pairs are rejected when the list is built, so they never take up space in it.
+    void setVoxelAdjacencySRV(const ComPtr<ID3D11ShaderResourceView>& voxelAdjacencySRV) {
+        this->voxelAdjacencySRV = voxelAdjacencySRV;
+    }
+
+private:
+    enum class Pass { BuildPairs, WriteArgs, SolvePairs, ApplyCorrections };
+    inline static constexpr int buildPairsEntryPoint = IDR_SHADER33;
+    inline static constexpr int applyCorrectionsEntryPoint = IDR_SHADER35;
+    inline static constexpr int writeArgsEntryPoint = IDR_SHADER36;
+    Pass activePass = Pass::BuildPairs;
+    int numParticleWorkgroups = 0;
+    int rebuildInterval = 1;
+    int substepsSinceRebuild = 0;
+    bool skinCheckPending = false;
+    uint listGeneration = 0;       // Incremented on each rebuild
+    uint stagedListGeneration = 0; // The list that the pending skin violation check was copied from
+    std::vector<uint> skinViolationData;
+    // Owned resources
+    ComPtr<ID3D11Buffer> neighborPairsBuffer;
+    ComPtr<ID3D11ShaderResourceView> neighborPairsSRV;
+    ComPtr<ID3D11UnorderedAccessView> neighborPairsUAV;
+    ComPtr<ID3D11Buffer> neighborPairCountBuffer;
+    ComPtr<ID3D11ShaderResourceView> neighborPairCountSRV;
+    ComPtr<ID3D11UnorderedAccessView> neighborPairCountUAV;
+    ComPtr<ID3D11Buffer> solveDispatchArgsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> solveDispatchArgsUAV;
+    ComPtr<ID3D11Buffer> positionCorrectionsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> positionCorrectionsUAV;
+    ComPtr<ID3D11Buffer> neighborListParticlesBuffer;
+    ComPtr<ID3D11ShaderResourceView> neighborListParticlesSRV;
+    ComPtr<ID3D11Buffer> skinViolationBuffer;
+    ComPtr<ID3D11UnorderedAccessView> skinViolationUAV;
+    ComPtr<ID3D11Buffer> skinViolationStaging;
+    // Passed in
+    ComPtr<ID3D11Buffer> particleCollisionCB;
+    ComPtr<ID3D11UnorderedAccessView> collisionStatsUAV;
+    ComPtr<ID3D11Buffer> particlesBuffer;
+    ComPtr<ID3D11UnorderedAccessView> particlesUAV;
+    ComPtr<ID3D11ShaderResourceView> oldParticlesSRV;
+    ComPtr<ID3D11ShaderResourceView> isSurfaceSRV;
+    ComPtr<ID3D11ShaderResourceView> voxelAdjacencySRV;
+
+    struct SortedGridResources {
+        ComPtr<ID3D11ShaderResourceView> particlesByCellSRV;
+        ComPtr<ID3D11ShaderResourceView> cellStartsSRV;
+        ComPtr<ID3D11ShaderResourceView> cellKeysSRV;
+        ComPtr<ID3D11ShaderResourceView> particleMinCellsSRV;
+        ComPtr<ID3D11Buffer> solveDispatchArgsBuffer;
+    } sortedGrid;
+
+    void bind() override {
+        switch (activePass) {
+        case Pass::BuildPairs: {
+            ID3D11ShaderResourceView* srvs[] = { sortedGrid.particlesByCellSRV.Get(), sortedGrid.cellStartsSRV.Get(), oldParticlesSRV.Get(), sortedGrid.cellKeysSRV.Get(), sortedGrid.particleMinCellsSRV.Get(), voxelAdjacencySRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get(), collisionStatsUAV.Get(), neighborPairsUAV.Get(), neighborPairCountUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        case Pass::WriteArgs: {
+            ID3D11ShaderResourceView* srvs[] = { neighborPairCountSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { solveDispatchArgsUAV.Get(), collisionStatsUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        case Pass::SolvePairs: {
+            ID3D11ShaderResourceView* srvs[] = { neighborPairsSRV.Get(), neighborPairCountSRV.Get(), oldParticlesSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get(), collisionStatsUAV.Get(), positionCorrectionsUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        case Pass::ApplyCorrections: {
+            ID3D11ShaderResourceView* srvs[] = { neighborListParticlesSRV.Get(), isSurfaceSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get(), collisionStatsUAV.Get(), positionCorrectionsUAV.Get(), skinViolationUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        }
+
+        ID3D11Buffer* cbvs[] = { particleCollisionCB.Get() };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    }
+
+    void unbind() override {
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+
+        ID3D11Buffer* cbvs[] = { nullptr };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    }
+
+    void initializeBuffers(int numParticles) {
+        numParticleWorkgroups = Utils::divideRoundUp(numParticles, SOLVE_NEIGHBOR_PAIRS_THREADS);
+
+        // Pairs are (uint, uint), stored as a structured buffer of 8-byte elements.
+        std::vector<uint64_t> emptyPairs(NEIGHBOR_PAIRS_PER_PARTICLE * numParticles, 0);
+        neighborPairsBuffer = DirectX::createReadWriteBuffer(emptyPairs);
+        neighborPairsSRV = DirectX::createSRV(neighborPairsBuffer);
+        neighborPairsUAV = DirectX::createUAV(neighborPairsBuffer);
+
+        neighborPairCountBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(1, 0));
+        neighborPairCountSRV = DirectX::createSRV(neighborPairCountBuffer);
+        neighborPairCountUAV = DirectX::createUAV(neighborPairCountBuffer);
+
+        solveDispatchArgsBuffer = DirectX::createIndirectArgsBuffer(1);
+        solveDispatchArgsUAV = DirectX::createUAV(solveDispatchArgsBuffer, 3, 0, DXGI_FORMAT_R32_UINT);
+
+        positionCorrectionsBuffer = DirectX::createReadWriteBuffer(std::vector<int>(3 * numParticles, 0));
+        positionCorrectionsUAV = DirectX::createUAV(positionCorrectionsBuffer);
+
+        neighborListParticlesBuffer = DirectX::createReadWriteBuffer(std::vector<Particle>(numParticles));
+        neighborListParticlesSRV = DirectX::createSRV(neighborListParticlesBuffer);
+
+        skinViolationBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(1, 0));
+        skinViolationUAV = DirectX::createUAV(skinViolationBuffer);
+        skinViolationStaging = DirectX::createStagingBuffer(skinViolationBuffer);
+    }
+
+    // Returns whether the pending stale-list check found a violation (and on which list), if the GPU has finished with it. Never waits.
+    bool tryReadSkinViolation(uint& violatedList) {
+        if (!skinCheckPending || !DirectX::tryReadStagingBuffer(skinViolationStaging, skinViolationData)) return false;
+
+        skinCheckPending = false;
+        violatedList = stagedListGeneration;
+        return !skinViolationData.empty() && skinViolationData[0] != 0;
+    }
+};
@@ -16,8 +16,9 @@ public:
         initializeBuffers(numParticles);
     };
 
+    // Dispatches over the particles of active (awake) voxels only. See VoxelActivityCompute.
     void dispatch() override {
-        ComputeShader::dispatch(numWorkgroups);
+        ComputeShader::dispatchIndirect(dispatchArgsBuffer, dispatchArgsOffset);
     }
 
     void updateParticleMassFromPaintValues(
@@ -54,6 +55,18 @@ public:
         this->isDraggingSRV = isDraggingSRV;
     }
 
+    void setActiveVoxels(
+        const ComPtr<ID3D11ShaderResourceView>& activeVoxelsSRV,
+        const ComPtr<ID3D11ShaderResourceView>& activeCountsSRV,
+        const ComPtr<ID3D11Buffer>& dispatchArgsBuffer,
+        UINT dispatchArgsOffset
+    ) {
+        this->activeVoxelsSRV = activeVoxelsSRV;
+        this->activeCountsSRV = activeCountsSRV;
+        this->dispatchArgsBuffer = dispatchArgsBuffer;
+        this->dispatchArgsOffset = dispatchArgsOffset;
+    }
+
 private:
     inline static constexpr int updateParticleWeightsEntryPoint = IDR_SHADER7;
     int numWorkgroups;
@@ -61,13 +74,17 @@ private:
     ComPtr<ID3D11UnorderedAccessView> particlesUAV;
     ComPtr<ID3D11UnorderedAccessView> oldParticlesUAV;
     ComPtr<ID3D11ShaderResourceView> isDraggingSRV;
+    ComPtr<ID3D11ShaderResourceView> activeVoxelsSRV;
+    ComPtr<ID3D11ShaderResourceView> activeCountsSRV;
+    ComPtr<ID3D11Buffer> dispatchArgsBuffer;
+    UINT dispatchArgsOffset = 0;
     ComPtr<ID3D11Buffer> preVgsConstantsBuffer;
     ComPtr<ID3D11UnorderedAccessView> paintDeltaUAV;  // Only used during update from paint values
     ComPtr<ID3D11UnorderedAccessView> paintValueUAV;  // Only used during update from paint values
 
     void bind() override
     {
-        ID3D11ShaderResourceView* srvs[] = { isDraggingSRV.Get() };
+        ID3D11ShaderResourceView* srvs[] = { isDraggingSRV.Get(), activeVoxelsSRV.Get(), activeCountsSRV.Get() };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
 		ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get(), oldParticlesUAV.Get(), paintDeltaUAV.Get(), paintValueUAV.Get() };
@@ -79,7 +96,7 @@ private:
 
     void unbind() override
     {
-        ID3D11ShaderResourceView* srvs[] = { nullptr };
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
         ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr, nullptr, nullptr };
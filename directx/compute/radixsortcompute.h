@@ -0,0 +1,136 @@
+#pragma once
+#include "directx/compute/computeshader.h"
+#include "directx/compute/prefixscancompute.h"
+#include <array>
+
+struct RadixSortCB {
+    uint shift{0};
+    uint numGroups{0};
+    uint padding0{0};
+    uint padding1{0};
+};
+
+/**
+ * Sorts (uint key, uint value) pairs by key, in place, with a least-significant-digit GPU radix sort (RADIX_SORT_BITS_PER_PASS bits per pass).
+ * Each pass counts digits per workgroup, prefix scans the counts (reusing PrefixScanCompute), then scatters each element stably to its sorted position.
+ *
+ * The sort always covers the whole buffer, so unused entries should be filled with a key that sorts last (e.g. all ones).
+ * NOTE: the number of elements must be a power of two, and at least RADIX_SORT_THREADS.
+ */
+class RadixSortCompute : public ComputeShader
+{
+    // Passes ping-pong between the input buffers and internal scratch buffers. An even number of passes leaves the result in the input buffers.
+    static_assert(RADIX_SORT_PASSES % 2 == 0, "Radix sort must use an even number of passes");
+
+public:
+    RadixSortCompute() = default;
+
+    RadixSortCompute(
+        const ComPtr<ID3D11Buffer>& keysBuffer,
+        const ComPtr<ID3D11Buffer>& valuesBuffer
+    ) : ComputeShader(IDR_SHADER28)
+    {
+        if (!keysBuffer || !valuesBuffer) return;
+        loadShaderObject(scatterEntryPoint);
+        initializeBuffers(keysBuffer, valuesBuffer);
+    }
+
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(scratchKeysBuffer);
+        DirectX::notifyMayaOfMemoryUsage(scratchValuesBuffer);
+        DirectX::notifyMayaOfMemoryUsage(digitCountsBuffer);
+        for (int pass = 0; pass < RADIX_SORT_PASSES; ++pass) {
+            DirectX::notifyMayaOfMemoryUsage(passCBs[pass]);
+        }
+        digitCountsScan.reset();
+    }
+
+    void dispatch() override {
+        for (pass = 0; pass < RADIX_SORT_PASSES; ++pass) {
+            isScatter = false;
+            ComputeShader::dispatch(numWorkgroups);
+
+            digitCountsScan.dispatch();
+
+            isScatter = true;
+            ComputeShader::dispatch(numWorkgroups, scatterEntryPoint);
+        }
+    }
+
+private:
+    inline static constexpr int scatterEntryPoint = IDR_SHADER29;
+    int numWorkgroups = 0;
+    int pass = 0;
+    bool isScatter = false;
+    // Index 0 is the input (and final output), index 1 is scratch. Pass i reads from i % 2 and writes to (i + 1) % 2.
+    std::array<ComPtr<ID3D11ShaderResourceView>, 2> keysSRVs;
+    std::array<ComPtr<ID3D11UnorderedAccessView>, 2> keysUAVs;
+    std::array<ComPtr<ID3D11ShaderResourceView>, 2> valuesSRVs;
+    std::array<ComPtr<ID3D11UnorderedAccessView>, 2> valuesUAVs;
+    ComPtr<ID3D11Buffer> scratchKeysBuffer;
+    ComPtr<ID3D11Buffer> scratchValuesBuffer;
+    ComPtr<ID3D11Buffer> digitCountsBuffer;
+    ComPtr<ID3D11ShaderResourceView> digitCountsSRV;
+    ComPtr<ID3D11UnorderedAccessView> digitCountsUAV;
+    std::array<ComPtr<ID3D11Buffer>, RADIX_SORT_PASSES> passCBs;
+    PrefixScanCompute digitCountsScan;
+
+    void bind() override {
+        int src = pass % 2;
+        int dst = 1 - src;
+
+        if (isScatter) {
+            ID3D11ShaderResourceView* srvs[] = { keysSRVs[src].Get(), valuesSRVs[src].Get(), digitCountsSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { keysUAVs[dst].Get(), valuesUAVs[dst].Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+        } else {
+            ID3D11ShaderResourceView* srvs[] = { keysSRVs[src].Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { digitCountsUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+        }
+
+        ID3D11Buffer* cbvs[] = { passCBs[pass].Get() };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    }
+
+    void unbind() override {
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+
+        ID3D11Buffer* cbvs[] = { nullptr };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    }
+
+    void initializeBuffers(const ComPtr<ID3D11Buffer>& keysBuffer, const ComPtr<ID3D11Buffer>& valuesBuffer) {
+        int numElements = DirectX::getNumElementsInBuffer(keysBuffer);
+        numWorkgroups = Utils::divideRoundUp(numElements, RADIX_SORT_THREADS);
+
+        std::vector<uint> emptyData(numElements, 0);
+        scratchKeysBuffer = DirectX::createReadWriteBuffer(emptyData);
+        scratchValuesBuffer = DirectX::createReadWriteBuffer(emptyData);
+
+        keysSRVs = { DirectX::createSRV(keysBuffer), DirectX::createSRV(scratchKeysBuffer) };
+        keysUAVs = { DirectX::createUAV(keysBuffer), DirectX::createUAV(scratchKeysBuffer) };
+        valuesSRVs = { DirectX::createSRV(valuesBuffer), DirectX::createSRV(scratchValuesBuffer) };
+        valuesUAVs = { DirectX::createUAV(valuesBuffer), DirectX::createUAV(scratchValuesBuffer) };
+
+        // One count per digit per workgroup. With power-of-two element counts (and bins), this is a power of two, as the scan requires.
+        // The scan also reads a whole block (2 * PREFIX_SCAN_THREADS) at a time, so small sorts get zeroed padding up to that, which is never written.
+        std::vector<uint> emptyCounts(std::max<int>(RADIX_SORT_BINS * numWorkgroups, 2 * PREFIX_SCAN_THREADS), 0);
+        digitCountsBuffer = DirectX::createReadWriteBuffer(emptyCounts);
+        digitCountsSRV = DirectX::createSRV(digitCountsBuffer);
+        digitCountsUAV = DirectX::createUAV(digitCountsBuffer);
+        digitCountsScan = PrefixScanCompute(digitCountsUAV);
+
+        for (int pass = 0; pass < RADIX_SORT_PASSES; ++pass) {
+            passCBs[pass] = DirectX::createConstantBuffer<RadixSortCB>({ static_cast<uint>(pass * RADIX_SORT_BITS_PER_PASS), static_cast<uint>(numWorkgroups), 0, 0 });
+        }
+    }
+};
@@ -1,10 +1,29 @@
 #pragma once
 
 #include "directx/compute/computeshader.h"
+#include <array>
+
+struct CollisionStats {
+    uint candidatePairs = 0;
+    uint duplicatePairs = 0;
+    uint overflowParticles = 0;
+    uint occupiedCells = 0;
+    uint neighborPairs = 0;
+    uint neighborPairOverflow = 0;
+    uint skinViolations = 0;
+    uint neighborRebuilds = 0;
+    uint culledVoxels = 0;
+    uint gluedPairs = 0;
+    std::array<uint, COLLISION_OCCUPANCY_BINS> cellOccupancy{}; // See COLLISION_STATS_OCCUPANCY_HISTOGRAM
+};
 
 /**
  * The workhorse of voxel collisions. Following broadphase presteps (building a dense array of particle indices sorted by grid cell),
- * this shader resolves collisions between particles in the same grid cell in a pairwise fashion.
+ * this shader resolves collisions between particles in the same grid cell in a pairwise fashion. Dense cells are sorted along one axis
+ * and swept instead (see COLLISION_SWEEP_MIN_PARTICLES), and the cellOccupancy histogram shows how many cells are that dense, for tuning the cell size.
+ *
+ * Supports both the hashed grid (dispatched over every bucket) and the sorted grid (dispatched indirectly over occupied cells; see BuildSortedCollisionGridCompute).
+ * Either way, it accumulates per-frame statistics (see COLLISION_STATS_*), which are read back a frame late so they never stall the pipeline.
  */
 class SolveCollisionsCompute : public ComputeShader
 {
@@ -22,10 +41,24 @@ public:
         particleCollisionCB(particleCollisionCB)
     {
         if (hashGridSize <= 0) return;
+        loadShaderObject(solveSortedEntryPoint);
         numWorkgroups = Utils::divideRoundUp(hashGridSize, SOLVE_COLLISION_THREADS);
+
+        collisionStatsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(COLLISION_STATS_SIZE, 0));
+        collisionStatsUAV = DirectX::createUAV(collisionStatsBuffer);
+        collisionStatsStaging = DirectX::createStagingBuffer(collisionStatsBuffer);
+    }
+
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(collisionStatsBuffer);
     }
 
     void dispatch() override {
+        if (useSortedGrid) {
+            ComputeShader::dispatchIndirect(sortedGrid.solveDispatchArgsBuffer, 0, solveSortedEntryPoint);
+            return;
+        }
+
         ComputeShader::dispatch(numWorkgroups);
     }
 
@@ -37,34 +70,117 @@ public:
         this->oldParticlesSRV = oldParticlesSRV;
     }
 
+    void setVoxelAdjacencySRV(const ComPtr<ID3D11ShaderResourceView>& voxelAdjacencySRV) {
+        this->voxelAdjacencySRV = voxelAdjacencySRV;
+    }
+
+    // Shared with the other collision passes (e.g. NeighborPairsCompute), so all collision stats come back in one readback.
+    const ComPtr<ID3D11UnorderedAccessView>& getCollisionStatsUAV() const { return collisionStatsUAV; }
+
+    void setSortedGrid(
+        const ComPtr<ID3D11ShaderResourceView>& particlesByCellSRV,
+        const ComPtr<ID3D11ShaderResourceView>& cellStartsSRV,
+        const ComPtr<ID3D11ShaderResourceView>& cellKeysSRV,
+        const ComPtr<ID3D11ShaderResourceView>& particleMinCellsSRV,
+        const ComPtr<ID3D11Buffer>& particleCollisionCB,
+        const ComPtr<ID3D11Buffer>& solveDispatchArgsBuffer
+    ) {
+        sortedGrid = { particlesByCellSRV, cellStartsSRV, cellKeysSRV, particleMinCellsSRV, particleCollisionCB, solveDispatchArgsBuffer };
+    }
+
+    void setUseSortedGrid(bool useSortedGrid) {
+        this->useSortedGrid = useSortedGrid && sortedGrid.solveDispatchArgsBuffer;
+    }
+
+    /**
+     * Call once per frame. Returns the stats of the last frame whose readback has completed (if any), and starts the readback of this
+     * frame's stats (then clears them for the next frame).
+     */
+    bool collectStats(CollisionStats& stats) {
+        if (!collisionStatsBuffer) return false;
+
+        bool hasStats = false;
+        if (readbackPending) {
+            std::vector<uint> statsData;
+            if (DirectX::tryReadStagingBuffer(collisionStatsStaging, statsData)) {
+                stats.candidatePairs = statsData[COLLISION_STATS_CANDIDATE_PAIRS];
+                stats.duplicatePairs = statsData[COLLISION_STATS_DUPLICATE_PAIRS];
+                stats.overflowParticles = statsData[COLLISION_STATS_OVERFLOW_PARTICLES];
+                stats.occupiedCells = statsData[COLLISION_STATS_OCCUPIED_CELLS];
+                stats.neighborPairs = statsData[COLLISION_STATS_NEIGHBOR_PAIRS];
+                stats.neighborPairOverflow = statsData[COLLISION_STATS_NEIGHBOR_PAIR_OVERFLOW];
+                stats.skinViolations = statsData[COLLISION_STATS_SKIN_VIOLATIONS];
+                stats.neighborRebuilds = statsData[COLLISION_STATS_NEIGHBOR_REBUILDS];
+                stats.culledVoxels = statsData[COLLISION_STATS_CULLED_VOXELS];
+                stats.gluedPairs = statsData[COLLISION_STATS_GLUED_PAIRS];
+                std::copy_n(statsData.begin() + COLLISION_STATS_OCCUPANCY_HISTOGRAM, COLLISION_OCCUPANCY_BINS, stats.cellOccupancy.begin());
+                readbackPending = false;
+                hasStats = true;
+            }
+        }
+
+        // If the last readback still isn't ready, keep accumulating into the same stats rather than overwriting the staging buffer.
+        if (!readbackPending) {
+            DirectX::getContext()->CopyResource(collisionStatsStaging.Get(), collisionStatsBuffer.Get());
+            DirectX::clearUintBuffer(collisionStatsUAV);
+            readbackPending = true;
+        }
+
+        return hasStats;
+    }
+
 private:
+    inline static constexpr int solveSortedEntryPoint = IDR_SHADER32;
     int numWorkgroups = 0;
+    bool useSortedGrid = false;
+    bool readbackPending = false;
     ComPtr<ID3D11UnorderedAccessView> particlesUAV;
     ComPtr<ID3D11ShaderResourceView> oldParticlesSRV;
+    ComPtr<ID3D11ShaderResourceView> voxelAdjacencySRV;
     ComPtr<ID3D11ShaderResourceView> particlesByCollisionCellSRV;
     ComPtr<ID3D11ShaderResourceView> collisionCellParticleCountsSRV;
     ComPtr<ID3D11Buffer> particleCollisionCB;
+    ComPtr<ID3D11Buffer> collisionStatsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> collisionStatsUAV;
+    ComPtr<ID3D11Buffer> collisionStatsStaging;
+
+    struct SortedGridResources {
+        ComPtr<ID3D11ShaderResourceView> particlesByCellSRV;
+        ComPtr<ID3D11ShaderResourceView> cellStartsSRV;
+        ComPtr<ID3D11ShaderResourceView> cellKeysSRV;
+        ComPtr<ID3D11ShaderResourceView> particleMinCellsSRV;
+        ComPtr<ID3D11Buffer> particleCollisionCB;
+        ComPtr<ID3D11Buffer> solveDispatchArgsBuffer;
+    } sortedGrid;
 
     void bind() override {
-        ID3D11ShaderResourceView* srvs[] = { particlesByCollisionCellSRV.Get(), collisionCellParticleCountsSRV.Get(), oldParticlesSRV.Get() };
-        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+        if (useSortedGrid) {
+            ID3D11ShaderResourceView* srvs[] = { sortedGrid.particlesByCellSRV.Get(), sortedGrid.cellStartsSRV.Get(), oldParticlesSRV.Get(), sortedGrid.cellKeysSRV.Get(), sortedGrid.particleMinCellsSRV.Get(), voxelAdjacencySRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
-        ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get() };
-        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            ID3D11Buffer* cbvs[] = { sortedGrid.particleCollisionCB.Get() };
+            DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+        } else {
+            ID3D11ShaderResourceView* srvs[] = { particlesByCollisionCellSRV.Get(), collisionCellParticleCountsSRV.Get(), oldParticlesSRV.Get(), nullptr, nullptr, voxelAdjacencySRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
-        ID3D11Buffer* cbvs[] = { particleCollisionCB.Get() };
-        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+            ID3D11Buffer* cbvs[] = { particleCollisionCB.Get() };
+            DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+        }
+
+        ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get(), collisionStatsUAV.Get() };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
     }
 
     void unbind() override {
-        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr };
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
-        ID3D11UnorderedAccessView* uavs[] = { nullptr };
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr };
         DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
 
         ID3D11Buffer* cbvs[] = { nullptr };
         DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
     }
 
-};
\ No newline at end of file
+};
@@ -1,37 +1,154 @@
 #pragma once
 
 #include "directx/compute/computeshader.h"
+#include "meshsdf.h"
+#include <algorithm>
+#include <cmath>
 
-// Hard-limit number of colliders. This is partly because dynamic-sized arrays
-// are not supported by constant buffers. But also, collider primitives aren't optimized for performance.
-// If there's ever a use case for more, would need to optimize collision code. Cbuffer can hold more, but could also use structured buffer.
+// CPU-side copy of every collider primitive. Colliders live in a structured buffer on the GPU, so there's no limit on their number.
 struct ColliderBuffer {
-    float worldMatrix[MAX_COLLIDERS][4][4];  // bottom row hijacked to store geometric parameters (e.g. radius, height, etc)
-    float inverseWorldMatrix[MAX_COLLIDERS][4][4];
+    std::vector<Collider> colliders;
+    std::vector<std::shared_ptr<const MeshSDF>> meshSDFs; // Indexed by mesh colliders (see MeshCollider::writeDataIntoBuffer)
+    int totalParticles = 0;
+
+    // Appends a zeroed collider and returns its index.
+    int addCollider() {
+        colliders.emplace_back();
+        return static_cast<int>(colliders.size()) - 1;
+    }
+
+    int numColliders() const { return static_cast<int>(colliders.size()); }
+
+    int addMeshSDF(const std::shared_ptr<const MeshSDF>& sdf) {
+        meshSDFs.push_back(sdf);
+        return static_cast<int>(meshSDFs.size()) - 1;
+    }
+};
+
+struct PrimitiveCollisionsConstants {
     int totalParticles = 0;
     int numColliders = 0;
-    int padding[2];                          // Padding to ensure 16-byte alignment
+    uint numUnbinnedColliders = 0;
+    uint colliderGridSize = 0;        // Number of hash buckets (a power of two), 0 if no collider is binned
+    float inverseColliderCellSize = 0.0f;
+    float substepStart = 0.0f;        // How far through the frame the current substep starts and ends (0 to 1), for interpolating moving colliders
+    float substepEnd = 1.0f;
+    int padding;
 };
 
+/**
+ * Resolves particle collisions against the collider primitives (boxes, spheres, capsules, cylinders, planes) and mesh colliders (signed distance fields).
+ *
+ * Rather than have every particle test every collider, colliders are binned into a hashed uniform grid whenever they change (which is rare,
+ * and there are few of them compared to particles, so this is done on the CPU). Each particle then tests only the colliders binned in its own cell,
+ * plus the few that are too large to bin (see COLLIDER_GRID_MAX_CELLS). Collider bounds are inflated by the max particle radius, so a particle
+ * never misses a collider just because its center is in a neighbouring cell.
+ *
+ * Kinematic colliders (animated ones) move from their previous frame's pose to their current one over the frame's substeps, rather than all at once
+ * on the first substep. Boxes, spheres and capsules that move are also swept: a particle that the collider passed through during a substep is put
+ * where it first touched the collider's surface, instead of being pushed out of whichever side it happens to end up nearest.
+ */
 class SolvePrimitiveCollisionsCompute : public ComputeShader
 {
 public:
     SolvePrimitiveCollisionsCompute() = default;
     SolvePrimitiveCollisionsCompute(
-        const ColliderBuffer& initColliderBuffer
-    ) : ComputeShader(IDR_SHADER13)
+        const ColliderBuffer& initColliderBuffer,
+        float maxParticleRadius
+    ) : ComputeShader(IDR_SHADER13), maxParticleRadius(maxParticleRadius)
     {
         initializeBuffers(initColliderBuffer);
     };
 
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(collidersBuffer);
+        DirectX::notifyMayaOfMemoryUsage(colliderMotionsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(colliderCellStartsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(colliderIndicesBuffer);
+        DirectX::notifyMayaOfMemoryUsage(sdfVolumesBuffer);
+        DirectX::notifyMayaOfMemoryUsage(sdfBrickTableBuffer);
+        DirectX::notifyMayaOfMemoryUsage(sdfSamplesBuffer);
+    }
+
     void updateColliderBuffer(const ColliderBuffer& newCB) {
-        if (colliderBuffer.Get() == nullptr) return;
-        numColliders = newCB.numColliders;
-        DirectX::updateConstantBuffer(colliderBuffer, newCB);
+        if (constantsBuffer.Get() == nullptr) return;
+        constants.totalParticles = newCB.totalParticles;
+        constants.numColliders = newCB.numColliders();
+        if (constants.numColliders <= 0) return;
+
+        // Colliders were added or removed, so the previous poses no longer line up with them: start again, at rest.
+        colliderMotions.assign(newCB.colliders.size(), ColliderMotion{});
+        for (int i = 0; i < constants.numColliders; ++i) {
+            ColliderMotion& motion = colliderMotions[i];
+            getColliderPose(newCB.colliders[i], motion.rotation, motion.translation);
+            std::copy(motion.rotation, motion.rotation + 4, motion.previousRotation);
+            std::copy(motion.translation, motion.translation + 3, motion.previousTranslation);
+        }
+        hasMovingColliders = false;
+
+        uploadColliders(newCB);
+    }
+
+    /**
+     * Like updateColliderBuffer, for when the same colliders have (maybe) moved since the last frame. Each collider's last pose becomes its previous pose,
+     * so the coming frame's substeps move it from there to its new pose.
+     */
+    void updateColliderPoses(const ColliderBuffer& newCB) {
+        if (constantsBuffer.Get() == nullptr) return;
+        if (colliderMotions.size() != newCB.colliders.size()) {
+            updateColliderBuffer(newCB);
+            return;
+        }
+
+        hasMovingColliders = false;
+        for (size_t i = 0; i < colliderMotions.size(); ++i) {
+            ColliderMotion& motion = colliderMotions[i];
+            std::copy(motion.rotation, motion.rotation + 4, motion.previousRotation);
+            std::copy(motion.translation, motion.translation + 3, motion.previousTranslation);
+            getColliderPose(newCB.colliders[i], motion.rotation, motion.translation);
+
+            // q and -q are the same rotation; flip the previous one if needed so interpolating takes the shorter way round.
+            float dot = 0.0f, rotationChange = 0.0f, translationChange = 0.0f;
+            for (int j = 0; j < 4; ++j) dot += motion.previousRotation[j] * motion.rotation[j];
+            for (int j = 0; j < 4; ++j) {
+                if (dot < 0.0f) motion.previousRotation[j] = -motion.previousRotation[j];
+                rotationChange = std::max(rotationChange, std::abs(motion.rotation[j] - motion.previousRotation[j]));
+            }
+            for (int j = 0; j < 3; ++j) {
+                translationChange = std::max(translationChange, std::abs(motion.translation[j] - motion.previousTranslation[j]));
+            }
+
+            motion.isMoving = (rotationChange > 1e-6f || translationChange > 1e-6f) ? 1 : 0;
+            hasMovingColliders |= (motion.isMoving != 0);
+        }
+
+        uploadColliders(newCB);
+    }
+
+    // For frames where no collider changed: anything that moved last frame is now at rest (in its current pose).
+    void settleColliderPoses() {
+        if (!hasMovingColliders) return;
+
+        for (ColliderMotion& motion : colliderMotions) {
+            std::copy(motion.rotation, motion.rotation + 4, motion.previousRotation);
+            std::copy(motion.translation, motion.translation + 3, motion.previousTranslation);
+            motion.isMoving = 0;
+        }
+        hasMovingColliders = false;
+        // The grid still bins colliders over both poses, which is conservative, so there's no need to rebin until they next change.
+        uploadToBuffer(colliderMotions, colliderMotionsBuffer, colliderMotionsSRV, colliderMotionsCapacity);
+    }
+
+    // Moving colliders are interpolated to where they are at the start and end of this substep.
+    void setSubstep(int substep, int numSubsteps) {
+        if (!hasMovingColliders || constants.numColliders <= 0) return;
+        constants.substepStart = static_cast<float>(substep) / numSubsteps;
+        constants.substepEnd = static_cast<float>(substep + 1) / numSubsteps;
+        DirectX::updateConstantBuffer(constantsBuffer, constants);
     }
 
     void dispatch() override {
-        if (numColliders <= 0) return;
+        if (constants.numColliders <= 0) return;
         ComputeShader::dispatch(numWorkgroups);
     }
 
@@ -43,26 +160,53 @@ public:
         this->oldParticlesSRV = oldParticlesSRV;
     }
 
-    const ComPtr<ID3D11Buffer>& getColliderBuffer() const {
-        return colliderBuffer;
-    }
-
 private:
     int numWorkgroups = 0;
-    int numColliders = 0;
+    float maxParticleRadius = 0.0f;
+    PrimitiveCollisionsConstants constants;
+    std::vector<ColliderMotion> colliderMotions;
+    bool hasMovingColliders = false;
+    // CPU side of the collider grid. colliderIndices lists the unbinned colliders first, then the colliders of each bucket in turn;
+    // bucket b's colliders are colliderIndices[cellStarts[b]] up to (not including) colliderIndices[cellStarts[b + 1]].
+    std::vector<uint> cellStarts;
+    std::vector<uint> colliderIndices;
+    size_t collidersCapacity = 0;
+    size_t colliderMotionsCapacity = 0;
+    size_t cellStartsCapacity = 0;
+    size_t colliderIndicesCapacity = 0;
+    // Mesh collider SDFs, concatenated. Only re-uploaded when a mesh collider is added, removed, or rebaked (not when it moves).
+    std::vector<std::shared_ptr<const MeshSDF>> uploadedMeshSDFs;
+    size_t sdfVolumesCapacity = 0;
+    size_t sdfBrickTableCapacity = 0;
+    size_t sdfSamplesCapacity = 0;
     ComPtr<ID3D11UnorderedAccessView> particlesUAV;
     ComPtr<ID3D11ShaderResourceView> oldParticlesSRV;
-    ComPtr<ID3D11Buffer> colliderBuffer;
+    ComPtr<ID3D11Buffer> constantsBuffer;
+    ComPtr<ID3D11Buffer> collidersBuffer;
+    ComPtr<ID3D11ShaderResourceView> collidersSRV;
+    ComPtr<ID3D11Buffer> colliderMotionsBuffer;
+    ComPtr<ID3D11ShaderResourceView> colliderMotionsSRV;
+    ComPtr<ID3D11Buffer> colliderCellStartsBuffer;
+    ComPtr<ID3D11ShaderResourceView> colliderCellStartsSRV;
+    ComPtr<ID3D11Buffer> colliderIndicesBuffer;
+    ComPtr<ID3D11ShaderResourceView> colliderIndicesSRV;
+    ComPtr<ID3D11Buffer> sdfVolumesBuffer;
+    ComPtr<ID3D11ShaderResourceView> sdfVolumesSRV;
+    ComPtr<ID3D11Buffer> sdfBrickTableBuffer;
+    ComPtr<ID3D11ShaderResourceView> sdfBrickTableSRV;
+    ComPtr<ID3D11Buffer> sdfSamplesBuffer;
+    ComPtr<ID3D11ShaderResourceView> sdfSamplesSRV;
 
     void bind() override
     {
         ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get() };
         DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
 
-        ID3D11ShaderResourceView* srvs[] = { oldParticlesSRV.Get() };
+        ID3D11ShaderResourceView* srvs[] = { oldParticlesSRV.Get(), collidersSRV.Get(), colliderCellStartsSRV.Get(), colliderIndicesSRV.Get(),
+                                              sdfVolumesSRV.Get(), sdfBrickTableSRV.Get(), sdfSamplesSRV.Get(), colliderMotionsSRV.Get() };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
 
-        ID3D11Buffer* cbvs[] = { colliderBuffer.Get() };
+        ID3D11Buffer* cbvs[] = { constantsBuffer.Get() };
         DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
     }
 
@@ -71,7 +215,7 @@ private:
         ID3D11UnorderedAccessView* nullUAVs[] = { nullptr };
         DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(nullUAVs), nullUAVs, nullptr);
 
-        ID3D11ShaderResourceView* nullSRVs[] = { nullptr };
+        ID3D11ShaderResourceView* nullSRVs[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
         DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(nullSRVs), nullSRVs);
 
         ID3D11Buffer* nullCBs[] = { nullptr };
@@ -79,9 +223,296 @@ private:
     }
 
     void initializeBuffers(const ColliderBuffer& initColliderBuffer) {
-        int totalParticles = initColliderBuffer.totalParticles;
-        numColliders = initColliderBuffer.numColliders;
-        numWorkgroups = Utils::divideRoundUp(totalParticles, VGS_THREADS); // TODO: use own thread group size
-        colliderBuffer = DirectX::createConstantBuffer(initColliderBuffer);
+        numWorkgroups = Utils::divideRoundUp(initColliderBuffer.totalParticles, VGS_THREADS); // TODO: use own thread group size
+        constantsBuffer = DirectX::createConstantBuffer(constants);
+        updateColliderBuffer(initColliderBuffer);
+    }
+
+    void uploadColliders(const ColliderBuffer& newCB) {
+        binColliders(newCB);
+        uploadToBuffer(newCB.colliders, collidersBuffer, collidersSRV, collidersCapacity);
+        uploadToBuffer(colliderMotions, colliderMotionsBuffer, colliderMotionsSRV, colliderMotionsCapacity);
+        if (newCB.meshSDFs != uploadedMeshSDFs) uploadMeshSDFs(newCB.meshSDFs);
+        uploadToBuffer(cellStarts, colliderCellStartsBuffer, colliderCellStartsSRV, cellStartsCapacity);
+        uploadToBuffer(colliderIndices, colliderIndicesBuffer, colliderIndicesSRV, colliderIndicesCapacity);
+        DirectX::updateConstantBuffer(constantsBuffer, constants);
+    }
+
+    /**
+     * The rigid part of a collider's world matrix, as a quaternion (x, y, z, w) and translation. Rows 0-2 of the (C++) matrix are the collider's local axes,
+     * i.e. the columns of the rotation matrix R that the shader applies as R * p.
+     */
+    static void getColliderPose(const Collider& collider, float rotation[4], float translation[3]) {
+        const auto& m = collider.worldMatrix;
+        float r00 = m[0][0], r11 = m[1][1], r22 = m[2][2];
+        float r01 = m[1][0], r10 = m[0][1];
+        float r02 = m[2][0], r20 = m[0][2];
+        float r12 = m[2][1], r21 = m[1][2];
+
+        float trace = r00 + r11 + r22;
+        if (trace > 0.0f) {
+            float s = std::sqrt(trace + 1.0f) * 2.0f;
+            rotation[0] = (r21 - r12) / s; rotation[1] = (r02 - r20) / s; rotation[2] = (r10 - r01) / s; rotation[3] = 0.25f * s;
+        } else if (r00 > r11 && r00 > r22) {
+            float s = std::sqrt(1.0f + r00 - r11 - r22) * 2.0f;
+            rotation[0] = 0.25f * s; rotation[1] = (r01 + r10) / s; rotation[2] = (r02 + r20) / s; rotation[3] = (r21 - r12) / s;
+        } else if (r11 > r22) {
+            float s = std::sqrt(1.0f + r11 - r00 - r22) * 2.0f;
+            rotation[0] = (r01 + r10) / s; rotation[1] = 0.25f * s; rotation[2] = (r12 + r21) / s; rotation[3] = (r02 - r20) / s;
+        } else {
+            float s = std::sqrt(1.0f + r22 - r00 - r11) * 2.0f;
+            rotation[0] = (r02 + r20) / s; rotation[1] = (r12 + r21) / s; rotation[2] = 0.25f * s; rotation[3] = (r10 - r01) / s;
+        }
+
+        for (int j = 0; j < 3; ++j) translation[j] = m[3][j];
+    }
+
+    // A copy of the collider (parameters and all), moved to its previous pose.
+    static Collider getPreviousCollider(const Collider& collider, const ColliderMotion& motion) {
+        Collider previous = collider;
+        const float x = motion.previousRotation[0], y = motion.previousRotation[1], z = motion.previousRotation[2], w = motion.previousRotation[3];
+        const float rotationMatrix[3][3] = {
+            { 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y - z * w),        2.0f * (x * z + y * w) },
+            { 2.0f * (x * y + z * w),        1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z - x * w) },
+            { 2.0f * (x * z - y * w),        2.0f * (y * z + x * w),        1.0f - 2.0f * (x * x + y * y) }
+        };
+
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) {
+                previous.worldMatrix[c][r] = rotationMatrix[r][c];
+            }
+            previous.worldMatrix[3][r] = motion.previousTranslation[r];
+        }
+        return previous;
     }
-};
\ No newline at end of file
+
+    /**
+     * World space AABB of a collider (as center and half extents), from its type and the geometric parameters hijacked into its world matrix.
+     * Returns false for colliders with no finite bounds (infinite planes).
+     */
+    static bool getColliderBounds(const Collider& collider, const ColliderBuffer& colliderBuffer, float center[3], float halfExtents[3]) {
+        const auto& m = collider.worldMatrix;
+        float localCenter[3] = { 0.0f, 0.0f, 0.0f };
+        float localHalfExtents[3] = { 0.0f, 0.0f, 0.0f };
+        int type = static_cast<int>(m[3][3]);
+
+        switch (type) {
+        case 0: // box
+            localHalfExtents[0] = m[0][3] * 0.5f;
+            localHalfExtents[1] = m[1][3] * 0.5f;
+            localHalfExtents[2] = m[2][3] * 0.5f;
+            break;
+        case 1: // sphere
+            localHalfExtents[0] = localHalfExtents[1] = localHalfExtents[2] = m[0][3];
+            break;
+        case 2: // capsule (aligned with local Y)
+            localHalfExtents[0] = localHalfExtents[2] = m[0][3];
+            localHalfExtents[1] = m[1][3] * 0.5f + m[0][3];
+            break;
+        case 3: // cylinder (aligned with local Y)
+            localHalfExtents[0] = localHalfExtents[2] = m[0][3];
+            localHalfExtents[1] = m[1][3] * 0.5f;
+            break;
+        case 4: // plane (local XZ)
+            if (m[2][3] != 0.0f) return false;
+            localHalfExtents[0] = m[0][3] * 0.5f;
+            localHalfExtents[2] = m[1][3] * 0.5f;
+            break;
+        case 5: { // mesh (the SDF volume isn't centered on the collider)
+            const MeshSDF* sdf = colliderBuffer.meshSDFs[static_cast<int>(m[0][3])].get();
+            if (!sdf) break; // Not baked (yet): zero-size bounds, which costs (almost) nothing
+            for (int i = 0; i < 3; ++i) {
+                localCenter[i] = 0.5f * (sdf->boundsMin(i) + sdf->boundsMax(i));
+                localHalfExtents[i] = 0.5f * (sdf->boundsMax(i) - sdf->boundsMin(i));
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+
+        // Rows 0-2 hold the (unscaled) local axes, row 3 the translation. The hijacked last column is ignored.
+        for (int j = 0; j < 3; ++j) {
+            center[j] = m[3][j];
+            halfExtents[j] = 0.0f;
+            for (int i = 0; i < 3; ++i) {
+                center[j] += localCenter[i] * m[i][j];
+                halfExtents[j] += std::abs(m[i][j]) * localHalfExtents[i];
+            }
+        }
+        return true;
+    }
+
+    void binColliders(const ColliderBuffer& colliderBuffer) {
+        const std::vector<Collider>& colliders = colliderBuffer.colliders;
+        struct Bounds { int minCell[3]; int maxCell[3]; };
+        const int numColliders = static_cast<int>(colliders.size());
+        std::vector<float> centers(numColliders * 3), halfExtents(numColliders * 3);
+        std::vector<bool> isBounded(numColliders);
+        std::vector<float> extents;
+
+        for (int i = 0; i < numColliders; ++i) {
+            isBounded[i] = getColliderBounds(colliders[i], colliderBuffer, &centers[i * 3], &halfExtents[i * 3]);
+            if (!isBounded[i]) continue;
+
+            // A moving collider sweeps through everything between its previous and current poses (roughly), so bin it over both.
+            if (i < static_cast<int>(colliderMotions.size()) && colliderMotions[i].isMoving) {
+                float previousCenter[3], previousHalfExtents[3];
+                getColliderBounds(getPreviousCollider(colliders[i], colliderMotions[i]), colliderBuffer, previousCenter, previousHalfExtents);
+                for (int j = 0; j < 3; ++j) {
+                    float lo = std::min(centers[i * 3 + j] - halfExtents[i * 3 + j], previousCenter[j] - previousHalfExtents[j]);
+                    float hi = std::max(centers[i * 3 + j] + halfExtents[i * 3 + j], previousCenter[j] + previousHalfExtents[j]);
+                    centers[i * 3 + j] = 0.5f * (lo + hi);
+                    halfExtents[i * 3 + j] = 0.5f * (hi - lo);
+                }
+            }
+
+            float maxHalfExtent = maxParticleRadius;
+            for (int j = 0; j < 3; ++j) {
+                halfExtents[i * 3 + j] += maxParticleRadius;
+                maxHalfExtent = std::max(maxHalfExtent, halfExtents[i * 3 + j]);
+            }
+            extents.push_back(2.0f * maxHalfExtent);
+        }
+
+        // Size cells to the median collider, so typical colliders span a handful of cells and outliers don't set the scale for everyone.
+        float cellSize = 0.0f;
+        if (!extents.empty()) {
+            std::nth_element(extents.begin(), extents.begin() + extents.size() / 2, extents.end());
+            cellSize = extents[extents.size() / 2];
+        }
+        float inverseCellSize = (cellSize > 0.0f) ? 1.0f / cellSize : 0.0f;
+
+        std::vector<uint> unbinned;
+        std::vector<std::pair<uint, uint>> entries; // (bucket, collider)
+        std::vector<Bounds> bounds;
+        std::vector<uint> binned;
+        for (int i = 0; i < numColliders; ++i) {
+            if (!isBounded[i] || inverseCellSize == 0.0f) {
+                unbinned.push_back(i);
+                continue;
+            }
+
+            Bounds b;
+            long long numCells = 1;
+            for (int j = 0; j < 3; ++j) {
+                b.minCell[j] = static_cast<int>(std::floor((centers[i * 3 + j] - halfExtents[i * 3 + j]) * inverseCellSize));
+                b.maxCell[j] = static_cast<int>(std::floor((centers[i * 3 + j] + halfExtents[i * 3 + j]) * inverseCellSize));
+                numCells *= static_cast<long long>(b.maxCell[j] - b.minCell[j] + 1);
+            }
+
+            if (numCells > COLLIDER_GRID_MAX_CELLS) {
+                unbinned.push_back(i);
+                continue;
+            }
+            bounds.push_back(b);
+            binned.push_back(i);
+        }
+
+        // Size the table to roughly twice the number of (cell, collider) entries, so few unrelated cells share a bucket.
+        size_t numEntries = 0;
+        for (const Bounds& b : bounds) {
+            numEntries += static_cast<size_t>(b.maxCell[0] - b.minCell[0] + 1) * (b.maxCell[1] - b.minCell[1] + 1) * (b.maxCell[2] - b.minCell[2] + 1);
+        }
+        uint gridSize = 0;
+        if (numEntries > 0) {
+            gridSize = 1;
+            while (gridSize < 2 * numEntries) gridSize <<= 1;
+        }
+
+        std::vector<uint> colliderBuckets;
+        for (size_t k = 0; k < binned.size(); ++k) {
+            const Bounds& b = bounds[k];
+            colliderBuckets.clear();
+            for (int x = b.minCell[0]; x <= b.maxCell[0]; ++x)
+            for (int y = b.minCell[1]; y <= b.maxCell[1]; ++y)
+            for (int z = b.minCell[2]; z <= b.maxCell[2]; ++z) {
+                colliderBuckets.push_back(hashColliderCell(x, y, z, gridSize));
+            }
+
+            // Two of a collider's cells can hash to the same bucket; list it there once so it isn't solved twice.
+            std::sort(colliderBuckets.begin(), colliderBuckets.end());
+            colliderBuckets.erase(std::unique(colliderBuckets.begin(), colliderBuckets.end()), colliderBuckets.end());
+            for (uint bucket : colliderBuckets) {
+                entries.emplace_back(bucket, binned[k]);
+            }
+        }
+
+        // Counting sort of the entries by bucket, after the unbinned colliders.
+        uint numUnbinned = static_cast<uint>(unbinned.size());
+        cellStarts.assign(gridSize + 1, 0);
+        for (const auto& entry : entries) {
+            ++cellStarts[entry.first + 1];
+        }
+        cellStarts[0] = numUnbinned;
+        for (uint b = 0; b < gridSize; ++b) {
+            cellStarts[b + 1] += cellStarts[b];
+        }
+
+        colliderIndices = unbinned;
+        colliderIndices.resize(numUnbinned + entries.size());
+        std::vector<uint> writeOffsets(cellStarts.begin(), cellStarts.end() - 1);
+        for (const auto& entry : entries) {
+            colliderIndices[writeOffsets[entry.first]++] = entry.second;
+        }
+
+        constants.numUnbinnedColliders = numUnbinned;
+        constants.colliderGridSize = gridSize;
+        constants.inverseColliderCellSize = inverseCellSize;
+    }
+
+    void uploadMeshSDFs(const std::vector<std::shared_ptr<const MeshSDF>>& meshSDFs) {
+        std::vector<SDFVolume> volumes(meshSDFs.size(), SDFVolume{});
+        std::vector<uint> brickTable;
+        std::vector<float> samples;
+
+        for (size_t i = 0; i < meshSDFs.size(); ++i) {
+            const MeshSDF* sdf = meshSDFs[i].get();
+            if (!sdf) continue; // Zero bricks: every lookup misses
+
+            SDFVolume& volume = volumes[i];
+            std::copy(sdf->origin, sdf->origin + 3, volume.origin);
+            std::copy(sdf->numBricks, sdf->numBricks + 3, volume.numBricks);
+            volume.cellSize = sdf->cellSize;
+            volume.brickTableOffset = static_cast<uint>(brickTable.size());
+
+            // Brick indices are local to each SDF; offset them to index the concatenated samples.
+            uint firstBrick = static_cast<uint>(samples.size() / (SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES));
+            for (uint brick : sdf->brickTable) {
+                brickTable.push_back(brick == SDF_BRICK_EMPTY ? SDF_BRICK_EMPTY : firstBrick + brick);
+            }
+            samples.insert(samples.end(), sdf->samples.begin(), sdf->samples.end());
+        }
+
+        uploadToBuffer(volumes, sdfVolumesBuffer, sdfVolumesSRV, sdfVolumesCapacity);
+        uploadToBuffer(brickTable, sdfBrickTableBuffer, sdfBrickTableSRV, sdfBrickTableCapacity);
+        uploadToBuffer(samples, sdfSamplesBuffer, sdfSamplesSRV, sdfSamplesCapacity);
+        uploadedMeshSDFs = meshSDFs;
+    }
+
+    // Structured buffers are grown (to the next power of two) only when the data outgrows them. Otherwise, just the used range is overwritten.
+    template<typename T>
+    static void uploadToBuffer(
+        const std::vector<T>& data,
+        ComPtr<ID3D11Buffer>& buffer,
+        ComPtr<ID3D11ShaderResourceView>& srv,
+        size_t& capacity
+    ) {
+        if (data.empty()) return;
+
+        if (data.size() > capacity) {
+            capacity = 1;
+            while (capacity < data.size()) capacity <<= 1;
+
+            std::vector<T> paddedData(data);
+            paddedData.resize(capacity);
+            DirectX::notifyMayaOfMemoryUsage(buffer);
+            buffer = DirectX::createReadWriteBuffer(paddedData, true, D3D11_BIND_SHADER_RESOURCE);
+            srv = DirectX::createSRV(buffer);
+            return;
+        }
+
+        D3D11_BOX box = { 0, 0, 0, static_cast<UINT>(data.size() * sizeof(T)), 1, 1 };
+        DirectX::getContext()->UpdateSubresource(buffer.Get(), 0, &box, data.data(), 0, 0);
+    }
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "directx/compute/computeshader.h"
+
+/**
+ * Maintains a compact list of every surface voxel's (global) index, so that collision building is dispatched over the shell of each model
+ * instead of over every particle. Interior voxels, the bulk of a solid mesh, then cost nothing.
+ *
+ * The list is compacted from the isSurface buffer whenever the global buffers are reallocated or restored from cache. In between, it's only appended to:
+ * the face constraints shader appends voxels the moment they become surface (see markFractured in faceconstraints.hlsl).
+ * Element 0 of the list holds the count (see SURFACE_VOXELS_COUNT_IDX).
+ */
+class SurfaceVoxelsCompute : public ComputeShader
+{
+public:
+    // Byte offsets into the dispatch args buffer, one (x, y, z) triple per consumer. Must match writesurfacevoxelargs.hlsl.
+    enum DispatchArgsSlot {
+        CULLING_ARGS = 0,
+        BUILD_GRID_ARGS = 1,
+        BUILD_PARTICLES_ARGS = 2,
+        NUM_ARGS_SLOTS = 3
+    };
+
+    static constexpr UINT argsOffset(int slot) {
+        return static_cast<UINT>(slot * 3 * sizeof(UINT));
+    }
+
+    SurfaceVoxelsCompute() = default;
+
+    SurfaceVoxelsCompute(int numVoxels) : ComputeShader(IDR_SHADER41)
+    {
+        if (numVoxels <= 0) return;
+        loadShaderObject(writeArgsEntryPoint);
+        initializeBuffers(numVoxels);
+    }
+
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(surfaceVoxelsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(dispatchArgsBuffer);
+    }
+
+    // Rebuilds the list from scratch. Call whenever the isSurface buffer is replaced wholesale (reallocated, or restored from cache).
+    void rebuild() {
+        if (!surfaceVoxelsUAV) return; // Not created yet
+
+        DirectX::clearUintBuffer(surfaceVoxelsUAV);
+        activePass = Pass::Compact;
+        ComputeShader::dispatch(numVoxelWorkgroups);
+    }
+
+    // Converts the current list length into dispatch args. Call before each collision build (the list may have grown since the last one).
+    void dispatch() override {
+        if (!surfaceVoxelsUAV) return;
+
+        activePass = Pass::WriteArgs;
+        ComputeShader::dispatch(1, writeArgsEntryPoint);
+    }
+
+    const ComPtr<ID3D11Buffer>& getSurfaceVoxelsBuffer() const { return surfaceVoxelsBuffer; }
+
+    const ComPtr<ID3D11ShaderResourceView>& getSurfaceVoxelsSRV() const { return surfaceVoxelsSRV; }
+
+    const ComPtr<ID3D11Buffer>& getDispatchArgsBuffer() const { return dispatchArgsBuffer; }
+
+    void setIsSurfaceSRV(const ComPtr<ID3D11ShaderResourceView>& isSurfaceSRV) {
+        this->isSurfaceSRV = isSurfaceSRV;
+    }
+
+private:
+    enum class Pass { Compact, WriteArgs };
+    inline static constexpr int writeArgsEntryPoint = IDR_SHADER42;
+    Pass activePass = Pass::Compact;
+    int numVoxelWorkgroups = 0;
+    // Owned resources
+    ComPtr<ID3D11Buffer> surfaceVoxelsBuffer;
+    ComPtr<ID3D11ShaderResourceView> surfaceVoxelsSRV;
+    ComPtr<ID3D11UnorderedAccessView> surfaceVoxelsUAV;
+    ComPtr<ID3D11Buffer> dispatchArgsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> dispatchArgsUAV;
+    // Passed in
+    ComPtr<ID3D11ShaderResourceView> isSurfaceSRV;
+
+    void bind() override {
+        switch (activePass) {
+        case Pass::Compact: {
+            ID3D11ShaderResourceView* srvs[] = { isSurfaceSRV.Get() };
+            DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+            ID3D11UnorderedAccessView* uavs[] = { surfaceVoxelsUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        case Pass::WriteArgs: {
+            ID3D11UnorderedAccessView* uavs[] = { surfaceVoxelsUAV.Get(), dispatchArgsUAV.Get() };
+            DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+            break;
+        }
+        }
+    }
+
+    void unbind() override {
+        ID3D11ShaderResourceView* srvs[] = { nullptr };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+    }
+
+    void initializeBuffers(int numVoxels) {
+        numVoxelWorkgroups = Utils::divideRoundUp(numVoxels, SURFACE_VOXELS_THREADS);
+
+        // Room for every voxel, plus the count.
+        surfaceVoxelsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(SURFACE_VOXELS_FIRST_IDX + numVoxels, 0));
+        surfaceVoxelsSRV = DirectX::createSRV(surfaceVoxelsBuffer);
+        surfaceVoxelsUAV = DirectX::createUAV(surfaceVoxelsBuffer);
+
+        dispatchArgsBuffer = DirectX::createIndirectArgsBuffer(NUM_ARGS_SLOTS);
+        dispatchArgsUAV = DirectX::createUAV(dispatchArgsBuffer, NUM_ARGS_SLOTS * 3, 0, DXGI_FORMAT_R32_UINT);
+    }
+};
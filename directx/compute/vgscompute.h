@@ -2,6 +2,20 @@
 
 #include "directx/compute/computeshader.h"
 #include "shaders/constants.hlsli"
+#include <vector>
+#include <algorithm>
+
+/**
+ * Convergence of the intra-voxel VGS solve over one frame's worth of substeps.
+ * Residuals are the largest single-particle correction in a voxel's last iteration, relative to the particle radius.
+ */
+struct VGSResidualStats {
+    std::vector<float> substepMaxResiduals; // Worst voxel residual of each substep, in order
+    float maxResidual = 0.0f;               // Worst of the above
+    float averageIterations = 0.0f;         // Iterations run per solved voxel
+    float convergedFraction = 0.0f;         // Fraction of solved voxels that stopped early below the residual tolerance
+    float bailedFraction = 0.0f;            // Fraction of solved voxels that stopped early because they were degenerate
+};
 
 class VGSCompute : public ComputeShader
 {
@@ -14,41 +28,146 @@ public:
         float voxelRestVolume
 	) : ComputeShader(IDR_SHADER3)
     {
-        numWorkgroups = Utils::divideRoundUp(numParticles / 8, VGS_THREADS);
         initializeBuffers(numParticles, particleRadius, voxelRestVolume);
     };
 
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(residualStatsBuffer);
+    }
+
+    // Dispatches over the active (awake) voxels only. See VoxelActivityCompute.
+    // Each dispatch writes its residual stats to the next slot of the history ring.
     void dispatch() override
     {
-        ComputeShader::dispatch(numWorkgroups);
+        currentStatsSlot = substepCounter % VGS_RESIDUAL_HISTORY_SIZE;
+        DirectX::clearUintBuffer(residualStatsSlotUAVs[currentStatsSlot]);
+
+        ComputeShader::dispatchIndirect(dispatchArgsBuffer, dispatchArgsOffset);
+        substepCounter++;
+        substepsSinceReadback++;
     };
 
     void updateVGSParameters(
         float relaxation,
         float edgeUniformity,
         uint iterCount,
-        float compliance
+        float compliance,
+        float residualTolerance
     ) {
         vgsConstants.relaxation = relaxation;
         vgsConstants.edgeUniformity = edgeUniformity;
         vgsConstants.iterCount = iterCount;
         vgsConstants.compliance = compliance;
+        vgsConstants.residualTolerance = residualTolerance;
+        DirectX::updateConstantBuffer(vgsConstantBuffer, vgsConstants);
+    }
+
+    void setIterationCount(uint iterCount) {
+        if (iterCount == vgsConstants.iterCount) return;
+        vgsConstants.iterCount = iterCount;
         DirectX::updateConstantBuffer(vgsConstantBuffer, vgsConstants);
     }
 
+    uint getIterationCount() const {
+        return vgsConstants.iterCount;
+    }
+
+    /**
+     * Call once per frame. Queues a copy of the residual stats of the substeps dispatched since the last call, and returns (in stats) 
+     * those of the previously queued copy, if the GPU has finished with it. Reading a frame late means we never stall waiting on the GPU.
+     * Returns false if there was nothing new to report.
+     */
+    bool collectResidualStats(VGSResidualStats& stats) {
+        bool hasStats = false;
+        if (readbackPending) {
+            std::vector<uint> history;
+            if (!DirectX::tryReadStagingBuffer(residualStatsStaging, history)) return false;
+
+            summarizeResidualStats(history, stats);
+            readbackPending = false;
+            hasStats = true;
+        }
+
+        if (substepsSinceReadback > 0) {
+            DirectX::getContext()->CopyResource(residualStatsStaging.Get(), residualStatsBuffer.Get());
+            pendingSubstepCount = std::min<uint>(substepsSinceReadback, VGS_RESIDUAL_HISTORY_SIZE);
+            pendingFirstSlot = (substepCounter - pendingSubstepCount) % VGS_RESIDUAL_HISTORY_SIZE;
+            substepsSinceReadback = 0;
+            readbackPending = true;
+        }
+
+        return hasStats;
+    }
+
     void setParticlesUAV(const ComPtr<ID3D11UnorderedAccessView>& particlesUAV) {
         this->particlesUAV = particlesUAV;
     }
 
+    void setActiveVoxels(
+        const ComPtr<ID3D11ShaderResourceView>& activeVoxelsSRV,
+        const ComPtr<ID3D11ShaderResourceView>& activeCountsSRV,
+        const ComPtr<ID3D11Buffer>& dispatchArgsBuffer,
+        UINT dispatchArgsOffset
+    ) {
+        this->activeVoxelsSRV = activeVoxelsSRV;
+        this->activeCountsSRV = activeCountsSRV;
+        this->dispatchArgsBuffer = dispatchArgsBuffer;
+        this->dispatchArgsOffset = dispatchArgsOffset;
+    }
+
 private:
-    int numWorkgroups = 0;
     ComPtr<ID3D11Buffer> vgsConstantBuffer;
     ComPtr<ID3D11UnorderedAccessView> particlesUAV;
+    ComPtr<ID3D11ShaderResourceView> activeVoxelsSRV;
+    ComPtr<ID3D11ShaderResourceView> activeCountsSRV;
+    ComPtr<ID3D11Buffer> dispatchArgsBuffer;
+    UINT dispatchArgsOffset = 0;
     VGSConstants vgsConstants;
+
+    // Residual history ring: one slot (and one UAV onto it) per substep.
+    ComPtr<ID3D11Buffer> residualStatsBuffer;
+    std::vector<ComPtr<ID3D11UnorderedAccessView>> residualStatsSlotUAVs;
+    ComPtr<ID3D11Buffer> residualStatsStaging;
+    uint substepCounter = 0;
+    uint currentStatsSlot = 0;
+    uint substepsSinceReadback = 0;
+    uint pendingFirstSlot = 0;
+    uint pendingSubstepCount = 0;
+    bool readbackPending = false;
+
+    void summarizeResidualStats(const std::vector<uint>& history, VGSResidualStats& stats) const {
+        stats = VGSResidualStats{};
+        uint totalIterations = 0;
+        uint totalConverged = 0;
+        uint totalBailed = 0;
+        uint totalVoxels = 0;
+
+        for (uint i = 0; i < pendingSubstepCount; ++i) {
+            const uint* slot = &history[((pendingFirstSlot + i) % VGS_RESIDUAL_HISTORY_SIZE) * VGS_RESIDUAL_STATS_STRIDE];
+
+            float substepMaxResidual;
+            memcpy(&substepMaxResidual, &slot[VGS_RESIDUAL_MAX], sizeof(float));
+            stats.substepMaxResiduals.push_back(substepMaxResidual);
+            stats.maxResidual = std::max(stats.maxResidual, substepMaxResidual);
+
+            totalIterations += slot[VGS_RESIDUAL_ITERATIONS];
+            totalConverged += slot[VGS_RESIDUAL_CONVERGED];
+            totalBailed += slot[VGS_RESIDUAL_BAILED];
+            totalVoxels += slot[VGS_RESIDUAL_VOXELS];
+        }
+
+        if (totalVoxels == 0) return;
+        stats.averageIterations = static_cast<float>(totalIterations) / totalVoxels;
+        stats.convergedFraction = static_cast<float>(totalConverged) / totalVoxels;
+        stats.bailedFraction = static_cast<float>(totalBailed) / totalVoxels;
+    }
     
     void bind() override
     {
-		ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get() };
+        ID3D11ShaderResourceView* srvs[] = { activeVoxelsSRV.Get(), activeCountsSRV.Get() };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+		ID3D11UnorderedAccessView* uavs[] = { particlesUAV.Get(), residualStatsSlotUAVs[currentStatsSlot].Get() };
 		DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
 
         ID3D11Buffer* cbvs[] = { vgsConstantBuffer.Get() };
@@ -57,7 +176,10 @@ private:
 
     void unbind() override
     {
-        ID3D11UnorderedAccessView* uavs[] = { nullptr };
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr };
         DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
 
         ID3D11Buffer* cbvs[] = { nullptr };
@@ -77,7 +199,15 @@ private:
         vgsConstants.particleRadius = particleRadius;
         vgsConstants.voxelRestVolume = voxelRestVolume;
         vgsConstants.compliance = 0;
+        vgsConstants.residualTolerance = 0;
     
         vgsConstantBuffer = DirectX::createConstantBuffer(vgsConstants);
+
+        residualStatsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(VGS_RESIDUAL_HISTORY_SIZE * VGS_RESIDUAL_STATS_STRIDE, 0));
+        residualStatsStaging = DirectX::createStagingBuffer(residualStatsBuffer);
+        residualStatsSlotUAVs.resize(VGS_RESIDUAL_HISTORY_SIZE);
+        for (uint i = 0; i < VGS_RESIDUAL_HISTORY_SIZE; ++i) {
+            residualStatsSlotUAVs[i] = DirectX::createUAV(residualStatsBuffer, VGS_RESIDUAL_STATS_STRIDE, i * VGS_RESIDUAL_STATS_STRIDE);
+        }
     }
 };
\ No newline at end of file
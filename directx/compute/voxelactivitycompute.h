@@ -0,0 +1,280 @@
+#pragma once
+
+#include "directx/compute/computeshader.h"
+#include "directx/compute/faceconstraintscompute.h"
+#include "directx/compute/constraintcompactioncompute.h"
+#include "shaders/constants.hlsli"
+#include <array>
+#include <algorithm>
+
+struct ActiveConstraintsCB {
+    uint numConstraints{0};
+    uint countSlot{0};
+    uint firstConstraint{0};
+    uint liveSlot{0};
+};
+
+/**
+ * Tracks which voxels are at rest (asleep) and, each substep, compacts the awake voxels and the constraints touching them
+ * into worklists. The solver shaders then dispatch indirectly over just those worklists (see getDispatchArgsBuffer).
+ *
+ * The per-voxel activity state itself lives in a global buffer (owned by the GlobalSolver) so it can be cached with the rest of the simulation state.
+ */
+class VoxelActivityCompute : public ComputeShader
+{
+public:
+    // Byte offsets into the dispatch args buffer, one (x, y, z) triple per consumer. Must match writeactivitydispatchargs.hlsl.
+    enum DispatchArgsSlot {
+        PREVGS_ARGS = 0,
+        VGS_ARGS = 1,
+        FACE_CONSTRAINTS_ARGS = 2, // + axis
+        LONG_RANGE_CONSTRAINTS_ARGS = 5, // + level
+        NUM_ARGS_SLOTS = 5 + LONG_RANGE_LEVELS
+    };
+
+    static constexpr UINT argsOffset(int slot) {
+        return static_cast<UINT>(slot * 3 * sizeof(UINT));
+    }
+
+    // How much faster (per substep) a sleeping voxel has to be pushed to wake up, relative to the speed it had to fall under to start resting.
+    static constexpr float WAKE_HYSTERESIS = 2.0f;
+    // How long a voxel must rest before it falls asleep.
+    static constexpr float SLEEP_DELAY_SECONDS = 0.25f;
+
+    VoxelActivityCompute() = default;
+
+    VoxelActivityCompute(
+        uint numParticles,
+        float particleRadius,
+        const std::array<FaceConstraints, 3>& faceConstraints,
+        const std::array<uint, LONG_RANGE_LEVELS + 1>& longRangeLevelOffsets
+    ) : ComputeShader(IDR_SHADER20)
+    {
+        loadShaderObject(buildActiveFaceConstraintsEntryPoint);
+        loadShaderObject(buildActiveLongRangeConstraintsEntryPoint);
+        loadShaderObject(writeDispatchArgsEntryPoint);
+        initializeBuffers(numParticles, particleRadius, faceConstraints, longRangeLevelOffsets);
+    }
+
+    void reset() override {
+        DirectX::notifyMayaOfMemoryUsage(activeVoxelsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(activeLongRangeConstraintsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(activeCountsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(dispatchArgsBuffer);
+        DirectX::notifyMayaOfMemoryUsage(activityCB);
+        for (int i = 0; i < 3; i++) {
+            DirectX::notifyMayaOfMemoryUsage(activeFaceConstraintsBuffers[i]);
+            DirectX::notifyMayaOfMemoryUsage(activeConstraintsCBs[i]);
+        }
+        for (int level = 0; level < LONG_RANGE_LEVELS; level++) {
+            DirectX::notifyMayaOfMemoryUsage(activeLongRangeConstraintsCBs[level]);
+        }
+    }
+
+    /**
+     * Updates voxel activity and rebuilds the active worklists and indirect dispatch args for this substep.
+     */
+    void dispatch() override {
+        DirectX::clearUintBuffer(activeCountsUAV);
+
+        passUAVs = { particlesUAV, activeVoxelsUAV, oldParticlesUAV, nullptr };
+        ComputeShader::dispatch(numVoxelWorkgroups);
+
+        // The constraint passes only visit live constraints (see ConstraintCompactionCompute).
+        for (int axis = 0; axis < 3; axis++) {
+            passUAVs = { faceConstraintIndicesUAVs[axis], activeFaceConstraintsUAVs[axis], nullptr, nullptr };
+            passCB = activeConstraintsCBs[axis];
+            passLiveConstraintsSRV = liveFaceConstraintsSRVs[axis];
+            ComputeShader::dispatchIndirect(liveDispatchArgsBuffer, ConstraintCompactionCompute::argsOffset(LIVE_FACE_CONSTRAINTS_SLOT + axis), buildActiveFaceConstraintsEntryPoint);
+        }
+
+        passUAVs = { longRangeParticleIndicesUAV, activeLongRangeConstraintsUAV, nullptr, nullptr };
+        passLiveConstraintsSRV = liveLongRangeConstraintsSRV;
+        for (int level = 0; level < LONG_RANGE_LEVELS; level++) {
+            passCB = activeLongRangeConstraintsCBs[level];
+            ComputeShader::dispatchIndirect(liveDispatchArgsBuffer, ConstraintCompactionCompute::argsOffset(LIVE_LONG_RANGE_CONSTRAINTS_SLOT + level), buildActiveLongRangeConstraintsEntryPoint);
+        }
+        passCB = nullptr;
+        passLiveConstraintsSRV = nullptr;
+
+        passUAVs = { nullptr, nullptr, nullptr, dispatchArgsUAV };
+        ComputeShader::dispatch(1, writeDispatchArgsEntryPoint);
+        passUAVs = {};
+    }
+
+    // Thresholds are in world units per substep (sleepDisplacement = speed * substep timestep).
+    void updateActivityParameters(bool sleepingEnabled, float sleepDisplacement, float sleepStrain, uint sleepDelay) {
+        const float wakeDisplacement = sleepDisplacement * WAKE_HYSTERESIS;
+        activityConstants.sleepingEnabled = sleepingEnabled ? 1 : 0;
+        activityConstants.sleepDisplacementSq = sleepDisplacement * sleepDisplacement;
+        activityConstants.wakeDisplacementSq = wakeDisplacement * wakeDisplacement;
+        activityConstants.sleepStrain = sleepStrain;
+        activityConstants.sleepDelay = sleepDelay;
+        DirectX::updateConstantBuffer(activityCB, activityConstants);
+    }
+
+    const ComPtr<ID3D11Buffer>& getDispatchArgsBuffer() const {
+        return dispatchArgsBuffer;
+    }
+
+    const ComPtr<ID3D11ShaderResourceView>& getActiveCountsSRV() const {
+        return activeCountsSRV;
+    }
+
+    const ComPtr<ID3D11ShaderResourceView>& getActiveVoxelsSRV() const {
+        return activeVoxelsSRV;
+    }
+
+    const ComPtr<ID3D11ShaderResourceView>& getActiveFaceConstraintsSRV(int axis) const {
+        return activeFaceConstraintsSRVs[axis];
+    }
+
+    const ComPtr<ID3D11ShaderResourceView>& getActiveLongRangeConstraintsSRV() const {
+        return activeLongRangeConstraintsSRV;
+    }
+
+    void setParticlesUAV(const ComPtr<ID3D11UnorderedAccessView>& particlesUAV) {
+        this->particlesUAV = particlesUAV;
+    }
+
+    void setOldParticlesUAV(const ComPtr<ID3D11UnorderedAccessView>& oldParticlesUAV) {
+        this->oldParticlesUAV = oldParticlesUAV;
+    }
+
+    void setVoxelActivityUAV(const ComPtr<ID3D11UnorderedAccessView>& voxelActivityUAV) {
+        this->voxelActivityUAV = voxelActivityUAV;
+    }
+
+    void setIsDraggingSRV(const ComPtr<ID3D11ShaderResourceView>& isDraggingSRV) {
+        this->isDraggingSRV = isDraggingSRV;
+    }
+
+    void setFaceConstraintIndicesUAV(int axis, const ComPtr<ID3D11UnorderedAccessView>& faceConstraintIndicesUAV) {
+        faceConstraintIndicesUAVs[axis] = faceConstraintIndicesUAV;
+    }
+
+    void setLongRangeParticleIndicesUAV(const ComPtr<ID3D11UnorderedAccessView>& longRangeParticleIndicesUAV) {
+        this->longRangeParticleIndicesUAV = longRangeParticleIndicesUAV;
+    }
+
+    void setLiveConstraints(const ConstraintCompactionCompute& constraintCompaction) {
+        for (int axis = 0; axis < 3; axis++) {
+            liveFaceConstraintsSRVs[axis] = constraintCompaction.getLiveFaceConstraintsSRV(axis);
+        }
+        liveLongRangeConstraintsSRV = constraintCompaction.getLiveLongRangeConstraintsSRV();
+        liveCountsSRV = constraintCompaction.getLiveCountsSRV();
+        liveDispatchArgsBuffer = constraintCompaction.getLiveDispatchArgsBuffer();
+    }
+
+private:
+    inline static constexpr int buildActiveFaceConstraintsEntryPoint = IDR_SHADER21;
+    inline static constexpr int buildActiveLongRangeConstraintsEntryPoint = IDR_SHADER22;
+    inline static constexpr int writeDispatchArgsEntryPoint = IDR_SHADER23;
+    int numVoxelWorkgroups = 0;
+    VoxelActivityConstants activityConstants;
+    // UAVs that differ per pass, bound to slots u0, u2, u4, and u5 respectively (see bind()).
+    std::array<ComPtr<ID3D11UnorderedAccessView>, 4> passUAVs;
+    // Constraint range and live list of the current worklist pass, bound to b1 and t1 respectively.
+    ComPtr<ID3D11Buffer> passCB;
+    ComPtr<ID3D11ShaderResourceView> passLiveConstraintsSRV;
+    // Owned resources
+    ComPtr<ID3D11Buffer> activityCB;
+    std::array<ComPtr<ID3D11Buffer>, 3> activeConstraintsCBs;
+    std::array<ComPtr<ID3D11Buffer>, LONG_RANGE_LEVELS> activeLongRangeConstraintsCBs;
+    ComPtr<ID3D11Buffer> activeVoxelsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> activeVoxelsUAV;
+    ComPtr<ID3D11ShaderResourceView> activeVoxelsSRV;
+    std::array<ComPtr<ID3D11Buffer>, 3> activeFaceConstraintsBuffers;
+    std::array<ComPtr<ID3D11UnorderedAccessView>, 3> activeFaceConstraintsUAVs;
+    std::array<ComPtr<ID3D11ShaderResourceView>, 3> activeFaceConstraintsSRVs;
+    ComPtr<ID3D11Buffer> activeLongRangeConstraintsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> activeLongRangeConstraintsUAV;
+    ComPtr<ID3D11ShaderResourceView> activeLongRangeConstraintsSRV;
+    ComPtr<ID3D11Buffer> activeCountsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> activeCountsUAV;
+    ComPtr<ID3D11ShaderResourceView> activeCountsSRV;
+    ComPtr<ID3D11Buffer> dispatchArgsBuffer;
+    ComPtr<ID3D11UnorderedAccessView> dispatchArgsUAV;
+    // Passed-in resources
+    ComPtr<ID3D11UnorderedAccessView> particlesUAV;
+    ComPtr<ID3D11UnorderedAccessView> oldParticlesUAV;
+    ComPtr<ID3D11UnorderedAccessView> voxelActivityUAV;
+    ComPtr<ID3D11ShaderResourceView> isDraggingSRV;
+    std::array<ComPtr<ID3D11UnorderedAccessView>, 3> faceConstraintIndicesUAVs;
+    ComPtr<ID3D11UnorderedAccessView> longRangeParticleIndicesUAV;
+    std::array<ComPtr<ID3D11ShaderResourceView>, 3> liveFaceConstraintsSRVs;
+    ComPtr<ID3D11ShaderResourceView> liveLongRangeConstraintsSRV;
+    ComPtr<ID3D11ShaderResourceView> liveCountsSRV;
+    ComPtr<ID3D11Buffer> liveDispatchArgsBuffer;
+
+    void bind() override
+    {
+        ID3D11ShaderResourceView* srvs[] = { isDraggingSRV.Get(), passLiveConstraintsSRV.Get(), liveCountsSRV.Get() };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+        ID3D11UnorderedAccessView* uavs[] = {
+            passUAVs[0].Get(), voxelActivityUAV.Get(), passUAVs[1].Get(), activeCountsUAV.Get(), passUAVs[2].Get(), passUAVs[3].Get()
+        };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+
+        ID3D11Buffer* cbvs[] = { activityCB.Get(), passCB.Get() };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    };
+
+    void unbind() override
+    {
+        ID3D11ShaderResourceView* srvs[] = { nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+
+        ID3D11UnorderedAccessView* uavs[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+        DirectX::getContext()->CSSetUnorderedAccessViews(0, ARRAYSIZE(uavs), uavs, nullptr);
+
+        ID3D11Buffer* cbvs[] = { nullptr, nullptr };
+        DirectX::getContext()->CSSetConstantBuffers(0, ARRAYSIZE(cbvs), cbvs);
+    };
+
+    void initializeBuffers(uint numParticles, float particleRadius, const std::array<FaceConstraints, 3>& faceConstraints, const std::array<uint, LONG_RANGE_LEVELS + 1>& longRangeLevelOffsets) {
+        uint numVoxels = numParticles / 8;
+        numVoxelWorkgroups = Utils::divideRoundUp(numVoxels, VGS_THREADS);
+        uint numLongRangeConstraints = longRangeLevelOffsets[LONG_RANGE_LEVELS];
+
+        activityConstants.sleepDisplacementSq = 0.0f;
+        activityConstants.wakeDisplacementSq = 0.0f;
+        activityConstants.sleepStrain = 0.0f;
+        activityConstants.particleRadius = particleRadius;
+        activityConstants.numVoxels = numVoxels;
+        activityConstants.sleepDelay = 0;
+        activityConstants.sleepingEnabled = 0;
+        activityCB = DirectX::createConstantBuffer(activityConstants);
+
+        // Worklists are sized for the worst case (everything awake). Sizes are padded to at least one element, since D3D11 doesn't allow empty buffers.
+        activeVoxelsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(std::max(numVoxels, 1u), 0));
+        activeVoxelsUAV = DirectX::createUAV(activeVoxelsBuffer);
+        activeVoxelsSRV = DirectX::createSRV(activeVoxelsBuffer);
+
+        for (int i = 0; i < 3; i++) {
+            uint numConstraints = faceConstraints[i].size();
+            activeFaceConstraintsBuffers[i] = DirectX::createReadWriteBuffer(std::vector<uint>(std::max(numConstraints, 1u), 0));
+            activeFaceConstraintsUAVs[i] = DirectX::createUAV(activeFaceConstraintsBuffers[i]);
+            activeFaceConstraintsSRVs[i] = DirectX::createSRV(activeFaceConstraintsBuffers[i]);
+            activeConstraintsCBs[i] = DirectX::createConstantBuffer<ActiveConstraintsCB>({ numConstraints, static_cast<uint>(ACTIVE_FACE_CONSTRAINTS_SLOT + i), 0, static_cast<uint>(LIVE_FACE_CONSTRAINTS_SLOT + i) });
+        }
+
+        activeLongRangeConstraintsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(std::max(numLongRangeConstraints, 1u), 0));
+        activeLongRangeConstraintsUAV = DirectX::createUAV(activeLongRangeConstraintsBuffer);
+        activeLongRangeConstraintsSRV = DirectX::createSRV(activeLongRangeConstraintsBuffer);
+        // Each level's active constraints are compacted into the same range its constraints occupy in the long-range constraint buffer.
+        for (int level = 0; level < LONG_RANGE_LEVELS; level++) {
+            uint firstConstraint = longRangeLevelOffsets[level];
+            uint numLevelConstraints = longRangeLevelOffsets[level + 1] - firstConstraint;
+            activeLongRangeConstraintsCBs[level] = DirectX::createConstantBuffer<ActiveConstraintsCB>({ numLevelConstraints, static_cast<uint>(ACTIVE_LONG_RANGE_CONSTRAINTS_SLOT + level), firstConstraint, static_cast<uint>(LIVE_LONG_RANGE_CONSTRAINTS_SLOT + level) });
+        }
+
+        activeCountsBuffer = DirectX::createReadWriteBuffer(std::vector<uint>(NUM_ACTIVE_SLOTS, 0));
+        activeCountsUAV = DirectX::createUAV(activeCountsBuffer);
+        activeCountsSRV = DirectX::createSRV(activeCountsBuffer);
+
+        dispatchArgsBuffer = DirectX::createIndirectArgsBuffer(NUM_ARGS_SLOTS);
+        dispatchArgsUAV = DirectX::createUAV(dispatchArgsBuffer, NUM_ARGS_SLOTS * 3, 0, DXGI_FORMAT_R32_UINT);
+    }
+};
@@ -99,6 +99,30 @@ public:
         return buffer;   
     }
 
+    /**
+     * Creates a typed (R32_UINT) buffer of (x, y, z) thread group counts, one triple per dispatch, that compute shaders
+     * can write into and that can be passed to DispatchIndirect. Each triple is initialized to (0, 1, 1).
+     */
+    static ComPtr<ID3D11Buffer> createIndirectArgsBuffer(UINT numDispatches) {
+        std::vector<UINT> initialArgs(numDispatches * 3, 1);
+        for (UINT i = 0; i < numDispatches; ++i) initialArgs[i * 3] = 0;
+
+        D3D11_BUFFER_DESC bufferDesc = {};
+        bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+        bufferDesc.ByteWidth = static_cast<UINT>(sizeof(UINT) * initialArgs.size());
+        bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+        bufferDesc.CPUAccessFlags = 0;
+        bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+
+        D3D11_SUBRESOURCE_DATA initData = {};
+        initData.pSysMem = initialArgs.data();
+
+        ComPtr<ID3D11Buffer> buffer;
+        HRESULT hr = dxDevice->CreateBuffer(&bufferDesc, &initData, buffer.GetAddressOf());
+        notifyMayaOfMemoryUsage(buffer, true);
+        return buffer;
+    }
+
     static ComPtr<ID3D11ShaderResourceView> createSRV(
         const ComPtr<ID3D11Buffer>& buffer,
         UINT elementCount = 0,
@@ -258,12 +282,74 @@ public:
         dxContext->Unmap(staging.Get(), 0);
     }
 
+    /**
+     * Creates a CPU-readable staging copy of the given buffer's description. Pair with CopyResource and tryReadStagingBuffer
+     * to read results back a frame later without stalling the pipeline (unlike copyBufferToVector).
+     */
+    static ComPtr<ID3D11Buffer> createStagingBuffer(const ComPtr<ID3D11Buffer>& buffer) {
+        D3D11_BUFFER_DESC desc;
+        buffer->GetDesc(&desc);
+
+        D3D11_BUFFER_DESC stagingDesc = {};
+        stagingDesc.Usage = D3D11_USAGE_STAGING;
+        stagingDesc.ByteWidth = desc.ByteWidth;
+        stagingDesc.BindFlags = 0;
+        stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        stagingDesc.MiscFlags = 0;
+        stagingDesc.StructureByteStride = desc.StructureByteStride;
+
+        ComPtr<ID3D11Buffer> staging;
+        HRESULT hr = dxDevice->CreateBuffer(&stagingDesc, nullptr, staging.GetAddressOf());
+        return staging;
+    }
+
+    /**
+     * Reads a staging buffer if the GPU has finished writing to it. Returns false (and leaves outData untouched) otherwise.
+     */
+    template<typename T>
+    static bool tryReadStagingBuffer(
+        const ComPtr<ID3D11Buffer>& staging,
+        std::vector<T>& outData
+    ) {
+        D3D11_BUFFER_DESC desc;
+        staging->GetDesc(&desc);
+
+        D3D11_MAPPED_SUBRESOURCE mapped = {};
+        HRESULT hr = dxContext->Map(staging.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+        if (FAILED(hr)) return false;
+
+        outData.resize(desc.ByteWidth / sizeof(T));
+        memcpy(outData.data(), mapped.pData, desc.ByteWidth);
+        dxContext->Unmap(staging.Get(), 0);
+        return true;
+    }
+
+    /**
+     * Reads a staging buffer, waiting for the GPU to finish writing to it if need be.
+     */
+    template<typename T>
+    static void readStagingBuffer(
+        const ComPtr<ID3D11Buffer>& staging,
+        std::vector<T>& outData
+    ) {
+        D3D11_BUFFER_DESC desc;
+        staging->GetDesc(&desc);
+
+        D3D11_MAPPED_SUBRESOURCE mapped = {};
+        HRESULT hr = dxContext->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped);
+        if (FAILED(hr)) return;
+
+        outData.resize(desc.ByteWidth / sizeof(T));
+        memcpy(outData.data(), mapped.pData, desc.ByteWidth);
+        dxContext->Unmap(staging.Get(), 0);
+    }
+
     /*
-    * Clears a UINT buffer with the value 0.
+    * Clears a UINT buffer with the given value (0 by default).
     */
-    static void clearUintBuffer(const ComPtr<ID3D11UnorderedAccessView>& uav) {
+    static void clearUintBuffer(const ComPtr<ID3D11UnorderedAccessView>& uav, UINT value = 0) {
         // See docs: 4 values are required even though only the first will be used, in our case.
-        UINT clearValues[4] = { 0, 0, 0, 0 };
+        UINT clearValues[4] = { value, value, value, value };
         DirectX::getContext()->ClearUnorderedAccessViewUint(uav.Get(), clearValues);
     }
 
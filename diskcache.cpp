@@ -0,0 +1,428 @@
+#include "diskcache.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    constexpr char FILE_MAGIC[8] = { 'C', 'U', 'B', 'I', 'T', 'S', 'I', 'M' };
+    constexpr uint32_t FILE_VERSION = 1;
+    constexpr uint32_t CHUNK_MAGIC = 0x4B4E4843; // "CHNK"
+    // Smaller files aren't worth rewriting, however much of them is dead space.
+    constexpr uint64_t MIN_COMPACT_BYTES = 16ull * 1024ull * 1024ull;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t numBuffers;
+        uint64_t key;
+    };
+
+    // Followed by numBuffers payload sizes (uint64_t), then the payloads themselves.
+    struct ChunkHeader {
+        uint32_t magic;
+        uint32_t numBuffers;    // 0 for a tombstone
+        double frame;
+    };
+
+    bool readAt(HANDLE file, uint64_t offset, void* data, DWORD size) {
+        LARGE_INTEGER position;
+        position.QuadPart = static_cast<LONGLONG>(offset);
+        DWORD bytesRead = 0;
+        return SetFilePointerEx(file, position, nullptr, FILE_BEGIN) && ReadFile(file, data, size, &bytesRead, nullptr) && bytesRead == size;
+    }
+
+    bool writeAll(HANDLE file, const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+            DWORD toWrite = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+            DWORD written = 0;
+            if (!WriteFile(file, bytes, toWrite, &written, nullptr) || written != toWrite) return false;
+            bytes += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    uint64_t getChunkSize(uint32_t numBuffers, uint64_t payloadBytes) {
+        return sizeof(ChunkHeader) + numBuffers * sizeof(uint64_t) + payloadBytes;
+    }
+}
+
+DiskCache::DiskCache(const std::wstring& path, uint64_t key, uint32_t numBuffers, uint64_t maxBytes)
+    : path(path), key(key), numBuffers(numBuffers), maxBytes(maxBytes)
+{
+    file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+
+    if (!loadIndex()) {
+        index.clear();
+        LARGE_INTEGER start = {};
+        if (!SetFilePointerEx(file, start, nullptr, FILE_BEGIN) || !SetEndOfFile(file) || !writeHeader(file)) {
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+            return;
+        }
+        fileSize = sizeof(FileHeader);
+        liveBytes = fileSize;
+    } else if (shouldCompact()) {
+        compact(); // (Before the writer starts, so there's nothing to wait for.)
+        if (!isOpen()) return;
+    }
+
+    writer = std::thread(&DiskCache::writeLoop, this);
+}
+
+DiskCache::~DiskCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_one();
+    if (writer.joinable()) writer.join();
+
+    unmap();
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+/**
+ * Rebuilds the index from the chunk headers of an existing file. A chunk cut short (e.g. Maya closed mid-write) ends the file there.
+ * Returns false if the file is new, or was written for a different key.
+ */
+bool DiskCache::loadIndex() {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) return false;
+    const uint64_t totalSize = static_cast<uint64_t>(size.QuadPart);
+
+    FileHeader header;
+    if (totalSize < sizeof(header) || !readAt(file, 0, &header, sizeof(header))) return false;
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header.version != FILE_VERSION
+        || header.numBuffers != numBuffers || header.key != key) {
+        return false;
+    }
+
+    uint64_t position = sizeof(header);
+    std::vector<uint64_t> sizes;
+    while (position + sizeof(ChunkHeader) <= totalSize) {
+        ChunkHeader chunk;
+        if (!readAt(file, position, &chunk, sizeof(chunk)) || chunk.magic != CHUNK_MAGIC) break;
+        if (chunk.numBuffers != 0 && chunk.numBuffers != numBuffers) break;
+
+        sizes.resize(chunk.numBuffers);
+        const DWORD sizesBytes = static_cast<DWORD>(sizes.size() * sizeof(uint64_t));
+        if (sizesBytes > 0 && !readAt(file, position + sizeof(chunk), sizes.data(), sizesBytes)) break;
+
+        uint64_t payloadBytes = 0;
+        for (uint64_t payloadSize : sizes) payloadBytes += payloadSize;
+        const uint64_t chunkSize = getChunkSize(chunk.numBuffers, payloadBytes);
+        if (position + chunkSize > totalSize) break;
+
+        if (chunk.numBuffers == 0) {
+            index.erase(chunk.frame);
+        } else {
+            index[chunk.frame] = { position + sizeof(chunk) + sizesBytes, sizes };
+        }
+        position += chunkSize;
+    }
+
+    if (position < totalSize) {
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(position);
+        SetFilePointerEx(file, end, nullptr, FILE_BEGIN);
+        SetEndOfFile(file);
+    }
+    fileSize = position;
+    liveBytes = sizeof(header);
+    for (const auto& [frame, entry] : index) liveBytes += getLiveChunkSize(frame);
+    return true;
+}
+
+bool DiskCache::writeHeader(HANDLE target) {
+    FileHeader header = {};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FILE_VERSION;
+    header.numBuffers = numBuffers;
+    header.key = key;
+    return writeAll(target, &header, sizeof(header));
+}
+
+// The size of the chunk a frame is (or will be, once written) read from, or 0 if it isn't on disk.
+uint64_t DiskCache::getLiveChunkSize(double frame) {
+    auto pendingIt = pendingWrites.find(frame);
+    if (pendingIt != pendingWrites.end()) return pendingIt->second.payloads ? pendingIt->second.chunkSize : 0;
+
+    auto entryIt = index.find(frame);
+    if (entryIt == index.end()) return 0;
+    uint64_t payloadBytes = 0;
+    for (uint64_t size : entryIt->second.sizes) payloadBytes += size;
+    return getChunkSize(numBuffers, payloadBytes);
+}
+
+bool DiskCache::shouldCompact() const {
+    const uint64_t deadBytes = fileSize - liveBytes;
+    return deadBytes >= MIN_COMPACT_BYTES && deadBytes * 4 >= fileSize;
+}
+
+/**
+ * Rewrites the file with only its live chunks, in frame order. They're copied to a temporary file first, which then replaces this one,
+ * so if anything fails part way, the old file is still intact (and still used). Blocks until every queued write is done.
+ */
+void DiskCache::compact() {
+    waitUntilIdle();
+    collectCompletedJobs();
+    unmap();
+
+    const std::wstring tempPath = path + L".tmp";
+    HANDLE tempFile = CreateFileW(tempPath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (tempFile == INVALID_HANDLE_VALUE) return;
+
+    bool written = writeHeader(tempFile);
+    uint64_t position = sizeof(FileHeader);
+    std::map<double, Entry> compactedIndex;
+    std::vector<uint8_t> payloads;
+    for (const auto& [frame, entry] : index) {
+        uint64_t payloadBytes = 0;
+        for (uint64_t size : entry.sizes) payloadBytes += size;
+        payloads.resize(payloadBytes);
+
+        ChunkHeader chunk = { CHUNK_MAGIC, numBuffers, frame };
+        written = written
+            && writeAll(tempFile, &chunk, sizeof(chunk))
+            && writeAll(tempFile, entry.sizes.data(), entry.sizes.size() * sizeof(uint64_t))
+            && readAt(file, entry.offset, payloads.data(), static_cast<DWORD>(payloadBytes))
+            && writeAll(tempFile, payloads.data(), payloads.size());
+        if (!written) break;
+
+        compactedIndex[frame] = { position + sizeof(chunk) + entry.sizes.size() * sizeof(uint64_t), entry.sizes };
+        position += getChunkSize(numBuffers, payloadBytes);
+    }
+    CloseHandle(tempFile);
+    if (!written) {
+        DeleteFileW(tempPath.c_str());
+        return;
+    }
+
+    // The file has to be closed to be replaced. If it can't be, it's reopened as it was.
+    CloseHandle(file);
+    if (MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        index.swap(compactedIndex);
+        fileSize = position;
+        liveBytes = position;
+    } else {
+        DeleteFileW(tempPath.c_str());
+    }
+
+    file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        index.clear();
+        fileSize = 0;
+        liveBytes = 0;
+    }
+}
+
+void DiskCache::waitUntilIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return jobs.empty() && !writing; });
+}
+
+// Once this returns, the writer thread is done changing the pending write's payloads (it only reads them from then on).
+void DiskCache::waitUntilEncoded(PendingWrite& pendingWrite) {
+    if (!pendingWrite.encoding) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    encoded.wait(lock, [&] { return encodedThrough > pendingWrite.sequence; });
+    pendingWrite.encoding = false;
+}
+
+bool DiskCache::write(double frame, Payloads&& payloads, Encoder encoder) {
+    if (!isOpen() || payloads.size() != numBuffers) return false;
+
+    uint64_t payloadBytes = 0;
+    for (const auto& payload : payloads) payloadBytes += payload.size();
+    const uint64_t chunkSize = getChunkSize(numBuffers, payloadBytes);
+    if (shouldCompact()) {
+        compact();
+        if (!isOpen()) return false;
+    }
+
+    const uint64_t replacedChunkSize = getLiveChunkSize(frame);
+    if (liveBytes - replacedChunkSize + chunkSize > maxBytes) return false;
+    fileSize += chunkSize;
+    liveBytes += chunkSize - replacedChunkSize;
+
+    const bool encoding = static_cast<bool>(encoder);
+    WriteJob job = { frame, nextSequence++, std::make_shared<Payloads>(std::move(payloads)), std::move(encoder), chunkSize };
+    pendingWrites[frame] = { job.sequence, job.payloads, chunkSize, encoding };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobAvailable.notify_one();
+    return true;
+}
+
+void DiskCache::erase(double frame) {
+    if (!contains(frame)) return;
+
+    liveBytes -= getLiveChunkSize(frame);
+    index.erase(frame);
+    const uint64_t chunkSize = getChunkSize(0, 0);
+    fileSize += chunkSize;
+    WriteJob job = { frame, nextSequence++, nullptr, nullptr, chunkSize };
+    pendingWrites[frame] = { job.sequence, nullptr, chunkSize, false };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+bool DiskCache::contains(double frame) {
+    collectCompletedJobs();
+    auto pendingIt = pendingWrites.find(frame);
+    if (pendingIt != pendingWrites.end()) return pendingIt->second.payloads != nullptr;
+    return index.find(frame) != index.end();
+}
+
+std::vector<double> DiskCache::getFrames() {
+    collectCompletedJobs();
+    std::vector<double> frames;
+    for (const auto& [frame, entry] : index) {
+        if (pendingWrites.find(frame) == pendingWrites.end()) frames.push_back(frame);
+    }
+    for (const auto& [frame, pendingWrite] : pendingWrites) {
+        if (pendingWrite.payloads) frames.push_back(frame);
+    }
+    std::sort(frames.begin(), frames.end());
+    return frames;
+}
+
+void DiskCache::prefetch(double frame, int numFrames) {
+    collectCompletedJobs();
+    std::vector<WIN32_MEMORY_RANGE_ENTRY> ranges;
+    uint64_t end = 0;
+    for (auto it = index.upper_bound(frame); it != index.end() && static_cast<int>(ranges.size()) < numFrames; ++it) {
+        uint64_t size = 0;
+        for (uint64_t payloadSize : it->second.sizes) size += payloadSize;
+        ranges.push_back({ reinterpret_cast<PVOID>(static_cast<uintptr_t>(it->second.offset)), static_cast<SIZE_T>(size) });
+        end = std::max<uint64_t>(end, it->second.offset + size);
+    }
+    if (ranges.empty() || !ensureMapped(end)) return;
+
+    // Offsets to addresses, now that the view is mapped.
+    for (auto& range : ranges) {
+        range.VirtualAddress = const_cast<uint8_t*>(mappedView) + reinterpret_cast<uintptr_t>(range.VirtualAddress);
+    }
+    PrefetchVirtualMemory(GetCurrentProcess(), ranges.size(), ranges.data(), 0);
+}
+
+uint64_t DiskCache::hash(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t result = seed;
+    for (size_t i = 0; i < size; ++i) {
+        result ^= bytes[i];
+        result *= 1099511628211ull;
+    }
+    return result;
+}
+
+void DiskCache::writeLoop() {
+    while (true) {
+        WriteJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return; // Only stop once everything queued is written
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            writing = true;
+        }
+
+        if (job.encoder) {
+            job.encoder(*job.payloads);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                encodedThrough = job.sequence + 1;
+            }
+            encoded.notify_all();
+        }
+
+        const uint32_t jobBuffers = job.payloads ? static_cast<uint32_t>(job.payloads->size()) : 0;
+        ChunkHeader chunk = { CHUNK_MAGIC, jobBuffers, job.frame };
+        Entry entry = { 0, std::vector<uint64_t>(jobBuffers) };
+        for (uint32_t i = 0; i < jobBuffers; ++i) entry.sizes[i] = (*job.payloads)[i].size();
+
+        LARGE_INTEGER position = {};
+        LARGE_INTEGER zero = {};
+        bool written = SetFilePointerEx(file, zero, &position, FILE_END)
+            && writeAll(file, &chunk, sizeof(chunk))
+            && writeAll(file, entry.sizes.data(), entry.sizes.size() * sizeof(uint64_t));
+        for (uint32_t i = 0; written && i < jobBuffers; ++i) {
+            written = writeAll(file, (*job.payloads)[i].data(), (*job.payloads)[i].size());
+        }
+        entry.offset = static_cast<uint64_t>(position.QuadPart) + sizeof(chunk) + entry.sizes.size() * sizeof(uint64_t);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            completedJobs.push_back({ std::move(job), written ? std::move(entry) : Entry{} });
+            writing = false;
+        }
+        idle.notify_all();
+    }
+}
+
+// Moves finished writes into the index. Writes superseded (by a later write or erase of the same frame) while in flight are dropped.
+void DiskCache::collectCompletedJobs() {
+    std::vector<std::pair<WriteJob, Entry>> completed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        completed.swap(completedJobs);
+    }
+
+    for (auto& [job, entry] : completed) {
+        // Encoded frames were counted at their size before encoding. Now that they're written, count what they actually took.
+        uint64_t writtenChunkSize = job.chunkSize;
+        if (!entry.sizes.empty()) {
+            uint64_t payloadBytes = 0;
+            for (uint64_t size : entry.sizes) payloadBytes += size;
+            writtenChunkSize = getChunkSize(numBuffers, payloadBytes);
+        }
+        fileSize = fileSize - job.chunkSize + writtenChunkSize;
+
+        auto pendingIt = pendingWrites.find(job.frame);
+        if (pendingIt == pendingWrites.end() || pendingIt->second.sequence != job.sequence) continue;
+        pendingWrites.erase(pendingIt);
+
+        // A failed write (entry without sizes) is just lost, like any other frame that didn't fit.
+        if (job.payloads && !entry.sizes.empty()) {
+            liveBytes = liveBytes - job.chunkSize + writtenChunkSize;
+            index[job.frame] = std::move(entry);
+        } else {
+            if (job.payloads) liveBytes -= job.chunkSize;
+            index.erase(job.frame);
+        }
+    }
+}
+
+bool DiskCache::ensureMapped(uint64_t size) {
+    if (mappedView && size <= mappedSize) return true;
+
+    unmap();
+    LARGE_INTEGER currentSize;
+    if (!GetFileSizeEx(file, &currentSize) || static_cast<uint64_t>(currentSize.QuadPart) < size) return false;
+
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) return false;
+    mappedView = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!mappedView) {
+        unmap();
+        return false;
+    }
+    mappedSize = static_cast<uint64_t>(currentSize.QuadPart);
+    return true;
+}
+
+void DiskCache::unmap() {
+    if (mappedView) UnmapViewOfFile(mappedView);
+    if (mapping) CloseHandle(mapping);
+    mappedView = nullptr;
+    mapping = nullptr;
+    mappedSize = 0;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+/**
+ * Second tier of the simulation cache: frames evicted from memory are appended to a file on disk, and read back through a memory mapping.
+ *
+ * The file is a header (with the key it was written for) followed by self-describing chunks, one per frame: the frame number, the size of each
+ * buffer's payload, then the payloads. Opening an existing file scans the chunk headers to rebuild the index, so a cache written in one session
+ * can be used in the next, as long as the key still matches. A later chunk for the same frame replaces an earlier one, and a chunk with no
+ * buffers (a tombstone) erases it. Nothing is ever rewritten in place.
+ *
+ * Replaced chunks and tombstones are dead space. Only live chunks count against the max size, and once dead space makes up a quarter of the file
+ * (see shouldCompact), the file is compacted: its live chunks are copied to a new file, which then replaces it. That's also checked on opening.
+ *
+ * Writes happen on a background thread. Frames still waiting to be written are read from memory until they're done. A write can also leave
+ * encoding its payloads to that thread (see write).
+ * Payloads are opaque here (SimulationCache encodes them with CacheCodec, and identifies buffers by their position in the chunk).
+ */
+class DiskCache {
+
+public:
+    using Payloads = std::vector<std::vector<uint8_t>>;
+    // Turns a frame's payloads into what's written, in place. Runs on the writer thread.
+    using Encoder = std::function<void(Payloads&)>;
+
+    // Opens (or creates) the file at path. Any existing contents written with a different key or number of buffers are discarded.
+    // maxBytes caps the live chunks; with dead space, the file can run up to a third (or 16 MB) larger before it's compacted.
+    DiskCache(const std::wstring& path, uint64_t key, uint32_t numBuffers, uint64_t maxBytes);
+    // Waits for pending writes to finish.
+    ~DiskCache();
+
+    DiskCache(const DiskCache&) = delete;
+    DiskCache& operator=(const DiskCache&) = delete;
+
+    bool isOpen() const { return file != INVALID_HANDLE_VALUE; }
+    uint64_t getKey() const { return key; }
+    uint64_t getFileSize() const { return fileSize; }
+    uint64_t getLiveBytes() const { return liveBytes; }
+
+    // Queues a frame to be written. Returns false (and writes nothing) if it would grow the live chunks past the max size.
+    // With an encoder, that's checked against the payloads as given (the size written is counted once it's known), and reading the frame
+    // before it's written waits for it to be encoded.
+    bool write(double frame, Payloads&& payloads, Encoder encoder = nullptr);
+    void erase(double frame);
+    bool contains(double frame);
+    std::vector<double> getFrames();
+
+    // Calls visitor(bufferIndex, data, size) for each of a frame's buffers. The data is only valid for the duration of the call.
+    // Returns false if the frame isn't on disk.
+    template<typename Visitor>
+    bool read(double frame, Visitor&& visitor);
+
+    // Hints the OS to start reading the next few frames after this one, so they're (likely) in memory by the time playback gets there.
+    void prefetch(double frame, int numFrames);
+
+    // 64-bit FNV-1a, for building keys.
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+private:
+    struct Entry {
+        uint64_t offset;              // Of the first payload
+        std::vector<uint64_t> sizes;
+    };
+
+    struct WriteJob {
+        double frame;
+        uint64_t sequence;
+        std::shared_ptr<Payloads> payloads; // Empty for a tombstone
+        Encoder encoder;
+        uint64_t chunkSize;                 // As counted in fileSize (before encoding)
+    };
+
+    struct PendingWrite {
+        uint64_t sequence;
+        std::shared_ptr<const Payloads> payloads;
+        uint64_t chunkSize;                 // As counted in liveBytes
+        bool encoding;                      // The writer thread may still be encoding the payloads, so they can't be read yet
+    };
+
+    std::wstring path;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    const uint8_t* mappedView = nullptr;
+    uint64_t mappedSize = 0;
+    uint64_t key;
+    uint32_t numBuffers;
+    uint64_t maxBytes;
+    uint64_t fileSize = 0;      // Including queued writes
+    uint64_t liveBytes = 0;     // The part of fileSize that isn't dead space (the header, and the latest chunk of each frame on disk)
+
+    // Only touched on the main thread
+    std::map<double, Entry> index;
+    std::map<double, PendingWrite> pendingWrites;
+    uint64_t nextSequence = 0;
+
+    // Shared with the writer thread
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable idle;
+    std::condition_variable encoded;
+    std::deque<WriteJob> jobs;
+    std::vector<std::pair<WriteJob, Entry>> completedJobs;
+    uint64_t encodedThrough = 0;    // Every job before this sequence number has been encoded
+    bool writing = false;
+    bool stopping = false;
+    std::thread writer;
+
+    bool loadIndex();
+    bool writeHeader(HANDLE target);
+    uint64_t getLiveChunkSize(double frame);
+    bool shouldCompact() const;
+    void compact();
+    void waitUntilIdle();
+    void waitUntilEncoded(PendingWrite& pendingWrite);
+    void writeLoop();
+    void collectCompletedJobs();
+    bool ensureMapped(uint64_t size);
+    void unmap();
+};
+
+template<typename Visitor>
+bool DiskCache::read(double frame, Visitor&& visitor) {
+    auto pendingIt = pendingWrites.find(frame);
+    if (pendingIt != pendingWrites.end()) {
+        if (!pendingIt->second.payloads) return false;
+        waitUntilEncoded(pendingIt->second);
+        if (pendingIt->second.payloads->empty()) return false;
+
+        const Payloads& payloads = *pendingIt->second.payloads;
+        for (size_t i = 0; i < payloads.size(); ++i) {
+            visitor(static_cast<uint32_t>(i), payloads[i].data(), payloads[i].size());
+        }
+        return true;
+    }
+
+    collectCompletedJobs();
+    auto entryIt = index.find(frame);
+    if (entryIt == index.end()) return false;
+
+    const Entry& entry = entryIt->second;
+    uint64_t end = entry.offset;
+    for (uint64_t size : entry.sizes) end += size;
+    if (!ensureMapped(end)) return false;
+
+    uint64_t offset = entry.offset;
+    for (size_t i = 0; i < entry.sizes.size(); ++i) {
+        visitor(static_cast<uint32_t>(i), mappedView + offset, static_cast<size_t>(entry.sizes[i]));
+        offset += entry.sizes[i];
+    }
+    return true;
+}
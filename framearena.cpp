@@ -0,0 +1,125 @@
+#include "framearena.h"
+#include <algorithm>
+#include <cstring>
+
+void FrameArena::reset(uint64_t blockSize, uint32_t blocksPerChunk) {
+    this->blockSize = blockSize;
+    this->blocksPerChunk = blocksPerChunk;
+    chunks.clear();
+    nextBlock.clear();
+    refCounts.clear();
+    freeList = noBlock;
+    numFreeBlocks = 0;
+    numUsedBlocks = 0;
+}
+
+void FrameArena::setMaxBytes(uint64_t maxBytes) {
+    maxBlocks = (blockSize > 0) ? std::min<uint64_t>(maxBytes / blockSize, noBlock - 1) : 0;
+}
+
+// Adds a chunk's worth of blocks to the free list, unless that would go past the max size.
+bool FrameArena::grow() {
+    const uint64_t firstBlock = nextBlock.size();
+    if (blocksPerChunk == 0 || firstBlock + blocksPerChunk > maxBlocks) return false;
+
+    chunks.push_back(std::make_unique<uint8_t[]>(blocksPerChunk * blockSize));
+    nextBlock.resize(firstBlock + blocksPerChunk);
+    refCounts.resize(firstBlock + blocksPerChunk);
+    for (uint32_t i = 0; i < blocksPerChunk; ++i) {
+        const uint32_t block = static_cast<uint32_t>(firstBlock) + i;
+        nextBlock[block] = (i + 1 < blocksPerChunk) ? block + 1 : freeList;
+    }
+    freeList = static_cast<uint32_t>(firstBlock);
+    numFreeBlocks += blocksPerChunk;
+    return true;
+}
+
+bool FrameArena::canAllocate(uint64_t numBlocks) const {
+    // Blocks freed after the max size was lowered aren't handed out again, so the arena drains back under it.
+    if (numUsedBlocks + numBlocks > maxBlocks) return false;
+
+    const uint64_t reservedBlocks = nextBlock.size();
+    const uint64_t growableBlocks = (blocksPerChunk > 0 && maxBlocks > reservedBlocks) ? (maxBlocks - reservedBlocks) / blocksPerChunk * blocksPerChunk : 0;
+    return numFreeBlocks + growableBlocks >= numBlocks;
+}
+
+uint32_t FrameArena::allocate(uint64_t size) {
+    const uint64_t numBlocks = getNumBlocks(size);
+    if (!canAllocate(numBlocks)) return noBlock;
+    while (numFreeBlocks < numBlocks) {
+        if (!grow()) return noBlock;
+    }
+
+    // Unlink the first numBlocks blocks of the free list, which then already form the chain.
+    const uint32_t firstBlock = freeList;
+    uint32_t lastBlock = firstBlock;
+    for (uint64_t i = 1; i < numBlocks; ++i) {
+        lastBlock = nextBlock[lastBlock];
+    }
+    freeList = nextBlock[lastBlock];
+    nextBlock[lastBlock] = noBlock;
+
+    numFreeBlocks -= static_cast<uint32_t>(numBlocks);
+    numUsedBlocks += static_cast<uint32_t>(numBlocks);
+    refCounts[firstBlock] = 1;
+    return firstBlock;
+}
+
+void FrameArena::retain(uint32_t firstBlock) {
+    if (firstBlock != noBlock) ++refCounts[firstBlock];
+}
+
+void FrameArena::release(uint32_t firstBlock) {
+    if (firstBlock == noBlock || --refCounts[firstBlock] > 0) return;
+
+    uint32_t lastBlock = firstBlock;
+    uint32_t numBlocks = 1;
+    while (nextBlock[lastBlock] != noBlock) {
+        lastBlock = nextBlock[lastBlock];
+        ++numBlocks;
+    }
+    nextBlock[lastBlock] = freeList;
+    freeList = firstBlock;
+
+    numFreeBlocks += numBlocks;
+    numUsedBlocks -= numBlocks;
+}
+
+void FrameArena::write(Cursor& cursor, const void* data, uint64_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        if (cursor.offset == blockSize) cursor = { nextBlock[cursor.block], 0 };
+
+        const uint64_t toWrite = std::min<uint64_t>(size, blockSize - cursor.offset);
+        std::memcpy(getBlockData(cursor.block) + cursor.offset, bytes, toWrite);
+        cursor.offset += toWrite;
+        bytes += toWrite;
+        size -= toWrite;
+    }
+}
+
+void FrameArena::read(Cursor& cursor, void* data, uint64_t size) const {
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        if (cursor.offset == blockSize) cursor = { nextBlock[cursor.block], 0 };
+
+        const uint64_t toRead = std::min<uint64_t>(size, blockSize - cursor.offset);
+        std::memcpy(bytes, getBlockData(cursor.block) + cursor.offset, toRead);
+        cursor.offset += toRead;
+        bytes += toRead;
+        size -= toRead;
+    }
+}
+
+const uint8_t* FrameArena::view(Cursor& cursor, uint64_t size, std::vector<uint8_t>& scratch) const {
+    if (cursor.offset == blockSize && size > 0) cursor = { nextBlock[cursor.block], 0 };
+    if (cursor.offset + size <= blockSize) {
+        const uint8_t* data = getBlockData(cursor.block) + cursor.offset;
+        cursor.offset += size;
+        return data;
+    }
+
+    scratch.resize(size);
+    read(cursor, scratch.data(), size);
+    return scratch.data();
+}
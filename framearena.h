@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+/**
+ * Memory for SimulationCache's frames: a flat arena of fixed-size blocks, handed out in chains (one per stored buffer) and kept on a free list when not in use.
+ * Chains are reference counted, so frames whose buffers didn't change can share them.
+ *
+ * Stored buffers vary a lot in size (a compressed one is a fraction of a raw one), so rather than fixed slots, each takes as many blocks as it needs.
+ * The arena grows a chunk of blocks at a time, up to its max size, and only gives memory back when it's reset. Once it's full, storing a frame reuses
+ * the blocks of whichever frames were evicted to make room, without allocating.
+ *
+ * The arena doesn't know what's in a chain: it's written and read sequentially through a Cursor.
+ */
+class FrameArena {
+
+public:
+    static constexpr uint32_t noBlock = UINT32_MAX;
+
+    // A position within a chain of blocks.
+    struct Cursor {
+        uint32_t block;
+        uint64_t offset;    // Within the block
+    };
+
+    // Frees everything, and sets the block geometry for what's allocated from here on.
+    void reset(uint64_t blockSize, uint32_t blocksPerChunk);
+    void setMaxBytes(uint64_t maxBytes);
+
+    // Whether numBlocks more blocks would fit (see getNumBlocks).
+    bool canAllocate(uint64_t numBlocks) const;
+    // Returns the first block of a chain big enough for size bytes (with a reference count of one), or noBlock if the arena can't fit it.
+    uint32_t allocate(uint64_t size);
+    void retain(uint32_t firstBlock);
+    // Frees the chain once nothing references it any more.
+    void release(uint32_t firstBlock);
+
+    Cursor begin(uint32_t firstBlock) const { return { firstBlock, 0 }; }
+    void write(Cursor& cursor, const void* data, uint64_t size);
+    void read(Cursor& cursor, void* data, uint64_t size) const;
+    // Returns a pointer to the next size bytes. Reads within a block point straight into the arena; reads spanning blocks are gathered into scratch.
+    const uint8_t* view(Cursor& cursor, uint64_t size, std::vector<uint8_t>& scratch) const;
+
+    uint64_t getNumBlocks(uint64_t size) const { return (size > blockSize) ? (size + blockSize - 1) / blockSize : 1; }
+    uint64_t getBlockSize() const { return blockSize; }
+    uint64_t getUsedBytes() const { return static_cast<uint64_t>(numUsedBlocks) * blockSize; }
+    uint64_t getReservedBytes() const { return static_cast<uint64_t>(nextBlock.size()) * blockSize; }
+
+private:
+    uint64_t blockSize = 0;
+    uint32_t blocksPerChunk = 0;
+    uint64_t maxBlocks = 0;
+    std::vector<std::unique_ptr<uint8_t[]>> chunks;
+    // Per block: the next block in its chain (or in the free list). noBlock ends both.
+    std::vector<uint32_t> nextBlock;
+    // Per block, only kept for the first block of a chain
+    std::vector<uint32_t> refCounts;
+    uint32_t freeList = noBlock;
+    uint32_t numFreeBlocks = 0;
+    uint32_t numUsedBlocks = 0;
+
+    uint8_t* getBlockData(uint32_t block) const { return chunks[block / blocksPerChunk].get() + (block % blocksPerChunk) * blockSize; }
+    bool grow();
+};
@@ -1,16 +1,25 @@
 #include "globalsolver.h"
 #include <maya/MGlobal.h>
 #include <maya/MFnTypedAttribute.h>
+#include <maya/MFnIntArrayData.h>
+#include <maya/MIntArray.h>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MFnUnitAttribute.h>
+#include <maya/MFnEnumAttribute.h>
 #include <maya/MFnDependencyNode.h>
 #include <maya/MAnimControl.h>
+#include <maya/MEventMessage.h>
+#include <maya/MDGContext.h>
+#include <maya/MDGContextGuard.h>
 #include "custommayaconstructs/tools/voxeldragcontext.h"
 #include "custommayaconstructs/usernodes/colliderlocator.h"
+#include "custommayaconstructs/usernodes/pbdnode.h"
 #include "custommayaconstructs/data/particledata.h"
 #include "custommayaconstructs/data/functionaldata.h"
 #include "custommayaconstructs/data/colliderdata.h"
 #include "simulationcache.h"
+#include <algorithm>
+#include <chrono>
 
 const MTypeId GlobalSolver::id(0x0013A7B1);
 const MString GlobalSolver::globalSolverNodeName("GlobalSolver");
@@ -19,28 +28,55 @@ MObject GlobalSolver::aNumSubsteps = MObject::kNullObj;
 MObject GlobalSolver::aParticleCollisionsEnabled = MObject::kNullObj;
 MObject GlobalSolver::aPrimitiveCollisionsEnabled = MObject::kNullObj;
 MObject GlobalSolver::aParticleFriction = MObject::kNullObj;
+MObject GlobalSolver::aCollisionBroadphase = MObject::kNullObj;
+MObject GlobalSolver::aNeighborListSkin = MObject::kNullObj;
 MObject GlobalSolver::aCacheFrequency = MObject::kNullObj;
+MObject GlobalSolver::aCacheInterpolation = MObject::kNullObj;
 MObject GlobalSolver::aMaxCacheSize = MObject::kNullObj;
+MObject GlobalSolver::aCacheCompression = MObject::kNullObj;
+MObject GlobalSolver::aCachePrecision = MObject::kNullObj;
+MObject GlobalSolver::aCacheKeyframeInterval = MObject::kNullObj;
+MObject GlobalSolver::aDiskCache = MObject::kNullObj;
+MObject GlobalSolver::aMaxDiskCacheSize = MObject::kNullObj;
+MObject GlobalSolver::aBakeAhead = MObject::kNullObj;
+MObject GlobalSolver::aBakeAheadFrames = MObject::kNullObj;
 MObject GlobalSolver::aParticleData = MObject::kNullObj;
 MObject GlobalSolver::aColliderData = MObject::kNullObj;
 MObject GlobalSolver::aParticleBufferOffset = MObject::kNullObj;
 MObject GlobalSolver::aTime = MObject::kNullObj;
 MObject GlobalSolver::aTrigger = MObject::kNullObj;
+MObject GlobalSolver::aCollisionCandidatePairs = MObject::kNullObj;
+MObject GlobalSolver::aCollisionDuplicatePairs = MObject::kNullObj;
+MObject GlobalSolver::aCollisionOverflowParticles = MObject::kNullObj;
+MObject GlobalSolver::aCollisionOccupiedCells = MObject::kNullObj;
+MObject GlobalSolver::aCollisionNeighborPairs = MObject::kNullObj;
+MObject GlobalSolver::aCollisionNeighborRebuilds = MObject::kNullObj;
+MObject GlobalSolver::aCollisionCulledVoxels = MObject::kNullObj;
+MObject GlobalSolver::aCollisionGluedPairs = MObject::kNullObj;
+MObject GlobalSolver::aCollisionCellOccupancy = MObject::kNullObj;
 MObject GlobalSolver::aSimulateFunction = MObject::kNullObj;
 std::unordered_map<GlobalSolver::BufferType, ComPtr<ID3D11Buffer>> GlobalSolver::buffers;
 std::unordered_map<GlobalSolver::BufferType, SimulationCache::Registration> GlobalSolver::bufferCacheRegistrations;
 std::unordered_map<uint, std::function<void()>> GlobalSolver::pbdSimulateFuncs;
 ColliderBuffer GlobalSolver::colliderBuffer;
 std::unordered_set<int> GlobalSolver::dirtyColliderIndices;
+bool GlobalSolver::collidersEditedInPlace = false;
 MTime GlobalSolver::lastComputeTime = MTime();
 
 GlobalSolver::~GlobalSolver() {
     // As with other Maya nodes, preRemovalCallback is not always called (e.g. on a new scene load), so also do cleanup here.
     MMessage::removeCallbacks(callbackIds);
+    cancelBakeAhead();
     unsubscribeFromDragStateChange();
+    surfaceVoxelsCompute.reset();
+    collisionCullingCompute.reset();
     buildCollisionGridCompute.reset();
+    buildSortedCollisionGridCompute.reset();
     buildCollisionParticleCompute.reset();
+    solveCollisionsCompute.reset();
+    neighborPairsCompute.reset();
     dragParticlesCompute.reset();
+    solvePrimitiveCollisionsCompute.reset();
     prefixScanCompute.reset();
     tearDown();
 }
@@ -75,12 +111,15 @@ void GlobalSolver::postConstructor() {
     callbackIds.append(callbackId);
     callbackId = MNodeMessage::addAttributeChangedCallback(thisMObject(), onCacheSizeChange, this);
     callbackIds.append(callbackId);
+    callbackId = MNodeMessage::addAttributeChangedCallback(thisMObject(), onBakeAheadChange, this);
+    callbackIds.append(callbackId);
 
     // Effectively a destructor callback to clean up when the node is deleted
     // This is more reliable than a destructor, because Maya won't necessarily call destructors on node deletion (unless undo queue is flushed)
     callbackId = MNodeMessage::addNodePreRemovalCallback(thisMObject(), [](MObject& node, void* clientData) {
         GlobalSolver* globalSolver = static_cast<GlobalSolver*>(clientData);
         MMessage::removeCallbacks(globalSolver->callbackIds);
+        globalSolver->cancelBakeAhead();
         globalSolver->unsubscribeFromDragStateChange();
         tearDown();
     }, this);
@@ -97,6 +136,8 @@ void GlobalSolver::maybeDeleteGlobalSolver() {
 }
 
 void GlobalSolver::tearDown() {
+    // Before the buffers (and their cached frames) go away, so the cache can be picked up again next session.
+    SimulationCache::instance()->flushToDisk();
     pbdSimulateFuncs.clear();
     lastComputeTime = MTime();
     for (auto& buffer : buffers) {
@@ -109,6 +150,7 @@ void GlobalSolver::tearDown() {
     globalSolverNodeObject = MObject::kNullObj;
     colliderBuffer = ColliderBuffer();
     dirtyColliderIndices.clear();
+    collidersEditedInPlace = false;
     bufferCacheRegistrations.clear();
 
     SimulationCache::instance()->tearDown();
@@ -134,8 +176,14 @@ void GlobalSolver::onParticleDataConnectionChange(MNodeMessage::AttributeMessage
         deleteParticleData(plug);
     }
 
+    std::vector<uint> objectParticleOffsets;
+    for (const auto& [logicalIndex, offset] : offsetForLogicalPlug) {
+        objectParticleOffsets.push_back(static_cast<uint>(offset));
+    }
+    std::sort(objectParticleOffsets.begin(), objectParticleOffsets.end());
+
     GlobalSolver* globalSolver = static_cast<GlobalSolver*>(clientData);
-    globalSolver->createGlobalComputeShaders(maximumParticleRadius);
+    globalSolver->createGlobalComputeShaders(maximumParticleRadius, objectParticleOffsets);
 
     // Set these *after* creating buffers, because doing so triggers each PBD node to go make UAVs / SRVs.
     MPlug particleBufferOffsetArrayPlug(globalSolverObj, aParticleBufferOffset);
@@ -216,12 +264,21 @@ void GlobalSolver::addParticleData(MPlug& particleDataToAddPlug) {
     std::vector<Particle>* const particles = particleData.get()->getData().particles;
     DirectX::addToBuffer<Particle>(buffers[BufferType::PARTICLE], *particles);
     DirectX::addToBuffer<Particle>(buffers[BufferType::OLDPARTICLE], *particles);
-    bufferCacheRegistrations[BufferType::PARTICLE] = simulationCache->registerBuffer(buffers[BufferType::PARTICLE]);
-    bufferCacheRegistrations[BufferType::OLDPARTICLE] = simulationCache->registerBuffer(buffers[BufferType::OLDPARTICLE]);
+    bufferCacheRegistrations[BufferType::PARTICLE] = simulationCache->registerBuffer(buffers[BufferType::PARTICLE], "particles", CacheEncoding::Particles);
+    bufferCacheRegistrations[BufferType::OLDPARTICLE] = simulationCache->registerBuffer(buffers[BufferType::OLDPARTICLE], "oldParticles", CacheEncoding::Particles);
 
     std::vector<uint>* const surfaceVal = particleData.get()->getData().isSurface;
     DirectX::addToBuffer<uint>(buffers[BufferType::SURFACE], *surfaceVal);
-    bufferCacheRegistrations[BufferType::SURFACE] = simulationCache->registerBuffer(buffers[BufferType::SURFACE]);
+    bufferCacheRegistrations[BufferType::SURFACE] = simulationCache->registerBuffer(buffers[BufferType::SURFACE], "isSurface");
+
+    // New voxels start awake (rest counter of 0)
+    std::vector<uint> voxelActivity(surfaceVal->size(), 0);
+    DirectX::addToBuffer<uint>(buffers[BufferType::ACTIVITY], voxelActivity);
+    bufferCacheRegistrations[BufferType::ACTIVITY] = simulationCache->registerBuffer(buffers[BufferType::ACTIVITY], "voxelActivity");
+
+    std::vector<VoxelAdjacency>* const voxelAdjacency = particleData.get()->getData().voxelAdjacency;
+    DirectX::addToBuffer<VoxelAdjacency>(buffers[BufferType::ADJACENCY], *voxelAdjacency);
+    bufferCacheRegistrations[BufferType::ADJACENCY] = simulationCache->registerBuffer(buffers[BufferType::ADJACENCY], "voxelAdjacency");
 
     return;
 }
@@ -244,11 +301,13 @@ void GlobalSolver::deleteParticleData(MPlug& particleDataToRemovePlug) {
     DirectX::deleteFromBuffer<MFloatPoint>(buffers[BufferType::PARTICLE], numRemovedParticles, offset);
     DirectX::deleteFromBuffer<MFloatPoint>(buffers[BufferType::OLDPARTICLE], numRemovedParticles, offset);
     DirectX::deleteFromBuffer<uint>(buffers[BufferType::SURFACE], numRemovedParticles / 8, offset / 8);
+    DirectX::deleteFromBuffer<uint>(buffers[BufferType::ACTIVITY], numRemovedParticles / 8, offset / 8);
+    DirectX::deleteFromBuffer<VoxelAdjacency>(buffers[BufferType::ADJACENCY], numRemovedParticles / 8, offset / 8);
 
     return;
 }
 
-void GlobalSolver::createGlobalComputeShaders(float maximumParticleRadius) {
+void GlobalSolver::createGlobalComputeShaders(float maximumParticleRadius, const std::vector<uint>& objectParticleOffsets) {
     int totalParticles = getTotalParticles();
     int totalVoxels = totalParticles / 8;
     ComPtr<ID3D11ShaderResourceView> particleSRV = DirectX::createSRV(buffers[BufferType::PARTICLE]);
@@ -261,7 +320,6 @@ void GlobalSolver::createGlobalComputeShaders(float maximumParticleRadius) {
         maximumParticleRadius // For collision assumptions to work, grid cell must be at least as big as the biggest particle
     );
     buildCollisionGridCompute.setParticlesSRV(particleSRV);
-    buildCollisionGridCompute.setIsSurfaceSRV(isSurfaceSRV);
 
     prefixScanCompute = PrefixScanCompute(
         buildCollisionGridCompute.getCollisionCellParticleCountsUAV()
@@ -273,7 +331,6 @@ void GlobalSolver::createGlobalComputeShaders(float maximumParticleRadius) {
         buildCollisionGridCompute.getParticleCollisionCB()
     );
     buildCollisionParticleCompute.setParticlesSRV(particleSRV);
-    buildCollisionParticleCompute.setIsSurfaceSRV(isSurfaceSRV);
 
     solveCollisionsCompute = SolveCollisionsCompute(
         buildCollisionGridCompute.getHashGridSize(),
@@ -283,17 +340,84 @@ void GlobalSolver::createGlobalComputeShaders(float maximumParticleRadius) {
     );
     solveCollisionsCompute.setParticlesUAV(particleUAV);
     solveCollisionsCompute.setOldParticlesSRV(oldParticlesSRV);
+    solveCollisionsCompute.setVoxelAdjacencySRV(DirectX::createSRV(buffers[BufferType::ADJACENCY]));
+
+    // Collision building only runs over the surface voxel list. PBD nodes append to it as constraints break, so they need the buffer too.
+    surfaceVoxelsCompute = SurfaceVoxelsCompute(totalVoxels);
+    surfaceVoxelsCompute.setIsSurfaceSRV(isSurfaceSRV);
+    surfaceVoxelsCompute.rebuild();
+    buffers[BufferType::SURFACE_LIST] = surfaceVoxelsCompute.getSurfaceVoxelsBuffer();
+    const ComPtr<ID3D11ShaderResourceView>& surfaceVoxelsSRV = surfaceVoxelsCompute.getSurfaceVoxelsSRV();
+    const ComPtr<ID3D11Buffer>& surfaceVoxelArgsBuffer = surfaceVoxelsCompute.getDispatchArgsBuffer();
+
+    // The grid builders only bin voxels that survive culling (a subset of the surface voxels).
+    collisionCullingCompute = CollisionCullingCompute(objectParticleOffsets, totalParticles, solveCollisionsCompute.getCollisionStatsUAV());
+    collisionCullingCompute.setParticlesSRV(particleSRV);
+    collisionCullingCompute.setIsSurfaceSRV(isSurfaceSRV);
+    collisionCullingCompute.setSurfaceVoxels(surfaceVoxelsSRV, surfaceVoxelArgsBuffer);
+    buildCollisionGridCompute.setIsSurfaceSRV(collisionCullingCompute.getCollisionCandidatesSRV());
+    buildCollisionGridCompute.setSurfaceVoxels(surfaceVoxelsSRV, surfaceVoxelArgsBuffer);
+    buildCollisionParticleCompute.setIsSurfaceSRV(collisionCullingCompute.getCollisionCandidatesSRV());
+    buildCollisionParticleCompute.setSurfaceVoxels(surfaceVoxelsSRV, surfaceVoxelArgsBuffer);
+
+    // The sorted grid is sized by particle count too, so it has to be rebuilt - but only if it's being used.
+    this->maxParticleRadius = maximumParticleRadius;
+    buildSortedCollisionGridCompute = BuildSortedCollisionGridCompute();
+    neighborPairsCompute = NeighborPairsCompute();
+    hasSortedCollisionGrid = false;
 
     dragParticlesCompute = DragParticlesCompute(totalVoxels);
     dragParticlesCompute.setParticlesUAV(particleUAV);
     buffers[BufferType::DRAGGING] = dragParticlesCompute.getIsDraggingBuffer();
 
     colliderBuffer.totalParticles = totalParticles;
-    solvePrimitiveCollisionsCompute = SolvePrimitiveCollisionsCompute(colliderBuffer);
+    solvePrimitiveCollisionsCompute = SolvePrimitiveCollisionsCompute(colliderBuffer, maxParticleRadius);
     solvePrimitiveCollisionsCompute.setParticlesUAV(particleUAV);
     solvePrimitiveCollisionsCompute.setOldParticlesSRV(oldParticlesSRV);
 }
 
+// A skin radius of 0 builds the plain sorted broadphase; anything else also builds neighbor lists on top of it.
+void GlobalSolver::createSortedCollisionGrid(float skinRadius) {
+    int totalParticles = getTotalParticles();
+    ComPtr<ID3D11ShaderResourceView> isSurfaceSRV = DirectX::createSRV(buffers[BufferType::SURFACE]);
+    buildSortedCollisionGridCompute = BuildSortedCollisionGridCompute(totalParticles, maxParticleRadius, skinRadius);
+    buildSortedCollisionGridCompute.setParticlesSRV(DirectX::createSRV(buffers[BufferType::PARTICLE]));
+    buildSortedCollisionGridCompute.setIsSurfaceSRV(collisionCullingCompute.getCollisionCandidatesSRV());
+    buildSortedCollisionGridCompute.setSurfaceVoxels(surfaceVoxelsCompute.getSurfaceVoxelsSRV(), surfaceVoxelsCompute.getDispatchArgsBuffer());
+
+    solveCollisionsCompute.setSortedGrid(
+        buildSortedCollisionGridCompute.getParticlesByCellSRV(),
+        buildSortedCollisionGridCompute.getCellStartsSRV(),
+        buildSortedCollisionGridCompute.getCellKeysSRV(),
+        buildSortedCollisionGridCompute.getParticleMinCellsSRV(),
+        buildSortedCollisionGridCompute.getParticleCollisionCB(),
+        buildSortedCollisionGridCompute.getSolveDispatchArgsBuffer()
+    );
+
+    neighborPairsCompute = NeighborPairsCompute();
+    if (skinRadius > 0.0f) {
+        neighborPairsCompute = NeighborPairsCompute(
+            totalParticles,
+            buildSortedCollisionGridCompute.getParticleCollisionCB(),
+            solveCollisionsCompute.getCollisionStatsUAV()
+        );
+        neighborPairsCompute.setSortedGrid(
+            buildSortedCollisionGridCompute.getParticlesByCellSRV(),
+            buildSortedCollisionGridCompute.getCellStartsSRV(),
+            buildSortedCollisionGridCompute.getCellKeysSRV(),
+            buildSortedCollisionGridCompute.getParticleMinCellsSRV(),
+            buildSortedCollisionGridCompute.getSolveDispatchArgsBuffer()
+        );
+        neighborPairsCompute.setParticles(buffers[BufferType::PARTICLE], DirectX::createUAV(buffers[BufferType::PARTICLE]));
+        neighborPairsCompute.setOldParticlesSRV(DirectX::createSRV(buffers[BufferType::OLDPARTICLE]));
+        neighborPairsCompute.setIsSurfaceSRV(isSurfaceSRV);
+        neighborPairsCompute.setVoxelAdjacencySRV(DirectX::createSRV(buffers[BufferType::ADJACENCY]));
+    }
+
+    sortedCollisionGridSkin = skinRadius;
+    hasSortedCollisionGrid = true;
+}
+
 void GlobalSolver::onSimulateFunctionConnectionChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData) {
     if (plug != GlobalSolver::aSimulateFunction || !(msg & (MNodeMessage::kConnectionMade | MNodeMessage::kConnectionBroken))) {
         return;
@@ -323,11 +447,6 @@ void GlobalSolver::onColliderDataConnectionChange(MNodeMessage::AttributeMessage
     int numColliders = colliderDataArrayPlug.evaluateNumElements(); // Does not reflect the removed plug yet, if this is a kConnectionBroken callback
     int plugLogicalIndex = plug.logicalIndex();
 
-    if (numColliders > MAX_COLLIDERS) {
-        MGlobal::displayError("cubit supports " + MString(std::to_string(MAX_COLLIDERS).c_str()) + " or fewer collider primitives. The added collider will not participate in collisions.");
-        return;
-    }
-
     ColliderBuffer newColliderBuffer;
     newColliderBuffer.totalParticles = colliderBuffer.totalParticles;
     
@@ -356,6 +475,8 @@ void GlobalSolver::onColliderDataConnectionChange(MNodeMessage::AttributeMessage
 
 void GlobalSolver::onColliderDataDirty(MObject& node, MPlug& plug, void* clientData) {
     if (plug != aColliderData) return;
+    // Animation dirties colliders once time has moved on; anything else (e.g. dragging one while paused) happens at the last computed time.
+    if (MAnimControl::currentTime() == lastComputeTime) collidersEditedInPlace = true;
     if (plug.isArray()) {
         // If the parent array plug is dirty, mark all elements dirty.
         // Unforunately, this is the case when animating a collider. Maya marks the parent dirty rather than the child.
@@ -372,12 +493,128 @@ void GlobalSolver::onColliderDataDirty(MObject& node, MPlug& plug, void* clientD
 void GlobalSolver::onCacheSizeChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData) {
     if (plug != aMaxCacheSize || !(msg & MNodeMessage::kAttributeSet)) return;
 
-    // Reset the simulation cache
+    // Reset the simulation cache (which also restores the start state, so the surface voxel list needs to be rebuilt)
     SimulationCache::instance()->resetCache();
+    static_cast<GlobalSolver*>(clientData)->surfaceVoxelsCompute.rebuild();
     MTime startTime = MAnimControl::minTime();
     MAnimControl::setCurrentTime(startTime);
 }
 
+void GlobalSolver::onBakeAheadChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData) {
+    if ((plug != aBakeAhead && plug != aBakeAheadFrames) || !(msg & MNodeMessage::kAttributeSet)) return;
+
+    GlobalSolver* globalSolver = static_cast<GlobalSolver*>(clientData);
+    if (MPlug(globalSolver->thisMObject(), aBakeAhead).asBool()) {
+        globalSolver->scheduleBakeAhead();
+    } else {
+        globalSolver->cancelBakeAhead();
+    }
+}
+
+void GlobalSolver::onBakeAheadIdle(void* clientData) {
+    // Whatever the artist is doing takes priority. Baking waits until they're done.
+    GlobalSolver* globalSolver = static_cast<GlobalSolver*>(clientData);
+    if (MAnimControl::isPlaying() || MAnimControl::isScrubbing() || globalSolver->isDragging) return;
+    if (!globalSolver->bakeAheadStep()) globalSolver->cancelBakeAhead();
+}
+
+void GlobalSolver::scheduleBakeAhead() {
+    if (bakeAheadCallbackId != 0 || !MPlug(thisMObject(), aBakeAhead).asBool()) return;
+    bakeAheadCallbackId = MEventMessage::addEventCallback("idle", onBakeAheadIdle, this);
+}
+
+void GlobalSolver::cancelBakeAhead() {
+    if (bakeAheadCallbackId == 0) return;
+    MMessage::removeCallback(bakeAheadCallbackId);
+    bakeAheadCallbackId = 0;
+}
+
+/**
+ * Simulates frames ahead of the playhead into the cache, so the timeline fills in while the artist works (and scrubbing forward hits the cache).
+ * Each idle event bakes for about bakeAheadStepSeconds, picking up from the furthest frame already cached within the look-ahead window, then restores
+ * the playhead frame so the viewport never shows a baked frame. Turning bakeAhead off cancels it.
+ *
+ * Returns false once there's nothing (more) to bake, until the next compute moves the playhead or changes what's cached.
+ */
+bool GlobalSolver::bakeAheadStep() {
+    MObject globalSolver = thisMObject();
+    const int lookAheadFrames = MPlug(globalSolver, aBakeAheadFrames).asInt();
+    const int cacheFrequency = MPlug(globalSolver, aCacheFrequency).asInt();
+    if (!MPlug(globalSolver, aBakeAhead).asBool() || lookAheadFrames <= 0 || cacheFrequency <= 0) return false;
+    if (pbdSimulateFuncs.empty() || getTotalParticles() == 0) return false;
+
+    // Baking has to end by restoring the frame the viewport is showing, so that frame must be cached.
+    const MTime::Unit unit = MTime::uiUnit();
+    const MTime playheadTime = MAnimControl::currentTime();
+    const double playhead = std::floor(playheadTime.as(unit));
+    SimulationCache* const simulationCache = SimulationCache::instance();
+    if (playhead < simulationCache->getStartFrame() || playhead != std::floor(lastComputeTime.as(unit)) || !simulationCache->hasCacheData(playheadTime)) return false;
+
+    // Carry on from the furthest stored frame that playing forward from the playhead would reach (allowing for gaps of up to the cache frequency).
+    // Interpolated frames are only approximate, so never simulate on from one.
+    const double lastFrame = std::min<double>(playhead + lookAheadFrames, std::floor(MAnimControl::maxTime().as(unit)));
+    double bakeFrame = playhead;
+    while (bakeFrame > simulationCache->getStartFrame() && !simulationCache->isFrameStored(bakeFrame)) --bakeFrame;
+    if (!simulationCache->isFrameStored(bakeFrame)) return false;
+    for (double frame = bakeFrame + 1; frame <= lastFrame && frame - bakeFrame <= cacheFrequency; ++frame) {
+        if (simulationCache->isFrameStored(frame)) bakeFrame = frame;
+    }
+    if (bakeFrame + cacheFrequency > lastFrame) return false;
+
+    simulationCache->tryUseCache(MTime(bakeFrame, unit), false);
+    // Animated colliders are posed at each baked frame, on a copy of the collider buffer (which stays posed at the playhead).
+    ColliderBuffer bakeColliderBuffer = colliderBuffer;
+    updateColliderPosesAtTime(MTime(bakeFrame, unit), bakeColliderBuffer);
+    solvePrimitiveCollisionsCompute.settleColliderPoses();
+
+    const int substeps = MPlug(globalSolver, aNumSubsteps).asInt();
+    const bool particleCollisionsEnabled = MPlug(globalSolver, aParticleCollisionsEnabled).asBool();
+    const bool primitiveCollisionsEnabled = MPlug(globalSolver, aPrimitiveCollisionsEnabled).asBool();
+    const float particleFriction = MPlug(globalSolver, aParticleFriction).asFloat();
+    const short collisionBroadphase = MPlug(globalSolver, aCollisionBroadphase).asShort();
+    const float neighborListSkin = MPlug(globalSolver, aNeighborListSkin).asFloat();
+
+    // Only stop on a cached frame, or the frames simulated since would be lost.
+    const auto stepStart = std::chrono::steady_clock::now();
+    double lastBakedFrame = bakeFrame;
+    for (double frame = bakeFrame + 1; frame <= lastFrame; ++frame) {
+        const MTime time(frame, unit);
+        updateColliderPosesAtTime(time, bakeColliderBuffer);
+        simulateFrame(substeps, particleCollisionsEnabled, primitiveCollisionsEnabled, particleFriction, collisionBroadphase, neighborListSkin);
+        if (frame - lastBakedFrame < cacheFrequency) continue;
+
+        simulationCache->cacheData(time);
+        lastBakedFrame = frame;
+        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count() >= bakeAheadStepSeconds) break;
+    }
+
+    solvePrimitiveCollisionsCompute.updateColliderPoses(colliderBuffer);
+    solvePrimitiveCollisionsCompute.settleColliderPoses();
+    simulationCache->tryUseCache(playheadTime, false);
+    surfaceVoxelsCompute.rebuild();
+    simulationCache->updateTimeline();
+    return lastBakedFrame + cacheFrequency <= lastFrame;
+}
+
+// Evaluates every collider at the given time (rather than the current time) into posedColliderBuffer, and moves the colliders there for the next frame.
+void GlobalSolver::updateColliderPosesAtTime(const MTime& time, ColliderBuffer& posedColliderBuffer) {
+    MPlug colliderDataArrayPlug(thisMObject(), aColliderData);
+    const int numElements = std::min(static_cast<int>(colliderDataArrayPlug.numElements()), posedColliderBuffer.numColliders());
+    if (numElements == 0) return;
+
+    MDGContext timeContext(time);
+    MDGContextGuard contextGuard(timeContext);
+    for (int i = 0; i < numElements; ++i) {
+        MPlug colliderDataPlug = colliderDataArrayPlug.elementByPhysicalIndex(i);
+        ColliderLocator* colliderLocator = static_cast<ColliderLocator*>(Utils::connectedNode(colliderDataPlug));
+        if (!colliderLocator) continue;
+
+        Utils::PluginData<ColliderData> colliderData(colliderDataPlug);
+        colliderLocator->writeDataIntoBuffer(colliderData.get(), posedColliderBuffer, i);
+    }
+    solvePrimitiveCollisionsCompute.updateColliderPoses(posedColliderBuffer);
+}
+
 MStatus GlobalSolver::initialize() {
     MStatus status;
 
@@ -388,7 +625,7 @@ MStatus GlobalSolver::initialize() {
     nAttr.setMin(1);
     nAttr.setSoftMin(5);
     nAttr.setSoftMax(20);
-    nAttr.setMax(30);
+    nAttr.setMax(MAX_SUBSTEPS);
     nAttr.setStorable(true);
     nAttr.setWritable(true);
     nAttr.setReadable(true);
@@ -423,6 +660,30 @@ MStatus GlobalSolver::initialize() {
     status = addAttribute(aParticleFriction);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    MFnEnumAttribute eAttr;
+    aCollisionBroadphase = eAttr.create("collisionBroadphase", "cbp", COLLISION_BROADPHASE_HASHED, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    eAttr.addField("Hashed Grid", COLLISION_BROADPHASE_HASHED);
+    eAttr.addField("Sorted Cells", COLLISION_BROADPHASE_SORTED);
+    eAttr.addField("Neighbor Lists", COLLISION_BROADPHASE_NEIGHBOR_LISTS);
+    eAttr.setStorable(true);
+    eAttr.setWritable(true);
+    eAttr.setReadable(true);
+    status = addAttribute(aCollisionBroadphase);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Bigger skins rebuild less often, but list (and solve) more pairs that never end up touching.
+    aNeighborListSkin = nFloatAttr.create("neighborListSkin", "nls", MFnNumericData::kFloat, 0.5f, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nFloatAttr.setMin(0.05f);
+    nFloatAttr.setSoftMax(1.0f);
+    nFloatAttr.setMax(2.0f);
+    nFloatAttr.setStorable(true);
+    nFloatAttr.setWritable(true);
+    nFloatAttr.setReadable(true);
+    status = addAttribute(aNeighborListSkin);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
     MFnNumericAttribute nIntAttr;
     aCacheFrequency = nIntAttr.create("cacheFrequency", "cf", MFnNumericData::kInt, 1, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -435,6 +696,14 @@ MStatus GlobalSolver::initialize() {
     status = addAttribute(aCacheFrequency);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    aCacheInterpolation = nBoolAttr.create("cacheInterpolation", "cip", MFnNumericData::kBoolean, false, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nBoolAttr.setStorable(true);
+    nBoolAttr.setWritable(true);
+    nBoolAttr.setReadable(true);
+    status = addAttribute(aCacheInterpolation);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
     aMaxCacheSize = nIntAttr.create("maxCacheSize", "mcs", MFnNumericData::kInt, 500, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
     nIntAttr.setMin(0);
@@ -447,6 +716,72 @@ MStatus GlobalSolver::initialize() {
     status = addAttribute(aMaxCacheSize);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    // Frames are encoded when cached, so changing these doesn't invalidate the frames already cached.
+    aCacheCompression = nBoolAttr.create("cacheCompression", "ccm", MFnNumericData::kBoolean, false, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nBoolAttr.setStorable(true);
+    nBoolAttr.setWritable(true);
+    nBoolAttr.setReadable(true);
+    status = addAttribute(aCacheCompression);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aCachePrecision = nFloatAttr.create("cachePrecision", "cpc", MFnNumericData::kFloat, 0.001f, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nFloatAttr.setMin(0.0f);
+    nFloatAttr.setSoftMax(0.01f);
+    nFloatAttr.setStorable(true);
+    nFloatAttr.setWritable(true);
+    nFloatAttr.setReadable(true);
+    status = addAttribute(aCachePrecision);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aCacheKeyframeInterval = nIntAttr.create("cacheKeyframeInterval", "cki", MFnNumericData::kInt, 8, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setMin(1);
+    nIntAttr.setSoftMax(30);
+    nIntAttr.setStorable(true);
+    nIntAttr.setWritable(true);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aCacheKeyframeInterval);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aDiskCache = nBoolAttr.create("diskCache", "dkc", MFnNumericData::kBoolean, false, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nBoolAttr.setStorable(true);
+    nBoolAttr.setWritable(true);
+    nBoolAttr.setReadable(true);
+    status = addAttribute(aDiskCache);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aMaxDiskCacheSize = nIntAttr.create("maxDiskCacheSize", "mds", MFnNumericData::kInt, 4000, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setMin(0);
+    nIntAttr.setSoftMin(1000);
+    nIntAttr.setSoftMax(20000);
+    nIntAttr.setStorable(true);
+    nIntAttr.setWritable(true);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aMaxDiskCacheSize);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aBakeAhead = nBoolAttr.create("bakeAhead", "bka", MFnNumericData::kBoolean, false, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nBoolAttr.setStorable(true);
+    nBoolAttr.setWritable(true);
+    nBoolAttr.setReadable(true);
+    status = addAttribute(aBakeAhead);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aBakeAheadFrames = nIntAttr.create("bakeAheadFrames", "baf", MFnNumericData::kInt, 48, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setMin(1);
+    nIntAttr.setSoftMax(240);
+    nIntAttr.setStorable(true);
+    nIntAttr.setWritable(true);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aBakeAheadFrames);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
     // Input attribute
     // Time attribute
     MFnUnitAttribute uTimeAttr;
@@ -510,9 +845,89 @@ MStatus GlobalSolver::initialize() {
     status = addAttribute(aParticleBufferOffset);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    aCollisionCandidatePairs = nIntAttr.create("collisionCandidatePairs", "ccp", MFnNumericData::kInt, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setStorable(false);
+    nIntAttr.setWritable(false);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aCollisionCandidatePairs);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aCollisionDuplicatePairs = nIntAttr.create("collisionDuplicatePairs", "cdp", MFnNumericData::kInt, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setStorable(false);
+    nIntAttr.setWritable(false);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aCollisionDuplicatePairs);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aCollisionOverflowParticles = nIntAttr.create("collisionOverflowParticles", "cop", MFnNumericData::kInt, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setStorable(false);
+    nIntAttr.setWritable(false);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aCollisionOverflowParticles);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aCollisionOccupiedCells = nIntAttr.create("collisionOccupiedCells", "coc", MFnNumericData::kInt, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setStorable(false);
+    nIntAttr.setWritable(false);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aCollisionOccupiedCells);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aCollisionNeighborPairs = nIntAttr.create("collisionNeighborPairs", "cnp", MFnNumericData::kInt, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setStorable(false);
+    nIntAttr.setWritable(false);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aCollisionNeighborPairs);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aCollisionNeighborRebuilds = nIntAttr.create("collisionNeighborRebuilds", "cnr", MFnNumericData::kInt, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setStorable(false);
+    nIntAttr.setWritable(false);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aCollisionNeighborRebuilds);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aCollisionCulledVoxels = nIntAttr.create("collisionCulledVoxels", "ccv", MFnNumericData::kInt, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setStorable(false);
+    nIntAttr.setWritable(false);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aCollisionCulledVoxels);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    aCollisionGluedPairs = nIntAttr.create("collisionGluedPairs", "cgp", MFnNumericData::kInt, 0, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    nIntAttr.setStorable(false);
+    nIntAttr.setWritable(false);
+    nIntAttr.setReadable(true);
+    status = addAttribute(aCollisionGluedPairs);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Histogram of particles per occupied collision cell: element b counts cells with 2^b up to 2^(b+1) particles (the last element, any more).
+    aCollisionCellOccupancy = tAttr.create("collisionCellOccupancy", "cco", MFnData::kIntArray, MObject::kNullObj, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    tAttr.setStorable(false);
+    tAttr.setWritable(false);
+    tAttr.setReadable(true);
+    status = addAttribute(aCollisionCellOccupancy);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
     status = attributeAffects(aTime, aTrigger);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    MObject collisionStatsAttributes[] = { aCollisionCandidatePairs, aCollisionDuplicatePairs, aCollisionOverflowParticles, aCollisionOccupiedCells, aCollisionNeighborPairs, aCollisionNeighborRebuilds,
+                                           aCollisionCulledVoxels, aCollisionGluedPairs, aCollisionCellOccupancy };
+    for (const MObject& collisionStatsAttribute : collisionStatsAttributes) {
+        status = attributeAffects(aTime, collisionStatsAttribute);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+
     return MS::kSuccess;
 }
 
@@ -523,12 +938,45 @@ MStatus GlobalSolver::initialize() {
  */
 MStatus GlobalSolver::compute(const MPlug& plug, MDataBlock& block) 
 {
+    if (plug == aCollisionCandidatePairs || plug == aCollisionDuplicatePairs || plug == aCollisionOverflowParticles || plug == aCollisionOccupiedCells
+        || plug == aCollisionNeighborPairs || plug == aCollisionNeighborRebuilds || plug == aCollisionCulledVoxels
+        || plug == aCollisionGluedPairs || plug == aCollisionCellOccupancy) {
+        block.outputValue(aCollisionCandidatePairs).setInt(static_cast<int>(collisionStats.candidatePairs));
+        block.outputValue(aCollisionDuplicatePairs).setInt(static_cast<int>(collisionStats.duplicatePairs));
+        block.outputValue(aCollisionOverflowParticles).setInt(static_cast<int>(collisionStats.overflowParticles));
+        block.outputValue(aCollisionOccupiedCells).setInt(static_cast<int>(collisionStats.occupiedCells));
+        block.outputValue(aCollisionNeighborPairs).setInt(static_cast<int>(collisionStats.neighborPairs));
+        block.outputValue(aCollisionNeighborRebuilds).setInt(static_cast<int>(collisionStats.neighborRebuilds));
+        block.outputValue(aCollisionCulledVoxels).setInt(static_cast<int>(collisionStats.culledVoxels));
+        block.outputValue(aCollisionGluedPairs).setInt(static_cast<int>(collisionStats.gluedPairs));
+        MIntArray cellOccupancy;
+        for (uint count : collisionStats.cellOccupancy) cellOccupancy.append(static_cast<int>(count));
+        block.outputValue(aCollisionCellOccupancy).set(MFnIntArrayData().create(cellOccupancy));
+        block.setClean(aCollisionCandidatePairs);
+        block.setClean(aCollisionDuplicatePairs);
+        block.setClean(aCollisionOverflowParticles);
+        block.setClean(aCollisionOccupiedCells);
+        block.setClean(aCollisionNeighborPairs);
+        block.setClean(aCollisionNeighborRebuilds);
+        block.setClean(aCollisionCulledVoxels);
+        block.setClean(aCollisionGluedPairs);
+        block.setClean(aCollisionCellOccupancy);
+        return MS::kSuccess;
+    }
+
     if (plug != aTrigger) return MS::kSuccess;
 
+    // Colliders only sweep from their last pose when time steps forward a single frame. After a jump, or edits made outside playback,
+    // there's no motion to sweep through (and one sweep across all of it would drag particles along), so they're placed at their new pose.
+    MTime time = block.inputValue(aTime).asTime();
+    const MTime::Unit unit = MTime::uiUnit();
+    const bool isNextFrame = std::floor(time.as(unit)) == std::floor(lastComputeTime.as(unit)) + 1 && !collidersEditedInPlace;
+    collidersEditedInPlace = false;
+
     if (dirtyColliderIndices.size() > 0) {
         MArrayDataHandle colliderDataArrayHandle = block.inputArrayValue(aColliderData);
         MPlug colliderDataArrayPlug(getOrCreateGlobalSolver(), aColliderData);
-        int numElements = colliderDataArrayPlug.numElements();
+        int numElements = std::min(static_cast<int>(colliderDataArrayPlug.numElements()), colliderBuffer.numColliders());
 
         for (int i = 0; i < numElements; ++i) {
             MPlug colliderDataPlug = colliderDataArrayPlug.elementByPhysicalIndex(i);
@@ -546,28 +994,73 @@ MStatus GlobalSolver::compute(const MPlug& plug, MDataBlock& block)
             colliderLocator->writeDataIntoBuffer(colliderData, colliderBuffer, i);
         }
 
-        solvePrimitiveCollisionsCompute.updateColliderBuffer(colliderBuffer);
+        solvePrimitiveCollisionsCompute.updateColliderPoses(colliderBuffer);
         dirtyColliderIndices.clear();
+        if (!isNextFrame) solvePrimitiveCollisionsCompute.settleColliderPoses();
+    } else {
+        solvePrimitiveCollisionsCompute.settleColliderPoses();
     }
 
-    MTime time = block.inputValue(aTime).asTime();
     SimulationCache* const simulationCache = SimulationCache::instance();
     bool hasCacheData = simulationCache->hasCacheData(time);
 
     // Do not simulate backwards unless we have cache data for that time
     if (time <= lastComputeTime && !hasCacheData) {
+        simulationCache->recordMiss();
+        simulationCache->updateTimeline();
         return MS::kSuccess;
     }
     lastComputeTime = time;
     
-    simulationCache->tryUseCache(time);
-    if (hasCacheData) return MS::kSuccess;
+    // Frames without cache data are simulated below (which marks the device buffers modified), so there's nothing to try restoring.
+    if (hasCacheData) {
+        simulationCache->tryUseCache(time);
+        // The restored isSurface buffer may have more (or fewer) surface voxels than the list that was appended to since.
+        surfaceVoxelsCompute.rebuild();
+        simulationCache->updateTimeline();
+        scheduleBakeAhead();
+        return MS::kSuccess;
+    }
+
+    simulateFrame(
+        block.inputValue(aNumSubsteps).asInt(),
+        block.inputValue(aParticleCollisionsEnabled).asBool(),
+        block.inputValue(aPrimitiveCollisionsEnabled).asBool(),
+        block.inputValue(aParticleFriction).asFloat(),
+        block.inputValue(aCollisionBroadphase).asShort(),
+        block.inputValue(aNeighborListSkin).asFloat()
+    );
+
+    int currentFrame = static_cast<int>(std::floor(time.as(MTime::uiUnit())));
+    int cacheFrequency = block.inputValue(aCacheFrequency).asInt();
+    if (cacheFrequency > 0 && (std::abs(static_cast<int>(currentFrame - lastCachedFrame)) >= cacheFrequency)) {
+        simulationCache->cacheData(time);
+        lastCachedFrame = currentFrame;
+    }
+    simulationCache->updateTimeline();
+    scheduleBakeAhead();
+
+    return MS::kSuccess;
+}
 
-    bool particleCollisionsEnabled = block.inputValue(aParticleCollisionsEnabled).asBool();
-    bool primitiveCollisionsEnabled = block.inputValue(aPrimitiveCollisionsEnabled).asBool();
-    float particleFriction = block.inputValue(aParticleFriction).asFloat();
+// Runs one frame's worth of substeps from whatever state the buffers are in (the playhead's, or a frame being baked ahead).
+void GlobalSolver::simulateFrame(int substeps, bool particleCollisionsEnabled, bool primitiveCollisionsEnabled, float particleFriction, short collisionBroadphase, float neighborListSkin) {
+    // Simulating changes what's on the device, so the next restore can't skip uploading buffers that look like they already hold its data.
+    SimulationCache::instance()->markBuffersModified();
+    // The attribute's max can be bypassed (e.g. by a connection), but per-substep stats only have room for this many.
+    substeps = std::clamp(substeps, 1, MAX_SUBSTEPS);
     buildCollisionGridCompute.setFriction(particleFriction);
-    int substeps = block.inputValue(aNumSubsteps).asInt();
+    bool useNeighborLists = (collisionBroadphase == COLLISION_BROADPHASE_NEIGHBOR_LISTS);
+    bool useSortedBroadphase = (collisionBroadphase == COLLISION_BROADPHASE_SORTED);
+    // The skin is baked into the sorted grid's cell size, so changing it (or switching to or from neighbor lists) means rebuilding the grid.
+    float skinRadius = useNeighborLists ? neighborListSkin * maxParticleRadius : 0.0f;
+    bool needsSortedGrid = (useSortedBroadphase || useNeighborLists);
+    if (needsSortedGrid && (!hasSortedCollisionGrid || skinRadius != sortedCollisionGridSkin) && getTotalParticles() > 0) {
+        createSortedCollisionGrid(skinRadius);
+    }
+    collisionCullingCompute.setSkinRadius(skinRadius);
+    buildSortedCollisionGridCompute.setFriction(particleFriction);
+    solveCollisionsCompute.setUseSortedGrid(useSortedBroadphase);
     dragParticlesCompute.setNumSubsteps(substeps);
 
     for (int i = 0; i < substeps; ++i) {
@@ -579,7 +1072,22 @@ MStatus GlobalSolver::compute(const MPlug& plug, MDataBlock& block)
             dragParticlesCompute.dispatch();
         }   
 
-        if (particleCollisionsEnabled) {
+        if (particleCollisionsEnabled && useNeighborLists) {
+            if (neighborPairsCompute.shouldRebuild(i)) {
+                surfaceVoxelsCompute.dispatch();
+                collisionCullingCompute.dispatch();
+                buildSortedCollisionGridCompute.dispatch();
+                neighborPairsCompute.rebuild();
+            }
+            neighborPairsCompute.dispatch();
+        } else if (particleCollisionsEnabled && useSortedBroadphase) {
+            surfaceVoxelsCompute.dispatch();
+            collisionCullingCompute.dispatch();
+            buildSortedCollisionGridCompute.dispatch();
+            solveCollisionsCompute.dispatch();
+        } else if (particleCollisionsEnabled) {
+            surfaceVoxelsCompute.dispatch();
+            collisionCullingCompute.dispatch();
             buildCollisionGridCompute.dispatch();
             prefixScanCompute.dispatch(); 
             buildCollisionParticleCompute.dispatch();
@@ -587,16 +1095,25 @@ MStatus GlobalSolver::compute(const MPlug& plug, MDataBlock& block)
         }
 
         if (primitiveCollisionsEnabled) {
+            solvePrimitiveCollisionsCompute.setSubstep(i, substeps);
             solvePrimitiveCollisionsCompute.dispatch();
         }
     }
 
-    int currentFrame = static_cast<int>(std::floor(time.as(MTime::uiUnit())));
-    int cacheFrequency = block.inputValue(aCacheFrequency).asInt();
-    if (cacheFrequency > 0 && (std::abs(static_cast<int>(currentFrame - lastCachedFrame)) >= cacheFrequency)) {
-        simulationCache->cacheData(time);
-        lastCachedFrame = currentFrame;
+    // Until a frame's stats are read back, collisionStats still holds an earlier frame's.
+    const bool hasNewStats = solveCollisionsCompute.collectStats(collisionStats);
+    if (hasNewStats && collisionStats.overflowParticles > 0 && !hasWarnedOfCollisionOverflow) {
+        MGlobal::displayWarning("Some particle collisions were skipped because too many particles shared a collision cell. See the GlobalSolver's collisionOverflowParticles attribute.");
+        hasWarnedOfCollisionOverflow = true;
+    }
+    if (useNeighborLists && hasNewStats) {
+        neighborPairsCompute.updateRebuildInterval(collisionStats, substeps);
     }
 
-    return MS::kSuccess;
+    // Once per simulated frame (rather than whenever Maya happens to evaluate the PBD nodes), step each node's adaptive VGS controller.
+    MPlug particleDataArrayPlug(getOrCreateGlobalSolver(), aParticleData);
+    for (unsigned int i = 0; i < particleDataArrayPlug.numElements(); ++i) {
+        PBDNode* pbdNode = static_cast<PBDNode*>(Utils::connectedNode(particleDataArrayPlug.elementByPhysicalIndex(i)));
+        if (pbdNode) pbdNode->updateAdaptiveVGS();
+    }
 }
\ No newline at end of file
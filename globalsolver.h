@@ -4,6 +4,10 @@
 #include <maya/MCallbackIdArray.h>
 #include "directx/compute/dragparticlescompute.h"
 #include "directx/compute/buildcollisiongridcompute.h"
+#include "directx/compute/buildsortedcollisiongridcompute.h"
+#include "directx/compute/neighborpairscompute.h"
+#include "directx/compute/surfacevoxelscompute.h"
+#include "directx/compute/collisioncullingcompute.h"
 #include "directx/compute/prefixscancompute.h"
 #include "directx/compute/buildcollisionparticlescompute.h"
 #include "directx/compute/solvecollisionscompute.h"
@@ -33,7 +37,10 @@ public:
         PARTICLE,
         OLDPARTICLE,
         SURFACE,
-        DRAGGING
+        DRAGGING,
+        ACTIVITY,   // Per-voxel sleep state (see VoxelActivityCompute)
+        ADJACENCY,  // Per-voxel intact face connections, so collisions skip voxels that are still glued together
+        SURFACE_LIST // Compact list of surface voxel indices (see SurfaceVoxelsCompute). Derived from SURFACE, so not cached.
     };
     static std::unordered_map<BufferType, ComPtr<ID3D11Buffer>> buffers;
     static std::unordered_map<BufferType, SimulationCache::Registration> bufferCacheRegistrations;
@@ -48,8 +55,18 @@ public:
     static MObject aParticleCollisionsEnabled;
     static MObject aPrimitiveCollisionsEnabled;
     static MObject aParticleFriction;
+    static MObject aCollisionBroadphase; // COLLISION_BROADPHASE_* (see constants.hlsli)
+    static MObject aNeighborListSkin;    // neighbor list skin radius, as a multiple of the largest particle radius
     static MObject aCacheFrequency; // how often to cache a frame of simulation data
+    static MObject aCacheInterpolation; // restore frames skipped by the cache frequency by interpolating the frames either side
     static MObject aMaxCacheSize;   // cache size in MB
+    static MObject aCacheCompression; // compress cached frames (see CacheCodec)
+    static MObject aCachePrecision;   // quantization step of compressed particle positions, 0 for lossless
+    static MObject aCacheKeyframeInterval; // max number of compressed frames chained from each keyframe (see SimulationCache)
+    static MObject aDiskCache;        // spill frames evicted from memory to disk (see DiskCache)
+    static MObject aMaxDiskCacheSize; // disk cache size in MB
+    static MObject aBakeAhead;        // simulate frames ahead of the playhead into the cache in idle time (see bakeAheadStep)
+    static MObject aBakeAheadFrames;  // how many frames ahead of the playhead to bake
     // Input attributes
     static MObject aTime;
     static MObject aParticleData;
@@ -58,6 +75,16 @@ public:
     // Output attributes
     static MObject aParticleBufferOffset;
     static MObject aTrigger;
+    // Particle collision statistics for the last frame whose GPU readback has completed (see SolveCollisionsCompute)
+    static MObject aCollisionCandidatePairs;
+    static MObject aCollisionDuplicatePairs;
+    static MObject aCollisionOverflowParticles;
+    static MObject aCollisionOccupiedCells;
+    static MObject aCollisionNeighborPairs;
+    static MObject aCollisionNeighborRebuilds;
+    static MObject aCollisionCulledVoxels;
+    static MObject aCollisionGluedPairs;
+    static MObject aCollisionCellOccupancy;
 
     static MObject globalSolverNodeObject;
 
@@ -78,29 +105,51 @@ private:
     static void onColliderDataConnectionChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData);
     static void onColliderDataDirty(MObject& node, MPlug& plug, void* clientData);
     static void onCacheSizeChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData);
+    static void onBakeAheadChange(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData);
+    static void onBakeAheadIdle(void* clientData);
     static void addParticleData(MPlug& particleDataToAddPlug);
     static void deleteParticleData(MPlug& particleDataToRemovePlug);
     static void calculateNewOffsetsAndParticleRadius(MPlug changedPlug, MNodeMessage::AttributeMessage changeType, std::unordered_map<int, int>& offsetForLogicalPlug, float& maximumParticleRadius);
     static void maybeDeleteGlobalSolver();
     MCallbackIdArray callbackIds;
     uint lastCachedFrame = UINT_MAX;
+    // Registered only while there's baking to do (an idle callback keeps Maya from ever going idle).
+    MCallbackId bakeAheadCallbackId = 0;
+    static constexpr double bakeAheadStepSeconds = 0.05; // roughly how long each idle event bakes for
 
     // Maps PBD node plug index to its simulate function.
     // Essentially a cache so we don't have to retrieve the function from plugs every frame.
     static std::unordered_map<uint, std::function<void()>> pbdSimulateFuncs;
     static ColliderBuffer colliderBuffer;
     static std::unordered_set<int> dirtyColliderIndices;
+    static bool collidersEditedInPlace; // Set when colliders are dirtied without time moving, so their change isn't swept through
     static MTime lastComputeTime;
 
     // Global compute shaders
-    void createGlobalComputeShaders(float maxParticleRadius);
+    void createGlobalComputeShaders(float maxParticleRadius, const std::vector<uint>& objectParticleOffsets);
+    void createSortedCollisionGrid(float skinRadius);
+    void simulateFrame(int substeps, bool particleCollisionsEnabled, bool primitiveCollisionsEnabled, float particleFriction, short collisionBroadphase, float neighborListSkin);
+    void scheduleBakeAhead();
+    void cancelBakeAhead();
+    bool bakeAheadStep();
+    void updateColliderPosesAtTime(const MTime& time, ColliderBuffer& posedColliderBuffer);
     DragParticlesCompute dragParticlesCompute;
+    SurfaceVoxelsCompute surfaceVoxelsCompute;
+    CollisionCullingCompute collisionCullingCompute;
     BuildCollisionGridCompute buildCollisionGridCompute;
+    BuildSortedCollisionGridCompute buildSortedCollisionGridCompute; // Created on first use (it needs several times the memory of the hashed grid)
     PrefixScanCompute prefixScanCompute;
     BuildCollisionParticlesCompute buildCollisionParticleCompute;
     SolveCollisionsCompute solveCollisionsCompute;
+    NeighborPairsCompute neighborPairsCompute; // Created along with the sorted grid, when using neighbor lists
     SolvePrimitiveCollisionsCompute solvePrimitiveCollisionsCompute;
     
+    float maxParticleRadius = 0.0f;
+    bool hasSortedCollisionGrid = false;
+    float sortedCollisionGridSkin = 0.0f;
+    CollisionStats collisionStats;
+    bool hasWarnedOfCollisionOverflow = false;
+
     bool isDragging = false;
     EventBase::Unsubscribe unsubscribeFromDragStateChange;
 
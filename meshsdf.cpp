@@ -0,0 +1,204 @@
+#include "meshsdf.h"
+#include "cgalhelper.h"
+#include "utils.h"
+#include "cachecodec.h"
+#include <maya/MFnMesh.h>
+#include <maya/MPointArray.h>
+#include <maya/MIntArray.h>
+#include <maya/MGlobal.h>
+#include <CGAL/boost/graph/helpers.h>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+
+namespace {
+    // Guards against a cell size that's tiny compared to the mesh (every brick of the full grid gets a distance query).
+    constexpr uint64_t MAX_SDF_BRICKS = 1u << 22;
+    constexpr int SAMPLES_PER_BRICK = SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES;
+
+    struct BakeContext {
+        const CGALHelper::Tree* aabbTree;
+        const CGALHelper::SideTester* sideTester;
+        float narrowBand;
+        std::vector<uint8_t> isNarrowBandBrick;   // Per brick of the full grid
+        std::vector<uint> candidateBricks;        // Bricks that may be within the narrow band
+        std::vector<uint8_t> isCandidateInBand;   // Per candidate: does any sample actually fall within the narrow band?
+        std::vector<float> candidateSamples;      // SAMPLES_PER_BRICK per candidate
+    };
+
+    CGALHelper::Point_3 brickSamplePosition(const MeshSDF& sdf, uint brickIdx, int sx, int sy, int sz) {
+        uint bx = brickIdx % sdf.numBricks[0];
+        uint by = (brickIdx / sdf.numBricks[0]) % sdf.numBricks[1];
+        uint bz = brickIdx / (sdf.numBricks[0] * sdf.numBricks[1]);
+        return CGALHelper::Point_3(
+            sdf.origin[0] + (bx * SDF_BRICK_CELLS + sx) * sdf.cellSize,
+            sdf.origin[1] + (by * SDF_BRICK_CELLS + sy) * sdf.cellSize,
+            sdf.origin[2] + (bz * SDF_BRICK_CELLS + sz) * sdf.cellSize
+        );
+    }
+}
+
+std::shared_ptr<const MeshSDF> MeshSDF::bake(const MObject& mesh, const MMatrix& meshToLocal, float cellSize, int narrowBandCells) {
+    MStatus status;
+    MFnMesh meshFn(mesh, &status);
+    if (status != MS::kSuccess || cellSize <= 0.0f) return nullptr;
+
+    MPointArray points;
+    meshFn.getPoints(points, MSpace::kObject);
+    MIntArray triangleCounts, triangleVertices;
+    meshFn.getTriangles(triangleCounts, triangleVertices);
+    if (points.length() == 0 || triangleVertices.length() == 0) return nullptr;
+
+    std::shared_ptr<MeshSDF> sdf = std::make_shared<MeshSDF>();
+    sdf->cellSize = cellSize;
+    const float narrowBand = std::max(narrowBandCells, 1) * cellSize;
+
+    CGALHelper::SurfaceMesh cgalMesh;
+    std::vector<CGALHelper::SurfaceMesh::Vertex_index> cgalVertices(points.length());
+    double boundsMin[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+    double boundsMax[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    for (unsigned int i = 0; i < points.length(); ++i) {
+        MPoint p = points[i] * meshToLocal;
+        cgalVertices[i] = cgalMesh.add_vertex(CGALHelper::Point_3(p.x, p.y, p.z));
+        for (int axis = 0; axis < 3; ++axis) {
+            boundsMin[axis] = std::min(boundsMin[axis], p[axis]);
+            boundsMax[axis] = std::max(boundsMax[axis], p[axis]);
+        }
+    }
+    for (unsigned int i = 0; i + 2 < triangleVertices.length(); i += 3) {
+        cgalMesh.add_face(cgalVertices[triangleVertices[i]], cgalVertices[triangleVertices[i + 1]], cgalVertices[triangleVertices[i + 2]]);
+    }
+
+    if (!CGAL::is_closed(cgalMesh)) {
+        MGlobal::displayError("Mesh collider input mesh must be water tight.");
+        return nullptr;
+    }
+
+    // Pad by the narrow band (plus a cell), so the band never gets cut off at the edge of the volume.
+    uint64_t totalBricks = 1;
+    for (int axis = 0; axis < 3; ++axis) {
+        float padding = narrowBand + cellSize;
+        sdf->origin[axis] = static_cast<float>(boundsMin[axis]) - padding;
+        float extent = static_cast<float>(boundsMax[axis] - boundsMin[axis]) + 2.0f * padding;
+        sdf->numBricks[axis] = std::max(1u, static_cast<uint>(std::ceil(extent / (SDF_BRICK_CELLS * cellSize))));
+        totalBricks *= sdf->numBricks[axis];
+    }
+
+    if (totalBricks > MAX_SDF_BRICKS) {
+        MGlobal::displayError("Mesh collider cell size is too small for the size of the mesh. Increase the cell size.");
+        return nullptr;
+    }
+
+    CGALHelper::Tree aabbTree(cgalMesh.faces().first, cgalMesh.faces().second, cgalMesh);
+    aabbTree.accelerate_distance_queries(); // Build now: the distance query structure is built lazily otherwise, which isn't thread safe
+    CGALHelper::SideTester sideTester(aabbTree);
+
+    BakeContext context;
+    context.aabbTree = &aabbTree;
+    context.sideTester = &sideTester;
+    context.narrowBand = narrowBand;
+    context.isNarrowBandBrick.resize(totalBricks, 0);
+
+    // First pass: find the bricks near enough to the surface to (maybe) be in the narrow band.
+    BakeTaskData baseTaskData = { &context, sdf.get(), MeshSDF::findNarrowBandBricks, 0, static_cast<int>(totalBricks) };
+    MThreadPool::init();
+    MThreadPool::newParallelRegion(MeshSDF::bakeInParallel, (void*)&baseTaskData);
+    MThreadPool::release(); // reduce reference count incurred by opening a new parallel region
+
+    for (uint i = 0; i < totalBricks; ++i) {
+        if (context.isNarrowBandBrick[i]) context.candidateBricks.push_back(i);
+    }
+
+    // Second pass: sample every candidate brick.
+    int numCandidates = static_cast<int>(context.candidateBricks.size());
+    context.isCandidateInBand.resize(numCandidates, 0);
+    context.candidateSamples.resize(static_cast<size_t>(numCandidates) * SAMPLES_PER_BRICK);
+    baseTaskData = { &context, sdf.get(), MeshSDF::sampleBricks, 0, numCandidates };
+    MThreadPool::newParallelRegion(MeshSDF::bakeInParallel, (void*)&baseTaskData);
+    MThreadPool::release(); // reduce reference count incurred by opening a new parallel region
+    MThreadPool::release(); // reduce reference count incurred by init()
+
+    // Keep only the bricks with some sample inside the narrow band.
+    sdf->brickTable.assign(totalBricks, SDF_BRICK_EMPTY);
+    uint numKept = 0;
+    for (int i = 0; i < numCandidates; ++i) {
+        if (!context.isCandidateInBand[i]) continue;
+
+        sdf->brickTable[context.candidateBricks[i]] = numKept++;
+        auto first = context.candidateSamples.begin() + static_cast<size_t>(i) * SAMPLES_PER_BRICK;
+        sdf->samples.insert(sdf->samples.end(), first, first + SAMPLES_PER_BRICK);
+    }
+
+    std::vector<uint8_t> contents(sizeof(sdf->origin) + sizeof(sdf->cellSize) + sizeof(sdf->numBricks));
+    std::memcpy(contents.data(), sdf->origin, sizeof(sdf->origin));
+    std::memcpy(contents.data() + sizeof(sdf->origin), &sdf->cellSize, sizeof(sdf->cellSize));
+    std::memcpy(contents.data() + sizeof(sdf->origin) + sizeof(sdf->cellSize), sdf->numBricks, sizeof(sdf->numBricks));
+    const uint8_t* brickTableBytes = reinterpret_cast<const uint8_t*>(sdf->brickTable.data());
+    contents.insert(contents.end(), brickTableBytes, brickTableBytes + sdf->brickTable.size() * sizeof(uint));
+    const uint8_t* sampleBytes = reinterpret_cast<const uint8_t*>(sdf->samples.data());
+    contents.insert(contents.end(), sampleBytes, sampleBytes + sdf->samples.size() * sizeof(float));
+    sdf->contentHash = CacheCodec::hash(contents);
+
+    return sdf;
+}
+
+void MeshSDF::bakeInParallel(void* data, MThreadRootTask* rootTask) {
+    const BakeTaskData* baseTaskData = static_cast<const BakeTaskData*>(data);
+    const int numBricks = baseTaskData->last;
+    const int numTasks = Utils::divideRoundUp(numBricks, BRICKS_PER_TASK);
+
+    std::vector<BakeTaskData> taskData(numTasks, *baseTaskData);
+    for (int i = 0; i < numTasks; ++i) {
+        taskData[i].first = i * BRICKS_PER_TASK;
+        taskData[i].last = std::min(numBricks, (i + 1) * BRICKS_PER_TASK);
+        MThreadPool::createTask(baseTaskData->taskFunc, (void*)&taskData[i], rootTask);
+    }
+    MThreadPool::executeAndJoin(rootTask);
+}
+
+/**
+ * A brick can only hold a sample within the narrow band if its center is within the narrow band plus half the brick's diagonal of the surface.
+ */
+MThreadRetVal MeshSDF::findNarrowBandBricks(void* data) {
+    const BakeTaskData* taskData = static_cast<const BakeTaskData*>(data);
+    BakeContext* context = static_cast<BakeContext*>(taskData->context);
+    const MeshSDF& sdf = *taskData->sdf;
+
+    const double halfBrick = 0.5 * SDF_BRICK_CELLS * sdf.cellSize;
+    const double reach = context->narrowBand + std::sqrt(3.0) * halfBrick;
+    for (int i = taskData->first; i < taskData->last; ++i) {
+        CGALHelper::Point_3 corner = brickSamplePosition(sdf, i, 0, 0, 0);
+        CGALHelper::Point_3 center(corner.x() + halfBrick, corner.y() + halfBrick, corner.z() + halfBrick);
+        context->isNarrowBandBrick[i] = (context->aabbTree->squared_distance(center) <= reach * reach) ? 1 : 0;
+    }
+
+    return 0;
+}
+
+MThreadRetVal MeshSDF::sampleBricks(void* data) {
+    const BakeTaskData* taskData = static_cast<const BakeTaskData*>(data);
+    BakeContext* context = static_cast<BakeContext*>(taskData->context);
+    const MeshSDF& sdf = *taskData->sdf;
+    const float narrowBand = context->narrowBand;
+
+    for (int i = taskData->first; i < taskData->last; ++i) {
+        float* brickSamples = &context->candidateSamples[static_cast<size_t>(i) * SAMPLES_PER_BRICK];
+        bool isInBand = false;
+
+        for (int sz = 0; sz < SDF_BRICK_SAMPLES; ++sz)
+        for (int sy = 0; sy < SDF_BRICK_SAMPLES; ++sy)
+        for (int sx = 0; sx < SDF_BRICK_SAMPLES; ++sx) {
+            CGALHelper::Point_3 p = brickSamplePosition(sdf, context->candidateBricks[i], sx, sy, sz);
+            float distance = static_cast<float>(std::sqrt(context->aabbTree->squared_distance(p)));
+            if ((*context->sideTester)(p) == CGAL::ON_BOUNDED_SIDE) distance = -distance;
+
+            isInBand |= (std::abs(distance) < narrowBand);
+            brickSamples[sx + SDF_BRICK_SAMPLES * (sy + SDF_BRICK_SAMPLES * sz)] = std::clamp(distance, -narrowBand, narrowBand);
+        }
+
+        context->isCandidateInBand[i] = isInBand ? 1 : 0;
+    }
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <maya/MObject.h>
+#include <maya/MMatrix.h>
+#include <maya/MThreadPool.h>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include "shaders/constants.hlsli"
+
+/**
+ * A sparse, narrow-band signed distance field of a (closed) mesh, for mesh colliders (see MeshCollider).
+ *
+ * The volume is split into bricks of SDF_BRICK_SAMPLES^3 samples, and only bricks within the narrow band of the surface are kept.
+ * Neighbouring bricks share their boundary samples, so sampling (trilinearly) never has to read across bricks, and the cost of a lookup is
+ * the same no matter how many triangles the mesh has. Distances are negative inside the mesh and clamped to the narrow band.
+ */
+struct MeshSDF {
+    float origin[3] = { 0.0f, 0.0f, 0.0f };   // Corner of brick (0, 0, 0), in collider-local space
+    float cellSize = 0.0f;
+    uint numBricks[3] = { 0, 0, 0 };
+    std::vector<uint> brickTable;             // Per brick (x fastest): index of the brick's samples, or SDF_BRICK_EMPTY
+    std::vector<float> samples;               // SDF_BRICK_SAMPLES^3 per brick (x fastest)
+    uint64_t contentHash = 0;                 // Of all of the above (see CacheCodec::hash), so the simulation cache's disk key can tell SDFs apart
+
+    float boundsMin(int axis) const { return origin[axis]; }
+    float boundsMax(int axis) const { return origin[axis] + numBricks[axis] * SDF_BRICK_CELLS * cellSize; }
+
+    /**
+     * Bakes the SDF of a mesh, with its points transformed by meshToLocal first. Returns nullptr (and displays an error) if the mesh isn't closed,
+     * or the volume would be unreasonably large for the cell size.
+     */
+    static std::shared_ptr<const MeshSDF> bake(const MObject& mesh, const MMatrix& meshToLocal, float cellSize, int narrowBandCells);
+
+private:
+    struct BakeTaskData {
+        void* context;         // Opaque to the header (CGAL types), see meshsdf.cpp
+        MeshSDF* sdf;
+        MThreadFunc taskFunc;
+        int first;
+        int last;              // Exclusive
+    };
+
+    static constexpr int BRICKS_PER_TASK = 64;
+    static void bakeInParallel(void* data, MThreadRootTask* rootTask);
+    static MThreadRetVal findNarrowBandBricks(void* data);
+    static MThreadRetVal sampleBricks(void* data);
+};
@@ -0,0 +1,130 @@
+#include "particleinterpolation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    constexpr size_t PARTICLES_PER_VOXEL = 8;
+    constexpr size_t FLOATS_PER_PARTICLE = 4; // x, y, z, packed radius and inverse mass (see Particle)
+    constexpr size_t FLOATS_PER_VOXEL = PARTICLES_PER_VOXEL * FLOATS_PER_PARTICLE;
+    constexpr int MAX_SHAPE_MATCHING_ITERATIONS = 20;
+
+    struct Vec3 {
+        float x, y, z;
+    };
+
+    Vec3 operator+(const Vec3& a, const Vec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    Vec3 operator-(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    Vec3 operator*(const Vec3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+    float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Vec3 cross(const Vec3& a, const Vec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    struct Quat {
+        float w, x, y, z;
+    };
+
+    Quat multiply(const Quat& a, const Quat& b) {
+        return {
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+            a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+        };
+    }
+
+    Vec3 rotate(const Quat& q, const Vec3& v) {
+        const Vec3 u = { q.x, q.y, q.z };
+        const Vec3 uv = cross(u, v);
+        return v + uv * (2.0f * q.w) + cross(u, uv) * 2.0f;
+    }
+
+    /**
+     * The rotation that best maps fromOffsets onto toOffsets: the rotational part of sum(to * from^T), found by repeatedly rotating towards it
+     * (Müller et al., "A Robust Method to Extract the Rotational Part of Deformations"). Converges in a few iterations for the small rotations
+     * between nearby frames.
+     */
+    Quat matchRotation(const Vec3* fromOffsets, const Vec3* toOffsets) {
+        Quat q = { 1.0f, 0.0f, 0.0f, 0.0f };
+        for (int iteration = 0; iteration < MAX_SHAPE_MATCHING_ITERATIONS; ++iteration) {
+            Vec3 torque = { 0.0f, 0.0f, 0.0f };
+            float alignment = 0.0f;
+            for (size_t i = 0; i < PARTICLES_PER_VOXEL; ++i) {
+                const Vec3 rotated = rotate(q, fromOffsets[i]);
+                torque = torque + cross(rotated, toOffsets[i]);
+                alignment += dot(rotated, toOffsets[i]);
+            }
+
+            const Vec3 omega = torque * (1.0f / (std::abs(alignment) + 1e-9f));
+            const float angle = std::sqrt(dot(omega, omega));
+            if (angle < 1e-6f) break;
+
+            const Vec3 axis = omega * (std::sin(angle * 0.5f) / angle);
+            q = multiply({ std::cos(angle * 0.5f), axis.x, axis.y, axis.z }, q);
+            const float length = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+            q = { q.w / length, q.x / length, q.y / length, q.z / length };
+        }
+        return q;
+    }
+
+    // Slerp from no rotation to q, the short way round.
+    Quat scaleRotation(Quat q, float t) {
+        if (q.w < 0.0f) q = { -q.w, -q.x, -q.y, -q.z };
+        const float halfAngle = std::acos(std::min<float>(q.w, 1.0f));
+        const float sinHalfAngle = std::sin(halfAngle);
+        if (sinHalfAngle < 1e-6f) return { 1.0f, 0.0f, 0.0f, 0.0f };
+
+        const float scale = std::sin(t * halfAngle) / sinHalfAngle;
+        return { std::cos(t * halfAngle), q.x * scale, q.y * scale, q.z * scale };
+    }
+
+    Vec3 loadPosition(const float* voxel, size_t particle) {
+        const float* p = voxel + particle * FLOATS_PER_PARTICLE;
+        return { p[0], p[1], p[2] };
+    }
+}
+
+void ParticleInterpolation::interpolate(const std::vector<uint8_t>& from, const std::vector<uint8_t>& to, float t, std::vector<uint8_t>& output) {
+    output.assign(from.begin(), from.end());
+    if (to.size() != from.size()) return;
+
+    constexpr size_t voxelBytes = FLOATS_PER_VOXEL * sizeof(float);
+    const size_t numVoxels = from.size() / voxelBytes;
+    float fromVoxel[FLOATS_PER_VOXEL], toVoxel[FLOATS_PER_VOXEL], outputVoxel[FLOATS_PER_VOXEL];
+    Vec3 fromOffsets[PARTICLES_PER_VOXEL], toOffsets[PARTICLES_PER_VOXEL];
+
+    for (size_t v = 0; v < numVoxels; ++v) {
+        const size_t offset = v * voxelBytes;
+        // Voxels that haven't moved (e.g. sleeping ones) are already right.
+        if (std::memcmp(from.data() + offset, to.data() + offset, voxelBytes) == 0) continue;
+        std::memcpy(fromVoxel, from.data() + offset, voxelBytes);
+        std::memcpy(toVoxel, to.data() + offset, voxelBytes);
+
+        Vec3 fromCentroid = { 0.0f, 0.0f, 0.0f }, toCentroid = { 0.0f, 0.0f, 0.0f };
+        for (size_t i = 0; i < PARTICLES_PER_VOXEL; ++i) {
+            fromCentroid = fromCentroid + loadPosition(fromVoxel, i);
+            toCentroid = toCentroid + loadPosition(toVoxel, i);
+        }
+        fromCentroid = fromCentroid * (1.0f / PARTICLES_PER_VOXEL);
+        toCentroid = toCentroid * (1.0f / PARTICLES_PER_VOXEL);
+        for (size_t i = 0; i < PARTICLES_PER_VOXEL; ++i) {
+            fromOffsets[i] = loadPosition(fromVoxel, i) - fromCentroid;
+            toOffsets[i] = loadPosition(toVoxel, i) - toCentroid;
+        }
+
+        const Quat rotation = matchRotation(fromOffsets, toOffsets);
+        const Quat partialRotation = scaleRotation(rotation, t);
+        const Vec3 centroid = fromCentroid + (toCentroid - fromCentroid) * t;
+
+        std::memcpy(outputVoxel, fromVoxel, voxelBytes);
+        for (size_t i = 0; i < PARTICLES_PER_VOXEL; ++i) {
+            // What the rotation doesn't account for (the voxel deforming) is blended in linearly, so t = 1 lands exactly on to.
+            const Vec3 deformation = toOffsets[i] - rotate(rotation, fromOffsets[i]);
+            const Vec3 position = centroid + rotate(partialRotation, fromOffsets[i]) + deformation * t;
+            float* p = outputVoxel + i * FLOATS_PER_PARTICLE;
+            p[0] = position.x;
+            p[1] = position.y;
+            p[2] = position.z;
+        }
+        std::memcpy(output.data() + offset, outputVoxel, voxelBytes);
+    }
+}
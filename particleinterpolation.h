@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * Reconstructs particle buffers between two cached frames (see SimulationCache), for scrubbing through frames that weren't cached.
+ *
+ * Particles are blended a voxel (8 particles) at a time rather than one by one, since a voxel that spins between the two frames would otherwise
+ * shrink and shear on the way. Each voxel's motion is split into a rigid part - the translation of its centroid, and the rotation that best maps its
+ * particles' offsets from the centroid in one frame onto those in the other (shape matching) - and whatever deformation is left over.
+ * The translation is interpolated linearly and the rotation by slerp, and the deformation is blended in linearly on top.
+ */
+namespace ParticleInterpolation {
+    // Blends from (t = 0) towards to (t = 1). Both hold whole voxels of particles (x, y, z, packed radius and inverse mass).
+    // Only positions are blended: the fourth word of each particle, and any buffer whose size doesn't match, come from from.
+    void interpolate(const std::vector<uint8_t>& from, const std::vector<uint8_t>& to, float t, std::vector<uint8_t>& output);
+}
@@ -1,6 +1,8 @@
 #include "pbd.h"
 #include "utils.h"
 #include "cube.h"
+#include <immintrin.h>
+#include <algorithm>
 
 std::array<FaceConstraints, 3> PBD::constructFaceToFaceConstraints(const MSharedPtr<Voxels> voxels, std::array<std::vector<int>, 3>& voxelToFaceConstraintIndices) {
     std::array<FaceConstraints, 3> faceConstraints;
@@ -35,11 +37,11 @@ std::array<FaceConstraints, 3> PBD::constructFaceToFaceConstraints(const MShared
 
 LongRangeConstraints PBD::constructLongRangeConstraints(const MSharedPtr<Voxels> voxels, const std::array<std::vector<int>, 3>& voxelToFaceConstraintIndices, std::array<uint, 3> faceConstraintsCounts) {
     LongRangeConstraints longRangeConstraints;
-    // Up to 4 long range constraint indices per face constraint index
+    // Up to 4 level 0 long range constraint indices per face constraint index, then one per coarser level.
     // Use 0xFFFFFFF as sentinel for no LR constraint
-    longRangeConstraints.faceIdxToLRConstraintIndices[0].resize(4 * faceConstraintsCounts[0], 0xFFFFFFFF);
-    longRangeConstraints.faceIdxToLRConstraintIndices[1].resize(4 * faceConstraintsCounts[1], 0xFFFFFFFF);
-    longRangeConstraints.faceIdxToLRConstraintIndices[2].resize(4 * faceConstraintsCounts[2], 0xFFFFFFFF);
+    longRangeConstraints.faceIdxToLRConstraintIndices[0].resize(LONG_RANGE_CONSTRAINTS_PER_FACE * faceConstraintsCounts[0], 0xFFFFFFFF);
+    longRangeConstraints.faceIdxToLRConstraintIndices[1].resize(LONG_RANGE_CONSTRAINTS_PER_FACE * faceConstraintsCounts[1], 0xFFFFFFFF);
+    longRangeConstraints.faceIdxToLRConstraintIndices[2].resize(LONG_RANGE_CONSTRAINTS_PER_FACE * faceConstraintsCounts[2], 0xFFFFFFFF);
 
     const std::vector<uint32_t>& mortonCodes = voxels->mortonCodes;
     const std::unordered_map<uint32_t, uint32_t>& mortonCodesToSortedIdx = voxels->mortonCodesToSortedIdx;
@@ -96,50 +98,279 @@ LongRangeConstraints PBD::constructLongRangeConstraints(const MSharedPtr<Voxels>
         for (int axis = 0; axis < 3; ++axis) {
             for (uint faceConstraintIdx : faceConstraintIndices[axis]) {
                 uint visitedCount = faceConstraintVisitedCounts[axis][faceConstraintIdx];
-                uint lrConstraintArrayOffset = faceConstraintIdx * 4 + (visitedCount - 1);
+                uint lrConstraintArrayOffset = faceConstraintIdx * LONG_RANGE_CONSTRAINTS_PER_FACE + (visitedCount - 1);
                 longRangeConstraints.faceIdxToLRConstraintIndices[axis][lrConstraintArrayOffset] = currentLRConstraintIdx;
             }
         }
     }
 
+    longRangeConstraints.levelOffsets[1] = static_cast<uint>(longRangeConstraints.particleIndices.size() / 8);
+    for (int level = 1; level < LONG_RANGE_LEVELS; ++level) {
+        constructCoarseLongRangeConstraints(voxels, voxelToFaceConstraintIndices, level, longRangeConstraints);
+        longRangeConstraints.levelOffsets[level + 1] = static_cast<uint>(longRangeConstraints.particleIndices.size() / 8);
+    }
+
     return longRangeConstraints;
 }
 
-ParticleDataContainer PBD::createParticles(const MSharedPtr<Voxels> voxels) {
+// Coarse levels use clusters of (2^(level+1))^3 voxels, aligned to multiples of the cluster size. Since voxels are sorted by Morton code,
+// the voxels of an aligned cluster are exactly a contiguous run sharing the same high Morton bits.
+// A cluster gets a constraint if it's at least MIN_COARSE_CLUSTER_OCCUPANCY full, and its 8 corner voxels are occupied and connected through it
+// (the constraint keeps the corner particles in the shape of the whole cluster, so it mustn't tie separate pieces together).
+// Partially occupied clusters have fewer internal faces to break, so their counters start part way to the break threshold.
+void PBD::constructCoarseLongRangeConstraints(
+    const MSharedPtr<Voxels> voxels, 
+    const std::array<std::vector<int>, 3>& voxelToFaceConstraintIndices, 
+    int level, 
+    LongRangeConstraints& longRangeConstraints
+) {
+    const std::vector<uint32_t>& mortonCodes = voxels->mortonCodes;
+    const std::unordered_map<uint32_t, uint32_t>& mortonCodesToSortedIdx = voxels->mortonCodesToSortedIdx;
     const int numOccupied = voxels->numOccupied;
-    const MMatrixArray& modelMatrices = voxels->modelMatrices;
-    double scaleArr[3] = {1.0, 1.0, 1.0};
-    float particleRadius = static_cast<float>(voxels->voxelSize) * 0.25f;
 
-    for (int i = 0; i < numOccupied; i++) {
-        MMatrix voxelToWorld = modelMatrices[i];
-        MTransformationMatrix voxelTransform(voxelToWorld);
-        voxelTransform.getScale(scaleArr, MSpace::kWorld);
-
-        for (int j = 0; j < 8; j++) {
-            // Offset the particle towards the center of the voxel by particleRadius along each axis
-            MPoint corner = MPoint(cubeCorners[j][0], cubeCorners[j][1], cubeCorners[j][2]);
-            corner -= ((particleRadius / scaleArr[0]) * Utils::sign(corner));
-            
-            corner = corner * voxelToWorld;
-            uint32_t packedRadiusAndW = Utils::packTwoFloatsInUint32(particleRadius, 1.0f); // w is initialized to 1.0f but is user-editable via the voxel paint tool
-            particles.push_back({static_cast<float>(corner.x), static_cast<float>(corner.y), static_cast<float>(corner.z), packedRadiusAndW});
-            totalParticles++;
+    const uint clusterShift = 3 * (level + 1);
+    const uint clusterSize = 1u << (level + 1);
+    const uint voxelsPerCluster = 1u << clusterShift;
+    const uint fullClusterFaces = 3 * clusterSize * clusterSize * (clusterSize - 1);
+    const int faceSlot = 4 + (level - 1);
+
+    int runStart = 0;
+    while (runStart < numOccupied) {
+        const uint32_t clusterKey = mortonCodes[runStart] >> clusterShift;
+        int runEnd = runStart + 1;
+        while (runEnd < numOccupied && (mortonCodes[runEnd] >> clusterShift) == clusterKey) runEnd++;
+
+        if (static_cast<float>(runEnd - runStart) < MIN_COARSE_CLUSTER_OCCUPANCY * voxelsPerCluster) {
+            runStart = runEnd;
+            continue;
+        }
+
+        std::array<uint32_t, 3> clusterOrigin;
+        Utils::fromMortonCode(clusterKey << clusterShift, clusterOrigin[0], clusterOrigin[1], clusterOrigin[2]);
+
+        // Corner particles of the cluster: particle `corner` of each of the cluster's 8 corner voxels (see level 0 in constructLongRangeConstraints).
+        std::array<uint, 8> particleIndices;
+        bool hasAllCorners = true;
+        for (uint corner = 0; corner < 8 && hasAllCorners; ++corner) {
+            uint32_t cornerMortonCode = Utils::toMortonCode(
+                clusterOrigin[0] + ((corner >> 0) & 1) * (clusterSize - 1),
+                clusterOrigin[1] + ((corner >> 1) & 1) * (clusterSize - 1),
+                clusterOrigin[2] + ((corner >> 2) & 1) * (clusterSize - 1)
+            );
+            auto cornerIt = mortonCodesToSortedIdx.find(cornerMortonCode);
+            hasAllCorners = (cornerIt != mortonCodesToSortedIdx.end());
+            if (hasAllCorners) particleIndices[corner] = (cornerIt->second * 8u + corner) << 4;
+        }
+        if (!hasAllCorners || !coarseClusterConnected(mortonCodes, runStart, runEnd, clusterSize)) {
+            runStart = runEnd;
+            continue;
+        }
+        const size_t firstParticleEntry = longRangeConstraints.particleIndices.size();
+        longRangeConstraints.particleIndices.insert(longRangeConstraints.particleIndices.end(), particleIndices.begin(), particleIndices.end());
+
+        // Every face constraint between two voxels of the cluster counts toward breaking it.
+        uint currentLRConstraintIdx = static_cast<uint>(longRangeConstraints.particleIndices.size() / 8 - 1);
+        uint clusterFaces = 0;
+        for (int voxelIdx = runStart; voxelIdx < runEnd; ++voxelIdx) {
+            std::array<uint32_t, 3> voxelCoords;
+            Utils::fromMortonCode(mortonCodes[voxelIdx], voxelCoords[0], voxelCoords[1], voxelCoords[2]);
+
+            for (int axis = 0; axis < 3; ++axis) {
+                if ((voxelCoords[axis] & (clusterSize - 1)) == clusterSize - 1) continue; // +axis neighbour is outside the cluster
+
+                int faceConstraintIdx = voxelToFaceConstraintIndices[axis][voxelIdx];
+                if (faceConstraintIdx == -1) continue;
+                longRangeConstraints.faceIdxToLRConstraintIndices[axis][faceConstraintIdx * LONG_RANGE_CONSTRAINTS_PER_FACE + faceSlot] = currentLRConstraintIdx;
+                clusterFaces++;
+            }
+        }
+
+        // A partial cluster may break after proportionally fewer faces than a full one (but always at least one).
+        const uint threshold = LONG_RANGE_BREAK_THRESHOLD(level);
+        const uint allowedBreaks = std::max<uint>(1, (threshold * clusterFaces + fullClusterFaces / 2) / fullClusterFaces);
+        longRangeConstraints.particleIndices[firstParticleEntry] |= threshold - allowedBreaks;
+
+        runStart = runEnd;
+    }
+}
+
+// Flood fills a coarse cluster's voxels (the run [runStart, runEnd) of mortonCodes) across shared faces from one corner,
+// and returns whether that reaches all 8 corners. The cluster is aligned, so the low Morton bits of a voxel are its position within the cluster.
+bool PBD::coarseClusterConnected(const std::vector<uint32_t>& mortonCodes, int runStart, int runEnd, uint clusterSize) {
+    const uint32_t localMask = clusterSize * clusterSize * clusterSize - 1;
+    std::vector<uint8_t> occupied(localMask + 1, 0);
+    for (int voxelIdx = runStart; voxelIdx < runEnd; ++voxelIdx) {
+        occupied[mortonCodes[voxelIdx] & localMask] = 1;
+    }
+
+    std::vector<uint8_t> reached(localMask + 1, 0);
+    std::vector<uint32_t> stack = { 0 }; // Corner 0 (the cluster origin)
+    reached[0] = 1;
+    while (!stack.empty()) {
+        std::array<uint32_t, 3> coords;
+        Utils::fromMortonCode(stack.back(), coords[0], coords[1], coords[2]);
+        stack.pop_back();
+
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int direction = -1; direction <= 1; direction += 2) {
+                std::array<uint32_t, 3> neighborCoords = coords;
+                neighborCoords[axis] += direction; // Wraps past 0, so it fails the bounds check below
+                if (neighborCoords[axis] >= clusterSize) continue;
+
+                uint32_t neighborCode = Utils::toMortonCode(neighborCoords[0], neighborCoords[1], neighborCoords[2]);
+                if (!occupied[neighborCode] || reached[neighborCode]) continue;
+                reached[neighborCode] = 1;
+                stack.push_back(neighborCode);
+            }
         }
     }
 
+    for (uint corner = 0; corner < 8; ++corner) {
+        uint32_t cornerCode = Utils::toMortonCode(
+            ((corner >> 0) & 1) * (clusterSize - 1),
+            ((corner >> 1) & 1) * (clusterSize - 1),
+            ((corner >> 2) & 1) * (clusterSize - 1)
+        );
+        if (!reached[cornerCode]) return false;
+    }
+    return true;
+}
+
+ParticleDataContainer PBD::createParticles(const MSharedPtr<Voxels> voxels) {
+    const int numOccupied = voxels->numOccupied;
+    const float voxelSize = static_cast<float>(voxels->voxelSize);
+    float particleRadius = voxelSize * 0.25f;
+
+    // Every voxel shares the grid's uniform scale (voxelSize), so the inward offset of each particle is the same for all voxels:
+    // the corner (+-0.5 in voxel-local space) moved towards the center by particleRadius along each axis.
+    // Likewise, radius and w are uniform at creation time, so the half-precision packing is done once.
+    // (w is initialized to 1.0f but is user-editable via the voxel paint tool)
+    ParticleGenerationTaskData baseTaskData {
+        &voxels->modelMatrices,
+        nullptr,
+        0.5f - (particleRadius / voxelSize),
+        Utils::packTwoFloatsInUint32(particleRadius, 1.0f),
+        0,
+        numOccupied
+    };
+
+    particles.clear();
+    particles.resize(static_cast<size_t>(numOccupied) * 8);
+    totalParticles = static_cast<uint>(particles.size());
+    baseTaskData.particles = particles.data();
+
+    MThreadPool::init();
+    MThreadPool::newParallelRegion(PBD::createParticlesInParallel, (void*)&baseTaskData);
+    MThreadPool::release(); // reduce reference count incurred by opening a new parallel region
+    MThreadPool::release(); // reduce reference count incurred by init()
+
     renderParticlesBuffer = DirectX::createReadWriteBuffer(particles);
     renderParticlesUAV = DirectX::createUAV(renderParticlesBuffer);
     renderParticlesSRV = DirectX::createSRV(renderParticlesBuffer);
 
+    createVoxelAdjacency(voxels);
+
     return {
         totalParticles,
         &particles,
         &voxels->isSurface,
+        &voxelAdjacency,
         particleRadius
     };
 }
 
+// Every pair of face-adjacent voxels starts out joined by a face constraint (see constructFaceToFaceConstraints),
+// so each voxel starts out glued to all of its occupied face neighbours. The face constraints shader clears bits as constraints break.
+void PBD::createVoxelAdjacency(const MSharedPtr<Voxels> voxels) {
+    const std::vector<uint32_t>& mortonCodes = voxels->mortonCodes;
+    const std::unordered_map<uint32_t, uint32_t>& mortonCodesToSortedIdx = voxels->mortonCodesToSortedIdx;
+    const int numOccupied = voxels->numOccupied;
+
+    voxelAdjacency.clear();
+    voxelAdjacency.resize(numOccupied);
+    for (int i = 0; i < numOccupied; i++) {
+        std::array<uint32_t, 3> voxelCoords;
+        Utils::fromMortonCode(mortonCodes[i], voxelCoords[0], voxelCoords[1], voxelCoords[2]);
+
+        uint faceConnections = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            std::array<uint32_t, 3> neighborCoords = voxelCoords;
+            neighborCoords[axis] += 1;
+            if (mortonCodesToSortedIdx.find(Utils::toMortonCode(neighborCoords[0], neighborCoords[1], neighborCoords[2])) != mortonCodesToSortedIdx.end()) {
+                faceConnections |= (1u << (2 * axis));
+            }
+
+            if (voxelCoords[axis] == 0) continue;
+            neighborCoords[axis] -= 2;
+            if (mortonCodesToSortedIdx.find(Utils::toMortonCode(neighborCoords[0], neighborCoords[1], neighborCoords[2])) != mortonCodesToSortedIdx.end()) {
+                faceConnections |= (1u << (2 * axis + 1));
+            }
+        }
+
+        voxelAdjacency[i].gridCoords = voxelCoords[0] | (voxelCoords[1] << VOXEL_GRID_COORD_BITS) | (voxelCoords[2] << (2 * VOXEL_GRID_COORD_BITS));
+        voxelAdjacency[i].modelVoxelIdx = static_cast<uint>(i);
+        voxelAdjacency[i].faceConnections = faceConnections;
+    }
+}
+
+void PBD::createParticlesInParallel(void* data, MThreadRootTask* rootTask) {
+    const ParticleGenerationTaskData* baseTaskData = static_cast<const ParticleGenerationTaskData*>(data);
+    const int numVoxels = baseTaskData->lastVoxel;
+    const int numTasks = Utils::divideRoundUp(numVoxels, VOXELS_PER_PARTICLE_TASK);
+
+    std::vector<ParticleGenerationTaskData> taskData(numTasks, *baseTaskData);
+    for (int i = 0; i < numTasks; ++i) {
+        taskData[i].firstVoxel = i * VOXELS_PER_PARTICLE_TASK;
+        taskData[i].lastVoxel = std::min(numVoxels, (i + 1) * VOXELS_PER_PARTICLE_TASK);
+        MThreadPool::createTask(PBD::createParticlesForVoxelRange, (void*)&taskData[i], rootTask);
+    }
+    MThreadPool::executeAndJoin(rootTask);
+}
+
+/**
+ * With row vectors (Maya convention), a voxel-local point p maps to world space as p.x * row0 + p.y * row1 + p.z * row2 + row3.
+ * Each particle sits at +-cornerOffset along every local axis, so we pre-scale the three axis rows once per voxel
+ * and each of the 8 particles is just the voxel center plus or minus each scaled axis.
+ */
+MThreadRetVal PBD::createParticlesForVoxelRange(void* data) {
+    const ParticleGenerationTaskData* taskData = static_cast<const ParticleGenerationTaskData*>(data);
+    const MMatrixArray& modelMatrices = *taskData->modelMatrices;
+    const __m128 cornerOffset = _mm_set1_ps(taskData->cornerOffset);
+    const __m128i packedRadiusAndW = _mm_set1_epi32(static_cast<int>(taskData->packedRadiusAndW));
+    // Selects xyz from a position and w from packedRadiusAndW
+    const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+    auto loadRow = [](const double* row) {
+        return _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(row)), _mm_cvtpd_ps(_mm_loadu_pd(row + 2)));
+    };
+
+    for (int i = taskData->firstVoxel; i < taskData->lastVoxel; ++i) {
+        const MMatrix& voxelToWorld = modelMatrices[i];
+        const __m128 axisX = _mm_mul_ps(loadRow(voxelToWorld.matrix[0]), cornerOffset);
+        const __m128 axisY = _mm_mul_ps(loadRow(voxelToWorld.matrix[1]), cornerOffset);
+        const __m128 axisZ = _mm_mul_ps(loadRow(voxelToWorld.matrix[2]), cornerOffset);
+        const __m128 center = loadRow(voxelToWorld.matrix[3]);
+
+        // The four corners of the -z face, then offset them along +-z. Order matches cubeCorners (Morton order: x fastest, then y, then z).
+        const __m128 xNeg = _mm_sub_ps(center, axisX);
+        const __m128 xPos = _mm_add_ps(center, axisX);
+        const __m128 xyCorners[4] = {
+            _mm_sub_ps(xNeg, axisY), _mm_sub_ps(xPos, axisY),
+            _mm_add_ps(xNeg, axisY), _mm_add_ps(xPos, axisY)
+        };
+
+        Particle* out = taskData->particles + static_cast<size_t>(i) * 8;
+        for (int j = 0; j < 4; ++j) {
+            const __m128 zNeg = _mm_sub_ps(xyCorners[j], axisZ);
+            const __m128 zPos = _mm_add_ps(xyCorners[j], axisZ);
+            _mm_storeu_ps(reinterpret_cast<float*>(out + j),     _mm_or_ps(_mm_and_ps(xyzMask, zNeg), _mm_andnot_ps(xyzMask, _mm_castsi128_ps(packedRadiusAndW))));
+            _mm_storeu_ps(reinterpret_cast<float*>(out + j + 4), _mm_or_ps(_mm_and_ps(xyzMask, zPos), _mm_andnot_ps(xyzMask, _mm_castsi128_ps(packedRadiusAndW))));
+        }
+    }
+
+    return 0;
+}
+
 void PBD::createComputeShaders(
     const MSharedPtr<Voxels> voxels, 
     const std::array<FaceConstraints, 3>& faceConstraints,
@@ -175,28 +406,94 @@ void PBD::createComputeShaders(
     faceConstraintsCompute.setLongRangeConstraintCountersUAV(longRangeConstraintsCompute.getLongRangeParticleIndicesUAV());
 
     preVGSCompute = PreVGSCompute(numParticles());
+
+    // Broken constraints are periodically dropped from dense live lists, so constraint passes stop launching threads for them.
+    constraintCompactionCompute = ConstraintCompactionCompute(faceConstraints, longRangeConstraintsCompute.getLevelOffsets());
+    constraintCompactionCompute.setLongRangeParticleIndicesUAV(longRangeConstraintsCompute.getLongRangeParticleIndicesUAV());
+    for (int axis = 0; axis < 3; ++axis) {
+        constraintCompactionCompute.setFaceConstraintIndicesUAV(axis, faceConstraintsCompute.getFaceConstraintIndicesUAV(axis));
+    }
+    faceConstraintsCompute.setLiveConstraints(
+        { constraintCompactionCompute.getLiveFaceConstraintsSRV(0), constraintCompactionCompute.getLiveFaceConstraintsSRV(1), constraintCompactionCompute.getLiveFaceConstraintsSRV(2) },
+        constraintCompactionCompute.getLiveCountsSRV(),
+        constraintCompactionCompute.getLiveDispatchArgsBuffer(),
+        {
+            ConstraintCompactionCompute::argsOffset(LIVE_FACE_CONSTRAINTS_SLOT),
+            ConstraintCompactionCompute::argsOffset(LIVE_FACE_CONSTRAINTS_SLOT + 1),
+            ConstraintCompactionCompute::argsOffset(LIVE_FACE_CONSTRAINTS_SLOT + 2)
+        }
+    );
+
+    // Every substep, the activity shader compacts awake voxels (and the constraints touching them) into worklists.
+    // The solver shaders then dispatch indirectly over those worklists, so sleeping voxels cost nothing.
+    voxelActivityCompute = VoxelActivityCompute(
+        numParticles(),
+        particleRadius,
+        faceConstraints,
+        longRangeConstraintsCompute.getLevelOffsets()
+    );
+    voxelActivityCompute.setLongRangeParticleIndicesUAV(longRangeConstraintsCompute.getLongRangeParticleIndicesUAV());
+    voxelActivityCompute.setLiveConstraints(constraintCompactionCompute);
+    for (int axis = 0; axis < 3; ++axis) {
+        voxelActivityCompute.setFaceConstraintIndicesUAV(axis, faceConstraintsCompute.getFaceConstraintIndicesUAV(axis));
+    }
+
+    const ComPtr<ID3D11Buffer>& dispatchArgsBuffer = voxelActivityCompute.getDispatchArgsBuffer();
+    const ComPtr<ID3D11ShaderResourceView>& activeCountsSRV = voxelActivityCompute.getActiveCountsSRV();
+    preVGSCompute.setActiveVoxels(
+        voxelActivityCompute.getActiveVoxelsSRV(), activeCountsSRV, dispatchArgsBuffer, VoxelActivityCompute::argsOffset(VoxelActivityCompute::PREVGS_ARGS)
+    );
+    vgsCompute.setActiveVoxels(
+        voxelActivityCompute.getActiveVoxelsSRV(), activeCountsSRV, dispatchArgsBuffer, VoxelActivityCompute::argsOffset(VoxelActivityCompute::VGS_ARGS)
+    );
+    longRangeConstraintsCompute.setActiveConstraints(
+        voxelActivityCompute.getActiveLongRangeConstraintsSRV(), activeCountsSRV, dispatchArgsBuffer, VoxelActivityCompute::argsOffset(VoxelActivityCompute::LONG_RANGE_CONSTRAINTS_ARGS)
+    );
+    faceConstraintsCompute.setActiveConstraints(
+        { voxelActivityCompute.getActiveFaceConstraintsSRV(0), voxelActivityCompute.getActiveFaceConstraintsSRV(1), voxelActivityCompute.getActiveFaceConstraintsSRV(2) },
+        activeCountsSRV,
+        dispatchArgsBuffer,
+        {
+            VoxelActivityCompute::argsOffset(VoxelActivityCompute::FACE_CONSTRAINTS_ARGS),
+            VoxelActivityCompute::argsOffset(VoxelActivityCompute::FACE_CONSTRAINTS_ARGS + 1),
+            VoxelActivityCompute::argsOffset(VoxelActivityCompute::FACE_CONSTRAINTS_ARGS + 2)
+        }
+    );
 }
 
 // See note in PBDNode destructor
 // Only need to reset compute shaders that own buffers
 void PBD::resetComputeShaders() {
+    vgsCompute.reset();
     faceConstraintsCompute.reset();
     longRangeConstraintsCompute.reset();
+    voxelActivityCompute.reset();
+    constraintCompactionCompute.reset();
 }
 
 void PBD::setGPUResourceHandles(
     ComPtr<ID3D11UnorderedAccessView> particleUAV,
     ComPtr<ID3D11UnorderedAccessView> oldParticlesUAV,
     ComPtr<ID3D11UnorderedAccessView> isSurfaceUAV,
-    ComPtr<ID3D11ShaderResourceView> isDraggingSRV
+    ComPtr<ID3D11ShaderResourceView> isDraggingSRV,
+    ComPtr<ID3D11UnorderedAccessView> voxelActivityUAV,
+    ComPtr<ID3D11UnorderedAccessView> voxelAdjacencyUAV,
+    ComPtr<ID3D11UnorderedAccessView> surfaceVoxelsUAV,
+    uint voxelOffset
 ) {
     vgsCompute.setParticlesUAV(particleUAV);
     faceConstraintsCompute.setParticlesUAV(particleUAV);
     faceConstraintsCompute.setIsSurfaceUAV(isSurfaceUAV);
+    faceConstraintsCompute.setVoxelAdjacencyUAV(voxelAdjacencyUAV);
+    faceConstraintsCompute.setSurfaceVoxels(surfaceVoxelsUAV, voxelOffset);
     preVGSCompute.setParticlesUAV(particleUAV);
     preVGSCompute.setOldParticlesUAV(oldParticlesUAV);
     preVGSCompute.setIsDraggingSRV(isDraggingSRV);
     longRangeConstraintsCompute.setParticlesUAV(particleUAV);
+    voxelActivityCompute.setParticlesUAV(particleUAV);
+    voxelActivityCompute.setOldParticlesUAV(oldParticlesUAV);
+    voxelActivityCompute.setIsDraggingSRV(isDraggingSRV);
+    voxelActivityCompute.setVoxelActivityUAV(voxelActivityUAV);
 }
 
 void PBD::updateFaceConstraintsWithPaintValues(
@@ -205,7 +502,9 @@ void PBD::updateFaceConstraintsWithPaintValues(
     float constraintLow, 
     float constraintHigh
 ) {
+    constraintCompactionCompute.ensureCurrent();
     faceConstraintsCompute.updateFaceConstraintsFromPaint(paintDeltaUAV, paintValueUAV, constraintLow, constraintHigh);
+    SimulationCache::instance()->markBuffersModified();
 }
 
 void PBD::updateParticleMassWithPaintValues(
@@ -215,27 +514,53 @@ void PBD::updateParticleMassWithPaintValues(
     float massHigh
 ) {
     preVGSCompute.updateParticleMassFromPaintValues(paintDeltaUAV, paintValueUAV, massLow, massHigh);
+    SimulationCache::instance()->markBuffersModified();
 }
 
 // Note that FPS changes just make the playback choppier / smoother. A lower FPS means each frame is a bigger simulation timestep,
 // but the same time passes overall. To make the sim *run* slower or faster, you need to change the timeslider playback speed factor.
 void PBD::updateSimulationParameters(const SimulationParameters& simParams) {
+    vgsTargetResidual = simParams.vgsTargetResidual;
     if (simParams == simulationParameters) return;
 
     const float compliance = simParams.compliance / simParams.secondsPerFrame; // normalize compliance by timestep to keep behavior consistent at different substeps per frame.
-    vgsCompute.updateVGSParameters(simParams.vgsRelaxation, simParams.vgsEdgeUniformity, static_cast<uint>(simParams.vgsIterations), compliance);
+    // With the controller on, the user's iteration count is only the starting budget (see updateAdaptiveVGS).
+    const uint vgsIterations = (simParams.vgsTargetResidual > 0.0f) ? vgsCompute.getIterationCount() : simParams.vgsIterations;
+    vgsCompute.updateVGSParameters(simParams.vgsRelaxation, simParams.vgsEdgeUniformity, vgsIterations, compliance, simParams.vgsResidualTolerance);
     faceConstraintsCompute.updateVGSParameters(simParams.vgsRelaxation, simParams.vgsEdgeUniformity, static_cast<uint>(simParams.vgsIterations), compliance);
     longRangeConstraintsCompute.updateVGSParameters(simParams.vgsRelaxation, simParams.vgsEdgeUniformity, static_cast<uint>(simParams.vgsIterations), compliance);
     preVGSCompute.updatePreVgsConstants(simParams.secondsPerFrame, simParams.gravityStrength);
+
+    // Sleep thresholds are given per second, but the shader measures motion per substep.
+    const uint sleepDelay = std::max(1u, static_cast<uint>(std::ceil(VoxelActivityCompute::SLEEP_DELAY_SECONDS / simParams.secondsPerFrame)));
+    voxelActivityCompute.updateActivityParameters(simParams.sleepingEnabled, simParams.sleepVelocity * simParams.secondsPerFrame, simParams.sleepStrain, sleepDelay);
+}
+
+void PBD::updateAdaptiveVGS() {
+    if (!initialized) return;
+    if (!vgsCompute.collectResidualStats(vgsResidualStats)) return;
+    if (vgsTargetResidual <= 0.0f || vgsResidualStats.substepMaxResiduals.empty()) return;
+
+    uint iterationBudget = vgsCompute.getIterationCount();
+    if (vgsResidualStats.maxResidual > vgsTargetResidual) {
+        iterationBudget = std::min(iterationBudget + 1, MAX_ADAPTIVE_VGS_ITERATIONS);
+    } else if (vgsResidualStats.maxResidual < vgsTargetResidual * ADAPTIVE_VGS_LOWER_THRESHOLD) {
+        iterationBudget = std::max(iterationBudget - 1, 1u);
+    }
+
+    vgsCompute.setIterationCount(iterationBudget);
 }
 
 void PBD::mergeRenderParticles() {
+    constraintCompactionCompute.ensureCurrent();
     faceConstraintsCompute.mergeRenderParticles();
 }
 
 void PBD::simulateSubstep() {
     if (!initialized) return;
 
+    constraintCompactionCompute.onSubstep();
+    voxelActivityCompute.dispatch();
     preVGSCompute.dispatch();
     vgsCompute.dispatch();
     longRangeConstraintsCompute.dispatch();
@@ -9,24 +9,37 @@
 #include "directx/compute/faceconstraintscompute.h"
 #include "custommayaconstructs/data/particledata.h"
 #include "directx/compute/longrangeconstraintscompute.h"
+#include "directx/compute/voxelactivitycompute.h"
+#include "directx/compute/constraintcompactioncompute.h"
 
 #include <maya/MSharedPtr.h>
+#include <maya/MThreadPool.h>
 
 struct SimulationParameters {
     float compliance;
     float vgsRelaxation;
     float vgsEdgeUniformity;
     uint vgsIterations;
+    float vgsResidualTolerance;
+    float vgsTargetResidual;
     float gravityStrength;
     float secondsPerFrame;
+    bool sleepingEnabled;
+    float sleepVelocity;
+    float sleepStrain;
     
     bool operator==(const SimulationParameters& other) const {
         return (compliance == other.compliance &&
                 vgsRelaxation == other.vgsRelaxation &&
                 vgsEdgeUniformity == other.vgsEdgeUniformity &&
                 vgsIterations == other.vgsIterations &&
+                vgsResidualTolerance == other.vgsResidualTolerance &&
+                vgsTargetResidual == other.vgsTargetResidual &&
                 gravityStrength == other.gravityStrength &&
-                secondsPerFrame == other.secondsPerFrame);
+                secondsPerFrame == other.secondsPerFrame &&
+                sleepingEnabled == other.sleepingEnabled &&
+                sleepVelocity == other.sleepVelocity &&
+                sleepStrain == other.sleepStrain);
     };
 };
 
@@ -41,6 +54,8 @@ public:
 
     LongRangeConstraints constructLongRangeConstraints(MSharedPtr<Voxels> voxels, const std::array<std::vector<int>, 3>& voxelToFaceConstraintIndices, std::array<uint, 3> faceConstraintsCounts);
 
+    void constructCoarseLongRangeConstraints(MSharedPtr<Voxels> voxels, const std::array<std::vector<int>, 3>& voxelToFaceConstraintIndices, int level, LongRangeConstraints& longRangeConstraints);
+
     ParticleDataContainer createParticles(MSharedPtr<Voxels> voxels);
 
     void createComputeShaders(
@@ -53,7 +68,11 @@ public:
         ComPtr<ID3D11UnorderedAccessView> particleUAV,
         ComPtr<ID3D11UnorderedAccessView> oldParticlesUAV,
         ComPtr<ID3D11UnorderedAccessView> isSurfaceUAV,
-        ComPtr<ID3D11ShaderResourceView> isDraggingSRV
+        ComPtr<ID3D11ShaderResourceView> isDraggingSRV,
+        ComPtr<ID3D11UnorderedAccessView> voxelActivityUAV,
+        ComPtr<ID3D11UnorderedAccessView> voxelAdjacencyUAV,
+        ComPtr<ID3D11UnorderedAccessView> surfaceVoxelsUAV,
+        uint voxelOffset
     );
 
     void resetComputeShaders();
@@ -86,6 +105,14 @@ public:
 
     void updateSimulationParameters(const SimulationParameters& simParams);
 
+    // Call once per simulated frame, after its substeps. Picks up the latest VGS residual stats and, if a target residual is set
+    // (see SimulationParameters::vgsTargetResidual), nudges the VGS iteration budget toward it.
+    void updateAdaptiveVGS();
+
+    const VGSResidualStats& getVGSResidualStats() const {
+        return vgsResidualStats;
+    }
+
     const ComPtr<ID3D11ShaderResourceView>& getRenderParticlesSRV() const {
         return renderParticlesSRV;
     }
@@ -94,6 +121,7 @@ private:
     // Inverse mass (w) and particle radius stored, packed at half-precision, as 4th component.
     // TODO: particles do not need to be stored after the node is done initializing. (The global solver maintains them on the GPU, and should save them as a node attribute).
     std::vector<Particle> particles;
+    std::vector<VoxelAdjacency> voxelAdjacency;
     uint totalParticles{ 0 };
     bool initialized = false;
     int totalSubsteps = 0;
@@ -101,10 +129,37 @@ private:
     ComPtr<ID3D11UnorderedAccessView> renderParticlesUAV;
     ComPtr<ID3D11ShaderResourceView> renderParticlesSRV;
     SimulationParameters simulationParameters;
+    VGSResidualStats vgsResidualStats;
+    float vgsTargetResidual = 0.0f; // Of the adaptive VGS controller, as last passed to updateSimulationParameters (0 is off)
+
+    // Bounds of the adaptive VGS iteration budget.
+    static constexpr uint MAX_ADAPTIVE_VGS_ITERATIONS = 10;
+    // The budget is only lowered once the residual is comfortably under target, so it doesn't oscillate around it.
+    static constexpr float ADAPTIVE_VGS_LOWER_THRESHOLD = 0.5f;
+
+    // Payload for the parallel particle generator. Each task fills the 8 particles of a contiguous run of voxels.
+    struct ParticleGenerationTaskData {
+        const MMatrixArray* modelMatrices;
+        Particle* particles;
+        float cornerOffset;          // Distance of each particle from the voxel center, in voxel-local units
+        uint32_t packedRadiusAndW;
+        int firstVoxel;
+        int lastVoxel;               // Exclusive
+    };
+
+    static constexpr int VOXELS_PER_PARTICLE_TASK = 1024;
+    // Coarse long-range clusters need at least this fraction of their voxels (as well as all 8 corners, connected through the cluster).
+    static constexpr float MIN_COARSE_CLUSTER_OCCUPANCY = 0.5f;
+    static bool coarseClusterConnected(const std::vector<uint32_t>& mortonCodes, int runStart, int runEnd, uint clusterSize);
+    void createVoxelAdjacency(MSharedPtr<Voxels> voxels);
+    static void createParticlesInParallel(void* data, MThreadRootTask* rootTask);
+    static MThreadRetVal createParticlesForVoxelRange(void* data);
 
     // Shaders
     VGSCompute vgsCompute;
     FaceConstraintsCompute faceConstraintsCompute;
     PreVGSCompute preVGSCompute;
     LongRangeConstraintsCompute longRangeConstraintsCompute;
+    VoxelActivityCompute voxelActivityCompute;
+    ConstraintCompactionCompute constraintCompactionCompute;
 };
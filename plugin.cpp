@@ -17,9 +17,11 @@
 #include "custommayaconstructs/usernodes/capsulecollider.h"
 #include "custommayaconstructs/usernodes/cylindercollider.h"
 #include "custommayaconstructs/usernodes/planecollider.h"
+#include "custommayaconstructs/usernodes/meshcollider.h"
 #include "custommayaconstructs/commands/createcollidercommand.h"
 #include "custommayaconstructs/commands/changevoxeleditmodecommand.h"
 #include "custommayaconstructs/commands/applyvoxelpaintcommand.h"
+#include "custommayaconstructs/commands/cachestatscommand.h"
 #include "simulationcache.h"
 #include <maya/MDrawRegistry.h>
 #include <maya/MTransformationMatrix.h>
@@ -234,6 +236,8 @@ EXPORT MStatus initializePlugin(MObject obj)
 	CHECK_MSTATUS(status);
 	status = plugin.registerCommand(ApplyVoxelPaintCommand::commandName, ApplyVoxelPaintCommand::creator, ApplyVoxelPaintCommand::syntax);
 	CHECK_MSTATUS(status);
+	status = plugin.registerCommand(CacheStatsCommand::commandName, CacheStatsCommand::creator, CacheStatsCommand::syntax);
+	CHECK_MSTATUS(status);
 	status = plugin.registerData(VoxelData::fullName, VoxelData::id, VoxelData::creator);
 	CHECK_MSTATUS(status);
 	status = plugin.registerData(ParticleData::fullName, ParticleData::id, ParticleData::creator);
@@ -258,6 +262,8 @@ EXPORT MStatus initializePlugin(MObject obj)
 	CHECK_MSTATUS(status);
 	status = plugin.registerNode(PlaneCollider::typeName, PlaneCollider::id, PlaneCollider::creator, PlaneCollider::initialize, MPxNode::kLocatorNode, &ColliderDrawOverride::drawDbClassification);
 	CHECK_MSTATUS(status);
+	status = plugin.registerNode(MeshCollider::typeName, MeshCollider::id, MeshCollider::creator, MeshCollider::initialize, MPxNode::kLocatorNode, &ColliderDrawOverride::drawDbClassification);
+	CHECK_MSTATUS(status);
 	status = plugin.registerContextCommand("voxelDragContextCommand", VoxelDragContextCommand::creator);
 	CHECK_MSTATUS(status);
 	status = plugin.registerContextCommand("voxelPaintContextCommand", VoxelPaintContextCommand::creator);
@@ -326,6 +332,8 @@ EXPORT MStatus uninitializePlugin(MObject obj)
 	CHECK_MSTATUS(status);
 	status = plugin.deregisterCommand(ApplyVoxelPaintCommand::commandName);
 	CHECK_MSTATUS(status);
+	status = plugin.deregisterCommand(CacheStatsCommand::commandName);
+	CHECK_MSTATUS(status);
     status = plugin.deregisterContextCommand("voxelDragContextCommand");
 	CHECK_MSTATUS(status);
 	status = plugin.deregisterContextCommand("voxelPaintContextCommand");
@@ -350,6 +358,8 @@ EXPORT MStatus uninitializePlugin(MObject obj)
 	CHECK_MSTATUS(status);
 	status = plugin.deregisterNode(PlaneCollider::id);
 	CHECK_MSTATUS(status);
+	status = plugin.deregisterNode(MeshCollider::id);
+	CHECK_MSTATUS(status);
     status = MRenderer::theRenderer()->deregisterOverride(plugin::voxelRendererOverride);
 	CHECK_MSTATUS(status);
 	status = MDrawRegistry::deregisterDrawOverrideCreator(ColliderDrawOverride::drawDbClassification, ColliderDrawOverride::drawRegistrantId);
@@ -21,6 +21,29 @@
 #define IDR_SHADER17                    119
 #define IDR_SHADER18                    120
 #define IDR_SHADER19                    121
+#define IDR_SHADER20                    134
+#define IDR_SHADER21                    135
+#define IDR_SHADER22                    136
+#define IDR_SHADER23                    137
+#define IDR_SHADER24                    138
+#define IDR_SHADER25                    139
+#define IDR_SHADER26                    140
+#define IDR_SHADER27                    141
+#define IDR_SHADER28                    142
+#define IDR_SHADER29                    143
+#define IDR_SHADER30                    144
+#define IDR_SHADER31                    145
+#define IDR_SHADER32                    146
+#define IDR_SHADER33                    147
+#define IDR_SHADER34                    148
+#define IDR_SHADER35                    149
+#define IDR_SHADER36                    150
+#define IDR_SHADER37                    151
+#define IDR_SHADER38                    152
+#define IDR_SHADER39                    153
+#define IDR_SHADER40                    154
+#define IDR_SHADER41                    155
+#define IDR_SHADER42                    156
 #define IDR_MEL1                        122
 #define IDR_MEL2                        123
 #define IDR_MEL3                        124
@@ -38,7 +61,7 @@
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        134
+#define _APS_NEXT_RESOURCE_VALUE        157
 #define _APS_NEXT_COMMAND_VALUE         40001
 #define _APS_NEXT_CONTROL_VALUE         1001
 #define _APS_NEXT_SYMED_VALUE           101
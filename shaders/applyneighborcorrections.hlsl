@@ -0,0 +1,39 @@
+#include "neighborpairs_shared.hlsl"
+#include "common.hlsl"
+
+StructuredBuffer<Particle> neighborListParticles : register(t0); // Particles as of the last neighbor list rebuild
+StructuredBuffer<uint> isSurfaceVoxel : register(t1);
+RWStructuredBuffer<Particle> particles : register(u0);
+RWStructuredBuffer<uint> collisionStats : register(u1);
+RWStructuredBuffer<int> positionCorrections : register(u2);
+RWStructuredBuffer<uint> skinViolation : register(u3); // Set if any particle is past half the skin radius (cleared on rebuild)
+
+/**
+ * Applies (and resets) the corrections accumulated by solveneighborpairs.hlsl. Then checks how far each particle has moved since the neighbor list
+ * was built: past half the skin radius, two approaching particles could touch without being listed, so the list is stale, and it's rebuilt
+ * once the flag is read back (see NeighborPairsCompute::shouldRebuild).
+ */
+[numthreads(SOLVE_NEIGHBOR_PAIRS_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    if (gId.x >= numParticles) return;
+    // Only surface particles are binned, so only they can have pairs.
+    if (!isSurfaceVoxel[gId.x >> 3]) return;
+
+    int3 fixedCorrection = int3(positionCorrections[3 * gId.x], positionCorrections[3 * gId.x + 1], positionCorrections[3 * gId.x + 2]);
+    float3 position = particles[gId.x].position;
+    if (any(fixedCorrection != 0)) {
+        position += fromFixedPoint(fixedCorrection);
+        particles[gId.x].position = position;
+        positionCorrections[3 * gId.x] = 0;
+        positionCorrections[3 * gId.x + 1] = 0;
+        positionCorrections[3 * gId.x + 2] = 0;
+    }
+
+    float3 displacement = position - neighborListParticles[gId.x].position;
+    float halfSkin = 0.5f * skinRadius;
+    if (dot(displacement, displacement) > halfSkin * halfSkin) {
+        InterlockedAdd(collisionStats[COLLISION_STATS_SKIN_VIOLATIONS], 1);
+        skinViolation[0] = 1;
+    }
+}
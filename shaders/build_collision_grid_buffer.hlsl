@@ -4,6 +4,7 @@
 
 StructuredBuffer<Particle> particles : register(t0);
 StructuredBuffer<uint> isSurfaceVoxel : register(t1);
+StructuredBuffer<uint> surfaceVoxels : register(t2);
 RWStructuredBuffer<uint> collisionCellParticleCounts : register(u0);
 
 /**
@@ -13,15 +14,18 @@ RWStructuredBuffer<uint> collisionCellParticleCounts : register(u0);
 [numthreads(BUILD_COLLISION_GRID_THREADS, 1, 1)]
 void main(uint3 gId : SV_DispatchThreadID)
 {
-    if (gId.x >= numParticles) return;
+    // Dispatched over the particles of the surface voxel list only, so interior voxels cost nothing.
+    uint listIdx = gId.x >> 3;
+    if (listIdx >= surfaceVoxels[SURFACE_VOXELS_COUNT_IDX]) return;
 
-    int voxelIdx = gId.x >> 3;
-    // Optimization: only compute collisions for surface particles by culling non-surface voxels early.
+    uint voxelIdx = surfaceVoxels[SURFACE_VOXELS_FIRST_IDX + listIdx];
+    uint particleIdx = (voxelIdx << 3) | (gId.x & 7);
+    // Surface voxels can still be culled (see CollisionCullingCompute).
     if (!isSurfaceVoxel[voxelIdx]) {
         return;
     }
 
-    Particle particle = particles[gId.x];
+    Particle particle = particles[particleIdx];
     float radius = particleRadius(particle);
     int3 gridMinOverlap = int3(floor((particle.position - radius) * inverseCellSize));
     int3 gridMaxOverlap = int3(floor((particle.position + radius) * inverseCellSize));
@@ -0,0 +1,59 @@
+#include "particle_collisions_shared.hlsl"
+#include "common.hlsl"
+#include "constants.hlsli"
+
+StructuredBuffer<Particle> particles : register(t0);
+StructuredBuffer<uint> isSurfaceVoxel : register(t1);
+StructuredBuffer<uint> surfaceVoxels : register(t2);
+RWStructuredBuffer<uint> cellKeys : register(u0);
+RWStructuredBuffer<uint> particleIndices : register(u1);
+RWStructuredBuffer<uint> sortEntryCount : register(u2);
+RWStructuredBuffer<uint> particleMinCells : register(u3);
+
+/**
+ * Sorted broadphase, step 1: each thread represents a (surface) particle, and emits one (cell key, particle index) pair for every cell
+ * the particle overlaps. The pairs are then radix sorted by key, so each cell's particles end up contiguous.
+ * 
+ * Unlike the hashed grid, a key identifies exactly one cell (up to COLLISION_CELL_KEY_BITS wrapping), so unrelated cells never share a bucket.
+ */
+[numthreads(BUILD_COLLISION_PARTICLE_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    // Dispatched over the particles of the surface voxel list only, so interior voxels cost nothing.
+    uint listIdx = gId.x >> 3;
+    if (listIdx >= surfaceVoxels[SURFACE_VOXELS_COUNT_IDX]) return;
+
+    uint voxelIdx = surfaceVoxels[SURFACE_VOXELS_FIRST_IDX + listIdx];
+    uint particleIdx = (voxelIdx << 3) | (gId.x & 7);
+    // Surface voxels can still be culled (see CollisionCullingCompute).
+    if (!isSurfaceVoxel[voxelIdx]) {
+        return;
+    }
+
+    Particle particle = particles[particleIdx];
+    float radius = particleRadius(particle) + 0.5f * skinRadius;
+    int3 gridMinOverlap = int3(floor((particle.position - radius) * inverseCellSize));
+    int3 gridMaxOverlap = int3(floor((particle.position + radius) * inverseCellSize));
+
+    // The narrowphase uses the bin-time min cell to decide which shared cell owns a pair (so pairs aren't solved once per shared cell).
+    // Only the low bits are needed: two particles that share a cell have min cells at most one apart on each axis.
+    uint3 wrappedMinCell = asuint(gridMinOverlap) & ((1u << COLLISION_CELL_KEY_BITS) - 1);
+    particleMinCells[particleIdx] = wrappedMinCell.x | (wrappedMinCell.y << COLLISION_CELL_KEY_BITS) | (wrappedMinCell.z << (2 * COLLISION_CELL_KEY_BITS));
+
+    // Reserve all of this particle's entries with one atomic. Because we make the cells as large as the largest particle, this will be at most 8.
+    int3 numOverlaps = gridMaxOverlap - gridMinOverlap + 1;
+    uint numEntries = numOverlaps.x * numOverlaps.y * numOverlaps.z;
+    uint entryIdx;
+    InterlockedAdd(sortEntryCount[0], numEntries, entryIdx);
+    if (entryIdx + numEntries > hashGridSize) return; // Can't happen with cells at least as big as particles, but don't write out of bounds.
+
+    for (int z = gridMinOverlap.z; z <= gridMaxOverlap.z; ++z) {
+        for (int y = gridMinOverlap.y; y <= gridMaxOverlap.y; ++y) {
+            for (int x = gridMinOverlap.x; x <= gridMaxOverlap.x; ++x) {
+                cellKeys[entryIdx] = getParticleCellKey(x, y, z);
+                particleIndices[entryIdx] = particleIdx;
+                ++entryIdx;
+            }
+        }
+    }
+}
@@ -4,21 +4,25 @@
 
 StructuredBuffer<Particle> particles : register(t0);
 StructuredBuffer<uint> isSurfaceVoxel : register(t1);
+StructuredBuffer<uint> surfaceVoxels : register(t2);
 RWStructuredBuffer<uint> collisionCellParticleCounts : register(u0);
 RWStructuredBuffer<uint> particlesByCollisionCell : register(u1);
 
 [numthreads(BUILD_COLLISION_PARTICLE_THREADS, 1, 1)]
 void main(uint3 gId : SV_DispatchThreadID)
 {
-    if (gId.x >= numParticles) return;
+    // Dispatched over the particles of the surface voxel list only, so interior voxels cost nothing.
+    uint listIdx = gId.x >> 3;
+    if (listIdx >= surfaceVoxels[SURFACE_VOXELS_COUNT_IDX]) return;
 
-    int voxelIdx = gId.x >> 3;
-    // Optimization: only compute collisions for surface particles by culling non-surface voxels early.
+    uint voxelIdx = surfaceVoxels[SURFACE_VOXELS_FIRST_IDX + listIdx];
+    uint particleIdx = (voxelIdx << 3) | (gId.x & 7);
+    // Surface voxels can still be culled (see CollisionCullingCompute).
     if (!isSurfaceVoxel[voxelIdx]) {
         return;
     }
 
-    Particle particle = particles[gId.x];
+    Particle particle = particles[particleIdx];
     float particleRadius = unpackHalf2x16(particle.radiusAndInvMass).x;
     int3 gridMinOverlap = int3(floor((particle.position - particleRadius) * inverseCellSize));
     int3 gridMaxOverlap = int3(floor((particle.position + particleRadius) * inverseCellSize));
@@ -31,7 +35,7 @@ void main(uint3 gId : SV_DispatchThreadID)
                 int cellHash = getParticleCellHash(x, y, z);
                 int sortedParticleIndex;
                 InterlockedAdd(collisionCellParticleCounts[cellHash], -1, sortedParticleIndex);
-                particlesByCollisionCell[sortedParticleIndex] = gId.x;
+                particlesByCollisionCell[sortedParticleIndex] = particleIdx;
             }
         }
     }
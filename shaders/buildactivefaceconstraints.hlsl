@@ -0,0 +1,42 @@
+#include "voxelactivity_shared.hlsl"
+
+RWStructuredBuffer<int> faceConstraintsIndices : register(u0);
+RWStructuredBuffer<uint> activeFaceConstraints : register(u2);
+StructuredBuffer<uint> liveFaceConstraints : register(t1);
+StructuredBuffer<uint> liveCounts : register(t2);
+
+cbuffer ActiveConstraintsCB : register(b1)
+{
+    uint numConstraints;
+    uint countSlot;
+    uint firstConstraint; // Unused for face constraints (see buildactivelongrangeconstraints.hlsl)
+    uint liveSlot;
+};
+
+/**
+ * One thread per live (unbroken, as of the last compaction) face constraint (one dispatch per axis). Propagates wake-ups across intact faces, so that a moving
+ * voxel keeps its whole connected island awake (one face per substep), and appends constraints touching an awake voxel to the active list.
+ */
+[numthreads(VGS_THREADS, 1, 1)]
+void main(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (globalThreadId.x >= liveCounts[liveSlot]) return;
+    uint constraintIdx = liveFaceConstraints[globalThreadId.x];
+
+    int voxelAIdx = faceConstraintsIndices[constraintIdx * 2];
+    int voxelBIdx = faceConstraintsIndices[constraintIdx * 2 + 1];
+    if (voxelAIdx == -1 || voxelBIdx == -1) return;
+
+    uint activityA = voxelActivity[voxelAIdx];
+    uint activityB = voxelActivity[voxelBIdx];
+
+    // Only voxels that actually moved propagate wake-ups (not voxels that were merely woken), otherwise two neighbours would keep waking each other forever.
+    if (activityA & ACTIVITY_MOVED_BIT) InterlockedOr(voxelActivity[voxelBIdx], ACTIVITY_WOKEN_BIT);
+    if (activityB & ACTIVITY_MOVED_BIT) InterlockedOr(voxelActivity[voxelAIdx], ACTIVITY_WOKEN_BIT);
+
+    if (!isAwake(activityA) && !isAwake(activityB)) return;
+
+    uint activeIdx;
+    InterlockedAdd(activeCounts[countSlot], 1, activeIdx);
+    activeFaceConstraints[activeIdx] = constraintIdx;
+}
@@ -0,0 +1,45 @@
+#include "voxelactivity_shared.hlsl"
+
+RWStructuredBuffer<uint> longRangeParticleIndices : register(u0);
+RWStructuredBuffer<uint> activeLongRangeConstraints : register(u2);
+StructuredBuffer<uint> liveLongRangeConstraints : register(t1);
+StructuredBuffer<uint> liveCounts : register(t2);
+
+// One dispatch per long-range level. Each level's constraints (and its active list) occupy the range starting at firstConstraint.
+cbuffer ActiveConstraintsCB : register(b1)
+{
+    uint numConstraints;
+    uint countSlot;
+    uint firstConstraint;
+    uint liveSlot;
+};
+
+bool longRangeConstraintBroken(uint particleIdx0) {
+    // See longrangeconstraints.hlsl
+    return (particleIdx0 & 0xF) == LONG_RANGE_BROKEN;
+}
+
+/**
+ * One thread per live (unbroken, as of the last compaction) long-range constraint. A constraint is active if any of the (up to 8) voxels its particles belong to is awake.
+ */
+[numthreads(VGS_THREADS, 1, 1)]
+void main(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (globalThreadId.x >= liveCounts[liveSlot]) return;
+    uint constraintIdx = liveLongRangeConstraints[firstConstraint + globalThreadId.x];
+
+    uint particleIdx0 = longRangeParticleIndices[constraintIdx << 3];
+    if (longRangeConstraintBroken(particleIdx0)) return;
+
+    bool anyAwake = false;
+    [unroll] for (uint i = 0; i < 8; ++i) {
+        // Particle indices are shifted left by 4 (lower bits are the broken counter), and there are 8 particles per voxel.
+        uint voxelIdx = longRangeParticleIndices[(constraintIdx << 3) + i] >> 7;
+        anyAwake = anyAwake || isAwake(voxelActivity[voxelIdx]);
+    }
+    if (!anyAwake) return;
+
+    uint activeIdx;
+    InterlockedAdd(activeCounts[countSlot], 1, activeIdx);
+    activeLongRangeConstraints[firstConstraint + activeIdx] = constraintIdx;
+}
@@ -0,0 +1,3 @@
+#define SORTED_BROADPHASE
+#define BUILD_NEIGHBOR_PAIRS
+#include "solvecollisions.hlsl"
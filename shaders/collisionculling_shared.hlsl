@@ -0,0 +1,77 @@
+#ifndef COLLISION_CULLING_SHARED_HLSL
+#define COLLISION_CULLING_SHARED_HLSL
+
+#include "common.hlsl"
+#include "constants.hlsli"
+
+// A contiguous run of voxels belonging to one object (PBD node), and its clusters.
+struct CollisionObjectRange {
+    uint firstVoxel;
+    uint numVoxels;
+    uint firstCluster;
+    uint numClusters;
+};
+
+cbuffer CollisionCullingCB : register(b0)
+{
+    uint numVoxels;
+    uint numClusters;
+    uint numObjects;
+    float skinRadius;
+};
+
+StructuredBuffer<CollisionObjectRange> objectRanges : register(t0);
+
+// Bounds are stored as order-preserving uints so they can be refit with atomic min / max.
+// Entries [0, numClusters) are clusters, [numClusters, numClusters + numObjects) are objects.
+uint floatToOrderedUint(float f) {
+    uint u = asuint(f);
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+float orderedUintToFloat(uint u) {
+    return asfloat((u & 0x80000000u) ? (u & 0x7FFFFFFFu) : ~u);
+}
+
+uint3 floatToOrderedUint(float3 f) {
+    return uint3(floatToOrderedUint(f.x), floatToOrderedUint(f.y), floatToOrderedUint(f.z));
+}
+
+float3 orderedUintToFloat(uint3 u) {
+    return float3(orderedUintToFloat(u.x), orderedUintToFloat(u.y), orderedUintToFloat(u.z));
+}
+
+// Bounds that nothing was refit into (e.g. clusters of only interior voxels) are still at their cleared values (min > max).
+bool boundsAreEmpty(uint3 orderedMin, uint3 orderedMax) {
+    return orderedMin.x > orderedMax.x;
+}
+
+// Objects are few, and sorted by first voxel, so a binary search is cheaper than storing an object index per voxel.
+uint findObject(uint voxelIdx) {
+    uint low = 0;
+    uint high = numObjects - 1;
+    while (low < high) {
+        uint mid = (low + high + 1) >> 1;
+        if (objectRanges[mid].firstVoxel <= voxelIdx) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+uint getClusterIdx(uint voxelIdx, CollisionObjectRange object) {
+    return object.firstCluster + (voxelIdx - object.firstVoxel) / COLLISION_CLUSTER_SIZE;
+}
+
+bool aabbsOverlap(float3 minA, float3 maxA, float3 minB, float3 maxB) {
+    return all(minA <= maxB) && all(minB <= maxA);
+}
+
+bool sphereOverlapsAabb(float4 sphere, float3 aabbMin, float3 aabbMax) {
+    float3 offset = sphere.xyz - clamp(sphere.xyz, aabbMin, aabbMax);
+    return dot(offset, offset) <= sphere.w * sphere.w;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include "particle_collisions_shared.hlsl"
+#include "common.hlsl"
+#include "constants.hlsli"
+
+// Shared by the per-cell narrowphase (solvecollisions.hlsl) and the neighbor pair narrowphase (solveneighborpairs.hlsl).
+StructuredBuffer<Particle> frameStartParticles : register(t2);
+RWStructuredBuffer<Particle> particles : register(u0);
+RWStructuredBuffer<uint> collisionStats : register(u1);
+StructuredBuffer<VoxelAdjacency> voxelAdjacency : register(t5);
+
+static const float jitterEpsilon = 1e-3f;
+static const float relaxationFactor = 0.35f;
+
+bool doParticlesOverlap(
+    float3 positionA,
+    float3 positionB,
+    float radiusA,
+    float radiusB,
+    out float distanceSquared, 
+    out float3 particleAToB
+)
+{
+    particleAToB = positionB - positionA;
+    distanceSquared = dot(particleAToB, particleAToB);
+    if (distanceSquared < 1e-6f) return false; // Avoid division by zero or NaN
+
+    return (distanceSquared < (radiusA + radiusB) * (radiusA + radiusB));
+}
+
+// Voxels joined by an intact face constraint are held together by it, and their facing particles are always in contact, so collisions between them
+// would just fight the constraint. Only face neighbours (in the same model) can be glued, which is cheap to check from grid coordinates.
+bool areVoxelsGlued(uint voxelIdxA, uint voxelIdxB) {
+    VoxelAdjacency adjacencyA = voxelAdjacency[voxelIdxA];
+    VoxelAdjacency adjacencyB = voxelAdjacency[voxelIdxB];
+    if (voxelIdxA - adjacencyA.modelVoxelIdx != voxelIdxB - adjacencyB.modelVoxelIdx) return false;
+
+    const uint mask = (1u << VOXEL_GRID_COORD_BITS) - 1;
+    int3 coordsA = int3(adjacencyA.gridCoords & mask, (adjacencyA.gridCoords >> VOXEL_GRID_COORD_BITS) & mask, adjacencyA.gridCoords >> (2 * VOXEL_GRID_COORD_BITS));
+    int3 coordsB = int3(adjacencyB.gridCoords & mask, (adjacencyB.gridCoords >> VOXEL_GRID_COORD_BITS) & mask, adjacencyB.gridCoords >> (2 * VOXEL_GRID_COORD_BITS));
+    int3 offset = coordsB - coordsA;
+    if (abs(offset.x) + abs(offset.y) + abs(offset.z) != 1) return false;
+
+    uint axis = (offset.x != 0) ? 0 : ((offset.y != 0) ? 1 : 2);
+    uint faceBit = 2 * axis + ((offset[axis] > 0) ? 0 : 1);
+    return (adjacencyA.faceConnections >> faceBit) & 1;
+}
+
+// Approximates the center of a voxel that owns a particle by the average of the particle and its diagonal particle in the voxel.
+// The diagonal particle is retrieved using index relationships between different particles in the voxel (by construction).
+float3 getVoxelCenterOfParticle(Particle particle, uint particleGlobalIdx, uint voxelIdx) {
+    int particleIdxInVoxel = (particleGlobalIdx - (voxelIdx << 3));
+    int particleDiagIdx = (voxelIdx << 3) + 7 - particleIdxInVoxel;
+    Particle particleDiag = particles[particleDiagIdx];
+    return (particle.position + particleDiag.position) * 0.5f;
+}
+
+void applyFriction(Particle preCollisionA, Particle preCollisionB, Particle frameStartParticleA, Particle frameStartParticleB, inout Particle postCollisionA, inout Particle postCollisionB, float3 augmentedNormal, float collisionDelta) {
+    if (friction <= 0) return;
+
+    float3 frameDeltaA = preCollisionA.position - frameStartParticleA.position;
+    float3 frameDeltaB = preCollisionB.position - frameStartParticleB.position;
+    float3 relFrameDelta = frameDeltaA - frameDeltaB;
+    float3 relTangent = relFrameDelta - dot(relFrameDelta, augmentedNormal) * augmentedNormal;
+
+    float relTangentLenSq = dot(relTangent, relTangent);
+    if (relTangentLenSq < 1e-8f) return;
+
+    float maxTangent = friction * collisionDelta;
+    float scale = min(1.0f, maxTangent / sqrt(relTangentLenSq));
+    float3 relTangentClamped = relTangent * scale;
+
+    float invMassA = particleInverseMass(preCollisionA);
+    float invMassB = particleInverseMass(preCollisionB);
+    float invMassSumReciprocal = 1 / (invMassA + invMassB);
+
+    postCollisionA.position -= (invMassA * invMassSumReciprocal) * relTangentClamped;
+    postCollisionB.position += (invMassB * invMassSumReciprocal) * relTangentClamped;
+}
+
+/**
+ * Resolves a collision between two particles of different voxels, if they overlap. Outputs the position corrections for each (including friction).
+ * Returns false (and no corrections) if there's nothing to resolve.
+ */
+bool solveParticlePair(
+    Particle particleA,
+    Particle particleB,
+    uint globalParticleIdxA,
+    uint globalParticleIdxB,
+    out float3 correctionA,
+    out float3 correctionB
+) {
+    correctionA = float3(0, 0, 0);
+    correctionB = float3(0, 0, 0);
+
+    float distanceSquared;
+    float3 particleAToB;
+    float2 particleRadiusAndInvMassA = unpackHalf2x16(particleA.radiusAndInvMass);
+    float2 particleRadiusAndInvMassB = unpackHalf2x16(particleB.radiusAndInvMass);
+    float invMassSum = particleRadiusAndInvMassA.y + particleRadiusAndInvMassB.y;
+    if (invMassSum <= 0.0f) return false; // Both particles are immovable.
+
+    if (!doParticlesOverlap(particleA.position, particleB.position, particleRadiusAndInvMassA.x, particleRadiusAndInvMassB.x, distanceSquared, particleAToB)) return false;
+    particleAToB = normalize(particleAToB);
+    float delta = (particleRadiusAndInvMassA.x + particleRadiusAndInvMassB.x) - sqrt(distanceSquared);
+    
+    float jitterThreshold = jitterEpsilon * min(particleRadiusAndInvMassA.x, particleRadiusAndInvMassB.x);            
+    if (delta <= jitterThreshold) return false;
+    delta -= jitterThreshold; 
+
+    // Get the particles diagonal to A and B within their respective voxels.
+    // Then approximate the voxel centers to augment collision normals, to avoid voxel interlock.
+    float3 voxelACenter = getVoxelCenterOfParticle(particleA, globalParticleIdxA, globalParticleIdxA >> 3);
+    float3 voxelBCenter = getVoxelCenterOfParticle(particleB, globalParticleIdxB, globalParticleIdxB >> 3);
+
+    // Test for voxel-center collision, treating each center as an imaginary "particle" with radius 1.5x that of the voxel's real particles. 
+    float3 augmentedNormal = particleAToB;
+    float3 voxelAToB;
+    if (doParticlesOverlap(voxelACenter, voxelBCenter, 1.5f * particleRadiusAndInvMassA.x, 1.5f * particleRadiusAndInvMassB.x, distanceSquared, voxelAToB)) {
+        augmentedNormal = normalize(normalize(voxelAToB) + particleAToB);
+    }
+    
+    float invMassSumReciprocal = 1 / (invMassSum);
+
+    Particle postCollisionA = particleA;
+    Particle postCollisionB = particleB;
+    postCollisionA.position -= delta * relaxationFactor * (invMassSumReciprocal * particleRadiusAndInvMassA.y) * augmentedNormal;
+    postCollisionB.position += delta * relaxationFactor * (invMassSumReciprocal * particleRadiusAndInvMassB.y) * augmentedNormal;
+
+    // We do have to do some extra per-collision-pair global reads to apply friction. There's not enough shared memory to store frame start positions.
+    // But since these reads only happen on actual collisions (not on all candidates), it's manageable.
+    applyFriction(
+        particleA, 
+        particleB,
+        frameStartParticles[globalParticleIdxA],
+        frameStartParticles[globalParticleIdxB],
+        postCollisionA,
+        postCollisionB,
+        augmentedNormal,
+        delta
+    );
+
+    correctionA = postCollisionA.position - particleA.position;
+    correctionB = postCollisionB.position - particleB.position;
+    return true;
+}
@@ -0,0 +1,17 @@
+#include "constraintcompaction_shared.hlsl"
+
+/**
+ * One thread per face constraint (one dispatch per axis). Appends the constraint to the axis' live list if it hasn't broken.
+ */
+[numthreads(VGS_THREADS, 1, 1)]
+void main(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint constraintIdx = globalThreadId.x;
+    if (constraintIdx >= numConstraints) return;
+
+    if (constraintIndices[constraintIdx * 2] == 0xFFFFFFFF || constraintIndices[constraintIdx * 2 + 1] == 0xFFFFFFFF) return;
+
+    uint liveIdx;
+    InterlockedAdd(liveCounts[liveSlot], 1, liveIdx);
+    liveConstraints[liveIdx] = constraintIdx;
+}
@@ -0,0 +1,18 @@
+#include "constraintcompaction_shared.hlsl"
+
+/**
+ * One thread per long-range constraint (one dispatch per level). Appends the constraint to its level's range of the live list if it hasn't broken.
+ */
+[numthreads(VGS_THREADS, 1, 1)]
+void main(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (globalThreadId.x >= numConstraints) return;
+    uint constraintIdx = firstConstraint + globalThreadId.x;
+
+    // See longrangeconstraints.hlsl: the lower 4 bits of the first particle index count broken internal faces.
+    if ((constraintIndices[constraintIdx << 3] & 0xF) == LONG_RANGE_BROKEN) return;
+
+    uint liveIdx;
+    InterlockedAdd(liveCounts[liveSlot], 1, liveIdx);
+    liveConstraints[firstConstraint + liveIdx] = constraintIdx;
+}
@@ -0,0 +1,21 @@
+#include "constants.hlsli"
+
+StructuredBuffer<uint> isSurfaceVoxel : register(t0);
+RWStructuredBuffer<uint> surfaceVoxels : register(u0);
+
+/**
+ * One thread per voxel. Rebuilds the surface voxel list from scratch (after the global buffers are reallocated, or the cache is restored).
+ * Between rebuilds, the list is only ever appended to, by whichever shader turns a voxel into a surface voxel.
+ * The count (element 0) must be cleared before dispatching.
+ */
+[numthreads(SURFACE_VOXELS_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    uint numVoxels, stride;
+    isSurfaceVoxel.GetDimensions(numVoxels, stride);
+    if (gId.x >= numVoxels || !isSurfaceVoxel[gId.x]) return;
+
+    uint listIdx;
+    InterlockedAdd(surfaceVoxels[SURFACE_VOXELS_COUNT_IDX], 1, listIdx);
+    surfaceVoxels[SURFACE_VOXELS_FIRST_IDX + listIdx] = gId.x;
+}
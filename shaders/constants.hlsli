@@ -12,7 +12,112 @@
 #define BUILD_COLLISION_PARTICLE_THREADS 256
 #define SOLVE_COLLISION_THREADS 32        // CAREFUL: this directly affects the amount of shared memory available to each collision cell.
 #define PREFIX_SCAN_THREADS 512  // This MUST be a power of two (many assumptions in the scan code rely on this).
-#define MAX_COLLIDERS 256
+#define RADIX_SORT_THREADS 256   // Elements per radix sort workgroup (one per thread). Sort buffer sizes must be a multiple of this.
+#define RADIX_SORT_BITS_PER_PASS 4
+#define RADIX_SORT_BINS (1 << RADIX_SORT_BITS_PER_PASS)
+#define RADIX_SORT_PASSES (32 / RADIX_SORT_BITS_PER_PASS)
+
+// Collision broadphase modes (GlobalSolver::aCollisionBroadphase)
+#define COLLISION_BROADPHASE_HASHED 0   // Cells hashed into a fixed-size table (unrelated cells can share a bucket)
+#define COLLISION_BROADPHASE_SORTED 1   // (cell key, particle) pairs radix sorted by Morton cell key; one bucket per cell key (see COLLISION_CELL_KEY_BITS)
+#define COLLISION_BROADPHASE_NEIGHBOR_LISTS 2   // Sorted cells with an inflated ("skin") radius, listing nearby pairs that are reused over several substeps
+// Sorted broadphase cell keys interleave the low COLLISION_CELL_KEY_BITS bits of each cell coordinate (3 x 10 bits fit the 32-bit sort key).
+// So cells are only exact within 1024 cells along each axis: cells that differ by a multiple of 2^COLLISION_CELL_KEY_BITS along an axis
+// share a key. That only costs some extra candidate pairs, which the narrowphase rejects by distance.
+#define COLLISION_CELL_KEY_BITS 10
+#define COLLISION_CELL_KEY_EMPTY 0xFFFFFFFFu  // Key for unused sort entries, so they sort to the end.
+
+// Per-frame particle collision statistics, accumulated over all substeps.
+#define COLLISION_STATS_CANDIDATE_PAIRS 0     // Particle pairs (from different voxels) considered by the narrowphase
+#define COLLISION_STATS_DUPLICATE_PAIRS 1     // Candidate pairs also present in another cell (solved again in hashed mode, skipped in sorted mode)
+#define COLLISION_STATS_OVERFLOW_PARTICLES 2  // Cell entries dropped because they didn't fit in the narrowphase's shared memory
+#define COLLISION_STATS_OCCUPIED_CELLS 3      // Non-empty cells (or hash buckets)
+#define COLLISION_STATS_NEIGHBOR_PAIRS 4          // Pairs listed by neighbor list rebuilds
+#define COLLISION_STATS_NEIGHBOR_PAIR_OVERFLOW 5  // Pairs that didn't fit in the neighbor list
+#define COLLISION_STATS_SKIN_VIOLATIONS 6         // Particle substeps spent further than half the skin radius from where their neighbor list was built
+#define COLLISION_STATS_NEIGHBOR_REBUILDS 7       // Neighbor list rebuilds
+#define COLLISION_STATS_CULLED_VOXELS 8           // Surface voxels left out of collision binning by the bounding volume hierarchy
+#define COLLISION_STATS_GLUED_PAIRS 9             // Pairs skipped because their voxels are still joined by an intact face constraint
+#define COLLISION_STATS_OCCUPANCY_HISTOGRAM 10    // COLLISION_OCCUPANCY_BINS counts of occupied cells: bin b counts cells of 2^b up to 2^(b+1) particles (the last bin, any more)
+#define COLLISION_OCCUPANCY_BINS 12
+#define COLLISION_STATS_SIZE (COLLISION_STATS_OCCUPANCY_HISTOGRAM + COLLISION_OCCUPANCY_BINS)
+// Cells with at least this many particles are sorted along their longest axis and swept, rather than testing all pairs (see solvecollisions.hlsl).
+#define COLLISION_SWEEP_MIN_PARTICLES 32
+
+// Collision culling bounding volume hierarchy: object AABBs > voxel cluster AABBs > voxel bounding spheres (see CollisionCullingCompute).
+// Voxels are Morton-ordered within each object, so runs of consecutive voxels make spatially compact clusters.
+#define COLLISION_CULLING_THREADS 256
+#define COLLISION_CLUSTER_SIZE 32
+#define COLLISION_OBJECT_FRACTURED 1u   // Object flag: some voxel has lost a face constraint, so the object can collide with itself
+#define COLLISION_CLUSTER_SELF_CONTACT 2u // Cluster candidate value: it reaches a part of its own (intact) object that it was apart from at rest
+
+// Values of the isSurface buffer. Any non-zero value is a surface voxel.
+#define SURFACE_VOXEL 1u
+#define SURFACE_VOXEL_FRACTURED 3u      // Became (or stayed) surface because one of its face constraints broke
+
+// Compact list of surface voxel indices (see SurfaceVoxelsCompute). Element 0 holds the count and the indices follow it,
+// so shaders that append to the list only need one extra UAV.
+#define SURFACE_VOXELS_THREADS 256
+#define SURFACE_VOXELS_COUNT_IDX 0
+#define SURFACE_VOXELS_FIRST_IDX 1
+
+// Primitive collider broadphase (see SolvePrimitiveCollisionsCompute). Colliders are binned on the CPU into a hashed uniform grid by their bounds,
+// and each particle only tests the colliders in its own cell. Colliders that would cover more than COLLIDER_GRID_MAX_CELLS cells (e.g. infinite planes)
+// aren't binned; every particle tests them.
+#define COLLIDER_GRID_MAX_CELLS 64
+
+// Mesh collider signed distance fields (see MeshSDF). Samples are stored in bricks of SDF_BRICK_SAMPLES^3. Neighbouring bricks share their
+// boundary samples, so each brick covers SDF_BRICK_CELLS cells per axis and trilinear sampling never reads across bricks.
+#define SDF_BRICK_SAMPLES 8
+#define SDF_BRICK_CELLS (SDF_BRICK_SAMPLES - 1)
+#define SDF_BRICK_EMPTY 0xFFFFFFFFu   // Brick table entry of a brick outside the narrow band
+
+// Neighbor list narrowphase (COLLISION_BROADPHASE_NEIGHBOR_LISTS)
+#define SOLVE_NEIGHBOR_PAIRS_THREADS 256
+#define NEIGHBOR_PAIRS_PER_PARTICLE 16            // Pair list capacity, per particle
+
+// Voxel activity (sleeping) bit layout. The lower 16 bits count consecutive substeps a voxel has been at rest.
+// A voxel is asleep once that count reaches VoxelActivityConstants::sleepDelay.
+#define ACTIVITY_REST_COUNTER_MASK 0xFFFFu
+#define ACTIVITY_MOVED_BIT (1u << 16)      // Moved above the wake threshold last substep. Wakes neighbours through intact faces.
+#define ACTIVITY_WOKEN_BIT (1u << 17)      // Woken by a moving neighbour. Resets the rest counter on the next activity update.
+
+// Long-range constraints form a hierarchy of cluster sizes: level 0 is 2x2x2 voxels, level 1 is 4x4x4, level 2 is 8x8x8, ...
+// Level 0 clusters start at every voxel (overlapping), coarser clusters are aligned to their size (disjoint).
+#define LONG_RANGE_LEVELS 3
+// Each face constraint is inside up to 4 level 0 clusters, and at most one cluster of each coarser level.
+#define LONG_RANGE_CONSTRAINTS_PER_FACE (4 + LONG_RANGE_LEVELS - 1)
+// A long-range constraint breaks once this many of its internal face constraints have broken. Three is the fewest that can cut
+// a corner voxel off a 2x2x2 cluster. Coarser clusters have far more internal faces, most of which can break without splitting the cluster,
+// so the threshold doubles with the cluster span. It has to stay below LONG_RANGE_BROKEN, as the counter is only 4 bits.
+#define LONG_RANGE_BREAK_THRESHOLD(level) (3u << (level))
+// Once its threshold is reached, the counter is set to this, so readers can tell a constraint is broken without knowing its level.
+#define LONG_RANGE_BROKEN 0xFu
+
+// Slots in the active element counts buffer. Face constraints use one slot per axis, long-range constraints one per level.
+#define ACTIVE_VOXELS_SLOT 0
+#define ACTIVE_FACE_CONSTRAINTS_SLOT 1
+#define ACTIVE_LONG_RANGE_CONSTRAINTS_SLOT 4
+#define NUM_ACTIVE_SLOTS (ACTIVE_LONG_RANGE_CONSTRAINTS_SLOT + LONG_RANGE_LEVELS)
+
+// Slots in the live (unbroken) constraint counts buffer, and the matching (x, y, z) triples in the live dispatch args buffer.
+// See ConstraintCompactionCompute.
+#define LIVE_FACE_CONSTRAINTS_SLOT 0
+#define LIVE_LONG_RANGE_CONSTRAINTS_SLOT 3
+#define NUM_LIVE_SLOTS (LIVE_LONG_RANGE_CONSTRAINTS_SLOT + LONG_RANGE_LEVELS)
+
+// The most substeps a frame can have (the max of the GlobalSolver's numSubsteps attribute, which the solver also clamps to).
+#define MAX_SUBSTEPS 30
+
+// Per-substep VGS residual statistics. Each substep writes one slot of VGS_RESIDUAL_STATS_STRIDE uints into a ring of
+// VGS_RESIDUAL_HISTORY_SIZE slots, one per substep of a frame.
+#define VGS_RESIDUAL_HISTORY_SIZE MAX_SUBSTEPS
+#define VGS_RESIDUAL_STATS_STRIDE 5
+#define VGS_RESIDUAL_MAX 0             // asuint of the largest final residual over all voxels (non-negative floats sort as uints)
+#define VGS_RESIDUAL_ITERATIONS 1      // Total iterations run, summed over voxels
+#define VGS_RESIDUAL_CONVERGED 2       // Number of voxels that stopped early below the tolerance
+#define VGS_RESIDUAL_VOXELS 3          // Number of voxels solved
+#define VGS_RESIDUAL_BAILED 4          // Number of voxels that stopped early because they were degenerate (not counted as converged)
 
 struct VGSConstants
 {
@@ -23,7 +128,7 @@ struct VGSConstants
     uint iterCount;
     uint numVoxels;
     float compliance;
-    int padding0;
+    float residualTolerance;   // Stop iterating once a voxel's residual (max particle correction / particle radius) falls below this. 0 disables.
 };
 
 struct PreVGSConstants
@@ -38,6 +143,18 @@ struct PreVGSConstants
     int padding2;
 };
 
+struct VoxelActivityConstants
+{
+    float sleepDisplacementSq;  // Squared per-substep particle displacement under which a voxel counts as resting
+    float wakeDisplacementSq;   // Squared per-substep particle displacement over which a sleeping voxel wakes (hysteresis: larger than the sleep threshold)
+    float sleepStrain;          // Max edge strain under which a voxel counts as resting
+    float particleRadius;
+    uint numVoxels;
+    uint padding0;
+    uint sleepDelay;            // Number of consecutive resting substeps before a voxel falls asleep
+    uint sleepingEnabled;
+};
+
 struct Particle
 {
 #ifdef __cplusplus
@@ -50,4 +167,69 @@ struct Particle
     uint radiusAndInvMass; // Packed as two half-floats: [lower 16 bits: radius, upper 16 bits: inverse mass]
 };
 
+// A primitive collider. The matrices are column-major in HLSL (like the cbuffer default), so the C++ [row][col] is HLSL [col][row].
+struct Collider
+{
+#ifdef __cplusplus
+    float worldMatrix[4][4];         // [0..2][3] hijacked to store geometric parameters (e.g. radius, height, etc), [3][3] the collider type
+    float inverseWorldMatrix[4][4];  // [3][3] hijacked to store friction
+#else
+    column_major float4x4 worldMatrix;
+    column_major float4x4 inverseWorldMatrix;
+#endif
+};
+
+// A collider's rigid motion over the last frame, parallel to the colliders buffer (see SolvePrimitiveCollisionsCompute::updateColliderPoses).
+// Rotations are quaternions (x, y, z, w) of the rotation in worldMatrix; previousRotation is sign-aligned with rotation, so lerping them goes the short way round.
+struct ColliderMotion
+{
+#ifdef __cplusplus
+    float previousRotation[4];
+    float rotation[4];
+    float previousTranslation[3];
+    uint isMoving;
+    float translation[3];
+    float padding;
+#else
+    float4 previousRotation;
+    float4 rotation;
+    float3 previousTranslation;
+    uint isMoving;
+    float3 translation;
+    float padding;
+#endif
+};
+
+// Where a mesh collider's SDF lives in the (shared) brick table and sample buffers. Mesh colliders index these by worldMatrix[0][3] (C++).
+struct SDFVolume
+{
+#ifdef __cplusplus
+    float origin[3];
+#else
+    float3 origin;       // Corner of brick (0, 0, 0), in collider-local space
+#endif
+    float cellSize;
+#ifdef __cplusplus
+    uint numBricks[3];
+#else
+    uint3 numBricks;
+#endif
+    uint brickTableOffset;
+};
+
+// Hash of a collider grid cell into a table of gridSize (a power of two) buckets. Shared so the CPU binning and the shader agree exactly.
+inline uint hashColliderCell(int x, int y, int z, uint gridSize)
+{
+    return (((uint)x * 73856093u) ^ ((uint)y * 19349663u) ^ ((uint)z * 83492791u)) & (gridSize - 1u);
+}
+
+// Which of a voxel's face neighbours it is still glued to, so collisions can skip them.
+#define VOXEL_GRID_COORD_BITS 10   // Matches the 10 bits per axis of the voxelizer's Morton codes
+struct VoxelAdjacency
+{
+    uint gridCoords;      // Voxel grid coordinates within its model, packed x | y << 10 | z << 20
+    uint modelVoxelIdx;   // Index of the voxel within its model (so two voxels are in the same model iff their global and model indices differ equally)
+    uint faceConnections; // Bit 2 * axis: intact face constraint with the +axis neighbour. Bit 2 * axis + 1: with the -axis neighbour.
+};
+
 #endif // CONSTANTS_HLSLI
\ No newline at end of file
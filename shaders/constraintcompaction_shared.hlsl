@@ -0,0 +1,17 @@
+#include "constants.hlsli"
+
+// Face constraint indices are ints (-1 when broken), but read here as uints: a broken face shows up as 0xFFFFFFFF.
+RWStructuredBuffer<uint> constraintIndices : register(u0);
+RWStructuredBuffer<uint> liveConstraints : register(u1);
+RWStructuredBuffer<uint> liveCounts : register(u2);
+RWBuffer<uint> liveDispatchArgs : register(u3);
+
+// One dispatch per face axis / long-range level. Long-range levels share one live list, each level compacting
+// into the range its constraints occupy in the long-range constraint buffer (starting at firstConstraint).
+cbuffer ConstraintCompactionCB : register(b0)
+{
+    uint numConstraints;
+    uint firstConstraint;
+    uint liveSlot;
+    uint padding0;
+};
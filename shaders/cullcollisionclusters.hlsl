@@ -0,0 +1,90 @@
+#include "collisionculling_shared.hlsl"
+
+StructuredBuffer<uint> clusterObjects : register(t1);
+StructuredBuffer<uint4> boundsMin : register(t2);
+StructuredBuffer<uint4> boundsMax : register(t3);
+StructuredBuffer<uint> objectFlags : register(t4);
+StructuredBuffer<uint4> restBoundsMin : register(t5); // Cluster bounds as of the first refit (see CollisionCullingCompute)
+StructuredBuffer<uint4> restBoundsMax : register(t6);
+RWStructuredBuffer<uint> clusterIsCandidate : register(u0);
+
+// Whether a cluster overlaps another cluster of its own object that it didn't overlap at rest, i.e. the object has folded onto itself there.
+// Clusters that overlapped at rest are neighbours on the surface, whose particles are always that close. (Clusters with no surface voxels at rest
+// have empty rest bounds, so they count as apart from everything.)
+bool hasSelfContact(uint clusterIdx, float3 clusterMinF, float3 clusterMaxF, CollisionObjectRange object) {
+    uint3 restMin = restBoundsMin[clusterIdx].xyz;
+    uint3 restMax = restBoundsMax[clusterIdx].xyz;
+    bool hasRestBounds = !boundsAreEmpty(restMin, restMax);
+    float3 restMinF = orderedUintToFloat(restMin);
+    float3 restMaxF = orderedUintToFloat(restMax);
+
+    for (uint otherIdx = object.firstCluster; otherIdx < object.firstCluster + object.numClusters; ++otherIdx) {
+        if (otherIdx == clusterIdx) continue;
+
+        uint3 otherMin = boundsMin[otherIdx].xyz;
+        uint3 otherMax = boundsMax[otherIdx].xyz;
+        if (boundsAreEmpty(otherMin, otherMax) || !aabbsOverlap(clusterMinF, clusterMaxF, orderedUintToFloat(otherMin), orderedUintToFloat(otherMax))) continue;
+
+        uint3 otherRestMin = restBoundsMin[otherIdx].xyz;
+        uint3 otherRestMax = restBoundsMax[otherIdx].xyz;
+        if (hasRestBounds && !boundsAreEmpty(otherRestMin, otherRestMax)
+            && aabbsOverlap(restMinF, restMaxF, orderedUintToFloat(otherRestMin), orderedUintToFloat(otherRestMax))) continue;
+
+        return true;
+    }
+    return false;
+}
+
+/**
+ * One thread per cluster. A cluster can only collide with other objects whose AABB overlaps both its object's AABB (the object level test,
+ * which rejects most pairs of objects at once) and its own AABB. Fractured objects can also collide with themselves, so all of their clusters are kept.
+ * Intact objects can still fold onto themselves, so a cluster that reaches a part of its object it was apart from at rest is kept as a whole
+ * (marked COLLISION_CLUSTER_SELF_CONTACT, which the voxel pass doesn't cull further).
+ */
+[numthreads(COLLISION_CULLING_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    uint clusterIdx = gId.x;
+    if (clusterIdx >= numClusters) return;
+
+    uint3 clusterMin = boundsMin[clusterIdx].xyz;
+    uint3 clusterMax = boundsMax[clusterIdx].xyz;
+    if (boundsAreEmpty(clusterMin, clusterMax)) {
+        clusterIsCandidate[clusterIdx] = 0;
+        return;
+    }
+
+    uint objectIdx = clusterObjects[clusterIdx];
+    if (objectFlags[objectIdx] & COLLISION_OBJECT_FRACTURED) {
+        clusterIsCandidate[clusterIdx] = 1;
+        return;
+    }
+
+    float3 clusterMinF = orderedUintToFloat(clusterMin);
+    float3 clusterMaxF = orderedUintToFloat(clusterMax);
+    if (hasSelfContact(clusterIdx, clusterMinF, clusterMaxF, objectRanges[objectIdx])) {
+        clusterIsCandidate[clusterIdx] = COLLISION_CLUSTER_SELF_CONTACT;
+        return;
+    }
+
+    float3 objectMinF = orderedUintToFloat(boundsMin[numClusters + objectIdx].xyz);
+    float3 objectMaxF = orderedUintToFloat(boundsMax[numClusters + objectIdx].xyz);
+
+    uint isCandidate = 0;
+    for (uint otherIdx = 0; otherIdx < numObjects; ++otherIdx) {
+        if (otherIdx == objectIdx) continue;
+
+        uint3 otherMin = boundsMin[numClusters + otherIdx].xyz;
+        uint3 otherMax = boundsMax[numClusters + otherIdx].xyz;
+        if (boundsAreEmpty(otherMin, otherMax)) continue;
+
+        float3 otherMinF = orderedUintToFloat(otherMin);
+        float3 otherMaxF = orderedUintToFloat(otherMax);
+        if (aabbsOverlap(objectMinF, objectMaxF, otherMinF, otherMaxF) && aabbsOverlap(clusterMinF, clusterMaxF, otherMinF, otherMaxF)) {
+            isCandidate = 1;
+            break;
+        }
+    }
+
+    clusterIsCandidate[clusterIdx] = isCandidate;
+}
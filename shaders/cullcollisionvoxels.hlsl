@@ -0,0 +1,65 @@
+#include "collisionculling_shared.hlsl"
+
+StructuredBuffer<uint> isSurfaceVoxel : register(t1);
+StructuredBuffer<uint4> boundsMin : register(t2);
+StructuredBuffer<uint4> boundsMax : register(t3);
+StructuredBuffer<uint> objectFlags : register(t4);
+StructuredBuffer<uint> clusterIsCandidate : register(t5);
+StructuredBuffer<float4> voxelSpheres : register(t6);
+StructuredBuffer<uint> surfaceVoxels : register(t7);
+RWStructuredBuffer<uint> isCollisionCandidate : register(u0);
+RWStructuredBuffer<uint> collisionStats : register(u1);
+
+groupshared uint s_numCulledVoxels;
+
+/**
+ * One thread per surface voxel (see SurfaceVoxelsCompute). Writes the final per-voxel mask that collision binning uses in place of isSurface:
+ * surface voxels in candidate clusters whose bounding sphere reaches another object's AABB (or any surface voxel of a fractured object,
+ * or of a cluster in contact with its own object).
+ * Voxels not in the list are never candidates; the mask is cleared before this pass.
+ */
+[numthreads(COLLISION_CULLING_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID, uint3 localId : SV_GroupThreadID)
+{
+    if (localId.x == 0) s_numCulledVoxels = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    if (gId.x < surfaceVoxels[SURFACE_VOXELS_COUNT_IDX]) {
+        uint voxelIdx = surfaceVoxels[SURFACE_VOXELS_FIRST_IDX + gId.x];
+        uint isCandidate = 0;
+        bool isSurface = (isSurfaceVoxel[voxelIdx] != 0);
+        uint objectIdx = findObject(voxelIdx);
+        CollisionObjectRange object = objectRanges[objectIdx];
+
+        uint clusterCandidate = clusterIsCandidate[getClusterIdx(voxelIdx, object)];
+        if (isSurface && clusterCandidate) {
+            if ((objectFlags[objectIdx] & COLLISION_OBJECT_FRACTURED) || clusterCandidate == COLLISION_CLUSTER_SELF_CONTACT) {
+                isCandidate = 1;
+            } else {
+                float4 sphere = voxelSpheres[voxelIdx];
+                for (uint otherIdx = 0; otherIdx < numObjects; ++otherIdx) {
+                    if (otherIdx == objectIdx) continue;
+
+                    uint3 otherMin = boundsMin[numClusters + otherIdx].xyz;
+                    uint3 otherMax = boundsMax[numClusters + otherIdx].xyz;
+                    if (boundsAreEmpty(otherMin, otherMax)) continue;
+
+                    if (sphereOverlapsAabb(sphere, orderedUintToFloat(otherMin), orderedUintToFloat(otherMax))) {
+                        isCandidate = 1;
+                        break;
+                    }
+                }
+            }
+        }
+
+        isCollisionCandidate[voxelIdx] = isCandidate;
+        if (isSurface && !isCandidate) {
+            InterlockedAdd(s_numCulledVoxels, 1);
+        }
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+    if (localId.x == 0 && s_numCulledVoxels > 0) {
+        InterlockedAdd(collisionStats[COLLISION_STATS_CULLED_VOXELS], s_numCulledVoxels);
+    }
+}
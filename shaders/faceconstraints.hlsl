@@ -1,39 +1,73 @@
 #include "vgs_core.hlsl"
 #include "faceconstraints_shared.hlsl"
 
+StructuredBuffer<uint> activeFaceConstraints : register(t0);
+StructuredBuffer<uint> activeCounts : register(t1);
 RWStructuredBuffer<uint> longRangeConstraintCounters : register(u4);
 RWStructuredBuffer<uint> longRangeConstraintIndices : register(u5);
+RWStructuredBuffer<VoxelAdjacency> voxelAdjacency : register(u6);
+RWStructuredBuffer<uint> surfaceVoxels : register(u7); // Global (not offset), hence voxelOffset
+
+// Interior voxels exposed by a break join the surface voxel list, so collision building picks them up.
+// The exchange makes sure a voxel is appended only once, even if several of its constraints break at the same time.
+void markFractured(int voxelIdx) {
+    uint previousSurface;
+    InterlockedExchange(isSurfaceVoxel[voxelIdx], SURFACE_VOXEL_FRACTURED, previousSurface);
+    if (previousSurface) return;
+
+    uint listIdx;
+    InterlockedAdd(surfaceVoxels[SURFACE_VOXELS_COUNT_IDX], 1, listIdx);
+    uint numEntries, stride;
+    surfaceVoxels.GetDimensions(numEntries, stride);
+    if (SURFACE_VOXELS_FIRST_IDX + listIdx < numEntries) {
+        surfaceVoxels[SURFACE_VOXELS_FIRST_IDX + listIdx] = voxelOffset + voxelIdx;
+    }
+}
 
 void breakConstraint(int constraintIdx, int voxelAIdx, int voxelBIdx) {
-    isSurfaceVoxel[voxelAIdx] = 1;
-    isSurfaceVoxel[voxelBIdx] = 1;
+    markFractured(voxelAIdx);
+    markFractured(voxelBIdx);
+
+    // Voxel B is voxel A's +axis neighbour.
+    InterlockedAnd(voxelAdjacency[voxelAIdx].faceConnections, ~(1u << (2 * axis)));
+    InterlockedAnd(voxelAdjacency[voxelBIdx].faceConnections, ~(1u << (2 * axis + 1)));
 
     faceConstraintsIndices[constraintIdx * 2] = -1;
     faceConstraintsIndices[constraintIdx * 2 + 1] = -1;
 
-    // Each face constraint belongs to up to 4 long-range constraints.
-    for (int i = 0; i < 4; ++i) {
-        uint longRangeConstraintIdx = longRangeConstraintIndices[constraintIdx * 4 + i];
+    // Each face constraint belongs to up to 4 level 0 long-range constraints, and one of each coarser level.
+    for (int i = 0; i < LONG_RANGE_CONSTRAINTS_PER_FACE; ++i) {
+        uint longRangeConstraintIdx = longRangeConstraintIndices[constraintIdx * LONG_RANGE_CONSTRAINTS_PER_FACE + i];
         if (longRangeConstraintIdx == 0xFFFFFFFF) continue;
 
         // The counters buffer doubles as the LR particles indices buffer. We hijack the lower 4 bits of the first particle index
         // to act as a counter of how many face constraints associated with this long-range constraint have been broken.
-        uint original;
-        InterlockedAdd(longRangeConstraintCounters[longRangeConstraintIdx << 3], 1, original);
+        // Coarse clusters contain far more than 15 faces, so the counter stops at its level's break threshold (where it's set to LONG_RANGE_BROKEN)
+        // rather than overflowing into the index. The first 4 entries are level 0, then one per coarser level.
+        uint threshold = LONG_RANGE_BREAK_THRESHOLD(i < 4 ? 0 : i - 3);
+        uint counterIdx = longRangeConstraintIdx << 3;
+        uint expected = longRangeConstraintCounters[counterIdx];
+        [allow_uav_condition] while ((expected & 0xF) < threshold) {
+            uint desired = ((expected & 0xF) + 1 >= threshold) ? (expected | LONG_RANGE_BROKEN) : expected + 1;
+            uint original;
+            InterlockedCompareExchange(longRangeConstraintCounters[counterIdx], expected, desired, original);
+            if (original == expected) break;
+            expected = original;
+        }
     }
 }
 
 /**
 * Solves face constraints for a pair of voxels using the VGS method.
-* One thread = one face constraint. 
+* One thread = one active face constraint (i.e. one touching an awake voxel).
 */
 [numthreads(VGS_THREADS, 1, 1)]
 void main(
     uint3 globalThreadId : SV_DispatchThreadID
 )
 {
-    uint constraintIdx = globalThreadId.x;
-    if (constraintIdx >= numConstraints) return;
+    if (globalThreadId.x >= activeCounts[ACTIVE_FACE_CONSTRAINTS_SLOT + axis]) return;
+    uint constraintIdx = activeFaceConstraints[globalThreadId.x];
 
     // A face constraint deals with two voxels, which we'll refer to as A and B throughout this shader.
     int voxelAIdx = faceConstraintsIndices[constraintIdx * 2];
@@ -12,8 +12,8 @@ cbuffer FaceConstraintsCB : register(b1)
     int faceBId;          // Which face index this constraint corresponds to on voxel B (only used for paint value lookup)
     float constraintLow;
     float constraintHigh;
-    int padding0;
-    int padding1;
+    int axis;             // Which axis (x = 0, y = 1, z = 2) this set of constraints is aligned with
+    uint voxelOffset;     // Where this model's voxels start in the global voxel buffers
     int padding2;
 };
 
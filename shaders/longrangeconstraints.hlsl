@@ -1,14 +1,17 @@
 #include "vgs_core.hlsl"
 
 StructuredBuffer<uint> longRangeParticleIndices : register(t0);
+StructuredBuffer<uint> activeLongRangeConstraints : register(t1);
+StructuredBuffer<uint> activeCounts : register(t2);
 RWStructuredBuffer<Particle> particles : register(u0);
 
+// One dispatch per level (coarsest first). The level's active constraints start at firstConstraint in the active list.
 cbuffer LongRangeConstraintsCB : register(b0)
 {
     uint numConstraints;
+    uint firstConstraint;
+    uint countSlot;
     uint padding0;
-    uint padding1;
-    uint padding2;
 };
 
 cbuffer VGSConstantsCB : register(b1)
@@ -18,18 +21,18 @@ cbuffer VGSConstantsCB : register(b1)
 
 bool longRangeConstraintBroken(uint particleIdx0) {
     // The lower 4 bits (0xF) of the first particle are a counter of how many face constraints associated with this long-range constraint have been broken.
-    // Three is a bit of a heuristic: it's the minimum number of face constraints internal to a 2x2x2 voxel grouping
-    // that may disconnect the group into multiple parts. If that many (or more) are broken, we must break the long-range constraint.
-    return (particleIdx0 & 0xF) >= 3u;
+    // Once that reaches the threshold for the constraint's level (a bit of a heuristic, see LONG_RANGE_BREAK_THRESHOLD), the cluster may be disconnected
+    // into multiple parts, so the long-range constraint must break. faceconstraints.hlsl then sets the counter to LONG_RANGE_BROKEN.
+    return (particleIdx0 & 0xF) == LONG_RANGE_BROKEN;
 }
 
 [numthreads(VGS_THREADS, 1, 1)]
 void main(uint3 globalThreadId : SV_DispatchThreadID)
 {
-    uint constraintIdx = globalThreadId.x;
-    if (constraintIdx >= numConstraints) {
+    if (globalThreadId.x >= activeCounts[countSlot]) {
         return;
     }
+    uint constraintIdx = activeLongRangeConstraints[firstConstraint + globalThreadId.x];
 
     uint particleIdx0 = longRangeParticleIndices[constraintIdx << 3];
     if (longRangeConstraintBroken(particleIdx0)) return;
@@ -0,0 +1,20 @@
+#include "constants.hlsli"
+
+StructuredBuffer<uint> sortedCellKeys : register(t0);
+StructuredBuffer<uint> sortEntryCount : register(t1);
+RWStructuredBuffer<uint> cellStartFlags : register(u0);
+
+/**
+ * Sorted broadphase: flags the first entry of each cell's run in the sorted (cell key, particle) list.
+ * The flags are then prefix scanned, turning each flag into the index of its cell (plus one) - see write_collision_cells.hlsl.
+ */
+[numthreads(BUILD_COLLISION_PARTICLE_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    // No bounds check: dispatched over exactly the size of the sort buffer.
+    uint entryIdx = gId.x;
+    bool isCellStart = entryIdx < sortEntryCount[0]
+        && (entryIdx == 0 || sortedCellKeys[entryIdx] != sortedCellKeys[entryIdx - 1]);
+
+    cellStartFlags[entryIdx] = isCellStart ? 1 : 0;
+}
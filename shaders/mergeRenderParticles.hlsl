@@ -3,13 +3,15 @@
 #include "faceconstraints_shared.hlsl"
 
 RWStructuredBuffer<Particle> renderParticles : register(u4);
+StructuredBuffer<uint> liveFaceConstraints : register(t0);
+StructuredBuffer<uint> liveCounts : register(t1);
 
 [numthreads(VGS_THREADS, 1, 1)]
 void main(
     uint3 globalThreadId : SV_DispatchThreadID
 ) {
-    uint constraintIdx = globalThreadId.x;
-    if (constraintIdx >= numConstraints) return;
+    if (globalThreadId.x >= liveCounts[LIVE_FACE_CONSTRAINTS_SLOT + axis]) return;
+    uint constraintIdx = liveFaceConstraints[globalThreadId.x];
 
     int voxelAIdx = faceConstraintsIndices[constraintIdx * 2];
     int voxelBIdx = faceConstraintsIndices[constraintIdx * 2 + 1];
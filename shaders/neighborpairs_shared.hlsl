@@ -0,0 +1,12 @@
+#include "particle_collisions_shared.hlsl"
+#include "constants.hlsli"
+
+// Position corrections from the neighbor pair narrowphase are accumulated atomically, as fixed-point integers (scaled by correctionScale),
+// since many pairs can correct the same particle in one dispatch.
+int3 toFixedPoint(float3 correction) {
+    return int3(round(correction * correctionScale));
+}
+
+float3 fromFixedPoint(int3 correction) {
+    return float3(correction) / correctionScale;
+}
@@ -1,12 +1,37 @@
+#ifndef PARTICLE_COLLISIONS_SHARED_HLSL
+#define PARTICLE_COLLISIONS_SHARED_HLSL
+
 cbuffer ParticleCollisionsConstantBuffer : register(b0)
 {
     float inverseCellSize;
     uint hashGridSize;
     uint numParticles;    // typically the same as hashGridSize, but to be more robust, bind separately.
     float friction;
+    float skinRadius;           // Neighbor lists only: extra distance at which pairs are listed (particles are binned with half of it added to their radius)
+    uint maxNeighborPairs;      // Neighbor lists only: capacity of the pair list
+    float correctionScale;      // Neighbor lists only: fixed-point scale of accumulated position corrections
+    uint padding0;
 };
 
 int getParticleCellHash(int gridPosX, int gridPosY, int gridPosZ) {
     int hash = (gridPosX * 92837111) ^ (gridPosY * 689287499) ^ (gridPosZ * 283923481);
     return abs(hash) % hashGridSize;
-}
\ No newline at end of file
+}
+
+// Spreads the low 10 bits of x so there are two zero bits between each.
+uint expandBits(uint x) {
+    x &= 0x3FF;
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x << 8)) & 0x0300F00F;
+    x = (x | (x << 4)) & 0x030C30C3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// Morton (Z-order) key of a grid cell, used by the sorted broadphase. Negative coordinates wrap (two's complement low bits),
+// see COLLISION_CELL_KEY_BITS.
+uint getParticleCellKey(int gridPosX, int gridPosY, int gridPosZ) {
+    return expandBits(asuint(gridPosX)) | (expandBits(asuint(gridPosY)) << 1) | (expandBits(asuint(gridPosZ)) << 2);
+}
+
+#endif
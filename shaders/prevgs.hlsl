@@ -1,18 +1,25 @@
 #include "common.hlsl"
 #include "prevgs_shared.hlsl"
 
+StructuredBuffer<uint> activeVoxels : register(t1);
+StructuredBuffer<uint> activeCounts : register(t2);
+
+// One thread per particle of each active (awake) voxel.
 [numthreads(VGS_THREADS, 1, 1)]
 void main(uint3 gId : SV_DispatchThreadID) 
 {
-    if (gId.x >= preVgsConstants.numParticles) return; 
+    uint activeVoxelIdx = gId.x >> 3;
+    if (activeVoxelIdx >= activeCounts[ACTIVE_VOXELS_SLOT]) return;
+
+    uint voxelIndex = activeVoxels[activeVoxelIdx];
+    uint particleIdx = (voxelIndex << 3) + (gId.x & 7);
     
-    Particle particle = particles[gId.x];
+    Particle particle = particles[particleIdx];
     if (massIsInfinite(particle)) return;
 
-    Particle oldParticle = oldParticles[gId.x];
-    oldParticles[gId.x] = particle;
+    Particle oldParticle = oldParticles[particleIdx];
+    oldParticles[particleIdx] = particle;
 
-    int voxelIndex = gId.x >> 3;
     if (isDragging[voxelIndex]) return;
 
     float3 delta = (particle.position - oldParticle.position);
@@ -20,6 +27,6 @@ void main(uint3 gId : SV_DispatchThreadID)
     particle.position += delta;
     
     // Write back to global memory
-    particles[gId.x] = particle;
+    particles[particleIdx] = particle;
 }
 
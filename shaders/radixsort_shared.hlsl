@@ -0,0 +1,13 @@
+#include "constants.hlsli"
+
+cbuffer RadixSortConstantBuffer : register(b0)
+{
+    uint shift;         // Lowest key bit of the digit sorted by this pass
+    uint numGroups;     // Workgroups per pass (each sorts RADIX_SORT_THREADS elements)
+    uint padding0;
+    uint padding1;
+};
+
+uint getDigit(uint key) {
+    return (key >> shift) & (RADIX_SORT_BINS - 1);
+}
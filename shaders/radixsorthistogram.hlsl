@@ -0,0 +1,27 @@
+#include "radixsort_shared.hlsl"
+
+StructuredBuffer<uint> keys : register(t0);
+RWStructuredBuffer<uint> digitCounts : register(u0);
+
+groupshared uint s_digitCounts[RADIX_SORT_BINS];
+
+/**
+ * Counts the digits of each workgroup's block of keys. Counts are written digit-major (all workgroups' counts of digit 0, then digit 1, ...),
+ * so that a prefix scan over the whole buffer yields each workgroup's output offset for each digit.
+ */
+[numthreads(RADIX_SORT_THREADS, 1, 1)]
+void main(uint3 globalId : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID)
+{
+    if (groupThreadId.x < RADIX_SORT_BINS) {
+        s_digitCounts[groupThreadId.x] = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // No bounds check: the sort buffer size is a multiple of RADIX_SORT_THREADS by construction.
+    InterlockedAdd(s_digitCounts[getDigit(keys[globalId.x])], 1);
+    GroupMemoryBarrierWithGroupSync();
+
+    if (groupThreadId.x < RADIX_SORT_BINS) {
+        digitCounts[groupThreadId.x * numGroups + groupId.x] = s_digitCounts[groupThreadId.x];
+    }
+}
@@ -0,0 +1,80 @@
+#include "radixsort_shared.hlsl"
+
+StructuredBuffer<uint> keysIn : register(t0);
+StructuredBuffer<uint> valuesIn : register(t1);
+StructuredBuffer<uint> scannedDigitCounts : register(t2); // Inclusive scan of the histogram pass output
+RWStructuredBuffer<uint> keysOut : register(u0);
+RWStructuredBuffer<uint> valuesOut : register(u1);
+
+groupshared uint s_keys[RADIX_SORT_THREADS];
+groupshared uint s_values[RADIX_SORT_THREADS];
+groupshared uint s_scan[2][RADIX_SORT_THREADS];
+groupshared uint s_digitStart[RADIX_SORT_BINS];
+groupshared uint s_digitEnd[RADIX_SORT_BINS];
+
+// Exclusive (Hillis-Steele) scan of one value per thread across the workgroup. Also outputs the workgroup total.
+uint groupExclusiveScan(uint value, uint threadIdx, out uint total) {
+    s_scan[0][threadIdx] = value;
+    GroupMemoryBarrierWithGroupSync();
+
+    uint src = 0;
+    for (uint offset = 1; offset < RADIX_SORT_THREADS; offset <<= 1) {
+        uint sum = s_scan[src][threadIdx];
+        if (threadIdx >= offset) sum += s_scan[src][threadIdx - offset];
+        s_scan[1 - src][threadIdx] = sum;
+        src = 1 - src;
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    uint inclusive = s_scan[src][threadIdx];
+    total = s_scan[src][RADIX_SORT_THREADS - 1];
+    GroupMemoryBarrierWithGroupSync(); // s_scan is reused by the next call
+    return inclusive - value;
+}
+
+/**
+ * Stable scatter of one radix sort pass. Each workgroup first sorts its block by digit in shared memory (one 1-bit split per digit bit),
+ * so that elements with the same digit are contiguous and their rank within the block is just their distance from the digit's first element.
+ * The global destination is then the workgroup's offset for that digit (from the scanned histogram) plus that rank.
+ */
+[numthreads(RADIX_SORT_THREADS, 1, 1)]
+void main(uint3 globalId : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID)
+{
+    uint threadIdx = groupThreadId.x;
+    uint key = keysIn[globalId.x];
+    uint value = valuesIn[globalId.x];
+
+    // Each split moves elements with a 0 bit in front of those with a 1 bit, preserving order within each. After every split,
+    // thread i picks up whichever element landed in slot i.
+    for (uint bit = 0; bit < RADIX_SORT_BITS_PER_PASS; ++bit) {
+        uint isOne = (getDigit(key) >> bit) & 1;
+        uint numZeros;
+        uint zerosBefore = groupExclusiveScan(1 - isOne, threadIdx, numZeros);
+        uint newIdx = isOne ? numZeros + (threadIdx - zerosBefore) : zerosBefore;
+
+        s_keys[newIdx] = key;
+        s_values[newIdx] = value;
+        GroupMemoryBarrierWithGroupSync();
+
+        key = s_keys[threadIdx];
+        value = s_values[threadIdx];
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    // Find the [start, end) range of each digit present in the (now locally sorted) block.
+    uint digit = getDigit(key);
+    if (threadIdx == 0 || getDigit(s_keys[threadIdx - 1]) != digit) {
+        s_digitStart[digit] = threadIdx;
+    }
+    if (threadIdx == RADIX_SORT_THREADS - 1 || getDigit(s_keys[threadIdx + 1]) != digit) {
+        s_digitEnd[digit] = threadIdx + 1;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint digitCountInGroup = s_digitEnd[digit] - s_digitStart[digit];
+    uint groupDigitOffset = scannedDigitCounts[digit * numGroups + groupId.x] - digitCountInGroup; // inclusive -> exclusive
+    uint dstIdx = groupDigitOffset + (threadIdx - s_digitStart[digit]);
+
+    keysOut[dstIdx] = key;
+    valuesOut[dstIdx] = value;
+}
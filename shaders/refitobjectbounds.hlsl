@@ -0,0 +1,28 @@
+#include "collisionculling_shared.hlsl"
+
+StructuredBuffer<uint> clusterObjects : register(t1);
+RWStructuredBuffer<uint4> boundsMin : register(u0);
+RWStructuredBuffer<uint4> boundsMax : register(u1);
+
+/**
+ * One thread per cluster. Grows each object's AABB to contain its (non-empty) clusters. Going through clusters rather than voxels
+ * keeps the number of atomics on each object's bounds small.
+ */
+[numthreads(COLLISION_CULLING_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    uint clusterIdx = gId.x;
+    if (clusterIdx >= numClusters) return;
+
+    uint4 clusterMin = boundsMin[clusterIdx];
+    uint4 clusterMax = boundsMax[clusterIdx];
+    if (boundsAreEmpty(clusterMin.xyz, clusterMax.xyz)) return;
+
+    uint objectBoundsIdx = numClusters + clusterObjects[clusterIdx];
+    InterlockedMin(boundsMin[objectBoundsIdx].x, clusterMin.x);
+    InterlockedMin(boundsMin[objectBoundsIdx].y, clusterMin.y);
+    InterlockedMin(boundsMin[objectBoundsIdx].z, clusterMin.z);
+    InterlockedMax(boundsMax[objectBoundsIdx].x, clusterMax.x);
+    InterlockedMax(boundsMax[objectBoundsIdx].y, clusterMax.y);
+    InterlockedMax(boundsMax[objectBoundsIdx].z, clusterMax.z);
+}
@@ -0,0 +1,59 @@
+#include "collisionculling_shared.hlsl"
+
+StructuredBuffer<Particle> particles : register(t1);
+StructuredBuffer<uint> isSurfaceVoxel : register(t2);
+StructuredBuffer<uint> surfaceVoxels : register(t3);
+RWStructuredBuffer<uint4> boundsMin : register(u0);
+RWStructuredBuffer<uint4> boundsMax : register(u1);
+RWStructuredBuffer<uint> objectFlags : register(u2);
+RWStructuredBuffer<float4> voxelSpheres : register(u3);
+
+/**
+ * One thread per surface voxel (see SurfaceVoxelsCompute). Fits a bounding sphere around each surface voxel's particles (inflated by half the skin, so that two spheres
+ * overlap whenever any of their particles are within skin distance), and grows its cluster's AABB to contain it.
+ * Interior voxels never collide, so they're left out of every bound.
+ */
+[numthreads(COLLISION_CULLING_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    if (gId.x >= surfaceVoxels[SURFACE_VOXELS_COUNT_IDX]) return;
+    uint voxelIdx = surfaceVoxels[SURFACE_VOXELS_FIRST_IDX + gId.x];
+
+    uint surface = isSurfaceVoxel[voxelIdx];
+    if (!surface) return;
+
+    uint objectIdx = findObject(voxelIdx);
+    CollisionObjectRange object = objectRanges[objectIdx];
+    if (surface == SURFACE_VOXEL_FRACTURED) {
+        InterlockedOr(objectFlags[objectIdx], COLLISION_OBJECT_FRACTURED);
+    }
+
+    uint startIdx = voxelIdx << 3;
+    Particle voxelParticles[8];
+    float3 center = float3(0.0f, 0.0f, 0.0f);
+    float maxParticleRadius = 0.0f;
+    [unroll] for (uint i = 0; i < 8; ++i) {
+        voxelParticles[i] = particles[startIdx + i];
+        center += voxelParticles[i].position;
+        maxParticleRadius = max(maxParticleRadius, particleRadius(voxelParticles[i]));
+    }
+    center *= 0.125f;
+
+    float maxDistanceSq = 0.0f;
+    [unroll] for (uint j = 0; j < 8; ++j) {
+        float3 offset = voxelParticles[j].position - center;
+        maxDistanceSq = max(maxDistanceSq, dot(offset, offset));
+    }
+    float radius = sqrt(maxDistanceSq) + maxParticleRadius + 0.5f * skinRadius;
+    voxelSpheres[voxelIdx] = float4(center, radius);
+
+    uint clusterIdx = getClusterIdx(voxelIdx, object);
+    uint3 sphereMin = floatToOrderedUint(center - radius);
+    uint3 sphereMax = floatToOrderedUint(center + radius);
+    InterlockedMin(boundsMin[clusterIdx].x, sphereMin.x);
+    InterlockedMin(boundsMin[clusterIdx].y, sphereMin.y);
+    InterlockedMin(boundsMin[clusterIdx].z, sphereMin.z);
+    InterlockedMax(boundsMax[clusterIdx].x, sphereMax.x);
+    InterlockedMax(boundsMax[clusterIdx].y, sphereMax.y);
+    InterlockedMax(boundsMax[clusterIdx].z, sphereMax.z);
+}
@@ -1,72 +1,88 @@
-#include "particle_collisions_shared.hlsl"
-#include "common.hlsl"
-#include "constants.hlsli"
+#include "collisionresponse_shared.hlsl"
 
 StructuredBuffer<uint> particleIndices : register(t0);
 StructuredBuffer<uint> collisionCellParticleCounts : register(t1);
-StructuredBuffer<Particle> frameStartParticles : register(t2);
-RWStructuredBuffer<Particle> particles : register(u0);
-
-static const float jitterEpsilon = 1e-3f;
-static const float relaxationFactor = 0.35f;
-
-bool doParticlesOverlap(
-    float3 positionA,
-    float3 positionB,
-    float radiusA,
-    float radiusB,
-    out float distanceSquared, 
-    out float3 particleAToB
-)
-{
-    particleAToB = positionB - positionA;
-    distanceSquared = dot(particleAToB, particleAToB);
-    if (distanceSquared < 1e-6f) return false; // Avoid division by zero or NaN
-
-    return (distanceSquared < (radiusA + radiusB) * (radiusA + radiusB));
-}
-
-// Approximates the center of a voxel that owns a particle by the average of the particle and its diagonal particle in the voxel.
-// The diagonal particle is retrieved using index relationships between different particles in the voxel (by construction).
-float3 getVoxelCenterOfParticle(Particle particle, uint particleGlobalIdx, uint voxelIdx) {
-    int particleIdxInVoxel = (particleGlobalIdx - (voxelIdx << 3));
-    int particleDiagIdx = (voxelIdx << 3) + 7 - particleIdxInVoxel;
-    Particle particleDiag = particles[particleDiagIdx];
-    return (particle.position + particleDiag.position) * 0.5f;
-}
+#ifdef SORTED_BROADPHASE
+StructuredBuffer<uint> sortedCellKeys : register(t3);
+StructuredBuffer<uint> particleMinCells : register(t4);
+#endif
+#ifdef BUILD_NEIGHBOR_PAIRS
+RWStructuredBuffer<uint2> neighborPairs : register(u2);
+RWStructuredBuffer<uint> neighborPairCount : register(u3);
+#endif
 
 // Max out shared memory. See note below about how many particles each thread can store, based
 // on the number of threads per workgroup and how many threads are assigned to each cell. (And see constants.hlsli for SOLVE_COLLISION_THREADS).
+#ifdef SORTED_BROADPHASE
+#define SHARED_MEMORY_SIZE 1170 // maximum number of (float4 + uint + bool + uint)'s can fit in 32KB of shared memory
+groupshared uint s_minCells[SHARED_MEMORY_SIZE];
+#else
 #define SHARED_MEMORY_SIZE 1365 // maximum number of (float4 + uint + bool)'s can fit in 32KB of shared memory
+#endif
 groupshared Particle s_particles[SHARED_MEMORY_SIZE];
 groupshared uint s_globalParticleIndices[SHARED_MEMORY_SIZE];
 groupshared bool s_positionChanged[SHARED_MEMORY_SIZE];
 
-void applyFriction(Particle preCollisionA, Particle preCollisionB, Particle frameStartParticleA, Particle frameStartParticleB, inout Particle postCollisionA, inout Particle postCollisionB, float3 augmentedNormal, float collisionDelta) {
-    if (friction <= 0) return;
-
-    float3 frameDeltaA = preCollisionA.position - frameStartParticleA.position;
-    float3 frameDeltaB = preCollisionB.position - frameStartParticleB.position;
-    float3 relFrameDelta = frameDeltaA - frameDeltaB;
-    float3 relTangent = relFrameDelta - dot(relFrameDelta, augmentedNormal) * augmentedNormal;
-
-    float relTangentLenSq = dot(relTangent, relTangent);
-    if (relTangentLenSq < 1e-8f) return;
-
-    float maxTangent = friction * collisionDelta;
-    float scale = min(1.0f, maxTangent / sqrt(relTangentLenSq));
-    float3 relTangentClamped = relTangent * scale;
+#ifdef SORTED_BROADPHASE
+// A particle pair that shares several cells is owned by just one of them: the cell at the max of the two particles' min cells (always a cell both
+// were binned into). Min cells are packed, wrapped coordinates (see build_collision_keys.hlsl), at most one apart per axis, so "max" accounts for wrapping.
+uint getPairOwnerCellKey(uint packedMinCellA, uint packedMinCellB) {
+    const uint mask = (1u << COLLISION_CELL_KEY_BITS) - 1;
+    int ownerCell[3];
+    [unroll] for (uint axis = 0; axis < 3; ++axis) {
+        uint a = (packedMinCellA >> (axis * COLLISION_CELL_KEY_BITS)) & mask;
+        uint b = (packedMinCellB >> (axis * COLLISION_CELL_KEY_BITS)) & mask;
+        ownerCell[axis] = (((a - b) & mask) == 1) ? a : b;
+    }
+    return getParticleCellKey(ownerCell[0], ownerCell[1], ownerCell[2]);
+}
+#else
+// Hashed grid equivalent of the above, only used for statistics: buckets are solved independently, so pairs that share several cells are solved in each.
+uint getPairOwnerCellHash(Particle particleA, Particle particleB) {
+    int3 minCellA = int3(floor((particleA.position - particleRadius(particleA)) * inverseCellSize));
+    int3 minCellB = int3(floor((particleB.position - particleRadius(particleB)) * inverseCellSize));
+    int3 ownerCell = max(minCellA, minCellB);
+    return getParticleCellHash(ownerCell.x, ownerCell.y, ownerCell.z);
+}
+#endif
 
-    float invMassA = particleInverseMass(preCollisionA);
-    float invMassB = particleInverseMass(preCollisionB);
-    float invMassSumReciprocal = 1 / (invMassA + invMassB);
+/**
+ * Orders a cell's particles (this thread's section of shared memory) by position along an axis. Shell sort, because it's in place:
+ * there's no shared memory to spare for keys or a scratch copy.
+ */
+void sortCellAlongAxis(uint sharedMemoryStartIdx, uint numParticles, float3 axis) {
+    static const uint gaps[8] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+    for (uint g = 0; g < 8; ++g) {
+        uint gap = gaps[g];
+        for (uint i = gap; i < numParticles; ++i) {
+            Particle particle = s_particles[sharedMemoryStartIdx + i];
+            uint globalParticleIdx = s_globalParticleIndices[sharedMemoryStartIdx + i];
+#ifdef SORTED_BROADPHASE
+            uint minCell = s_minCells[sharedMemoryStartIdx + i];
+#endif
+            float key = dot(particle.position, axis);
+
+            uint j = i;
+            for (; j >= gap && dot(s_particles[sharedMemoryStartIdx + j - gap].position, axis) > key; j -= gap) {
+                s_particles[sharedMemoryStartIdx + j] = s_particles[sharedMemoryStartIdx + j - gap];
+                s_globalParticleIndices[sharedMemoryStartIdx + j] = s_globalParticleIndices[sharedMemoryStartIdx + j - gap];
+#ifdef SORTED_BROADPHASE
+                s_minCells[sharedMemoryStartIdx + j] = s_minCells[sharedMemoryStartIdx + j - gap];
+#endif
+            }
 
-    postCollisionA.position -= (invMassA * invMassSumReciprocal) * relTangentClamped;
-    postCollisionB.position += (invMassB * invMassSumReciprocal) * relTangentClamped;
+            s_particles[sharedMemoryStartIdx + j] = particle;
+            s_globalParticleIndices[sharedMemoryStartIdx + j] = globalParticleIdx;
+#ifdef SORTED_BROADPHASE
+            s_minCells[sharedMemoryStartIdx + j] = minCell;
+#endif
+        }
+    }
 }
 
 /**
  * Resolve collisions between particles in the same collision cell. (Particles have been pre-binned into all cells they overlap)
+ * With BUILD_NEIGHBOR_PAIRS, instead lists the pairs within skin distance of each other, for the neighbor pair narrowphase to reuse over several substeps.
  * Note: no shared memory barriers are needed because each thread writes to its own section of shared memory. (so "shared" is a bit of a misnomer here :D)
 */
 [numthreads(SOLVE_COLLISION_THREADS, 1, 1)]
@@ -79,21 +95,50 @@ void main(uint3 globalId : SV_DispatchThreadID, uint3 groupThreadId : SV_GroupTh
 
     // Store particles in shared memory.
     uint numParticlesInCell = particleEndIdx - particleStartIdx;
+    float3 boundsMin = asfloat(0x7f7fffff).xxx; // FLT_MAX
+    float3 boundsMax = -boundsMin;
     for (uint u = 0; u < numParticlesInCell; ++u) {
         if (sharedMemoryStartIdx + u >= SHARED_MEMORY_SIZE) break; // Ignore any particles that would overflow shared memory.
         uint globalParticleIdx = particleIndices[particleStartIdx + u];
         s_globalParticleIndices[sharedMemoryStartIdx + u] = globalParticleIdx;
         s_particles[sharedMemoryStartIdx + u] = particles[globalParticleIdx];
+        boundsMin = min(boundsMin, s_particles[sharedMemoryStartIdx + u].position);
+        boundsMax = max(boundsMax, s_particles[sharedMemoryStartIdx + u].position);
         s_positionChanged[sharedMemoryStartIdx + u] = false; // Initialize position changed flags.
+#ifdef SORTED_BROADPHASE
+        s_minCells[sharedMemoryStartIdx + u] = particleMinCells[globalParticleIdx];
+#endif
+    }
+
+#ifdef SORTED_BROADPHASE
+    uint cellKey = (numParticlesInCell > 0) ? sortedCellKeys[particleStartIdx] : 0;
+#endif
+    uint numCandidatePairs = 0;
+    uint numDuplicatePairs = 0;
+    uint numGluedPairs = 0;
+    uint numStoredParticles = min(numParticlesInCell, SHARED_MEMORY_SIZE - min(sharedMemoryStartIdx, SHARED_MEMORY_SIZE));
+    uint numOverflowParticles = numParticlesInCell - numStoredParticles;
+
+    // Dense cells (e.g. crushed piles) would go quadratic testing all pairs. Instead, sort them along the axis they're most spread out on,
+    // and only test each particle against those that follow it until they're too far along that axis to touch.
+    // Positions move a little as pairs are solved, so the order can go slightly stale; any contact missed because of it is caught next substep.
+    bool useSweep = (numStoredParticles >= COLLISION_SWEEP_MIN_PARTICLES);
+    float3 sweepAxis = float3(0.0f, 0.0f, 0.0f);
+    if (useSweep) {
+        float3 extent = boundsMax - boundsMin;
+        sweepAxis = (extent.x >= extent.y && extent.x >= extent.z) ? float3(1.0f, 0.0f, 0.0f) : ((extent.y >= extent.z) ? float3(0.0f, 1.0f, 0.0f) : float3(0.0f, 0.0f, 1.0f));
+        sortCellAlongAxis(sharedMemoryStartIdx, numStoredParticles, sweepAxis);
     }
+    // Cells are sized to fit the largest particle (plus the skin, for neighbor lists), which bounds how far apart a touching pair can be.
+    float maxParticleRadius = 0.5f * (1.0f / inverseCellSize - skinRadius);
 
-    for (uint i = 0; i < numParticlesInCell; ++i) {
-        if (sharedMemoryStartIdx + i >= SHARED_MEMORY_SIZE) break;
-        for (uint j = i + 1; j < numParticlesInCell; ++j) {
-            if (sharedMemoryStartIdx + j >= SHARED_MEMORY_SIZE) break;
+    for (uint i = 0; i < numStoredParticles; ++i) {
+        uint sharedMemIdx_i = sharedMemoryStartIdx + i;
+        float sweepReach = particleRadius(s_particles[sharedMemIdx_i]) + maxParticleRadius + skinRadius;
 
-            uint sharedMemIdx_i = sharedMemoryStartIdx + i;
+        for (uint j = i + 1; j < numStoredParticles; ++j) {
             uint sharedMemIdx_j = sharedMemoryStartIdx + j;
+            if (useSweep && dot(s_particles[sharedMemIdx_j].position - s_particles[sharedMemIdx_i].position, sweepAxis) >= sweepReach) break;
             
             uint globalParticleIdx_i = s_globalParticleIndices[sharedMemIdx_i];
             uint globalParticleIdx_j = s_globalParticleIndices[sharedMemIdx_j];
@@ -102,66 +147,67 @@ void main(uint3 globalId : SV_DispatchThreadID, uint3 groupThreadId : SV_GroupTh
             uint globalVoxelIdx_j = globalParticleIdx_j >> 3;
             
             if (globalVoxelIdx_i == globalVoxelIdx_j) continue; // Skip particle pairs from the same voxel.
+            if (areVoxelsGlued(globalVoxelIdx_i, globalVoxelIdx_j)) {
+                ++numGluedPairs;
+                continue;
+            }
+            ++numCandidatePairs;
 
             Particle particleA = s_particles[sharedMemIdx_i];
             Particle particleB = s_particles[sharedMemIdx_j];
 
-            float distanceSquared;
-            float3 particleAToB;
-            float2 particleRadiusAndInvMassA = unpackHalf2x16(particleA.radiusAndInvMass);
-            float2 particleRadiusAndInvMassB = unpackHalf2x16(particleB.radiusAndInvMass);
-            float invMassSum = particleRadiusAndInvMassA.y + particleRadiusAndInvMassB.y;
-            if (invMassSum <= 0.0f) continue; // Both particles are immovable.
-
-            if (!doParticlesOverlap(particleA.position, particleB.position, particleRadiusAndInvMassA.x, particleRadiusAndInvMassB.x, distanceSquared, particleAToB)) continue;
-            particleAToB = normalize(particleAToB);
-            float delta = (particleRadiusAndInvMassA.x + particleRadiusAndInvMassB.x) - sqrt(distanceSquared);
-            
-            float jitterThreshold = jitterEpsilon * min(particleRadiusAndInvMassA.x, particleRadiusAndInvMassB.x);            
-            if (delta <= jitterThreshold) continue;
-            delta -= jitterThreshold; 
-
-            // Get the particles diagonal to A and B within their respective voxels.
-            // Then approximate the voxel centers to augment collision normals, to avoid voxel interlock.
-            float3 voxelACenter = getVoxelCenterOfParticle(particleA, globalParticleIdx_i, globalVoxelIdx_i);
-            float3 voxelBCenter = getVoxelCenterOfParticle(particleB, globalParticleIdx_j, globalVoxelIdx_j);
-
-            // Test for voxel-center collision, treating each center as an imaginary "particle" with radius 1.5x that of the voxel's real particles. 
-            float3 augmentedNormal = particleAToB;
-            float3 voxelAToB;
-            if (doParticlesOverlap(voxelACenter, voxelBCenter, 1.5f * particleRadiusAndInvMassA.x, 1.5f * particleRadiusAndInvMassB.x, distanceSquared, voxelAToB)) {
-                augmentedNormal = normalize(normalize(voxelAToB) + particleAToB);
+#ifdef SORTED_BROADPHASE
+            // Cells are exact, so the pair is solved in its owner cell only.
+            if (getPairOwnerCellKey(s_minCells[sharedMemIdx_i], s_minCells[sharedMemIdx_j]) != cellKey) {
+                ++numDuplicatePairs;
+                continue;
             }
-            
-            float invMassSumReciprocal = 1 / (invMassSum);
-
-            s_particles[sharedMemIdx_i].position -= delta * relaxationFactor * (invMassSumReciprocal * particleRadiusAndInvMassA.y) * augmentedNormal;
-            s_particles[sharedMemIdx_j].position += delta * relaxationFactor * (invMassSumReciprocal * particleRadiusAndInvMassB.y) * augmentedNormal;
-
-            // We do have to do some extra per-collision-pair global reads to apply friction. There's not enough shared memory to store frame start positions.
-            // But since these reads only happen on actual collisions (not on all candidates), it's manageable.
-            applyFriction(
-                particleA, 
-                particleB,
-                frameStartParticles[globalParticleIdx_i],
-                frameStartParticles[globalParticleIdx_j],
-                s_particles[sharedMemIdx_i],
-                s_particles[sharedMemIdx_j],
-                augmentedNormal,
-                delta
-            );
+#else
+            if (getPairOwnerCellHash(particleA, particleB) != globalId.x) ++numDuplicatePairs;
+#endif
+
+#ifdef BUILD_NEIGHBOR_PAIRS
+            // List every pair that could come into contact before any particle moves more than half the skin radius.
+            float maxContactDistance = particleRadius(particleA) + particleRadius(particleB) + skinRadius;
+            float3 particleAToB = particleB.position - particleA.position;
+            if (dot(particleAToB, particleAToB) >= maxContactDistance * maxContactDistance) continue;
+
+            uint pairIdx;
+            InterlockedAdd(neighborPairCount[0], 1, pairIdx);
+            if (pairIdx < maxNeighborPairs) {
+                neighborPairs[pairIdx] = uint2(globalParticleIdx_i, globalParticleIdx_j);
+            } else {
+                InterlockedAdd(collisionStats[COLLISION_STATS_NEIGHBOR_PAIR_OVERFLOW], 1);
+            }
+            continue;
+#else
+            float3 correctionA, correctionB;
+            if (!solveParticlePair(particleA, particleB, globalParticleIdx_i, globalParticleIdx_j, correctionA, correctionB)) continue;
 
+            s_particles[sharedMemIdx_i].position += correctionA;
+            s_particles[sharedMemIdx_j].position += correctionB;
             s_positionChanged[sharedMemIdx_i] = true;
             s_positionChanged[sharedMemIdx_j] = true;
+#endif
         }
     }
 
+    if (numParticlesInCell > 0) {
+        InterlockedAdd(collisionStats[COLLISION_STATS_OCCUPIED_CELLS], 1);
+        InterlockedAdd(collisionStats[COLLISION_STATS_OCCUPANCY_HISTOGRAM + min(firstbithigh(numParticlesInCell), COLLISION_OCCUPANCY_BINS - 1)], 1);
+    }
+    if (numCandidatePairs > 0) InterlockedAdd(collisionStats[COLLISION_STATS_CANDIDATE_PAIRS], numCandidatePairs);
+    if (numDuplicatePairs > 0) InterlockedAdd(collisionStats[COLLISION_STATS_DUPLICATE_PAIRS], numDuplicatePairs);
+    if (numGluedPairs > 0) InterlockedAdd(collisionStats[COLLISION_STATS_GLUED_PAIRS], numGluedPairs);
+    if (numOverflowParticles > 0) InterlockedAdd(collisionStats[COLLISION_STATS_OVERFLOW_PARTICLES], numOverflowParticles);
+
+#ifndef BUILD_NEIGHBOR_PAIRS
     // Write the particles back to global memory.
-    for (uint v = 0; v < numParticlesInCell; ++v) {
-        if (sharedMemoryStartIdx + v >= SHARED_MEMORY_SIZE) break; // Ignore any particles that would overflow shared memory.
+    for (uint v = 0; v < numStoredParticles; ++v) {
         if (!s_positionChanged[sharedMemoryStartIdx + v]) continue;
 
         uint globalParticleIdx = s_globalParticleIndices[sharedMemoryStartIdx + v];
         particles[globalParticleIdx] = s_particles[sharedMemoryStartIdx + v];
     }
+#endif
 }
\ No newline at end of file
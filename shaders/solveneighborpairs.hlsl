@@ -0,0 +1,27 @@
+#include "collisionresponse_shared.hlsl"
+#include "neighborpairs_shared.hlsl"
+
+StructuredBuffer<uint2> neighborPairs : register(t0);
+StructuredBuffer<uint> neighborPairCount : register(t1);
+RWStructuredBuffer<int> positionCorrections : register(u2); // 3 per particle, fixed point
+
+/**
+ * Neighbor list narrowphase: each thread resolves one pair from the list built by buildneighborpairs.hlsl (which may be several substeps old).
+ * Corrections from all of a particle's pairs are summed, then applied by applyneighborcorrections.hlsl.
+ */
+[numthreads(SOLVE_NEIGHBOR_PAIRS_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    if (gId.x >= min(neighborPairCount[0], maxNeighborPairs)) return;
+
+    uint2 pair = neighborPairs[gId.x];
+    float3 correctionA, correctionB;
+    if (!solveParticlePair(particles[pair.x], particles[pair.y], pair.x, pair.y, correctionA, correctionB)) return;
+
+    int3 fixedCorrectionA = toFixedPoint(correctionA);
+    int3 fixedCorrectionB = toFixedPoint(correctionB);
+    [unroll] for (uint axis = 0; axis < 3; ++axis) {
+        InterlockedAdd(positionCorrections[3 * pair.x + axis], fixedCorrectionA[axis]);
+        InterlockedAdd(positionCorrections[3 * pair.y + axis], fixedCorrectionB[axis]);
+    }
+}
@@ -4,24 +4,36 @@
 RWStructuredBuffer<Particle> particles : register(u0);
 StructuredBuffer<Particle> oldParticles : register(t0);
 
-/**
- * Store colliders in a constant buffer for fast access. We assume a relatively small number of colliders.
- */
-cbuffer ColliderBuffer : register(b0)
-{    
-    float4x4 worldMatrix[MAX_COLLIDERS];
-    float4x4 inverseWorldMatrix[MAX_COLLIDERS];
+StructuredBuffer<Collider> colliders : register(t1);
+// Colliders binned by hashed grid cell (see SolvePrimitiveCollisionsCompute::binColliders). colliderIndices starts with the unbinned colliders,
+// which every particle tests; bucket b's colliders are colliderIndices[colliderCellStarts[b]] up to colliderIndices[colliderCellStarts[b + 1]].
+StructuredBuffer<uint> colliderCellStarts : register(t2);
+StructuredBuffer<uint> colliderIndices : register(t3);
+// Mesh collider SDFs (see MeshSDF). Every mesh collider's brick table and bricks are concatenated into one buffer each.
+StructuredBuffer<SDFVolume> sdfVolumes : register(t4);
+StructuredBuffer<uint> sdfBrickTable : register(t5);
+StructuredBuffer<float> sdfSamples : register(t6);
+StructuredBuffer<ColliderMotion> colliderMotions : register(t7);
+
+cbuffer PrimitiveCollisionsConstants : register(b0)
+{
     int totalParticles;
     int numColliders;
-    int padding[2];
+    uint numUnbinnedColliders;
+    uint colliderGridSize;
+    float inverseColliderCellSize;
+    float substepStart;
+    float substepEnd;
+    int padding;
 };
 
 /**
  * Applies a friction adjustment (a factor from 0 to 1) that determines how much lateral movement occurs against a collider.
  * A friction of 0 means no friction (full lateral movement), and a friction of 1 means full friction (no lateral movement).
+ * Movement is measured relative to the collider's surface (colliderDelta is how far the contact point moved), so particles ride along on moving colliders.
  */
-void applyFriction(inout Particle particle, Particle oldParticle, float3 colliderNormal, float friction) {
-    float3 deltaPos = particle.position - oldParticle.position;
+void applyFriction(inout Particle particle, Particle oldParticle, float3 colliderNormal, float friction, float3 colliderDelta) {
+    float3 deltaPos = particle.position - oldParticle.position - colliderDelta;
     float3 deltaTangent = deltaPos - dot(deltaPos, colliderNormal) * colliderNormal;
     particle.position -= deltaTangent * friction;
 }
@@ -34,6 +46,109 @@ void restoreMatrixRow(inout float4x4 wMatrix)
     wMatrix[3][3] = 1.0f;
 }
 
+float3x3 quaternionToMatrix(float4 q)
+{
+    return float3x3(
+        1.0f - 2.0f * (q.y * q.y + q.z * q.z), 2.0f * (q.x * q.y - q.z * q.w),        2.0f * (q.x * q.z + q.y * q.w),
+        2.0f * (q.x * q.y + q.z * q.w),        1.0f - 2.0f * (q.x * q.x + q.z * q.z), 2.0f * (q.y * q.z - q.x * q.w),
+        2.0f * (q.x * q.z - q.y * q.w),        2.0f * (q.y * q.z + q.x * q.w),        1.0f - 2.0f * (q.x * q.x + q.y * q.y)
+    );
+}
+
+// A moving collider's pose part way through the frame (0 is its pose last frame, 1 its pose now). Rotations are nlerped, which is plenty for a substep.
+void interpolatePose(ColliderMotion motion, float fraction, out float3x3 rotation, out float3 translation)
+{
+    rotation = quaternionToMatrix(normalize(lerp(motion.previousRotation, motion.rotation, fraction)));
+    translation = lerp(motion.previousTranslation, motion.translation, fraction);
+}
+
+// Overwrites the rigid part of a collider's matrices, leaving the hijacked elements (parameters, type, friction) as they are.
+void setPose(inout float4x4 wMatrix, inout float4x4 invWMatrix, float3x3 rotation, float3 translation)
+{
+    float3 invTranslation = -mul(transpose(rotation), translation);
+    [unroll] for (int r = 0; r < 3; ++r) {
+        [unroll] for (int c = 0; c < 3; ++c) {
+            wMatrix[r][c] = rotation[r][c];
+            invWMatrix[r][c] = rotation[c][r];
+        }
+        wMatrix[r][3] = translation[r];
+        invWMatrix[r][3] = invTranslation[r];
+    }
+}
+
+// Earliest fraction (0 to 1) of the way from start to end at which the segment enters a sphere at the origin, or -1 if it doesn't (or starts inside).
+float sweepSphere(float3 start, float3 end, float radius)
+{
+    float3 d = end - start;
+    float a = dot(d, d);
+    float b = dot(start, d);
+    float c = dot(start, start) - radius * radius;
+    if (c <= 0.0f || a == 0.0f) return -1.0f;
+
+    float discriminant = b * b - a * c;
+    if (discriminant < 0.0f) return -1.0f;
+    float t = (-b - sqrt(discriminant)) / a;
+    return (t >= 0.0f && t <= 1.0f) ? t : -1.0f;
+}
+
+// As sweepSphere, for a capsule aligned with Y (at the origin). The body is swept as an (infinite) cylinder, kept only between the caps.
+float sweepCapsule(float3 start, float3 end, float halfHeight, float radius)
+{
+    float3 startClosest = float3(0.0f, clamp(start.y, -halfHeight, halfHeight), 0.0f);
+    float3 toStart = start - startClosest;
+    if (dot(toStart, toStart) <= radius * radius) return -1.0f;
+
+    float3 d = end - start;
+    float tHit = 2.0f;
+    float a = d.x * d.x + d.z * d.z;
+    if (a > 1e-12f) {
+        float b = start.x * d.x + start.z * d.z;
+        float c = start.x * start.x + start.z * start.z - radius * radius;
+        float discriminant = b * b - a * c;
+        if (discriminant >= 0.0f) {
+            float t = (-b - sqrt(discriminant)) / a;
+            float y = start.y + t * d.y;
+            if (t >= 0.0f && t <= 1.0f && abs(y) <= halfHeight) tHit = t;
+        }
+    }
+
+    float3 capOffset = float3(0.0f, halfHeight, 0.0f);
+    float tCap = sweepSphere(start - capOffset, end - capOffset, radius);
+    if (tCap >= 0.0f) tHit = min(tHit, tCap);
+    tCap = sweepSphere(start + capOffset, end + capOffset, radius);
+    if (tCap >= 0.0f) tHit = min(tHit, tCap);
+
+    return (tHit <= 1.0f) ? tHit : -1.0f;
+}
+
+// As sweepSphere, for an axis-aligned box at the origin (slab test). Also returns the normal of the face the segment enters through.
+float sweepBox(float3 start, float3 end, float3 halfExtents, out float3 normal)
+{
+    normal = float3(0.0f, 0.0f, 0.0f);
+    if (all(abs(start) <= halfExtents)) return -1.0f;
+
+    float3 d = end - start;
+    float tEnter = 0.0f;
+    float tExit = 1.0f;
+    [unroll] for (int axis = 0; axis < 3; ++axis) {
+        if (abs(d[axis]) < 1e-8f) {
+            if (abs(start[axis]) > halfExtents[axis]) return -1.0f; // Parallel to, and outside, this slab
+            continue;
+        }
+
+        float tNear = (-sign(d[axis]) * halfExtents[axis] - start[axis]) / d[axis];
+        float tFar = (sign(d[axis]) * halfExtents[axis] - start[axis]) / d[axis];
+        if (tNear > tEnter) {
+            tEnter = tNear;
+            normal = float3(0.0f, 0.0f, 0.0f);
+            normal[axis] = -sign(d[axis]);
+        }
+        tExit = min(tExit, tFar);
+    }
+
+    return (tEnter <= tExit && any(normal != float3(0.0f, 0.0f, 0.0f))) ? tEnter : -1.0f;
+}
+
 float3 solveSphereCollision(float4x4 wMatrix, inout Particle particle, float particleRadius)
 {
     float sphereRadius = wMatrix[3][0]; 
@@ -239,43 +354,183 @@ float3 solveCapsuleCollision(float4x4 wMatrix, float4x4 invWMatrix, inout Partic
     return normalize(mul((float3x3)wMatrix, localNormal)); // Transform normal to world space (no transpose needed as no non-uniform scale/shear)
 }
 
-[numthreads(VGS_THREADS, 1, 1)]
-void main(uint3 globalThreadId : SV_DispatchThreadID)
+float sdfSample(uint brickStart, int3 sampleCoords)
 {
-    if (numColliders == 0) return;
-    if (globalThreadId.x >= (uint)totalParticles) return;
-    
-    Particle particle = particles[globalThreadId.x];
-    if (massIsInfinite(particle)) return;
-    Particle oldParticle = oldParticles[globalThreadId.x];
-    float radius = particleRadius(particle);
+    return sdfSamples[brickStart + sampleCoords.x + SDF_BRICK_SAMPLES * (sampleCoords.y + SDF_BRICK_SAMPLES * sampleCoords.z)];
+}
 
-    float3 colliderNormal;
-    for (int i = 0; i < numColliders; i++) {
-        float4x4 wMatrix = worldMatrix[i];
-        float4x4 invWMatrix = inverseWorldMatrix[i];
-        float friction = invWMatrix[3][3]; // Store friction in unused part of inverse matrix
-        invWMatrix[3][3] = 1.0f;           // Reset to valid matrix
-        int type = wMatrix[3][3];
-        
-        if (type == 0.0f) {
+/**
+ * Samples the mesh collider's SDF trilinearly (and its gradient, from the same 8 samples) at the particle, in collider-local space,
+ * and pushes the particle out along the gradient. Particles outside the volume, or in a brick outside the narrow band, don't collide.
+ */
+float3 solveMeshSDFCollision(float4x4 wMatrix, float4x4 invWMatrix, inout Particle particle, float particleRadius)
+{
+    SDFVolume volume = sdfVolumes[(uint)wMatrix[3][0]];
+    float3 localPos = mul(invWMatrix, float4(particle.position, 1.0f)).xyz;
+
+    float3 gridPos = (localPos - volume.origin) / volume.cellSize;
+    int3 brickCoords = int3(floor(gridPos / SDF_BRICK_CELLS));
+    if (any(brickCoords < 0) || any(brickCoords >= (int3)volume.numBricks)) return float3(0.0f, 0.0f, 0.0f);
+
+    uint brickIdx = sdfBrickTable[volume.brickTableOffset + brickCoords.x + volume.numBricks.x * (brickCoords.y + volume.numBricks.y * brickCoords.z)];
+    if (brickIdx == SDF_BRICK_EMPTY) return float3(0.0f, 0.0f, 0.0f);
+
+    uint brickStart = brickIdx * (SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES);
+    float3 brickPos = gridPos - brickCoords * SDF_BRICK_CELLS;
+    int3 cell = min(int3(brickPos), SDF_BRICK_CELLS - 1);
+    float3 t = brickPos - cell;
+
+    float d000 = sdfSample(brickStart, cell + int3(0, 0, 0));
+    float d100 = sdfSample(brickStart, cell + int3(1, 0, 0));
+    float d010 = sdfSample(brickStart, cell + int3(0, 1, 0));
+    float d110 = sdfSample(brickStart, cell + int3(1, 1, 0));
+    float d001 = sdfSample(brickStart, cell + int3(0, 0, 1));
+    float d101 = sdfSample(brickStart, cell + int3(1, 0, 1));
+    float d011 = sdfSample(brickStart, cell + int3(0, 1, 1));
+    float d111 = sdfSample(brickStart, cell + int3(1, 1, 1));
+
+    // Interpolate along x, then y, then z. The gradient is the derivative of the same interpolant.
+    float d00 = lerp(d000, d100, t.x), d10 = lerp(d010, d110, t.x);
+    float d01 = lerp(d001, d101, t.x), d11 = lerp(d011, d111, t.x);
+    float d0 = lerp(d00, d10, t.y), d1 = lerp(d01, d11, t.y);
+    float distance = lerp(d0, d1, t.z);
+
+    float penetration = distance - particleRadius;
+    if (penetration >= 0.0f) return float3(0.0f, 0.0f, 0.0f);
+
+    float3 gradient;
+    gradient.x = lerp(lerp(d100 - d000, d110 - d010, t.y), lerp(d101 - d001, d111 - d011, t.y), t.z);
+    gradient.y = lerp(lerp(d010 - d000, d110 - d100, t.x), lerp(d011 - d001, d111 - d101, t.x), t.z);
+    gradient.z = d1 - d0;
+    float gradientLengthSq = dot(gradient, gradient);
+    if (gradientLengthSq < 1e-12f) return float3(0.0f, 0.0f, 0.0f); // Flat (clamped) region, e.g. deep inside: no direction to push in
+
+    float3 localNormal = gradient * rsqrt(gradientLengthSq);
+    float3 adjustedLocalPos = localPos - penetration * localNormal;
+
+    restoreMatrixRow(wMatrix);
+    particle.position = mul(wMatrix, float4(adjustedLocalPos, 1.0f)).xyz;
+    return normalize(mul((float3x3)wMatrix, localNormal)); // Transform normal to world space (no transpose needed as no non-uniform scale/shear)
+}
+
+/**
+ * Continuous collision against a moving box, sphere or capsule. The particle's path relative to the collider runs from where it was (against the collider's
+ * pose at the start of the substep) to where it is now (against the pose at the end). If that path enters the collider, the collider hit the particle
+ * this substep - perhaps passing right through it - so the particle is put where it first touched the surface, carried along with the collider.
+ * Returns a zero normal if the path doesn't enter the collider (including if it starts inside), leaving it to the regular test.
+ */
+float3 solveSweptCollision(int type, float4x4 wMatrix, float4x4 invWMatrix, float3x3 startRotation, float3 startTranslation, inout Particle particle, Particle oldParticle, float particleRadius)
+{
+    float3 start = mul(transpose(startRotation), oldParticle.position - startTranslation);
+    float3 end = mul(invWMatrix, float4(particle.position, 1.0f)).xyz;
+
+    float t = -1.0f;
+    float3 localNormal = float3(0.0f, 0.0f, 0.0f);
+    if (type == 0) {
+        // Inflating the box by the particle radius squares off its (rounded) edges, which only errs on the side of colliding.
+        float3 halfExtents = float3(wMatrix[3][0] * 0.5f, wMatrix[3][1] * 0.5f, wMatrix[3][2] * 0.5f) + particleRadius;
+        t = sweepBox(start, end, halfExtents, localNormal);
+    }
+    else if (type == 1) {
+        t = sweepSphere(start, end, wMatrix[3][0] + particleRadius);
+        if (t >= 0.0f) localNormal = normalize(lerp(start, end, t));
+    }
+    else if (type == 2) {
+        float halfHeight = wMatrix[3][1] * 0.5f;
+        t = sweepCapsule(start, end, halfHeight, wMatrix[3][0] + particleRadius);
+        if (t >= 0.0f) {
+            float3 contact = lerp(start, end, t);
+            localNormal = normalize(contact - float3(0.0f, clamp(contact.y, -halfHeight, halfHeight), 0.0f));
+        }
+    }
+    if (t < 0.0f) return float3(0.0f, 0.0f, 0.0f);
+
+    restoreMatrixRow(wMatrix);
+    particle.position = mul(wMatrix, float4(lerp(start, end, t), 1.0f)).xyz;
+    return normalize(mul((float3x3)wMatrix, localNormal));
+}
+
+void solveCollider(uint colliderIdx, inout Particle particle, Particle oldParticle, float radius)
+{
+    float4x4 wMatrix = colliders[colliderIdx].worldMatrix;
+    float4x4 invWMatrix = colliders[colliderIdx].inverseWorldMatrix;
+    float friction = invWMatrix[3][3]; // Store friction in unused part of inverse matrix
+    invWMatrix[3][3] = 1.0f;           // Reset to valid matrix
+    int type = wMatrix[3][3];
+
+    // A moving collider is solved at its pose at the end of this substep (and swept from its pose at the start), rather than jumping to its final pose at once.
+    ColliderMotion motion = colliderMotions[colliderIdx];
+    float3x3 startRotation = (float3x3)wMatrix;
+    float3 startTranslation = motion.translation;
+    bool isMoving = (motion.isMoving != 0);
+    if (isMoving) {
+        float3x3 endRotation;
+        float3 endTranslation;
+        interpolatePose(motion, substepStart, startRotation, startTranslation);
+        interpolatePose(motion, substepEnd, endRotation, endTranslation);
+        setPose(wMatrix, invWMatrix, endRotation, endTranslation);
+    }
+
+    float3 colliderNormal = float3(0.0f, 0.0f, 0.0f);
+    if (isMoving && type <= 2) {
+        colliderNormal = solveSweptCollision(type, wMatrix, invWMatrix, startRotation, startTranslation, particle, oldParticle, radius);
+    }
+
+    // Otherwise (or if the sweep missed), the regular test at the collider's current pose.
+    if (all(colliderNormal == float3(0.0f, 0.0f, 0.0f))) {
+        if (type == 0) {
             colliderNormal = solveBoxCollision(wMatrix, invWMatrix, particle, radius);
         } 
-        else if (type == 1.0f) {
+        else if (type == 1) {
             colliderNormal = solveSphereCollision(wMatrix, particle, radius);
         }
-        else if (type == 2.0f) {
+        else if (type == 2) {
             colliderNormal = solveCapsuleCollision(wMatrix, invWMatrix, particle, radius);
         }
-        else if (type == 3.0f) {
+        else if (type == 3) {
             colliderNormal = solveCylinderCollision(wMatrix, invWMatrix, particle, radius);
         }
-        else if (type == 4.0f) {
+        else if (type == 4) {
             colliderNormal = solvePlaneCollision(wMatrix, particle, radius);
         }
+        else if (type == 5) {
+            colliderNormal = solveMeshSDFCollision(wMatrix, invWMatrix, particle, radius);
+        }
+    }
+    if (all(colliderNormal == float3(0.0f, 0.0f, 0.0f))) return; // No collision occurred
+
+    // How far the collider's surface moved under the particle this substep (zero for colliders at rest).
+    float3 colliderDelta = float3(0.0f, 0.0f, 0.0f);
+    if (isMoving) {
+        float3 localPos = mul(invWMatrix, float4(particle.position, 1.0f)).xyz;
+        colliderDelta = particle.position - (mul(startRotation, localPos) + startTranslation);
+    }
+
+    applyFriction(particle, oldParticle, colliderNormal, friction, colliderDelta);
+}
+
+[numthreads(VGS_THREADS, 1, 1)]
+void main(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    if (numColliders == 0) return;
+    if (globalThreadId.x >= (uint)totalParticles) return;
+    
+    Particle particle = particles[globalThreadId.x];
+    if (massIsInfinite(particle)) return;
+    Particle oldParticle = oldParticles[globalThreadId.x];
+    float radius = particleRadius(particle);
 
-        if (all(colliderNormal == float3(0.0f, 0.0f, 0.0f))) continue; // No collision occurred
-        applyFriction(particle, oldParticle, colliderNormal, friction);
+    for (uint i = 0; i < numUnbinnedColliders; ++i) {
+        solveCollider(colliderIndices[i], particle, oldParticle, radius);
+    }
+
+    if (colliderGridSize > 0) {
+        int3 cell = int3(floor(particle.position * inverseColliderCellSize));
+        uint bucket = hashColliderCell(cell.x, cell.y, cell.z, colliderGridSize);
+        uint cellEnd = colliderCellStarts[bucket + 1];
+        for (uint j = colliderCellStarts[bucket]; j < cellEnd; ++j) {
+            solveCollider(colliderIndices[j], particle, oldParticle, radius);
+        }
     }
 
     particles[globalThreadId.x] = particle;
@@ -0,0 +1,2 @@
+#define SORTED_BROADPHASE
+#include "solvecollisions.hlsl"
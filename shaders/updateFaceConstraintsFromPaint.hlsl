@@ -4,9 +4,12 @@
 
 RWBuffer<float> paintDeltas : register(u4);
 RWBuffer<float> paintValues : register(u5);
+StructuredBuffer<uint> liveFaceConstraints : register(t0);
+StructuredBuffer<uint> liveCounts : register(t1);
 
 // This entry point is for updating the face constraints based on paint values.
-// One thread per face constraint (over three dispatches, one per axis - just because that's how the face constraint data is stored).
+// One thread per live face constraint (over three dispatches, one per axis - just because that's how the face constraint data is stored).
+// Broken constraints are skipped via the live list (see ConstraintCompactionCompute); constraint indices are unchanged, so limits stay in place.
 // This runs every time a brush stroke ends - that way, we can use the computed delta to know which faces were updated, and can 
 // update the neighboring face in the constraint pair. (And it also means the simulation values are always in sync).
 [numthreads(VGS_THREADS, 1, 1)]
@@ -14,8 +17,8 @@ void main(
     uint3 globalThreadId : SV_DispatchThreadID
 )
 {
-    uint constraintIdx = globalThreadId.x;
-    if (constraintIdx >= numConstraints) return;
+    if (globalThreadId.x >= liveCounts[LIVE_FACE_CONSTRAINTS_SLOT + axis]) return;
+    uint constraintIdx = liveFaceConstraints[globalThreadId.x];
 
     int voxelAIdx = faceConstraintsIndices[constraintIdx * 2];
     int voxelBIdx = faceConstraintsIndices[constraintIdx * 2 + 1];
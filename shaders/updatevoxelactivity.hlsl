@@ -0,0 +1,86 @@
+#include "voxelactivity_shared.hlsl"
+
+StructuredBuffer<bool> isDragging : register(t0);
+RWStructuredBuffer<Particle> particles : register(u0);
+RWStructuredBuffer<uint> activeVoxels : register(u2);
+RWStructuredBuffer<Particle> oldParticles : register(u4);
+
+// Pairs of particle indices (within a voxel) that make up the 12 edges of a voxel, in cube.h corner order.
+static const uint2 voxelEdges[12] = {
+    uint2(0, 1), uint2(2, 3), uint2(4, 5), uint2(6, 7),
+    uint2(0, 2), uint2(1, 3), uint2(4, 6), uint2(5, 7),
+    uint2(0, 4), uint2(1, 5), uint2(2, 6), uint2(3, 7)
+};
+
+float maxEdgeStrain(Particle voxelParticles[8]) {
+    float restLength = 2.0f * activityConstants.particleRadius;
+    float maxStrain = 0.0f;
+    [unroll] for (uint i = 0; i < 12; ++i) {
+        float edgeLength = length(voxelParticles[voxelEdges[i].x].position - voxelParticles[voxelEdges[i].y].position);
+        maxStrain = max(maxStrain, abs(edgeLength - restLength));
+    }
+    return maxStrain / restLength;
+}
+
+/**
+ * One thread per voxel. Decides whether each voxel is resting, based on how far its particles moved last substep
+ * (particles - oldParticles, since preVGS copies particles to oldParticles before integrating) and how deformed it is.
+ * Awake voxels are appended to the active voxel list that the rest of the substep dispatches over.
+ * 
+ * Sleeping voxels are skipped by every other shader, but they can still be displaced by collisions or by constraints shared with awake
+ * neighbours. That displacement shows up here (compared against the larger wake threshold), which is how collisions wake sleeping voxels.
+ */
+[numthreads(VGS_THREADS, 1, 1)]
+void main(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint voxelIdx = globalThreadId.x;
+    if (voxelIdx >= activityConstants.numVoxels) return;
+
+    uint activeIdx;
+    if (!activityConstants.sleepingEnabled) {
+        voxelActivity[voxelIdx] = 0;
+        InterlockedAdd(activeCounts[ACTIVE_VOXELS_SLOT], 1, activeIdx);
+        activeVoxels[activeIdx] = voxelIdx;
+        return;
+    }
+
+    uint activity = voxelActivity[voxelIdx];
+    bool wasAwake = isAwake(activity);
+    uint startIdx = voxelIdx << 3;
+
+    Particle voxelParticles[8];
+    float maxDisplacementSq = 0.0f;
+    [unroll] for (uint i = 0; i < 8; ++i) {
+        voxelParticles[i] = particles[startIdx + i];
+        float3 displacement = voxelParticles[i].position - oldParticles[startIdx + i].position;
+        maxDisplacementSq = max(maxDisplacementSq, dot(displacement, displacement));
+    }
+
+    // Hysteresis: an awake voxel must slow down below the sleep threshold to start resting, but a sleeping voxel
+    // must be pushed past the (larger) wake threshold to wake up. This keeps voxels near the threshold from flickering.
+    bool moved = wasAwake ? (maxDisplacementSq > activityConstants.sleepDisplacementSq || maxEdgeStrain(voxelParticles) > activityConstants.sleepStrain)
+                          : (maxDisplacementSq > activityConstants.wakeDisplacementSq);
+    moved = moved || isDragging[voxelIdx];
+
+    uint restCount = activity & ACTIVITY_REST_COUNTER_MASK;
+    if (moved) {
+        activity = ACTIVITY_MOVED_BIT;
+    } else if (activity & ACTIVITY_WOKEN_BIT) {
+        activity = 0;
+    } else {
+        activity = min(restCount + 1, ACTIVITY_REST_COUNTER_MASK);
+    }
+    voxelActivity[voxelIdx] = activity;
+
+    if (isAwake(activity)) {
+        InterlockedAdd(activeCounts[ACTIVE_VOXELS_SLOT], 1, activeIdx);
+        activeVoxels[activeIdx] = voxelIdx;
+        return;
+    }
+
+    // Asleep: zero out the velocity so that any small residual motion doesn't accumulate, and so that
+    // the next displacement measured above is purely whatever pushed the voxel during the last substep.
+    [unroll] for (uint j = 0; j < 8; ++j) {
+        oldParticles[startIdx + j] = voxelParticles[j];
+    }
+}
@@ -1,31 +1,59 @@
 #include "vgs_core.hlsl"
 
+StructuredBuffer<uint> activeVoxels : register(t0);
+StructuredBuffer<uint> activeCounts : register(t1);
 RWStructuredBuffer<Particle> particles : register(u0);
+RWStructuredBuffer<uint> residualStats : register(u1); // This substep's slot of the residual history (see VGS_RESIDUAL_* in constants.hlsli)
 
 cbuffer VGSConstantBuffer : register(b0)
 {
     VGSConstants vgsConstants;
 };
 
+// Residual stats are reduced per group first so that only one thread per group touches the global counters.
+groupshared uint groupResidualStats[VGS_RESIDUAL_STATS_STRIDE];
+
 [numthreads(VGS_THREADS, 1, 1)]
-void main(uint3 globalThreadId : SV_DispatchThreadID)
+void main(uint3 globalThreadId : SV_DispatchThreadID, uint3 localThreadId : SV_GroupThreadID)
 {
-    uint voxel_idx = globalThreadId.x;
-    if (voxel_idx >= vgsConstants.numVoxels) return;
-
-    uint start_idx = voxel_idx << 3;
-    
-    Particle voxelParticles[8];
-    for (int i = 0; i < 8; ++i) {
-        voxelParticles[i] = particles[start_idx + i];
+    if (localThreadId.x < VGS_RESIDUAL_STATS_STRIDE) {
+        groupResidualStats[localThreadId.x] = 0;
     }
+    GroupMemoryBarrierWithGroupSync();
+
+    // No early return: every thread must reach the barrier below.
+    if (globalThreadId.x < activeCounts[ACTIVE_VOXELS_SLOT]) {
+        uint voxel_idx = activeVoxels[globalThreadId.x];
+        uint start_idx = voxel_idx << 3;
+        
+        Particle voxelParticles[8];
+        for (int i = 0; i < 8; ++i) {
+            voxelParticles[i] = particles[start_idx + i];
+        }
 
-    doVGSIterations(voxelParticles, vgsConstants, false);
+        uint iterationsRun;
+        bool bailedOut;
+        float residual = doVGSIterations(voxelParticles, vgsConstants, false, iterationsRun, bailedOut);
 
-    // Write back the updated particles
-    for (int j = 0; j < 8; ++j) {
-        if (massIsInfinite(voxelParticles[j])) continue;
-        particles[start_idx + j] = voxelParticles[j];
+        // Write back the updated particles
+        for (int j = 0; j < 8; ++j) {
+            if (massIsInfinite(voxelParticles[j])) continue;
+            particles[start_idx + j] = voxelParticles[j];
+        }
+
+        InterlockedMax(groupResidualStats[VGS_RESIDUAL_MAX], asuint(residual));
+        InterlockedAdd(groupResidualStats[VGS_RESIDUAL_ITERATIONS], iterationsRun);
+        InterlockedAdd(groupResidualStats[VGS_RESIDUAL_CONVERGED], !bailedOut && iterationsRun < vgsConstants.iterCount ? 1u : 0u);
+        InterlockedAdd(groupResidualStats[VGS_RESIDUAL_BAILED], bailedOut ? 1u : 0u);
+        InterlockedAdd(groupResidualStats[VGS_RESIDUAL_VOXELS], 1u);
     }
+    GroupMemoryBarrierWithGroupSync();
 
-}
\ No newline at end of file
+    if (localThreadId.x == 0) {
+        InterlockedMax(residualStats[VGS_RESIDUAL_MAX], groupResidualStats[VGS_RESIDUAL_MAX]);
+        InterlockedAdd(residualStats[VGS_RESIDUAL_ITERATIONS], groupResidualStats[VGS_RESIDUAL_ITERATIONS]);
+        InterlockedAdd(residualStats[VGS_RESIDUAL_CONVERGED], groupResidualStats[VGS_RESIDUAL_CONVERGED]);
+        InterlockedAdd(residualStats[VGS_RESIDUAL_BAILED], groupResidualStats[VGS_RESIDUAL_BAILED]);
+        InterlockedAdd(residualStats[VGS_RESIDUAL_VOXELS], groupResidualStats[VGS_RESIDUAL_VOXELS]);
+    }
+}
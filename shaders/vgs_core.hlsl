@@ -40,10 +40,15 @@ float calcMassNormalization(
     return 1.0f / (maxInvMass + compliance);
 }
 
-void doVGSIterations(
+// Returns the voxel's residual after the last iteration run: the largest single-particle correction of that iteration,
+// relative to the particle radius. If vgsConstants.residualTolerance is non-zero, stops as soon as the residual falls below it.
+// bailedOut is set if it instead stopped early because the voxel was inverted (and bailOnInverted) or degenerate.
+float doVGSIterations(
     inout Particle particles[8],
     VGSConstants vgsConstants,
-    bool bailOnInverted
+    bool bailOnInverted,
+    out uint iterationsRun,
+    out bool bailedOut
 ) {
     float relaxation = vgsConstants.relaxation;
     float edgeUniformity = vgsConstants.edgeUniformity;
@@ -51,6 +56,9 @@ void doVGSIterations(
     float particleRadius = vgsConstants.particleRadius;
     uint iterCount = vgsConstants.iterCount;
     float massNormalization = calcMassNormalization(particles, vgsConstants.compliance);
+    float residual = 0.0f;
+    iterationsRun = 0;
+    bailedOut = false;
 
     for (uint iter = 0; iter < iterCount; iter++)
     {
@@ -75,7 +83,10 @@ void doVGSIterations(
         // Check for flipping
         float volume = dot(cross(u0, u1), u2);
         if (volume < 0.0f) {
-            if (bailOnInverted) return;
+            if (bailOnInverted) {
+                bailedOut = true;
+                return residual;
+            }
             volume = -volume;
 
             // Per mcgraw et al., if the voxel has been inverted (negative volume), flip the shortest edge to correct it.
@@ -96,7 +107,10 @@ void doVGSIterations(
 
         // Bail if volume is too small (voxel is degenerate, there's no way to know how to restore it.
         // Other constraints may restore it later).
-        if (volume < eps) return;
+        if (volume < eps) {
+            bailedOut = true;
+            return residual;
+        }
 
         // Volume preservation
         float mult = 0.5f * pow(abs(voxelRestVolume / volume), oneThird); // (abs to appease FXC)
@@ -110,13 +124,39 @@ void doVGSIterations(
         // Lerp between current positions and goal positions weighted by inverse mass (relative to max inverse mass)
         // NOTE: this seems to produce the right effect, but I fear it introduces compliance / increases time to converge, because a single iteration 
         // won't preserve a voxel's COM. It might be better to compute the COM shift after applying the position updates, and then apply a COM correction step.
-        particles[0].position = lerp(particles[0].position, center - u0 - u1 - u2, particleInverseMass(particles[0]) * massNormalization);
-        particles[1].position = lerp(particles[1].position, center + u0 - u1 - u2, particleInverseMass(particles[1]) * massNormalization);
-        particles[2].position = lerp(particles[2].position, center - u0 + u1 - u2, particleInverseMass(particles[2]) * massNormalization);
-        particles[3].position = lerp(particles[3].position, center + u0 + u1 - u2, particleInverseMass(particles[3]) * massNormalization);
-        particles[4].position = lerp(particles[4].position, center - u0 - u1 + u2, particleInverseMass(particles[4]) * massNormalization);
-        particles[5].position = lerp(particles[5].position, center + u0 - u1 + u2, particleInverseMass(particles[5]) * massNormalization);
-        particles[6].position = lerp(particles[6].position, center - u0 + u1 + u2, particleInverseMass(particles[6]) * massNormalization);
-        particles[7].position = lerp(particles[7].position, center + u0 + u1 + u2, particleInverseMass(particles[7]) * massNormalization);
+        float3 goals[8] = {
+            center - u0 - u1 - u2,
+            center + u0 - u1 - u2,
+            center - u0 + u1 - u2,
+            center + u0 + u1 - u2,
+            center - u0 - u1 + u2,
+            center + u0 - u1 + u2,
+            center - u0 + u1 + u2,
+            center + u0 + u1 + u2
+        };
+
+        float maxCorrectionSq = 0.0f;
+        [unroll] for (uint i = 0; i < 8; ++i) {
+            float3 corrected = lerp(particles[i].position, goals[i], particleInverseMass(particles[i]) * massNormalization);
+            float3 correction = corrected - particles[i].position;
+            maxCorrectionSq = max(maxCorrectionSq, dot(correction, correction));
+            particles[i].position = corrected;
+        }
+
+        iterationsRun = iter + 1;
+        residual = sqrt(maxCorrectionSq) / particleRadius;
+        if (residual < vgsConstants.residualTolerance) break;
     }
+
+    return residual;
+}
+
+void doVGSIterations(
+    inout Particle particles[8],
+    VGSConstants vgsConstants,
+    bool bailOnInverted
+) {
+    uint iterationsRun;
+    bool bailedOut;
+    doVGSIterations(particles, vgsConstants, bailOnInverted, iterationsRun, bailedOut);
 }
\ No newline at end of file
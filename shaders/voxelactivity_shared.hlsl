@@ -0,0 +1,14 @@
+#include "common.hlsl"
+#include "constants.hlsli"
+
+cbuffer VoxelActivityCB : register(b0)
+{
+    VoxelActivityConstants activityConstants;
+};
+
+RWStructuredBuffer<uint> voxelActivity : register(u1);
+RWStructuredBuffer<uint> activeCounts : register(u3);
+
+bool isAwake(uint activity) {
+    return !activityConstants.sleepingEnabled || (activity & ACTIVITY_REST_COUNTER_MASK) < activityConstants.sleepDelay;
+}
@@ -0,0 +1,38 @@
+#include "constants.hlsli"
+
+StructuredBuffer<uint> sortedCellKeys : register(t0);
+StructuredBuffer<uint> sortEntryCount : register(t1);
+StructuredBuffer<uint> scannedCellStartFlags : register(t2);
+RWStructuredBuffer<uint> cellStarts : register(u0);
+RWBuffer<uint> solveDispatchArgs : register(u1);
+
+/**
+ * Sorted broadphase: writes the start of each (occupied) cell into a dense array, in the same layout the narrowphase uses for the hashed grid:
+ * cell i's entries are [cellStarts[i], cellStarts[i + 1]). The thread on the last entry also writes the guard entries and the narrowphase dispatch args.
+ */
+[numthreads(BUILD_COLLISION_PARTICLE_THREADS, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    uint entryIdx = gId.x;
+    uint numEntries = sortEntryCount[0];
+    if (entryIdx >= max(numEntries, 1)) return;
+
+    bool isCellStart = entryIdx < numEntries
+        && (entryIdx == 0 || sortedCellKeys[entryIdx] != sortedCellKeys[entryIdx - 1]);
+    if (isCellStart) {
+        cellStarts[scannedCellStartFlags[entryIdx] - 1] = entryIdx;
+    }
+
+    if (entryIdx != max(numEntries, 1) - 1) return;
+
+    // Every narrowphase thread past the last cell (up to the end of its workgroup) must see an empty cell.
+    uint numCells = (numEntries == 0) ? 0 : scannedCellStartFlags[entryIdx];
+    uint numWorkgroups = (numCells + SOLVE_COLLISION_THREADS - 1) / SOLVE_COLLISION_THREADS;
+    for (uint cellIdx = numCells; cellIdx <= numWorkgroups * SOLVE_COLLISION_THREADS; ++cellIdx) {
+        cellStarts[cellIdx] = numEntries;
+    }
+
+    solveDispatchArgs[0] = numWorkgroups;
+    solveDispatchArgs[1] = 1;
+    solveDispatchArgs[2] = 1;
+}
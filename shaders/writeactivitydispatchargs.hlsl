@@ -0,0 +1,26 @@
+#include "constants.hlsli"
+
+RWStructuredBuffer<uint> activeCounts : register(u3);
+RWBuffer<uint> dispatchArgs : register(u5);
+
+void writeArgs(uint slot, uint numThreads) {
+    dispatchArgs[slot * 3] = (numThreads + VGS_THREADS - 1) / VGS_THREADS;
+    dispatchArgs[slot * 3 + 1] = 1;
+    dispatchArgs[slot * 3 + 2] = 1;
+}
+
+// Single thread: converts the active element counts into thread group counts for DispatchIndirect.
+// Arg slot order must match VoxelActivityCompute::DispatchArgsSlot.
+[numthreads(1, 1, 1)]
+void main(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    uint numActiveVoxels = activeCounts[ACTIVE_VOXELS_SLOT];
+    writeArgs(0, numActiveVoxels * 8);  // preVGS: one thread per particle
+    writeArgs(1, numActiveVoxels);      // VGS: one thread per voxel
+    writeArgs(2, activeCounts[ACTIVE_FACE_CONSTRAINTS_SLOT]);
+    writeArgs(3, activeCounts[ACTIVE_FACE_CONSTRAINTS_SLOT + 1]);
+    writeArgs(4, activeCounts[ACTIVE_FACE_CONSTRAINTS_SLOT + 2]);
+    [unroll] for (uint level = 0; level < LONG_RANGE_LEVELS; ++level) {
+        writeArgs(5 + level, activeCounts[ACTIVE_LONG_RANGE_CONSTRAINTS_SLOT + level]);
+    }
+}
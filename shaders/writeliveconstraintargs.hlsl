@@ -0,0 +1,12 @@
+#include "constraintcompaction_shared.hlsl"
+
+// Single thread: converts the live constraint counts into thread group counts for DispatchIndirect (one triple per live slot).
+[numthreads(1, 1, 1)]
+void main(uint3 globalThreadId : SV_DispatchThreadID)
+{
+    [unroll] for (uint slot = 0; slot < NUM_LIVE_SLOTS; ++slot) {
+        liveDispatchArgs[slot * 3] = (liveCounts[slot] + VGS_THREADS - 1) / VGS_THREADS;
+        liveDispatchArgs[slot * 3 + 1] = 1;
+        liveDispatchArgs[slot * 3 + 2] = 1;
+    }
+}
@@ -0,0 +1,19 @@
+#include "particle_collisions_shared.hlsl"
+#include "constants.hlsli"
+
+StructuredBuffer<uint> neighborPairCount : register(t0);
+RWBuffer<uint> solveDispatchArgs : register(u0);
+RWStructuredBuffer<uint> collisionStats : register(u1);
+
+// Single thread: converts the neighbor pair count into thread group counts for DispatchIndirect, and records the rebuild in the stats.
+[numthreads(1, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    uint numPairs = min(neighborPairCount[0], maxNeighborPairs);
+    solveDispatchArgs[0] = (numPairs + SOLVE_NEIGHBOR_PAIRS_THREADS - 1) / SOLVE_NEIGHBOR_PAIRS_THREADS;
+    solveDispatchArgs[1] = 1;
+    solveDispatchArgs[2] = 1;
+
+    InterlockedAdd(collisionStats[COLLISION_STATS_NEIGHBOR_PAIRS], numPairs);
+    InterlockedAdd(collisionStats[COLLISION_STATS_NEIGHBOR_REBUILDS], 1);
+}
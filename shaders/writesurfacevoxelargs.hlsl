@@ -0,0 +1,26 @@
+#include "constants.hlsli"
+
+RWStructuredBuffer<uint> surfaceVoxels : register(u0);
+RWBuffer<uint> dispatchArgs : register(u1);
+
+void writeArgs(uint slot, uint numThreads, uint threadsPerGroup) {
+    dispatchArgs[slot * 3] = (numThreads + threadsPerGroup - 1) / threadsPerGroup;
+    dispatchArgs[slot * 3 + 1] = 1;
+    dispatchArgs[slot * 3 + 2] = 1;
+}
+
+// Single thread: converts the surface voxel count into thread group counts for DispatchIndirect.
+// Arg slot order must match SurfaceVoxelsCompute::DispatchArgsSlot.
+[numthreads(1, 1, 1)]
+void main(uint3 gId : SV_DispatchThreadID)
+{
+    // Appends can't overflow as long as each voxel is only appended once, but clamp anyway so readers never index past the list.
+    uint numEntries, stride;
+    surfaceVoxels.GetDimensions(numEntries, stride);
+    uint numSurfaceVoxels = min(surfaceVoxels[SURFACE_VOXELS_COUNT_IDX], numEntries - SURFACE_VOXELS_FIRST_IDX);
+    surfaceVoxels[SURFACE_VOXELS_COUNT_IDX] = numSurfaceVoxels;
+
+    writeArgs(0, numSurfaceVoxels, COLLISION_CULLING_THREADS);                // Collision culling: one thread per voxel
+    writeArgs(1, numSurfaceVoxels * 8, BUILD_COLLISION_GRID_THREADS);         // Hashed grid counts: one thread per particle
+    writeArgs(2, numSurfaceVoxels * 8, BUILD_COLLISION_PARTICLE_THREADS);     // Hashed grid binning and sorted grid keys: one thread per particle
+}
@@ -4,17 +4,30 @@
 #include <maya/MEventMessage.h>
 #include <maya/MNodeMessage.h>
 #include "globalsolver.h"
+#include "particleinterpolation.h"
+#include "meshsdf.h"
+#include "utils.h"
+#include "custommayaconstructs/usernodes/pbdnode.h"
+#include "custommayaconstructs/data/colliderdata.h"
+#include <maya/MGlobal.h>
+#include <maya/MFileIO.h>
+#include <maya/MDGContext.h>
+#include <maya/MDGContextGuard.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
 
 const MString SimulationCache::timeSliderDrawContextName("SimulationCacheTimeSliderContext");
 SimulationCache* SimulationCache::simulationCacheInstance = nullptr;
 
-SimulationCache::SimulationCache() {
+SimulationCache::SimulationCache() : captureEncoder(std::make_unique<CaptureEncoder>()) {
     MTimeSliderCustomDrawManager& drawManager = MTimeSliderCustomDrawManager::instance();
     customDrawID = drawManager.registerCustomDrawOutside(MTimeSliderCustomDrawManager::kAbove, timeSliderDrawContextName, MString("Cubit Simulation Cache"), 0);
 }
 
 SimulationCache::~SimulationCache() {
-    drawPrimitives.clear();
     MTimeSliderCustomDrawManager::instance().deregisterCustomDraw(customDrawID); 
 }
 
@@ -34,150 +47,1031 @@ SimulationCache* const SimulationCache::instance() {
     return simulationCacheInstance;
 }
 
-SimulationCache::Registration SimulationCache::registerBuffer(ComPtr<ID3D11Buffer> buffer) {
-    registry.insert(buffer);
+double SimulationCache::getPlaybackStartFrame() {
+    return std::floor(MAnimControl::minTime().as(MTime::uiUnit()));
+}
+
+const std::vector<uint8_t>& SimulationCache::getStartFrameData(const ComPtr<ID3D11Buffer>& buffer) {
+    static const std::vector<uint8_t> noData;
+    auto orderIt = std::find(registrationOrder.begin(), registrationOrder.end(), buffer);
+    return (orderIt == registrationOrder.end()) ? noData : startFrameData[orderIt - registrationOrder.begin()];
+}
+
+SimulationCache::Registration SimulationCache::registerBuffer(ComPtr<ID3D11Buffer> buffer, const std::string& name, CacheEncoding encoding) {
+    auto orderIt = std::find(registrationOrder.begin(), registrationOrder.end(), buffer);
+    const size_t bufferIndex = orderIt - registrationOrder.begin();
+    if (orderIt == registrationOrder.end()) {
+        registrationOrder.push_back(buffer);
+        startFrameData.emplace_back();
+        startFrameContentHashes.push_back(0);
+        deviceContentHashes.push_back(0);
+    }
+    registry[buffer] = encoding;
+    bufferNames[buffer] = name;
+    startFrameHashDirty = true;
 
     // Add its initial data to the cache start frame (special frame that persists even when clearing the cache)
-    MTime startTime = MAnimControl::minTime();
-    double startFrame = std::floor(startTime.as(MTime::uiUnit()));
-    std::vector<uint8_t>& bufferData = cache[startFrame][buffer];
-    DirectX::copyBufferToVector(buffer, bufferData);
-    singleFrameCacheSize += static_cast<int>(bufferData.size());
+    DirectX::copyBufferToVector(buffer, startFrameData[bufferIndex]);
+    startFrameContentHashes[bufferIndex] = CacheCodec::hash(startFrameData[bufferIndex]);
+    deviceContentHashes[bufferIndex] = startFrameContentHashes[bufferIndex];
+    if (std::isnan(startFrameKey)) startFrameKey = getPlaybackStartFrame();
+    startFrameSnapshots.erase(buffer);
+
+    // Frames cached (or in flight) don't have this buffer, so they're dropped.
+    discardCaptures();
+    clearFrames();
+    updateTimeline();
 
     return Registration(buffer);
 }
 
 void SimulationCache::unregisterBuffer(ComPtr<ID3D11Buffer> buffer) {
+    // Moved-from registrations unregister nothing.
+    auto orderIt = std::find(registrationOrder.begin(), registrationOrder.end(), buffer);
+    if (orderIt == registrationOrder.end()) return;
+
+    discardCaptures();
+    const size_t bufferIndex = orderIt - registrationOrder.begin();
+    startFrameData.erase(startFrameData.begin() + bufferIndex);
+    startFrameContentHashes.erase(startFrameContentHashes.begin() + bufferIndex);
+    deviceContentHashes.erase(deviceContentHashes.begin() + bufferIndex);
+    registrationOrder.erase(orderIt);
     registry.erase(buffer);
+    bufferNames.erase(buffer);
+    startFrameSnapshots.erase(buffer);
+    startFrameHashDirty = true;
 
-    for (auto it = cache.begin(); it != cache.end(); ) {
-        it->second.erase(buffer);
+    clearFrames();
+    updateTimeline();
+}
 
-        if (it->second.empty()) {
-            removeMarkerAtFrame(it->first);
-            cachedFrames.erase(it->first);
-            it = cache.erase(it);
-        } else {
-            ++it;
+void SimulationCache::markBuffersModified() {
+    std::fill(deviceContentHashes.begin(), deviceContentHashes.end(), 0);
+}
+
+SimulationCache::CachedFrame* SimulationCache::findFrame(double frameKey) {
+    if (!(frameKey >= frameIndexBase)) return nullptr; // Also catches NaN
+    const size_t index = static_cast<size_t>(frameKey - frameIndexBase);
+    if (index >= frameIndex.size() || !frameIndex[index].isCached) return nullptr;
+    return &frameIndex[index];
+}
+
+// The index entry for a frame, growing the index to cover it if need be. Invalidates pointers from findFrame.
+SimulationCache::CachedFrame& SimulationCache::getFrameSlot(double frameKey) {
+    const size_t numBuffers = registrationOrder.size();
+    if (numCachedFrames == 0) {
+        frameIndex.clear();
+        storedBuffers.clear();
+        frameIndexBase = std::min<double>(frameKey, startFrameKey);
+    } else if (frameKey < frameIndexBase) {
+        // Frames are mostly cached going forward from the start frame, so this (unlike growing the index at the end) is rare.
+        const size_t shift = static_cast<size_t>(frameIndexBase - frameKey);
+        frameIndex.insert(frameIndex.begin(), shift, CachedFrame());
+        storedBuffers.insert(storedBuffers.begin(), shift * numBuffers, StoredBuffer());
+        frameIndexBase = frameKey;
+        lowestCachedIndex += shift;
+        highestCachedIndex += shift;
+    }
+
+    const size_t index = static_cast<size_t>(frameKey - frameIndexBase);
+    if (index >= frameIndex.size()) {
+        frameIndex.resize(index + 1);
+        storedBuffers.resize((index + 1) * numBuffers);
+    }
+    return frameIndex[index];
+}
+
+// The stored buffers of a frame in the index (cached or not). Invalidated along with pointers from findFrame.
+SimulationCache::StoredBuffer* SimulationCache::getStoredBuffers(double frameKey) {
+    return storedBuffers.data() + static_cast<size_t>(frameKey - frameIndexBase) * registrationOrder.size();
+}
+
+// The data of a stored buffer (which mustn't be one left out of a delta). Only valid until the next read.
+const uint8_t* SimulationCache::readStoredBuffer(const StoredBuffer& storedBuffer) {
+    FrameArena::Cursor cursor = frameArena.begin(storedBuffer.firstBlock);
+    return frameArena.view(cursor, storedBuffer.size, frameReadScratch);
+}
+
+// Uploads a restored buffer, unless the device already holds data with the same content hash.
+void SimulationCache::uploadBuffer(size_t bufferIndex, const uint8_t* data, uint64_t contentHash) {
+    if (contentHash != 0 && deviceContentHashes[bufferIndex] == contentHash) return;
+    DirectX::getContext()->UpdateSubresource(registrationOrder[bufferIndex].Get(), 0, nullptr, data, 0, 0);
+    deviceContentHashes[bufferIndex] = contentHash;
+}
+
+bool SimulationCache::isFrameCached(double frameKey) {
+    return frameKey == startFrameKey || findFrame(frameKey) != nullptr;
+}
+
+/**
+ * Drops every cached frame but the start frame, and sizes the arena's blocks for the current buffer layout: a 256th of a raw frame (rounded up to a power of two),
+ * so the buffers of a frame, each in its own chain, waste little of their last blocks. The arena grows a raw frame's worth of blocks at a time.
+ */
+void SimulationCache::clearFrames() {
+    for (size_t i = lowestCachedIndex; numCachedFrames > 0 && i <= highestCachedIndex; ++i) {
+        if (frameIndex[i].isCached) removeMarkerAtFrame(frameIndexBase + i);
+    }
+    frameIndex.clear();
+    storedBuffers.clear();
+    lastStandaloneCopies.assign(registrationOrder.size(), StandaloneCopy());
+    numCachedFrames = 0;
+    decodedFrame = std::numeric_limits<double>::quiet_NaN();
+    spilledFrame = std::numeric_limits<double>::quiet_NaN();
+    interpolationFrames.fill(std::numeric_limits<double>::quiet_NaN());
+
+    singleFrameCacheSize = 0;
+    for (const std::vector<uint8_t>& bufferData : startFrameData) {
+        singleFrameCacheSize += bufferData.size();
+    }
+
+    uint64_t blockSize = minArenaBlockSize;
+    while (blockSize < singleFrameCacheSize / 256 && blockSize < maxArenaBlockSize) {
+        blockSize *= 2;
+    }
+    const uint64_t blocksPerFrame = (singleFrameCacheSize + blockSize - 1) / blockSize + registrationOrder.size();
+    frameArena.reset(blockSize, static_cast<uint32_t>(std::max<uint64_t>(blocksPerFrame, 16)));
+}
+
+/**
+ * Evicts whichever of the lowest and highest cached frames is further from the current frame (never the start frame).
+ * Returns false if there's nothing left to evict.
+ */
+bool SimulationCache::evictFurthestFrame(double currentFrame) {
+    if (numCachedFrames == 0) return false;
+
+    const double lowest = frameIndexBase + lowestCachedIndex;
+    const double highest = frameIndexBase + highestCachedIndex;
+    evictFrame((std::abs(currentFrame - lowest) > std::abs(currentFrame - highest)) ? lowest : highest, true);
+    return true;
+}
+
+/**
+ * Evicts a frame, and (since they can no longer be decoded) every frame encoded against it. If spill is set, they're written to the disk cache first.
+ * Frames are spilled before the frames they're encoded against are evicted, while they can still be decoded.
+ */
+void SimulationCache::evictFrame(double frameKey, bool spill) {
+    if (!findFrame(frameKey)) return;
+    bool spilled = spill && diskCache && spillToDisk(frameKey);
+    // Only evictions that make room spill (re-captures and resets just drop frames).
+    if (spill) ++stats.evictions;
+    if (spilled) ++stats.spills;
+
+    const double dependentFrame = findFrame(frameKey)->dependentFrame;
+    if (!std::isnan(dependentFrame)) evictFrame(dependentFrame, spill);
+
+    CachedFrame& cachedFrame = *findFrame(frameKey);
+    CachedFrame* reference = cachedFrame.isEncoded ? findFrame(cachedFrame.referenceFrame) : nullptr;
+    if (reference && reference->dependentFrame == frameKey) reference->dependentFrame = std::numeric_limits<double>::quiet_NaN();
+    cachedFrame = CachedFrame();
+    StoredBuffer* frameBuffers = getStoredBuffers(frameKey);
+    for (size_t i = 0; i < registrationOrder.size(); ++i) {
+        frameArena.release(frameBuffers[i].firstBlock);
+        frameBuffers[i] = StoredBuffer();
+    }
+
+    // Only the ends of the cached range can move, and only past frames that aren't cached.
+    if (--numCachedFrames > 0) {
+        while (!frameIndex[lowestCachedIndex].isCached) ++lowestCachedIndex;
+        while (!frameIndex[highestCachedIndex].isCached) --highestCachedIndex;
+    } else {
+        // Nothing's left to share the last standalone copies with, so they'd only be taking up room.
+        for (StandaloneCopy& copy : lastStandaloneCopies) {
+            frameArena.release(copy.storedBuffer.firstBlock);
+            copy = StandaloneCopy();
         }
     }
 
-    MTimeSliderCustomDrawManager::instance().setDrawPrimitives(customDrawID, drawPrimitives);
+    removeMarkerAtFrame(frameKey);
+    if (spilled) addMarkerToTimeline(frameKey, true);
+    forgetLoadedFrame(frameKey);
 }
 
-void SimulationCache::cacheData(const MTime& time) {
-    double currentFrame = std::floor(time.as(MTime::uiUnit()));
-    int maxCacheSizeMB = MPlug(GlobalSolver::getOrCreateGlobalSolver() , GlobalSolver::aMaxCacheSize).asInt();
-    const uint64_t maxBytes = (uint64_t)maxCacheSizeMB * 1024ull * 1024ull;
-    bool overLimit = (currentCacheSize + singleFrameCacheSize > (maxBytes - singleFrameCacheSize)); // subtract one frame size to account for start frame
-    
-    // If we've exceeded the cache budget, reuse the data from an existing cached frame (the one furthest from the current frame)
-    double frameToUse = currentFrame;
-    if (overLimit) {
-        double lowestCachedFrame = cachedFrames.empty() ? DBL_MAX : *cachedFrames.begin();
-        double highestCachedFrame = cachedFrames.empty() ? -DBL_MAX : *cachedFrames.rbegin();
-        bool direction = std::abs(currentFrame - lowestCachedFrame) > std::abs(currentFrame - highestCachedFrame);
-        frameToUse = (direction) ? lowestCachedFrame : highestCachedFrame;
-
-        // Exclude start frame from eviction
-        MTime startTime = MAnimControl::minTime();
-        double startFrame = std::floor(startTime.as(MTime::uiUnit()));
-        if (frameToUse == startFrame) frameToUse = direction ? *std::next(cachedFrames.begin()) : *std::prev(std::prev(cachedFrames.end()));
-    }
-
-    for (const auto& buffer : registry) {
-        std::vector<uint8_t>& bufferData = cache[frameToUse][buffer];
-        DirectX::copyBufferToVector(buffer, bufferData);
-    }
-
-    // With the data copied, if we were over the limit we can now evict the old frame
-    if (overLimit) {
-        cache[currentFrame] = std::move(cache[frameToUse]);
-        cache.erase(frameToUse);
-        cachedFrames.erase(frameToUse);
-        removeMarkerAtFrame(frameToUse);
+// For when a frame's data changes or goes away: anything holding a decoded copy of it has to read it again.
+void SimulationCache::forgetLoadedFrame(double frameKey) {
+    if (frameKey == decodedFrame) decodedFrame = std::numeric_limits<double>::quiet_NaN();
+    if (frameKey == spilledFrame) spilledFrame = std::numeric_limits<double>::quiet_NaN();
+    for (double& interpolationFrame : interpolationFrames) {
+        if (frameKey == interpolationFrame) interpolationFrame = std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+/**
+ * Decodes a compressed frame into output, which holds the decoded outputFrame (or NaN). Walks back along the frame's chain of references to the nearest
+ * frame whose data is already at hand (outputFrame, or the start frame), then decodes forward from there. Returns false if the chain is broken or a frame is corrupt.
+ * Buffers a delta left out are already right in the output, from decoding its reference.
+ */
+bool SimulationCache::decodeFrame(double frameKey, FrameData& output, double& outputFrame) {
+    decodeChain.clear();
+    bool fromStartFrame = false;
+    double chainFrame = frameKey;
+    while (chainFrame != outputFrame) {
+        const CachedFrame* cachedFrame = findFrame(chainFrame);
+        if (!cachedFrame || !cachedFrame->isEncoded) return false;
+        decodeChain.push_back(chainFrame);
+        if (cachedFrame->chainLength == 1) {
+            fromStartFrame = true;
+            break;
+        }
+        chainFrame = cachedFrame->referenceFrame;
+    }
+
+    // The output is overwritten as the chain is decoded, so it only holds a valid frame again once that's done.
+    outputFrame = std::numeric_limits<double>::quiet_NaN();
+    output.resize(registrationOrder.size());
+    bool decoded = true;
+    for (auto it = decodeChain.rbegin(); it != decodeChain.rend() && decoded; ++it) {
+        const bool isKeyframe = fromStartFrame && it == decodeChain.rbegin();
+        const StoredBuffer* frameBuffers = getStoredBuffers(*it);
+        for (size_t i = 0; i < registrationOrder.size() && decoded; ++i) {
+            if (frameBuffers[i].firstBlock == FrameArena::noBlock) continue;
+            const std::vector<uint8_t>& reference = isKeyframe ? startFrameData[i] : output[i];
+            decoded = CacheCodec::decode(readStoredBuffer(frameBuffers[i]), frameBuffers[i].size, reference, decodeScratch);
+            if (decoded) std::swap(output[i], decodeScratch);
+        }
+    }
+    if (!decoded) return false;
+
+    outputFrame = frameKey;
+    return true;
+}
+
+/**
+ * Reads a stored frame (the start frame, a frame in memory, or one on disk) into output, decoded. Like decodeFrame, output holds outputFrame (or NaN),
+ * so reading the same frame again is free. Returns false if the frame isn't stored, or is corrupt.
+ */
+bool SimulationCache::loadFrame(double frameKey, FrameData& output, double& outputFrame) {
+    if (frameKey == outputFrame) return true;
+
+    const CachedFrame* cachedFrame = findFrame(frameKey);
+    if (cachedFrame && cachedFrame->isEncoded) return decodeFrame(frameKey, output, outputFrame);
+
+    outputFrame = std::numeric_limits<double>::quiet_NaN();
+    output.resize(registrationOrder.size());
+    if (frameKey == startFrameKey) {
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            output[i] = startFrameData[i];
+        }
+    } else if (cachedFrame) {
+        const StoredBuffer* frameBuffers = getStoredBuffers(frameKey);
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            const uint8_t* data = readStoredBuffer(frameBuffers[i]);
+            output[i].assign(data, data + frameBuffers[i].size);
+        }
     } else {
-        currentCacheSize += singleFrameCacheSize;
+        bool decoded = true;
+        bool found = diskCache && diskCache->read(frameKey, [&](uint32_t bufferIndex, const uint8_t* data, size_t size) {
+            decoded = decoded && CacheCodec::decode(data, size, startFrameData[bufferIndex], output[bufferIndex]);
+        });
+        if (!found || !decoded) return false;
     }
 
-    addMarkerToTimeline(currentFrame);
-    MTimeSliderCustomDrawManager::instance().setDrawPrimitives(customDrawID, drawPrimitives);
+    outputFrame = frameKey;
+    return true;
+}
 
-    cachedFrames.insert(currentFrame);
+// Whether a frame has been captured but not yet collected (see collectCaptures).
+bool SimulationCache::isFrameInFlight(double frameKey) const {
+    return std::find(framesInFlight.begin(), framesInFlight.end(), frameKey) != framesInFlight.end();
 }
 
-bool SimulationCache::tryUseCache(const MTime& time) {
-    double currentFrame = std::floor(time.as(MTime::uiUnit()));
-    auto frameIt = cache.find(currentFrame);
-    if (frameIt == cache.end()) {
+// Whether a frame can be restored as is: it's the start frame, or cached in memory (or on its way there), or on disk.
+bool SimulationCache::isFrameStored(double frameKey) {
+    return isFrameCached(frameKey) || isFrameInFlight(frameKey) || (diskCache && diskCache->contains(frameKey));
+}
+
+/**
+ * The nearest stored frames either side of a frame, if cache interpolation is on and they're no further apart than the cache frequency
+ * (i.e. the frame was skipped over rather than never simulated).
+ */
+bool SimulationCache::findInterpolationFrames(double frameKey, double& fromFrame, double& toFrame) {
+    MObject globalSolver = GlobalSolver::getOrCreateGlobalSolver();
+    const int maxGap = MPlug(globalSolver, GlobalSolver::aCacheFrequency).asInt();
+    if (!MPlug(globalSolver, GlobalSolver::aCacheInterpolation).asBool() || maxGap < 2 || !(frameKey > startFrameKey)) return false;
+
+    fromFrame = frameKey - 1.0;
+    while (!isFrameStored(fromFrame)) {
+        if (frameKey - --fromFrame >= maxGap) return false;
+    }
+    for (toFrame = frameKey + 1.0; toFrame - fromFrame <= maxGap; ++toFrame) {
+        if (isFrameStored(toFrame)) return true;
+    }
+    return false;
+}
+
+/**
+ * Restores a frame that wasn't cached by interpolating between the stored frames either side (see ParticleInterpolation). Only the particle buffers
+ * are blended. Everything else (which voxels are on the surface, which constraints are broken, ...) can't be, so it all comes from the earlier frame,
+ * which keeps it consistent: anything that breaks in between shows up once the later frame is reached.
+ */
+bool SimulationCache::tryInterpolateFrame(double frameKey) {
+    double fromFrame, toFrame;
+    if (!findInterpolationFrames(frameKey, fromFrame, toFrame)) return false;
+
+    // Only wait on captures if one of the frames either side is still in flight. Collecting them can evict frames, so look again after.
+    if (isFrameInFlight(fromFrame) || isFrameInFlight(toFrame)) {
+        collectCaptures(true);
+        if (!findInterpolationFrames(frameKey, fromFrame, toFrame)) return false;
+    }
+
+    if (!loadFrame(fromFrame, interpolationData[0], interpolationFrames[0]) || !loadFrame(toFrame, interpolationData[1], interpolationFrames[1])) {
+        MGlobal::displayError("Failed to read the cached simulation frames to interpolate between. Try clearing the cache.");
         return false;
     }
 
+    const float t = static_cast<float>((frameKey - fromFrame) / (toFrame - fromFrame));
+    for (size_t i = 0; i < registrationOrder.size(); ++i) {
+        if (registry[registrationOrder[i]] == CacheEncoding::Particles) {
+            ParticleInterpolation::interpolate(interpolationData[0][i], interpolationData[1][i], t, decodeScratch);
+            uploadBuffer(i, decodeScratch.data(), 0);
+        } else {
+            uploadBuffer(i, interpolationData[0][i].data(), CacheCodec::hash(interpolationData[0][i]));
+        }
+    }
+    return true;
+}
+
+void SimulationCache::cacheData(const MTime& time) {
+    double currentFrame = std::floor(time.as(MTime::uiUnit()));
+    updateDiskCache();
+    collectCaptures(false);
+    if (currentFrame != startFrameKey) {
+        const auto captureStart = std::chrono::steady_clock::now();
+        beginCapture(currentFrame);
+        captureTimes.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - captureStart).count());
+        return;
+    }
+
+    captureStartFrame(currentFrame);
+}
+
+/**
+ * Captures the registered buffers as the start frame, keyed on currentFrame. The start frame is the reference keyframes are decoded against,
+ * so it's always stored raw, and captured right away. Frames encoded against the old one are dropped with it.
+ * Only resetCache moves the start frame elsewhere, so moving the playback range never overwrites it.
+ */
+void SimulationCache::captureStartFrame(double currentFrame) {
+    discardCaptures();
+    if (!std::isnan(startFrameKey) && startFrameKey != currentFrame) removeMarkerAtFrame(startFrameKey);
+    startFrameKey = currentFrame;
+    for (size_t i = 0; i < registrationOrder.size(); ++i) {
+        DirectX::copyBufferToVector(registrationOrder[i], startFrameData[i]);
+        startFrameContentHashes[i] = CacheCodec::hash(startFrameData[i]);
+        deviceContentHashes[i] = startFrameContentHashes[i];
+    }
+    startFrameSnapshots.clear();
+    startFrameHashDirty = true;
+    clearFrames();
+
+    addMarkerToTimeline(currentFrame);
+}
+
+// Copies the registered buffers into the next staging slot of the ring. Nothing is read back (or waited on) yet, unless the ring is full.
+void SimulationCache::beginCapture(double frameKey) {
+    if (registrationOrder.empty()) return;
+    if (pendingReadbacks.size() >= captureRingSize) {
+        readBackCapture(pendingReadbacks.front(), true);
+        captureEncoder->submit(std::move(pendingReadbacks.front().job));
+        pendingReadbacks.pop_front();
+    }
+
+    MObject globalSolver = GlobalSolver::getOrCreateGlobalSolver();
+    CaptureEncoder::Job job = {};
+    job.captureId = nextCaptureId++;
+    job.frame = frameKey;
+    job.compress = MPlug(globalSolver, GlobalSolver::aCacheCompression).asBool();
+    job.precision = MPlug(globalSolver, GlobalSolver::aCachePrecision).asFloat();
+    int keyframeInterval = MPlug(globalSolver, GlobalSolver::aCacheKeyframeInterval).asInt();
+
+    // Chain onto the last capture if there's room (and it's still the state this frame was simulated from), otherwise start a new chain with a keyframe.
+    bool isDelta = job.compress && !std::isnan(lastCaptureFrame) && lastCaptureChainLength < keyframeInterval
+        && lastCaptureRestoreCount == restoreCount;
+    job.isKeyframe = !isDelta;
+    job.referenceFrame = isDelta ? lastCaptureFrame : startFrameKey;
+    job.referenceCaptureId = isDelta ? lastCaptureId : 0;
+    job.chainLength = job.compress ? (isDelta ? lastCaptureChainLength + 1 : 1) : 0;
+
+    lastCaptureFrame = job.compress ? frameKey : std::numeric_limits<double>::quiet_NaN();
+    lastCaptureId = job.captureId;
+    lastCaptureChainLength = job.chainLength;
+    lastCaptureRestoreCount = restoreCount;
+
+    int slot = nextStagingSlot;
+    nextStagingSlot = (nextStagingSlot + 1) % captureRingSize;
+    std::vector<ComPtr<ID3D11Buffer>>& stagingBuffers = stagingRing[slot];
+    stagingBuffers.resize(registrationOrder.size());
+    if (!spareCaptureBuffers.empty()) {
+        job.buffers = std::move(spareCaptureBuffers.back());
+        spareCaptureBuffers.pop_back();
+    }
+    job.buffers.resize(registrationOrder.size());
+
     ID3D11DeviceContext* dxContext = DirectX::getContext();
-    for (const auto& bufferDataPair : frameIt->second) {
-        const ComPtr<ID3D11Buffer>& buffer = bufferDataPair.first;
-        const std::vector<uint8_t>& bufferData = bufferDataPair.second;
-        dxContext->UpdateSubresource(buffer.Get(), 0, nullptr, bufferData.data(), 0, 0);
+    for (size_t i = 0; i < registrationOrder.size(); ++i) {
+        const ComPtr<ID3D11Buffer>& buffer = registrationOrder[i];
+        D3D11_BUFFER_DESC bufferDesc, stagingDesc;
+        buffer->GetDesc(&bufferDesc);
+        if (stagingBuffers[i]) stagingBuffers[i]->GetDesc(&stagingDesc);
+        if (!stagingBuffers[i] || stagingDesc.ByteWidth != bufferDesc.ByteWidth) {
+            stagingBuffers[i] = DirectX::createStagingBuffer(buffer);
+        }
+        dxContext->CopyResource(stagingBuffers[i].Get(), buffer.Get());
+
+        // The data keeps whatever capacity it had from an earlier capture.
+        CaptureEncoder::CapturedBuffer& capturedBuffer = job.buffers[i];
+        capturedBuffer.buffer = buffer;
+        capturedBuffer.encoding = registry[buffer];
+        capturedBuffer.startFrameData = job.isKeyframe ? getStartFrameSnapshot(buffer) : nullptr;
     }
 
+    framesInFlight.push_back(frameKey);
+    pendingReadbacks.push_back({ slot, std::move(job) });
+}
+
+// Reads a capture's staging buffers into its job. Unless waiting, returns false if the GPU hasn't finished copying into them yet.
+bool SimulationCache::readBackCapture(PendingReadback& pendingReadback, bool wait) {
+    const std::vector<ComPtr<ID3D11Buffer>>& stagingBuffers = stagingRing[pendingReadback.slot];
+    std::vector<CaptureEncoder::CapturedBuffer>& capturedBuffers = pendingReadback.job.buffers;
+    if (capturedBuffers.empty()) return true;
+
+    // The copies were issued together, so once the last one is done, they all are.
+    const size_t last = capturedBuffers.size() - 1;
+    if (!DirectX::tryReadStagingBuffer(stagingBuffers[last], capturedBuffers[last].data)) {
+        if (!wait) return false;
+        DirectX::readStagingBuffer(stagingBuffers[last], capturedBuffers[last].data);
+    }
+    for (size_t i = 0; i < last; ++i) {
+        DirectX::readStagingBuffer(stagingBuffers[i], capturedBuffers[i].data);
+    }
+    return true;
+}
+
+/**
+ * Moves captures along: hands finished readbacks to the encoder, and adds encoded frames to the cache.
+ * If wait is set, every capture in flight is finished (e.g. before restoring one of them).
+ */
+void SimulationCache::collectCaptures(bool wait) {
+    while (!pendingReadbacks.empty() && readBackCapture(pendingReadbacks.front(), wait)) {
+        captureEncoder->submit(std::move(pendingReadbacks.front().job));
+        pendingReadbacks.pop_front();
+    }
+
+    if (wait) captureEncoder->waitUntilIdle();
+    captureEncoder->takeCompleted(completedCaptures);
+    for (CaptureEncoder::Job& job : completedCaptures) {
+        insertCapture(job);
+        spareCaptureBuffers.push_back(std::move(job.buffers));
+    }
+    completedCaptures.clear();
+}
+
+// Drops every capture in flight (e.g. because the cache is being reset).
+void SimulationCache::discardCaptures() {
+    pendingReadbacks.clear();
+    captureEncoder->waitUntilIdle();
+    captureEncoder->takeCompleted(completedCaptures);
+    completedCaptures.clear();
+    framesInFlight.clear();
+    lastCaptureFrame = std::numeric_limits<double>::quiet_NaN();
+}
+
+void SimulationCache::insertCapture(CaptureEncoder::Job& job) {
+    framesInFlight.erase(std::find(framesInFlight.begin(), framesInFlight.end(), job.frame));
+    encodeTimes.add(job.encodeMilliseconds);
+
+    // Re-caching a frame (e.g. after resimulating it) replaces it, and any frames encoded against the old version.
+    evictFrame(job.frame, false);
+    if (diskCache) diskCache->erase(job.frame);
+    forgetLoadedFrame(job.frame);
+
+    // A delta whose reference was evicted or replaced while it was in flight (or just now, to make room) can't be decoded.
+    // Start a new chain with the next capture.
+    const bool isDelta = job.compress && !job.isKeyframe;
+    auto hasReference = [&]() {
+        const CachedFrame* reference = findFrame(job.referenceFrame);
+        return reference && reference->captureId == job.referenceCaptureId;
+    };
+    if (isDelta && !hasReference()) {
+        lastCaptureFrame = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+    if (isDelta && !std::isnan(findFrame(job.referenceFrame)->dependentFrame)) {
+        evictFrame(findFrame(job.referenceFrame)->dependentFrame, true);
+    }
+
+    // Standalone copies of a buffer identical to the last one stored (encoded the same way) share its chain.
+    const float precision = job.compress ? job.precision : 0.0f;
+    auto findSharedCopy = [&](size_t bufferIndex) -> const StoredBuffer* {
+        const StandaloneCopy& copy = lastStandaloneCopies[bufferIndex];
+        const bool matches = !isDelta && copy.storedBuffer.firstBlock != FrameArena::noBlock && copy.hash == job.buffers[bufferIndex].hash
+            && copy.isEncoded == job.compress && copy.precision == precision;
+        return matches ? &copy.storedBuffer : nullptr;
+    };
+
+    // Evict frames (furthest from this one first) until this one fits. The start frame counts against the budget, but is never evicted.
+    // In a very small cache, that can evict this frame's own chain too.
+    int maxCacheSizeMB = MPlug(GlobalSolver::getOrCreateGlobalSolver(), GlobalSolver::aMaxCacheSize).asInt();
+    const uint64_t maxBytes = (uint64_t)maxCacheSizeMB * 1024ull * 1024ull;
+    frameArena.setMaxBytes(maxBytes > singleFrameCacheSize ? maxBytes - singleFrameCacheSize : 0);
+
+    // (Evicting can drop the copies this frame would have shared, so what it needs is recounted each time.)
+    auto getBlocksNeeded = [&]() {
+        uint64_t blocksNeeded = 0;
+        for (size_t i = 0; i < job.buffers.size(); ++i) {
+            if (!job.buffers[i].unchanged && !findSharedCopy(i)) blocksNeeded += frameArena.getNumBlocks(job.buffers[i].data.size());
+        }
+        return blocksNeeded;
+    };
+    while (!frameArena.canAllocate(getBlocksNeeded()) && evictFurthestFrame(job.frame)) {}
+    if (!frameArena.canAllocate(getBlocksNeeded()) || (isDelta && !hasReference())) {
+        lastCaptureFrame = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+
+    CachedFrame& cachedFrame = getFrameSlot(job.frame);
+    StoredBuffer* frameBuffers = getStoredBuffers(job.frame);
+    for (size_t i = 0; i < job.buffers.size(); ++i) {
+        const CaptureEncoder::CapturedBuffer& capturedBuffer = job.buffers[i];
+        StoredBuffer& storedBuffer = frameBuffers[i];
+        const bool isQuantized = job.compress && capturedBuffer.encoding == CacheEncoding::Particles && job.precision > 0.0f;
+        storedBuffer.contentHash = isQuantized ? 0 : capturedBuffer.hash;
+        if (capturedBuffer.unchanged) continue;
+
+        if (const StoredBuffer* sharedCopy = findSharedCopy(i)) {
+            frameArena.retain(sharedCopy->firstBlock);
+            storedBuffer.firstBlock = sharedCopy->firstBlock;
+            storedBuffer.size = sharedCopy->size;
+            continue;
+        }
+
+        storedBuffer.firstBlock = frameArena.allocate(capturedBuffer.data.size());
+        storedBuffer.size = capturedBuffer.data.size();
+        FrameArena::Cursor cursor = frameArena.begin(storedBuffer.firstBlock);
+        frameArena.write(cursor, capturedBuffer.data.data(), capturedBuffer.data.size());
+        if (isDelta) continue;
+
+        StandaloneCopy& copy = lastStandaloneCopies[i];
+        frameArena.release(copy.storedBuffer.firstBlock);
+        frameArena.retain(storedBuffer.firstBlock);
+        copy = { capturedBuffer.hash, job.compress, precision, storedBuffer };
+    }
+
+    cachedFrame.isCached = true;
+    cachedFrame.isEncoded = job.compress;
+    cachedFrame.referenceFrame = job.referenceFrame;
+    cachedFrame.chainLength = job.chainLength;
+    cachedFrame.captureId = job.captureId;
+    if (isDelta) findFrame(job.referenceFrame)->dependentFrame = job.frame;
+
+    const size_t index = static_cast<size_t>(job.frame - frameIndexBase);
+    lowestCachedIndex = (numCachedFrames == 0) ? index : std::min<size_t>(lowestCachedIndex, index);
+    highestCachedIndex = (numCachedFrames == 0) ? index : std::max<size_t>(highestCachedIndex, index);
+    ++numCachedFrames;
+
+    removeMarkerAtFrame(job.frame);
+    addMarkerToTimeline(job.frame);
+}
+
+const std::shared_ptr<const std::vector<uint8_t>>& SimulationCache::getStartFrameSnapshot(const ComPtr<ID3D11Buffer>& buffer) {
+    std::shared_ptr<const std::vector<uint8_t>>& snapshot = startFrameSnapshots[buffer];
+    if (!snapshot) snapshot = std::make_shared<const std::vector<uint8_t>>(getStartFrameData(buffer));
+    return snapshot;
+}
+
+bool SimulationCache::tryUseCache(const MTime& time, bool recordStats) {
+    const auto restoreStart = std::chrono::steady_clock::now();
+    auto count = [recordStats](uint64_t& counter) { if (recordStats) ++counter; };
+    double currentFrame = std::floor(time.as(MTime::uiUnit()));
+    if (isFrameInFlight(currentFrame)) collectCaptures(true);
+
+    // On a miss, the solver simulates this frame instead, which changes what's on the device.
+    const CachedFrame* cachedFrame = findFrame(currentFrame);
+    if (currentFrame == startFrameKey) {
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            uploadBuffer(i, startFrameData[i].data(), startFrameContentHashes[i]);
+        }
+        count(stats.startFrameHits);
+    } else if (!cachedFrame) {
+        updateDiskCache();
+        if (tryUseDiskCache(currentFrame)) {
+            count(stats.diskHits);
+        } else if (tryInterpolateFrame(currentFrame)) {
+            count(stats.interpolatedHits);
+        } else {
+            count(stats.misses);
+            markBuffersModified();
+            return false;
+        }
+    } else if (cachedFrame->isEncoded) {
+        if (!decodeFrame(currentFrame, decodedData, decodedFrame)) {
+            MGlobal::displayError("Failed to decode a cached simulation frame. Try clearing the cache.");
+            count(stats.misses);
+            markBuffersModified();
+            return false;
+        }
+        count(stats.memoryHits);
+        const StoredBuffer* frameBuffers = getStoredBuffers(currentFrame);
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            uploadBuffer(i, decodedData[i].data(), frameBuffers[i].contentHash);
+        }
+    } else {
+        const StoredBuffer* frameBuffers = getStoredBuffers(currentFrame);
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            // Checked here too, so buffers already on the device aren't even read from the arena.
+            const uint64_t contentHash = frameBuffers[i].contentHash;
+            if (contentHash == 0 || deviceContentHashes[i] != contentHash) uploadBuffer(i, readStoredBuffer(frameBuffers[i]), contentHash);
+        }
+        count(stats.memoryHits);
+    }
+
+    restoreCount++;
+    // Scrubbing or playing through memory can run into frames that were spilled to disk.
+    if (diskCache) diskCache->prefetch(currentFrame, diskPrefetchFrames);
+    if (recordStats) restoreTimes.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - restoreStart).count());
     return true;
 }
 
 bool SimulationCache::hasCacheData(const MTime& time) {
     double currentFrame = std::floor(time.as(MTime::uiUnit()));
-    return cache.find(currentFrame) != cache.end();
+    // Called once per compute, so it's also where captures in flight make progress.
+    collectCaptures(false);
+    if (isFrameCached(currentFrame) || isFrameInFlight(currentFrame)) return true;
+
+    updateDiskCache();
+    double fromFrame, toFrame;
+    return (diskCache && diskCache->contains(currentFrame)) || findInterpolationFrames(currentFrame, fromFrame, toFrame);
+}
+
+// Restores a frame from the disk cache. Frames on disk are encoded against the start frame (which is always in memory).
+bool SimulationCache::tryUseDiskCache(double frameKey) {
+    if (!diskCache) return false;
+
+    bool decoded = true;
+    bool found = diskCache->read(frameKey, [&](uint32_t bufferIndex, const uint8_t* data, size_t size) {
+        if (!decoded || !CacheCodec::decode(data, size, startFrameData[bufferIndex], decodeScratch)) {
+            decoded = false;
+            return;
+        }
+        uploadBuffer(bufferIndex, decodeScratch.data(), 0);
+    });
+
+    if (found && !decoded) {
+        MGlobal::displayError("Failed to decode a simulation frame from the disk cache. Try clearing the cache.");
+    }
+    return found && decoded;
+}
+
+/**
+ * Writes a cached frame to the disk cache, encoded (losslessly, beyond any quantization it already has) against the start frame,
+ * so it doesn't depend on any other frame. Returns false if the disk cache is full, or the frame can't be decoded.
+ *
+ * Frames that aren't already encoded that way are handed over raw (delta frames decoded first), and encoded on the disk cache's writer thread,
+ * so evicting them doesn't hold up playback.
+ */
+bool SimulationCache::spillToDisk(double frameKey) {
+    const CachedFrame& cachedFrame = *findFrame(frameKey);
+    const StoredBuffer* frameBuffers = getStoredBuffers(frameKey);
+    DiskCache::Payloads payloads(registrationOrder.size());
+    if (cachedFrame.isEncoded && cachedFrame.chainLength == 1) {
+        // Already encoded against the start frame
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            const uint8_t* data = readStoredBuffer(frameBuffers[i]);
+            payloads[i].assign(data, data + frameBuffers[i].size);
+        }
+        return diskCache->write(frameKey, std::move(payloads));
+    }
+
+    if (!cachedFrame.isEncoded) {
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            const uint8_t* data = readStoredBuffer(frameBuffers[i]);
+            payloads[i].assign(data, data + frameBuffers[i].size);
+        }
+    } else {
+        if (!decodeFrame(frameKey, spilledData, spilledFrame)) return false;
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            payloads[i] = spilledData[i];
+        }
+    }
+
+    // The writer thread encodes against snapshots of the start frame, which stay valid even if it's re-registered before the write is done.
+    std::vector<std::shared_ptr<const std::vector<uint8_t>>> references;
+    std::vector<CacheEncoding> encodings;
+    for (const ComPtr<ID3D11Buffer>& buffer : registrationOrder) {
+        references.push_back(getStartFrameSnapshot(buffer));
+        encodings.push_back(registry[buffer]);
+    }
+    auto encode = [references = std::move(references), encodings = std::move(encodings)](DiskCache::Payloads& rawPayloads) {
+        std::vector<uint8_t> encoded;
+        for (size_t i = 0; i < rawPayloads.size(); ++i) {
+            CacheCodec::encode(rawPayloads[i], *references[i], encodings[i], 0.0f, encoded);
+            rawPayloads[i].swap(encoded);
+        }
+    };
+    return diskCache->write(frameKey, std::move(payloads), std::move(encode));
+}
+
+void SimulationCache::flushToDisk() {
+    if (!diskCache) return;
+    collectCaptures(true);
+
+    for (size_t i = lowestCachedIndex; numCachedFrames > 0 && i <= highestCachedIndex; ++i) {
+        if (frameIndex[i].isCached) spillToDisk(frameIndexBase + i);
+    }
+}
+
+/**
+ * Opens the disk cache matching the current scene and settings (or closes it, if disabled). Any frames already in it show up on the timeline.
+ * Cheap to call when nothing has changed.
+ */
+void SimulationCache::updateDiskCache() {
+    MObject globalSolver = GlobalSolver::getOrCreateGlobalSolver();
+    if (!MPlug(globalSolver, GlobalSolver::aDiskCache).asBool() || registrationOrder.empty()) {
+        closeDiskCache();
+        diskCacheKey = 0;
+        return;
+    }
+
+    uint64_t key = getDiskCacheKey();
+    if (key == diskCacheKey) return;
+    closeDiskCache();
+    diskCacheKey = key;
+
+    MString workspaceRoot;
+    MGlobal::executeCommand("workspace -q -rootDirectory", workspaceRoot);
+    std::wstring directory = std::wstring(workspaceRoot.asWChar()) + L"cache";
+    CreateDirectoryW(directory.c_str(), nullptr); // OK if already exists
+    directory += L"/cubit";
+    CreateDirectoryW(directory.c_str(), nullptr);
+
+    std::wstring sceneName = MFileIO::currentFile().asWChar();
+    sceneName = sceneName.substr(sceneName.find_last_of(L"/\\") + 1);
+    sceneName = sceneName.substr(0, sceneName.find_last_of(L'.'));
+    std::wostringstream path;
+    path << directory << L"/" << sceneName << L"_" << std::hex << std::setw(16) << std::setfill(L'0') << key << L".cubitcache";
+    diskCachePath = path.str();
+
+    int maxDiskCacheSizeMB = MPlug(globalSolver, GlobalSolver::aMaxDiskCacheSize).asInt();
+    diskCache = std::make_unique<DiskCache>(diskCachePath, key, static_cast<uint32_t>(registrationOrder.size()), (uint64_t)maxDiskCacheSizeMB * 1024ull * 1024ull);
+    if (!diskCache->isOpen()) {
+        MGlobal::displayWarning("Could not open the simulation disk cache: " + MString(diskCachePath.c_str()));
+        diskCache.reset();
+        return;
+    }
+
+    for (double frameKey : diskCache->getFrames()) {
+        if (!isFrameCached(frameKey)) addMarkerToTimeline(frameKey, true);
+    }
+}
+
+void SimulationCache::closeDiskCache() {
+    if (!diskCache) return;
+
+    for (double frameKey : diskCache->getFrames()) {
+        if (!isFrameCached(frameKey)) removeMarkerAtFrame(frameKey);
+        forgetLoadedFrame(frameKey);
+    }
+    diskCache.reset();
+}
+
+// Anything that changes what a simulated frame would look like should be in here, colliders included (see hashColliders).
+uint64_t SimulationCache::getDiskCacheKey() {
+    if (startFrameHashDirty) {
+        startFrameHash = DiskCache::hash(nullptr, 0);
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            const CacheEncoding encoding = registry[registrationOrder[i]];
+            const uint64_t size = startFrameData[i].size();
+            startFrameHash = DiskCache::hash(&encoding, sizeof(encoding), startFrameHash);
+            startFrameHash = DiskCache::hash(&size, sizeof(size), startFrameHash);
+            startFrameHash = DiskCache::hash(startFrameData[i].data(), startFrameData[i].size(), startFrameHash);
+        }
+        startFrameHash = hashColliders(startFrameHash);
+        startFrameHashDirty = false;
+    }
+
+    uint64_t key = startFrameHash;
+    auto hashValue = [&key](const auto& value) { key = DiskCache::hash(&value, sizeof(value), key); };
+    MObject globalSolver = GlobalSolver::getOrCreateGlobalSolver();
+    hashValue(startFrameKey);
+    hashValue(MPlug(globalSolver, GlobalSolver::aNumSubsteps).asInt());
+    hashValue(MPlug(globalSolver, GlobalSolver::aParticleFriction).asFloat());
+    hashValue(MPlug(globalSolver, GlobalSolver::aNeighborListSkin).asFloat());
+    hashValue(MPlug(globalSolver, GlobalSolver::aCollisionBroadphase).asShort());
+    hashValue(MPlug(globalSolver, GlobalSolver::aParticleCollisionsEnabled).asBool());
+    hashValue(MPlug(globalSolver, GlobalSolver::aPrimitiveCollisionsEnabled).asBool());
+
+    // And each PBD node's solver settings
+    MPlug particleDataArrayPlug(globalSolver, GlobalSolver::aParticleData);
+    for (unsigned int i = 0; i < particleDataArrayPlug.numElements(); ++i) {
+        MPxNode* pbdNode = Utils::connectedNode(particleDataArrayPlug.elementByPhysicalIndex(i));
+        if (!pbdNode) continue;
+
+        const MObject pbdNodeObj = pbdNode->thisMObject();
+        for (const MObject& attribute : { PBDNode::aCompliance, PBDNode::aVgsRelaxation, PBDNode::aVgsEdgeUniformity, PBDNode::aVgsIterations,
+                                          PBDNode::aVgsResidualTolerance, PBDNode::aVgsTargetResidual, PBDNode::aGravityStrength,
+                                          PBDNode::aFaceConstraintLow, PBDNode::aFaceConstraintHigh, PBDNode::aParticleMassLow, PBDNode::aParticleMassHigh,
+                                          PBDNode::aSleepingEnabled, PBDNode::aSleepVelocity, PBDNode::aSleepStrain }) {
+            hashValue(MPlug(pbdNodeObj, attribute).asDouble());
+        }
+    }
+
+    MString scenePath = MFileIO::currentFile();
+    return DiskCache::hash(scenePath.asChar(), scenePath.length(), key);
+}
+
+/**
+ * Hashes every collider's setup as of the start frame: its type, pose, shape and friction. Only done when the start frame is captured,
+ * as it means evaluating the colliders at the start frame. (Animation after the start frame isn't hashed, only where it starts.)
+ */
+uint64_t SimulationCache::hashColliders(uint64_t seed) {
+    uint64_t hash = seed;
+    auto hashValue = [&hash](const auto& value) { hash = DiskCache::hash(&value, sizeof(value), hash); };
+
+    MPlug colliderDataArrayPlug(GlobalSolver::getOrCreateGlobalSolver(), GlobalSolver::aColliderData);
+    MDGContext startFrameContext(MTime(startFrameKey, MTime::uiUnit()));
+    MDGContextGuard contextGuard(startFrameContext);
+    for (unsigned int i = 0; i < colliderDataArrayPlug.numElements(); ++i) {
+        MPlug colliderDataPlug = colliderDataArrayPlug.elementByPhysicalIndex(i);
+        MPxNode* colliderNode = Utils::connectedNode(colliderDataPlug);
+        Utils::PluginData<ColliderData> colliderData(colliderDataPlug);
+        const ColliderData* data = colliderData.get();
+        if (!colliderNode || !data) continue;
+
+        const MString typeName = colliderNode->typeName();
+        hash = DiskCache::hash(typeName.asChar(), typeName.length(), hash);
+        const MMatrix worldMatrix = data->getWorldMatrix();
+        hash = DiskCache::hash(worldMatrix.matrix, sizeof(worldMatrix.matrix), hash);
+        hashValue(data->getFriction());
+        hashValue(data->getWidth());
+        hashValue(data->getHeight());
+        hashValue(data->getDepth());
+        hashValue(data->getRadius());
+        hashValue(data->isInfinite());
+        const std::shared_ptr<const MeshSDF>& meshSDF = data->getMeshSDF();
+        hashValue(meshSDF ? meshSDF->contentHash : 0ull);
+    }
+    return hash;
 }
 
 void SimulationCache::resetCache() {
     // This is a little outside the purview of what a cache should do, but it's very useful:
     // Before resetting the cache, reset the simulation to the start frame so we never lose the initial state.
-    MTime startTime = MAnimControl::minTime();
-    double startFrame = std::floor(startTime.as(MTime::uiUnit()));
-    tryUseCache(startTime); // effectively resets buffer data to start state
+    discardCaptures();
+    markBuffersModified();
+    if (!std::isnan(startFrameKey)) tryUseCache(MTime(startFrameKey, MTime::uiUnit())); // effectively resets buffer data to start state
     
-    cache.clear();
-    drawPrimitives.clear();
-    currentCacheSize = 0; 
-    cachedFrames.clear();
+    clearFrames();
+    markerRuns.clear();
+    markersDirty = true;
+    decodedData.clear();
+    spilledData.clear();
+    for (FrameData& frameData : interpolationData) {
+        frameData.clear();
+    }
 
-    // And recache the initial data for the start frame
-    cacheData(startTime);
-    currentCacheSize = 0; // zero again because cacheData already accounts for start frame and we don't want to double count it
+    // Frames on disk are cleared too (the file is recreated the next time it's needed).
+    if (diskCache) {
+        diskCache.reset();
+        DeleteFileW(diskCachePath.c_str());
+    }
+    diskCacheKey = 0;
+
+    // And recache the initial data as the start frame (which isn't stored in the frame arena), moved to where playback now starts.
+    captureStartFrame(getPlaybackStartFrame());
+    updateTimeline();
 }
 
-void SimulationCache::addMarkerToTimeline(double frameKey) {
-    if (hasMarkerAtFrame(frameKey)) return;
-    MTime time(frameKey, MTime::uiUnit());
+SimulationCache::Stats SimulationCache::getStats() {
+    Stats result = stats;
+    result.memoryFrames = numCachedFrames;
+    result.framesInFlight = framesInFlight.size();
+    result.arenaUsedBytes = frameArena.getUsedBytes();
+    result.arenaReservedBytes = frameArena.getReservedBytes();
+    if (diskCache) {
+        result.diskFrames = diskCache->getFrames().size();
+        result.diskFileBytes = diskCache->getFileSize();
+    }
+
+    result.buffers.resize(registrationOrder.size());
+    for (size_t i = 0; i < registrationOrder.size(); ++i) {
+        result.buffers[i].name = bufferNames[registrationOrder[i]];
+        result.buffers[i].encoding = registry[registrationOrder[i]];
+        result.buffers[i].frameBytes = startFrameData[i].size();
+    }
+    // Frames that share a chain (see StandaloneCopy) share its bytes.
+    std::unordered_set<uint32_t> countedChains;
+    for (size_t index = lowestCachedIndex; numCachedFrames > 0 && index <= highestCachedIndex; ++index) {
+        if (!frameIndex[index].isCached) continue;
+        const StoredBuffer* frameBuffers = getStoredBuffers(frameIndexBase + index);
+        for (size_t i = 0; i < registrationOrder.size(); ++i) {
+            if (frameBuffers[i].firstBlock == FrameArena::noBlock || !countedChains.insert(frameBuffers[i].firstBlock).second) continue;
+            result.buffers[i].storedBytes += frameBuffers[i].size;
+        }
+    }
+
+    result.numCaptures = captureTimes.getCount();
+    result.captureP50 = captureTimes.percentile(0.5);
+    result.captureP99 = captureTimes.percentile(0.99);
+    result.numEncodes = encodeTimes.getCount();
+    result.encodeP50 = encodeTimes.percentile(0.5);
+    result.encodeP99 = encodeTimes.percentile(0.99);
+    result.numRestores = restoreTimes.getCount();
+    result.restoreP50 = restoreTimes.percentile(0.5);
+    result.restoreP99 = restoreTimes.percentile(0.99);
+    return result;
+}
 
-    MTimeSliderDrawPrimitive marker(
-        MTimeSliderDrawPrimitive::kFilledRect,
-        time,
-        time + MTime(1.0, MTime::uiUnit()),
-        MColor(0.0f, 1.0f, 0.0f),
-        -1,
-        0
-    );
+void SimulationCache::resetStats() {
+    stats = Stats();
+    captureTimes.clear();
+    encodeTimes.clear();
+    restoreTimes.clear();
+}
+
+void SimulationCache::TimingSamples::add(double milliseconds) {
+    if (samples.size() < timingWindow) {
+        samples.push_back(milliseconds);
+    } else {
+        samples[next] = milliseconds;
+    }
+    next = (next + 1) % timingWindow;
+    ++count;
+}
+
+double SimulationCache::TimingSamples::percentile(double p) const {
+    if (samples.empty()) return 0.0;
+    std::vector<double> sorted = samples;
+    const size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    const size_t index = (rank > 0) ? rank - 1 : 0;
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
 
-    drawPrimitives.append(marker);
+void SimulationCache::TimingSamples::clear() {
+    samples.clear();
+    next = 0;
+    count = 0;
 }
 
-bool SimulationCache::hasMarkerAtFrame(double frameKey) {
-    for (size_t i = 0; i < drawPrimitives.length(); ++i) {
-        MTimeSliderDrawPrimitive prim = drawPrimitives[i];
-        if (prim.startTime().as(MTime::uiUnit()) == frameKey) {
-            return true;
+void SimulationCache::addMarkerToTimeline(double frameKey, bool onDisk) {
+    if (findMarkerRun(frameKey) != markerRuns.end()) return;
+
+    // Join the runs either side, if they're in the same tier and end (or start) right at this frame.
+    double start = frameKey;
+    double end = frameKey + 1.0;
+    auto next = markerRuns.upper_bound(frameKey);
+    if (next != markerRuns.begin()) {
+        auto previous = std::prev(next);
+        if (previous->second.end == start && previous->second.onDisk == onDisk) {
+            start = previous->first;
+            markerRuns.erase(previous);
         }
     }
-    return false;
+    if (next != markerRuns.end() && next->first == end && next->second.onDisk == onDisk) {
+        end = next->second.end;
+        next = markerRuns.erase(next);
+    }
+
+    markerRuns.emplace_hint(next, start, MarkerRun{ end, onDisk });
+    markersDirty = true;
+}
+
+// The marker run covering a frame, if any.
+std::map<double, SimulationCache::MarkerRun>::iterator SimulationCache::findMarkerRun(double frameKey) {
+    auto run = markerRuns.upper_bound(frameKey);
+    if (run == markerRuns.begin()) return markerRuns.end();
+    --run;
+    return (frameKey < run->second.end) ? run : markerRuns.end();
 }
 
 void SimulationCache::removeMarkerAtFrame(double frameKey) {
-    MTimeSliderDrawPrimitives newPrims;
-    for (size_t i = 0; i < drawPrimitives.length(); ++i) {
-        MTimeSliderDrawPrimitive prim = drawPrimitives[i];
-        if (prim.startTime().as(MTime::uiUnit()) != frameKey) {
-            newPrims.append(prim);
-        }
+    auto run = findMarkerRun(frameKey);
+    if (run == markerRuns.end()) return;
+
+    // Split the run around the frame.
+    const double start = run->first;
+    const MarkerRun marker = run->second;
+    run = markerRuns.erase(run);
+    if (frameKey + 1.0 < marker.end) run = markerRuns.emplace_hint(run, frameKey + 1.0, marker);
+    if (start < frameKey) markerRuns.emplace_hint(run, start, MarkerRun{ frameKey, marker.onDisk });
+    markersDirty = true;
+}
+
+// Hands the marker runs to the time slider, if they've changed since it was last given them.
+void SimulationCache::updateTimeline() {
+    if (!markersDirty) return;
+
+    MTimeSliderDrawPrimitives drawPrimitives;
+    for (const auto& [start, run] : markerRuns) {
+        MTimeSliderDrawPrimitive marker(
+            MTimeSliderDrawPrimitive::kFilledRect,
+            MTime(start, MTime::uiUnit()),
+            MTime(run.end, MTime::uiUnit()),
+            run.onDisk ? MColor(0.0f, 0.5f, 1.0f) : MColor(0.0f, 1.0f, 0.0f),
+            -1,
+            0
+        );
+        drawPrimitives.append(marker);
     }
-    drawPrimitives = std::move(newPrims);
-}
\ No newline at end of file
+
+    MTimeSliderCustomDrawManager::instance().setDrawPrimitives(customDrawID, drawPrimitives);
+    markersDirty = false;
+}
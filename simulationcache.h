@@ -5,9 +5,19 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <set>
+#include <string>
 #include "directx/directx.h"
+#include "cachecodec.h"
+#include "diskcache.h"
+#include "captureencoder.h"
+#include "framearena.h"
+#include <array>
+#include <deque>
+#include <map>
+#include <memory>
 #include <cstdint>
 #include <cfloat>
+#include <limits>
 
 class GlobalSolver; // forward declaration to make friend
 
@@ -51,32 +61,265 @@ public:
         ComPtr<ID3D11Buffer> buffer_;
     };
 
-    Registration registerBuffer(ComPtr<ID3D11Buffer> buffer);
+    // The name is only for reporting (see getStats).
+    Registration registerBuffer(ComPtr<ID3D11Buffer> buffer, const std::string& name, CacheEncoding encoding = CacheEncoding::Words);
     void resetCache();
+    // Writes every frame cached in memory to the disk cache (if enabled), so it can be reused next session.
+    void flushToDisk();
+
+    // Incremented every time cached data is written back into the registered buffers. Lets state derived from
+    // those buffers (but not cached itself) notice that it needs rebuilding.
+    uint64_t getRestoreCount() const {
+        return restoreCount;
+    }
+
+    // The frame the start state is cached at (NaN until a buffer is registered). It only moves when the cache is reset.
+    double getStartFrame() const {
+        return startFrameKey;
+    }
+
+    // Call after writing to registered buffers outside of a simulation step (e.g. painting), so the next restore doesn't skip uploading them.
+    void markBuffersModified();
+
+    // What one registered buffer takes up in the cache.
+    struct BufferStats {
+        std::string name;
+        CacheEncoding encoding = CacheEncoding::Words;
+        uint64_t frameBytes = 0;    // One raw copy (the start frame's)
+        uint64_t storedBytes = 0;   // Across every frame cached in memory, with shared chains counted once
+    };
+
+    /**
+     * For sizing the cache to a shot (see CacheStatsCommand). The counters and timings accumulate until resetStats; the rest describe
+     * what's resident right now. Timings are in milliseconds, over the last timingWindow samples of each.
+     */
+    struct Stats {
+        size_t memoryFrames = 0;    // Excluding the start frame
+        size_t framesInFlight = 0;
+        size_t diskFrames = 0;
+        uint64_t arenaUsedBytes = 0;
+        uint64_t arenaReservedBytes = 0;
+        uint64_t diskFileBytes = 0;
+        std::vector<BufferStats> buffers;
+
+        uint64_t memoryHits = 0;
+        uint64_t diskHits = 0;
+        uint64_t interpolatedHits = 0;
+        uint64_t startFrameHits = 0;
+        uint64_t misses = 0;        // Frames that had to come from the cache but couldn't (frames simulated on playback aren't counted)
+        uint64_t evictions = 0;     // Frames evicted from memory to make room (or because a frame they were encoded against was)
+        uint64_t spills = 0;        // Of those, how many were written to the disk cache
+
+        uint64_t numCaptures = 0;
+        double captureP50 = 0.0, captureP99 = 0.0;  // Main thread only: issuing the copies, and any readbacks that had to be waited on
+        uint64_t numEncodes = 0;
+        double encodeP50 = 0.0, encodeP99 = 0.0;    // On the capture encoder's thread
+        uint64_t numRestores = 0;
+        double restoreP50 = 0.0, restoreP99 = 0.0;  // Cache hits only
+    };
+    static constexpr size_t timingWindow = 1024;
+
+    Stats getStats();
+    void resetStats();
 
 private:
     friend class GlobalSolver;
     static SimulationCache* simulationCacheInstance;
     static const MString timeSliderDrawContextName;
-    // Each pointer points to where a ComPtr<ID3D11Buffer> is stored (typically as a member of another object)
-    std::unordered_set<ComPtr<ID3D11Buffer>, DirectX::ComPtrHash> registry;
-    // Frame number to map of buffer pointer to cached data (as vector of bytes)
-    std::unordered_map<double, std::unordered_map<ComPtr<ID3D11Buffer>, std::vector<uint8_t>, DirectX::ComPtrHash>> cache;
-    // Cached frames, in order - helps with eviction
-    std::set<double> cachedFrames;
-    MTimeSliderDrawPrimitives drawPrimitives;
+    // Per registered buffer, in registration order
+    using FrameData = std::vector<std::vector<uint8_t>>;
+
+    /**
+     * Cached frames live in the frame arena, one chain of blocks per buffer (see StoredBuffer).
+     * Every frame in the arena has the same buffer layout, so registering or unregistering a buffer drops them (the disk cache switches files then, too).
+     *
+     * Compressed frames are encoded (see CacheCodec) against a reference frame: either the start frame (a keyframe), or the frame captured just before
+     * them (a delta). Chains of deltas are capped at the keyframe interval, so restoring any frame decodes at most that many frames.
+     * Evicting a frame evicts every frame chained after it, too.
+     */
+    struct CachedFrame {
+        bool isCached = false;
+        bool isEncoded = false;
+        double referenceFrame = 0.0;  // Encoded frames only
+        int chainLength = 0;          // Number of encoded frames from the start frame to this one (1 for a keyframe)
+        uint64_t captureId = 0;       // Distinguishes re-captures of the same frame (so deltas in flight can tell if their reference was replaced)
+        // The frame encoded against this one, if any. There's at most one, as a capture is only ever the reference of the capture after it.
+        double dependentFrame = std::numeric_limits<double>::quiet_NaN();
+    };
+
+    /**
+     * Where a cached frame's copy of one buffer is. Buffers that didn't change since the frame before take no new space: a delta leaves them out
+     * (they decode to the same data as its reference), and a raw frame or keyframe shares the chain of the last identical standalone copy.
+     */
+    struct StoredBuffer {
+        uint32_t firstBlock = FrameArena::noBlock;  // noBlock if left out of a delta
+        uint64_t size = 0;
+        uint64_t contentHash = 0;   // Of the data it decodes to (see CacheCodec::hash), or 0 if that isn't known (quantized positions)
+    };
+    // Per buffer: the last copy stored that doesn't depend on another frame (raw, or a keyframe's), and what it was encoded with. Holds a reference to its chain.
+    struct StandaloneCopy {
+        uint64_t hash = 0;
+        bool isEncoded = false;
+        float precision = 0.0f;
+        StoredBuffer storedBuffer;
+    };
+
+    /**
+     * Frames are captured asynchronously: cacheData copies the registered buffers into a ring of staging buffers, which are read back on a later
+     * compute once the GPU is done with them (or, when the ring is full, waited on). The readback is then handed to the capture encoder to compress,
+     * and the frame is added to the cache once it comes back. Frames in flight still count as cached; restoring one finishes its capture first.
+     */
+    static constexpr int captureRingSize = 2;
+    struct PendingReadback {
+        int slot;
+        CaptureEncoder::Job job;
+    };
+    std::array<std::vector<ComPtr<ID3D11Buffer>>, captureRingSize> stagingRing;
+    int nextStagingSlot = 0;
+    std::deque<PendingReadback> pendingReadbacks;
+    std::unique_ptr<CaptureEncoder> captureEncoder;
+    std::vector<CaptureEncoder::Job> completedCaptures;
+    // Buffer lists of captures already stored, reused (along with the capacity of their data) by the next captures.
+    std::vector<std::vector<CaptureEncoder::CapturedBuffer>> spareCaptureBuffers;
+    std::vector<double> framesInFlight;
+    // Start frame copies shared with the capture encoder (which can't read the cache itself).
+    std::unordered_map<ComPtr<ID3D11Buffer>, std::shared_ptr<const std::vector<uint8_t>>, DirectX::ComPtrHash> startFrameSnapshots;
+    uint64_t nextCaptureId = 1;
+    // The last frame captured, which the next capture can be a delta against (as long as nothing has been restored or registered since).
+    double lastCaptureFrame = std::numeric_limits<double>::quiet_NaN();
+    uint64_t lastCaptureId = 0;
+    int lastCaptureChainLength = 0;
+    uint64_t lastCaptureRestoreCount = 0;
+
+    // Registered buffers, and how to compress them
+    std::unordered_map<ComPtr<ID3D11Buffer>, CacheEncoding, DirectX::ComPtrHash> registry;
+    std::unordered_map<ComPtr<ID3D11Buffer>, std::string, DirectX::ComPtrHash> bufferNames;
+    // Registered buffers, in the order they were registered. Cached frames (in memory and on disk) identify buffers by their position in this list.
+    std::vector<ComPtr<ID3D11Buffer>> registrationOrder;
+    // The start frame is always stored raw (it's the reference that compressed frames are decoded against), outside the frame arena.
+    FrameData startFrameData;
+    std::vector<uint64_t> startFrameContentHashes;
+    // Per buffer, the content hash of what was last uploaded to it, or 0 if it's since been simulated (or it isn't known).
+    // Restores skip uploading buffers that already hold the right data.
+    std::vector<uint64_t> deviceContentHashes;
+    double startFrameKey = std::numeric_limits<double>::quiet_NaN();
+    static constexpr uint64_t minArenaBlockSize = 4ull * 1024ull;
+    static constexpr uint64_t maxArenaBlockSize = 1024ull * 1024ull;
+    FrameArena frameArena;
+    // Indexed by frame number, from frameIndexBase. Cached frames are tracked by count and range (excluding the start frame), which helps with eviction.
+    std::vector<CachedFrame> frameIndex;
+    // Parallel to frameIndex: each frame's stored buffers, in registration order.
+    std::vector<StoredBuffer> storedBuffers;
+    std::vector<StandaloneCopy> lastStandaloneCopies;
+    double frameIndexBase = 0.0;
+    size_t numCachedFrames = 0;
+    size_t lowestCachedIndex = 0;
+    size_t highestCachedIndex = 0;
+    /**
+     * Timeline markers, as runs of consecutive frames in the same tier (memory or disk): run start to run end (exclusive).
+     * Adding or removing a frame's marker only touches the runs around it. The time slider's draw primitives (one per run) are rebuilt from these
+     * in updateTimeline, once per compute at most, rather than on every change.
+     */
+    struct MarkerRun {
+        double end;
+        bool onDisk;
+    };
+    std::map<double, MarkerRun> markerRuns;
+    bool markersDirty = false;
     int customDrawID = -1;
-    // These are both in bytes
+    // In bytes. The size of the start frame (and so of a raw frame), which counts against the cache budget but isn't in the arena.
     uint64_t singleFrameCacheSize = 0;
-    uint64_t currentCacheSize = 0;
+    uint64_t restoreCount = 0;
+    std::vector<uint8_t> decodeScratch;
+    std::vector<uint8_t> frameReadScratch;
+    std::vector<double> decodeChain;
+    // The (decoded) contents of the last compressed frame restored. Decoding a later frame in the same chain (e.g. when scrubbing forward)
+    // starts from here.
+    FrameData decodedData;
+    double decodedFrame = std::numeric_limits<double>::quiet_NaN();
+    // Same as above, for frames being written to disk (kept separately so spilling doesn't undo the work of restoring).
+    FrameData spilledData;
+    double spilledFrame = std::numeric_limits<double>::quiet_NaN();
+    // Same as above, for the stored frames either side of the last frame interpolated (see tryInterpolateFrame).
+    std::array<FrameData, 2> interpolationData;
+    std::array<double, 2> interpolationFrames = { std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN() };
+
+    // The latest timingWindow timings of something, in milliseconds (oldest overwritten first).
+    class TimingSamples {
+    public:
+        void add(double milliseconds);
+        // Nearest-rank percentile (p in [0, 1]) of the samples in the window, or 0 if there are none.
+        double percentile(double p) const;
+        uint64_t getCount() const { return count; }
+        void clear();
+
+    private:
+        std::vector<double> samples;
+        size_t next = 0;
+        uint64_t count = 0;     // Including samples that have left the window
+    };
+    // Only the counters and timings of Stats are kept; the rest is worked out in getStats.
+    Stats stats;
+    TimingSamples captureTimes;
+    TimingSamples encodeTimes;
+    TimingSamples restoreTimes;
+
+    /**
+     * Frames evicted from memory are spilled to a file in the project's cache directory (see DiskCache), instead of being lost.
+     * The file is keyed by a hash of the start frame, the buffer layout, the solver settings (global and per PBD node), the colliders
+     * and the scene path, so it's picked up again next session as long as none of those changed.
+     */
+    static constexpr int diskPrefetchFrames = 8;
+    std::unique_ptr<DiskCache> diskCache;
+    std::wstring diskCachePath;
+    uint64_t diskCacheKey = 0;           // Key of the disk cache last opened (or attempted)
+    uint64_t startFrameHash = 0;
+    bool startFrameHashDirty = true;
 
     SimulationCache();
     ~SimulationCache();
     void tearDown();
-    void addMarkerToTimeline(double frameKey);
-    bool hasMarkerAtFrame(double frameKey);
+    static double getPlaybackStartFrame();
+    const std::vector<uint8_t>& getStartFrameData(const ComPtr<ID3D11Buffer>& buffer);
+    CachedFrame* findFrame(double frameKey);
+    CachedFrame& getFrameSlot(double frameKey);
+    bool isFrameCached(double frameKey);
+    bool isFrameInFlight(double frameKey) const;
+    StoredBuffer* getStoredBuffers(double frameKey);
+    const uint8_t* readStoredBuffer(const StoredBuffer& storedBuffer);
+    void uploadBuffer(size_t bufferIndex, const uint8_t* data, uint64_t contentHash);
+    void clearFrames();
+    bool evictFurthestFrame(double currentFrame);
+    void evictFrame(double frameKey, bool spill);
+    bool decodeFrame(double frameKey, FrameData& output, double& outputFrame);
+    bool loadFrame(double frameKey, FrameData& output, double& outputFrame);
+    void forgetLoadedFrame(double frameKey);
+    bool isFrameStored(double frameKey);
+    bool findInterpolationFrames(double frameKey, double& fromFrame, double& toFrame);
+    bool tryInterpolateFrame(double frameKey);
+    void updateDiskCache();
+    void closeDiskCache();
+    uint64_t getDiskCacheKey();
+    uint64_t hashColliders(uint64_t seed);
+    bool spillToDisk(double frameKey);
+    bool tryUseDiskCache(double frameKey);
+    void captureStartFrame(double currentFrame);
+    void beginCapture(double frameKey);
+    bool readBackCapture(PendingReadback& pendingReadback, bool wait);
+    void collectCaptures(bool wait);
+    void discardCaptures();
+    void insertCapture(CaptureEncoder::Job& job);
+    const std::shared_ptr<const std::vector<uint8_t>>& getStartFrameSnapshot(const ComPtr<ID3D11Buffer>& buffer);
+    void addMarkerToTimeline(double frameKey, bool onDisk = false);
+    std::map<double, MarkerRun>::iterator findMarkerRun(double frameKey);
     void removeMarkerAtFrame(double frameKey);
+    void updateTimeline();
     void cacheData(const MTime& time);
-    bool tryUseCache(const MTime& time);
+    // Restores made for the solver's own use (e.g. baking ahead) pass recordStats = false, so the stats only describe frames the artist asked for.
+    bool tryUseCache(const MTime& time, bool recordStats = true);
     bool hasCacheData(const MTime& time);
+    // For a frame that could only have come from the cache (e.g. scrubbing back to one that isn't cached).
+    void recordMiss() {
+        ++stats.misses;
+    }
 };
\ No newline at end of file